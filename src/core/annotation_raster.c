@@ -0,0 +1,581 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Software rasterizer for burning annotations into exported images.
+//
+// Both passes work row by row and accumulate the coverage of a shape into a float buffer first, which is then blended
+// into the image in one go, so that the overlapping parts of a shape are not blended twice:
+// - Fills are scanline polygon fills using the nonzero winding rule, with exact horizontal coverage and
+//   ANNOTATION_RASTER_SUBSCANLINES sub-scanlines vertically.
+// - Outlines take the distance of each pixel center to the nearest line segment (this also gives round joins and
+//   caps), only looking at the pixels within reach of each segment.
+
+#include "common.h"
+#include "image.h"
+#include "annotation_raster.h"
+
+#include <math.h>
+#include <float.h>
+
+#define ANNOTATION_RASTER_SUBSCANLINES 4
+#define ANNOTATION_RASTER_ELLIPSE_SEGMENTS 48 // same as the viewer
+#define ANNOTATION_RASTER_MAX_BINS (4096 * 4096)
+
+typedef struct raster_edge_t {
+    float x0, y0, x1, y1; // y0 < y1
+    float dxdy;
+    i32 winding;
+} raster_edge_t;
+
+typedef struct raster_crossing_t {
+    float x;
+    i32 winding;
+} raster_crossing_t;
+
+typedef struct raster_context_t {
+    image_buffer_t* buffer;
+    float* coverage; // buffer->width * buffer->height, kept zeroed between shapes
+    i32* row_begin; // per row, the range of pixels with coverage
+    i32* row_end;
+    i32 touched_row_begin;
+    i32 touched_row_end;
+    raster_edge_t* edges;
+    i32 edge_count;
+    i32 edge_capacity;
+    raster_crossing_t* crossings;
+    i32 crossing_capacity;
+    i32* active_edges;
+    v2f* points; // shape points converted to buffer pixels
+    i32 point_capacity;
+    float ymin, ymax; // vertical extent of the edges added so far
+} raster_context_t;
+
+static bool annotation_raster_include_annotation(annotation_set_t* annotation_set, annotation_t* annotation, rgba_t* color) {
+    if (annotation->type == ANNOTATION_TEXT) {
+        return false;
+    }
+    if (annotation->group_id >= 0 && annotation->group_id < annotation_set->stored_group_count) {
+        annotation_group_t* group = annotation_set->stored_groups + annotation->group_id;
+        if (group->hidden) {
+            return false;
+        }
+        *color = group->color;
+    } else {
+        *color = annotation->color;
+    }
+    if (annotation->coordinate_count > 0) {
+        return true;
+    }
+    return annotation->type == ANNOTATION_ELLIPSE;
+}
+
+static i32 annotation_raster_get_point_count(annotation_t* annotation) {
+    if (annotation->coordinate_count > 0) {
+        return annotation->coordinate_count;
+    } else {
+        return ANNOTATION_RASTER_ELLIPSE_SEGMENTS;
+    }
+}
+
+static void annotation_raster_get_bin_range(annotation_raster_t* raster, bounds2f bounds, bounds2i* bin_range) {
+    float inv_bin_size = 1.0f / raster->bin_size;
+    i32 x0 = (i32)floorf((bounds.left - raster->grid_bounds.left) * inv_bin_size);
+    i32 y0 = (i32)floorf((bounds.top - raster->grid_bounds.top) * inv_bin_size);
+    i32 x1 = (i32)floorf((bounds.right - raster->grid_bounds.left) * inv_bin_size);
+    i32 y1 = (i32)floorf((bounds.bottom - raster->grid_bounds.top) * inv_bin_size);
+    // Anything outside the grid goes into the bins along the edge, so that queries can be clamped the same way.
+    bin_range->left = CLAMP(x0, 0, raster->bins_x - 1);
+    bin_range->top = CLAMP(y0, 0, raster->bins_y - 1);
+    bin_range->right = CLAMP(x1, 0, raster->bins_x - 1);
+    bin_range->bottom = CLAMP(y1, 0, raster->bins_y - 1);
+}
+
+bool annotation_raster_init(annotation_raster_t* raster, annotation_set_t* annotation_set, bounds2f world_bounds, float bin_size,
+                            float line_width, float fill_opacity) {
+    memset(raster, 0, sizeof(*raster));
+    if (!annotation_set || !(bin_size > 0.0f) || world_bounds.right < world_bounds.left || world_bounds.bottom < world_bounds.top) {
+        return false;
+    }
+    raster->line_width = ATLEAST(line_width, 0.0f);
+    raster->fill_opacity = CLAMP(fill_opacity, 0.0f, 1.0f);
+
+    i32 max_shape_count = annotation_set->active_annotation_count;
+    i32 max_point_count = 0;
+    for (i32 i = 0; i < max_shape_count; ++i) {
+        annotation_t* annotation = get_active_annotation(annotation_set, i);
+        rgba_t color;
+        if (annotation_raster_include_annotation(annotation_set, annotation, &color)) {
+            max_point_count += annotation_raster_get_point_count(annotation);
+        }
+    }
+    raster->shapes = (annotation_raster_shape_t*)malloc(ATLEAST(max_shape_count, 1) * sizeof(annotation_raster_shape_t));
+    raster->points = (v2f*)malloc(ATLEAST(max_point_count, 1) * sizeof(v2f));
+
+    // Shapes far outside the region can never end up in the image; the margin leaves room for thick outlines.
+    bounds2f cull_bounds = world_bounds;
+    cull_bounds.left -= bin_size;
+    cull_bounds.top -= bin_size;
+    cull_bounds.right += bin_size;
+    cull_bounds.bottom += bin_size;
+
+    for (i32 i = 0; i < max_shape_count; ++i) {
+        annotation_t* annotation = get_active_annotation(annotation_set, i);
+        rgba_t color;
+        if (!annotation_raster_include_annotation(annotation_set, annotation, &color)) {
+            continue;
+        }
+        annotation_raster_shape_t shape = {0};
+        shape.first_point = raster->point_count;
+        shape.color = color;
+        v2f* points = raster->points + raster->point_count;
+        if (annotation->coordinate_count > 0) {
+            shape.point_count = annotation->coordinate_count;
+            memcpy(points, annotation->coordinates, shape.point_count * sizeof(v2f));
+        } else {
+            // Ellipse defined by its control points, approximated the same way the viewer draws it.
+            v2f center = v2f_average(annotation->p0, annotation->p1);
+            v2f v = v2f_subtract(annotation->p1, annotation->p0);
+            float radius_x = v.x;
+            float radius_y = -v.y;
+            shape.point_count = ANNOTATION_RASTER_ELLIPSE_SEGMENTS;
+            for (i32 j = 0; j < shape.point_count; ++j) {
+                float theta = (float)j * (2.0f * (float)M_PI / ANNOTATION_RASTER_ELLIPSE_SEGMENTS);
+                points[j] = V2F(center.x + radius_x * cosf(theta), center.y + radius_y * sinf(theta));
+            }
+        }
+
+        shape.bounds = BOUNDS2F(points[0].x, points[0].y, points[0].x, points[0].y);
+        for (i32 j = 1; j < shape.point_count; ++j) {
+            shape.bounds.left = MIN(shape.bounds.left, points[j].x);
+            shape.bounds.top = MIN(shape.bounds.top, points[j].y);
+            shape.bounds.right = MAX(shape.bounds.right, points[j].x);
+            shape.bounds.bottom = MAX(shape.bounds.bottom, points[j].y);
+        }
+        if (shape.bounds.right < cull_bounds.left || shape.bounds.left > cull_bounds.right ||
+            shape.bounds.bottom < cull_bounds.top || shape.bounds.top > cull_bounds.bottom) {
+            continue;
+        }
+
+        if (annotation->type == ANNOTATION_POINT || shape.point_count == 1) {
+            shape.flags |= ANNOTATION_RASTER_SHAPE_POINT;
+        } else if (annotation->type != ANNOTATION_LINE && !annotation->is_open && shape.point_count >= 3) {
+            shape.flags |= ANNOTATION_RASTER_SHAPE_CLOSED;
+        }
+        raster->point_count += shape.point_count;
+        raster->shapes[raster->shape_count++] = shape;
+    }
+
+    // Bin the shapes into a uniform grid over the region (counting sort: count, prefix sum, then fill).
+    raster->grid_bounds = world_bounds;
+    float width = world_bounds.right - world_bounds.left;
+    float height = world_bounds.bottom - world_bounds.top;
+    while ((i64)ceilf(width / bin_size) * (i64)ceilf(height / bin_size) > ANNOTATION_RASTER_MAX_BINS) {
+        bin_size *= 2.0f;
+    }
+    raster->bin_size = bin_size;
+    raster->bins_x = ATLEAST((i32)ceilf(width / bin_size), 1);
+    raster->bins_y = ATLEAST((i32)ceilf(height / bin_size), 1);
+    i32 bin_count = raster->bins_x * raster->bins_y;
+    raster->bin_offsets = (i32*)calloc(bin_count + 1, sizeof(i32));
+
+    i64 total_entries = 0;
+    for (i32 i = 0; i < raster->shape_count; ++i) {
+        bounds2i range;
+        annotation_raster_get_bin_range(raster, raster->shapes[i].bounds, &range);
+        for (i32 y = range.top; y <= range.bottom; ++y) {
+            for (i32 x = range.left; x <= range.right; ++x) {
+                raster->bin_offsets[y * raster->bins_x + x + 1]++;
+            }
+        }
+        total_entries += (i64)(range.right - range.left + 1) * (range.bottom - range.top + 1);
+    }
+    if (total_entries > INT32_MAX) {
+        annotation_raster_destroy(raster);
+        return false;
+    }
+    for (i32 i = 0; i < bin_count; ++i) {
+        raster->bin_offsets[i + 1] += raster->bin_offsets[i];
+    }
+    raster->bin_shape_indices = (i32*)malloc(ATLEAST(total_entries, 1) * sizeof(i32));
+    i32* fill_positions = (i32*)malloc(bin_count * sizeof(i32));
+    memcpy(fill_positions, raster->bin_offsets, bin_count * sizeof(i32));
+    for (i32 i = 0; i < raster->shape_count; ++i) {
+        bounds2i range;
+        annotation_raster_get_bin_range(raster, raster->shapes[i].bounds, &range);
+        for (i32 y = range.top; y <= range.bottom; ++y) {
+            for (i32 x = range.left; x <= range.right; ++x) {
+                raster->bin_shape_indices[fill_positions[y * raster->bins_x + x]++] = i;
+            }
+        }
+    }
+    free(fill_positions);
+    return true;
+}
+
+void annotation_raster_destroy(annotation_raster_t* raster) {
+    if (raster->shapes) free(raster->shapes);
+    if (raster->points) free(raster->points);
+    if (raster->bin_offsets) free(raster->bin_offsets);
+    if (raster->bin_shape_indices) free(raster->bin_shape_indices);
+    memset(raster, 0, sizeof(*raster));
+}
+
+static inline void raster_touch(raster_context_t* ctx, i32 y, i32 x_begin, i32 x_end) {
+    ctx->row_begin[y] = MIN(ctx->row_begin[y], x_begin);
+    ctx->row_end[y] = MAX(ctx->row_end[y], x_end);
+    ctx->touched_row_begin = MIN(ctx->touched_row_begin, y);
+    ctx->touched_row_end = MAX(ctx->touched_row_end, y + 1);
+}
+
+// Blends the coverage accumulated so far into the buffer, and resets it for the next shape.
+static void raster_blend(raster_context_t* ctx, rgba_t color, float opacity) {
+    image_buffer_t* buffer = ctx->buffer;
+    for (i32 y = ctx->touched_row_begin; y < ctx->touched_row_end; ++y) {
+        float* row = ctx->coverage + (i64)y * buffer->width;
+        u8* pixels = buffer->pixels + (i64)y * buffer->stride_in_bytes;
+        for (i32 x = ctx->row_begin[y]; x < ctx->row_end[y]; ++x) {
+            float coverage = row[x];
+            if (coverage <= 0.0f) {
+                continue;
+            }
+            row[x] = 0.0f;
+            float alpha = MIN(coverage, 1.0f) * opacity;
+            u8* p = pixels + x * 4;
+            p[0] = (u8)((float)p[0] + ((float)color.b - (float)p[0]) * alpha + 0.5f);
+            p[1] = (u8)((float)p[1] + ((float)color.g - (float)p[1]) * alpha + 0.5f);
+            p[2] = (u8)((float)p[2] + ((float)color.r - (float)p[2]) * alpha + 0.5f);
+            p[3] = (u8)((float)p[3] + (255.0f - (float)p[3]) * alpha + 0.5f);
+        }
+        ctx->row_begin[y] = buffer->width;
+        ctx->row_end[y] = 0;
+    }
+    ctx->touched_row_begin = buffer->height;
+    ctx->touched_row_end = 0;
+}
+
+static void raster_add_edge(raster_context_t* ctx, v2f p0, v2f p1) {
+    i32 winding = 1;
+    if (p0.y > p1.y) {
+        v2f temp = p0;
+        p0 = p1;
+        p1 = temp;
+        winding = -1;
+    }
+    // Horizontal edges and edges outside the buffer rows never cross a sub-scanline. Edges to the right of the buffer
+    // can also be dropped: the span they would close is cut off at the right border anyway (see raster_fill()).
+    if (p0.y == p1.y || p1.y <= 0.0f || p0.y >= (float)ctx->buffer->height) {
+        return;
+    }
+    if (p0.x >= (float)ctx->buffer->width && p1.x >= (float)ctx->buffer->width) {
+        return;
+    }
+    if (ctx->edge_count == ctx->edge_capacity) {
+        ctx->edge_capacity = ATLEAST(ctx->edge_capacity * 2, 256);
+        ctx->edges = (raster_edge_t*)realloc(ctx->edges, ctx->edge_capacity * sizeof(raster_edge_t));
+    }
+    raster_edge_t* edge = ctx->edges + ctx->edge_count++;
+    edge->x0 = p0.x;
+    edge->y0 = p0.y;
+    edge->x1 = p1.x;
+    edge->y1 = p1.y;
+    edge->dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+    edge->winding = winding;
+    ctx->ymin = MIN(ctx->ymin, p0.y);
+    ctx->ymax = MAX(ctx->ymax, p1.y);
+}
+
+static int raster_compare_edges(const void* a, const void* b) {
+    float y0_a = ((const raster_edge_t*)a)->y0;
+    float y0_b = ((const raster_edge_t*)b)->y0;
+    return (y0_a > y0_b) - (y0_a < y0_b);
+}
+
+static inline void raster_accumulate_span(raster_context_t* ctx, i32 y, float x_start, float x_end, float weight) {
+    i32 width = ctx->buffer->width;
+    x_start = MAX(x_start, 0.0f);
+    x_end = MIN(x_end, (float)width);
+    if (x_end <= x_start) {
+        return;
+    }
+    float* row = ctx->coverage + (i64)y * width;
+    i32 i_start = (i32)x_start;
+    i32 i_end = (i32)x_end;
+    if (i_start == i_end) {
+        row[i_start] += (x_end - x_start) * weight;
+        raster_touch(ctx, y, i_start, i_start + 1);
+        return;
+    }
+    row[i_start] += ((float)(i_start + 1) - x_start) * weight;
+    for (i32 i = i_start + 1; i < i_end; ++i) {
+        row[i] += weight;
+    }
+    if (i_end < width) {
+        row[i_end] += (x_end - (float)i_end) * weight;
+        raster_touch(ctx, y, i_start, i_end + 1);
+    } else {
+        raster_touch(ctx, y, i_start, i_end);
+    }
+}
+
+// Fills the polygon using the nonzero winding rule.
+static void raster_fill_polygon(raster_context_t* ctx, v2f* points, i32 count) {
+    ctx->edge_count = 0;
+    ctx->ymin = FLT_MAX;
+    ctx->ymax = -FLT_MAX;
+    for (i32 i = 0; i < count; ++i) {
+        raster_add_edge(ctx, points[i], points[(i + 1) % count]);
+    }
+    i32 edge_count = ctx->edge_count;
+    if (edge_count == 0) {
+        return;
+    }
+    if (ctx->crossing_capacity < edge_count) {
+        ctx->crossing_capacity = ATLEAST(edge_count, 2 * ctx->crossing_capacity);
+        ctx->crossings = (raster_crossing_t*)realloc(ctx->crossings, ctx->crossing_capacity * sizeof(raster_crossing_t));
+        ctx->active_edges = (i32*)realloc(ctx->active_edges, ctx->crossing_capacity * sizeof(i32));
+    }
+    qsort(ctx->edges, edge_count, sizeof(raster_edge_t), raster_compare_edges);
+
+    i32 y_begin = (i32)floorf(MAX(ctx->ymin, 0.0f));
+    i32 y_end = (i32)ceilf(MIN(ctx->ymax, (float)ctx->buffer->height));
+    const float weight = 1.0f / ANNOTATION_RASTER_SUBSCANLINES;
+    i32 next_edge = 0;
+    i32 active_count = 0;
+    for (i32 y = y_begin; y < y_end; ++y) {
+        for (i32 s = 0; s < ANNOTATION_RASTER_SUBSCANLINES; ++s) {
+            float sample_y = (float)y + ((float)s + 0.5f) * weight;
+            // Update the active edge list: drop edges that ended, add edges that started.
+            i32 kept = 0;
+            for (i32 i = 0; i < active_count; ++i) {
+                if (ctx->edges[ctx->active_edges[i]].y1 > sample_y) {
+                    ctx->active_edges[kept++] = ctx->active_edges[i];
+                }
+            }
+            active_count = kept;
+            while (next_edge < edge_count && ctx->edges[next_edge].y0 <= sample_y) {
+                if (ctx->edges[next_edge].y1 > sample_y) {
+                    ctx->active_edges[active_count++] = next_edge;
+                }
+                ++next_edge;
+            }
+            if (active_count == 0) {
+                continue;
+            }
+
+            // Intersections with the sub-scanline, sorted by x (insertion sort, there are usually only a few).
+            i32 crossing_count = 0;
+            for (i32 i = 0; i < active_count; ++i) {
+                raster_edge_t* edge = ctx->edges + ctx->active_edges[i];
+                raster_crossing_t crossing = {edge->x0 + (sample_y - edge->y0) * edge->dxdy, edge->winding};
+                i32 j = crossing_count++;
+                while (j > 0 && ctx->crossings[j - 1].x > crossing.x) {
+                    ctx->crossings[j] = ctx->crossings[j - 1];
+                    --j;
+                }
+                ctx->crossings[j] = crossing;
+            }
+
+            i32 winding = 0;
+            float span_start = 0.0f;
+            for (i32 i = 0; i < crossing_count; ++i) {
+                i32 new_winding = winding + ctx->crossings[i].winding;
+                if (winding == 0 && new_winding != 0) {
+                    span_start = ctx->crossings[i].x;
+                } else if (winding != 0 && new_winding == 0) {
+                    raster_accumulate_span(ctx, y, span_start, ctx->crossings[i].x, weight);
+                }
+                winding = new_winding;
+            }
+            if (winding != 0) {
+                // The edges closing this span were beyond the right border.
+                raster_accumulate_span(ctx, y, span_start, (float)ctx->buffer->width, weight);
+            }
+        }
+    }
+}
+
+// Coverage of a line segment with round ends: pixels whose center is closer than 'reach - 0.5' to the segment are fully
+// covered, fading out to 0 at a distance of 'reach + 0.5'. Where segments overlap, the highest coverage wins.
+static void raster_stroke_segment(raster_context_t* ctx, v2f p0, v2f p1, float reach) {
+    i32 width = ctx->buffer->width;
+    float extent = reach + 0.5f;
+    i32 y_begin = (i32)floorf(MAX(MIN(p0.y, p1.y) - extent, 0.0f));
+    i32 y_end = (i32)ceilf(MIN(MAX(p0.y, p1.y) + extent, (float)ctx->buffer->height));
+    if (MAX(p0.x, p1.x) + extent <= 0.0f || MIN(p0.x, p1.x) - extent >= (float)width) {
+        return;
+    }
+    v2f d = v2f_subtract(p1, p0);
+    float length_squared = d.x * d.x + d.y * d.y;
+    float inv_length_squared = length_squared > 1e-12f ? 1.0f / length_squared : 0.0f;
+    for (i32 y = y_begin; y < y_end; ++y) {
+        float center_y = (float)y + 0.5f;
+        // Only the part of the segment within 'extent' vertically can be close enough to pixels on this row.
+        float x_a = p0.x;
+        float x_b = p1.x;
+        if (fabsf(d.y) > 1e-6f) {
+            float t0 = (center_y - extent - p0.y) / d.y;
+            float t1 = (center_y + extent - p0.y) / d.y;
+            if (t0 > t1) {
+                float temp = t0;
+                t0 = t1;
+                t1 = temp;
+            }
+            t0 = MAX(t0, 0.0f);
+            t1 = MIN(t1, 1.0f);
+            if (t0 > t1) {
+                continue;
+            }
+            x_a = p0.x + t0 * d.x;
+            x_b = p0.x + t1 * d.x;
+        }
+        i32 x_begin = (i32)floorf(MAX(MIN(x_a, x_b) - extent, 0.0f));
+        i32 x_end = (i32)ceilf(MIN(MAX(x_a, x_b) + extent, (float)width));
+        if (x_begin >= x_end) {
+            continue;
+        }
+        float* row = ctx->coverage + (i64)y * width;
+        float dy = center_y - p0.y;
+        for (i32 x = x_begin; x < x_end; ++x) {
+            float dx = (float)x + 0.5f - p0.x;
+            float t = CLAMP((dx * d.x + dy * d.y) * inv_length_squared, 0.0f, 1.0f);
+            float distance_x = dx - t * d.x;
+            float distance_y = dy - t * d.y;
+            float coverage = reach + 0.5f - sqrtf(distance_x * distance_x + distance_y * distance_y);
+            if (coverage > row[x]) {
+                row[x] = MIN(coverage, 1.0f);
+            }
+        }
+        raster_touch(ctx, y, x_begin, x_end);
+    }
+}
+
+static void raster_stroke_polyline(raster_context_t* ctx, v2f* points, i32 count, bool closed, float half_width) {
+    i32 segment_count = closed ? count : count - 1;
+    for (i32 i = 0; i < segment_count; ++i) {
+        raster_stroke_segment(ctx, points[i], points[(i + 1) % count], half_width);
+    }
+}
+
+static int compare_i32(const void* a, const void* b) {
+    i32 value_a = *(const i32*)a;
+    i32 value_b = *(const i32*)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+void annotation_raster_draw(annotation_raster_t* raster, image_buffer_t* buffer, v2f world_origin, v2f pixels_per_world_unit) {
+    if (raster->shape_count == 0 || !buffer->pixels || buffer->width <= 0 || buffer->height <= 0) {
+        return;
+    }
+    ASSERT(buffer->channels == 4);
+    ASSERT(pixels_per_world_unit.x > 0.0f && pixels_per_world_unit.y > 0.0f);
+
+    float half_width = raster->line_width * 0.5f;
+    float point_radius = ATLEAST(raster->line_width, 2.0f);
+    float margin = MAX(half_width, point_radius) + 1.0f;
+    bounds2f query = BOUNDS2F(world_origin.x - margin / pixels_per_world_unit.x,
+                              world_origin.y - margin / pixels_per_world_unit.y,
+                              world_origin.x + ((float)buffer->width + margin) / pixels_per_world_unit.x,
+                              world_origin.y + ((float)buffer->height + margin) / pixels_per_world_unit.y);
+
+    // Gather the shapes from the bins that overlap the buffer. Shapes spanning multiple bins show up more than once,
+    // so sort and deduplicate them (sorting also keeps the drawing order the same as the order of the annotations).
+    bounds2i range;
+    annotation_raster_get_bin_range(raster, query, &range);
+    i32 candidate_count = 0;
+    for (i32 y = range.top; y <= range.bottom; ++y) {
+        i32 row_offset = y * raster->bins_x;
+        candidate_count += raster->bin_offsets[row_offset + range.right + 1] - raster->bin_offsets[row_offset + range.left];
+    }
+    if (candidate_count == 0) {
+        return;
+    }
+    i32* candidates = (i32*)malloc(candidate_count * sizeof(i32));
+    i32 pos = 0;
+    for (i32 y = range.top; y <= range.bottom; ++y) {
+        i32 row_offset = y * raster->bins_x;
+        i32 begin = raster->bin_offsets[row_offset + range.left];
+        i32 end = raster->bin_offsets[row_offset + range.right + 1];
+        memcpy(candidates + pos, raster->bin_shape_indices + begin, (end - begin) * sizeof(i32));
+        pos += end - begin;
+    }
+    qsort(candidates, candidate_count, sizeof(i32), compare_i32);
+
+    raster_context_t ctx = {0};
+    ctx.buffer = buffer;
+    ctx.touched_row_begin = buffer->height;
+    ctx.touched_row_end = 0;
+
+    i32 previous = -1;
+    for (i32 c = 0; c < candidate_count; ++c) {
+        i32 shape_index = candidates[c];
+        if (shape_index == previous) {
+            continue;
+        }
+        previous = shape_index;
+        annotation_raster_shape_t* shape = raster->shapes + shape_index;
+        if (shape->bounds.right < query.left || shape->bounds.left > query.right ||
+            shape->bounds.bottom < query.top || shape->bounds.top > query.bottom) {
+            continue;
+        }
+
+        if (!ctx.coverage) {
+            ctx.coverage = (float*)calloc((size_t)buffer->width * buffer->height, sizeof(float));
+            ctx.row_begin = (i32*)malloc(buffer->height * sizeof(i32));
+            ctx.row_end = (i32*)calloc(buffer->height, sizeof(i32));
+            for (i32 y = 0; y < buffer->height; ++y) {
+                ctx.row_begin[y] = buffer->width;
+            }
+        }
+        if (ctx.point_capacity < shape->point_count) {
+            ctx.point_capacity = ATLEAST(shape->point_count, 2 * ctx.point_capacity);
+            ctx.points = (v2f*)realloc(ctx.points, ctx.point_capacity * sizeof(v2f));
+        }
+        v2f* world_points = raster->points + shape->first_point;
+        for (i32 i = 0; i < shape->point_count; ++i) {
+            ctx.points[i].x = (world_points[i].x - world_origin.x) * pixels_per_world_unit.x;
+            ctx.points[i].y = (world_points[i].y - world_origin.y) * pixels_per_world_unit.y;
+        }
+
+        float opacity = (float)shape->color.a * (1.0f / 255.0f);
+        if (shape->flags & ANNOTATION_RASTER_SHAPE_POINT) {
+            for (i32 i = 0; i < shape->point_count; ++i) {
+                raster_stroke_segment(&ctx, ctx.points[i], ctx.points[i], point_radius);
+            }
+            raster_blend(&ctx, shape->color, opacity);
+            continue;
+        }
+        bool closed = (shape->flags & ANNOTATION_RASTER_SHAPE_CLOSED) != 0;
+        if (closed && raster->fill_opacity > 0.0f) {
+            raster_fill_polygon(&ctx, ctx.points, shape->point_count);
+            raster_blend(&ctx, shape->color, opacity * raster->fill_opacity);
+        }
+        if (half_width > 0.0f) {
+            raster_stroke_polyline(&ctx, ctx.points, shape->point_count, closed, half_width);
+            raster_blend(&ctx, shape->color, opacity);
+        }
+    }
+
+    free(candidates);
+    if (ctx.coverage) free(ctx.coverage);
+    if (ctx.row_begin) free(ctx.row_begin);
+    if (ctx.row_end) free(ctx.row_end);
+    if (ctx.edges) free(ctx.edges);
+    if (ctx.crossings) free(ctx.crossings);
+    if (ctx.active_edges) free(ctx.active_edges);
+    if (ctx.points) free(ctx.points);
+}
@@ -0,0 +1,69 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common.h"
+#include "mathutils.h"
+#include "annotation.h"
+#include "image_resize.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CPU rasterization of annotations into image buffers, for burning annotations into exported images (no GPU needed).
+// The annotations are copied once (in world coordinates) and binned into a grid, so that each buffer only looks at the
+// annotations that might touch it. After setup the raster is read-only, so any number of threads can draw from it.
+
+enum annotation_raster_shape_flags_enum {
+	ANNOTATION_RASTER_SHAPE_CLOSED = 0x1,
+	ANNOTATION_RASTER_SHAPE_POINT = 0x2,
+};
+
+typedef struct annotation_raster_shape_t {
+	i32 first_point;
+	i32 point_count;
+	bounds2f bounds; // world coordinates, without the line width
+	rgba_t color;
+	u32 flags;
+} annotation_raster_shape_t;
+
+typedef struct annotation_raster_t {
+	annotation_raster_shape_t* shapes;
+	i32 shape_count;
+	v2f* points; // world coordinates
+	i32 point_count;
+	float line_width; // in pixels of the buffer drawn into; 0 = no outlines
+	float fill_opacity; // 0 = no fill
+	bounds2f grid_bounds;
+	float bin_size; // in world units
+	i32 bins_x;
+	i32 bins_y;
+	i32* bin_offsets; // bins_x * bins_y + 1 entries; shapes of bin i are bin_shape_indices[bin_offsets[i]] .. [bin_offsets[i + 1] - 1]
+	i32* bin_shape_indices;
+} annotation_raster_t;
+
+bool annotation_raster_init(annotation_raster_t* raster, annotation_set_t* annotation_set, bounds2f world_bounds, float bin_size,
+                            float line_width, float fill_opacity);
+void annotation_raster_draw(annotation_raster_t* raster, image_buffer_t* buffer, v2f world_origin, v2f pixels_per_world_unit);
+void annotation_raster_destroy(annotation_raster_t* raster);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "common.h"
+#include "stringutils.h"
+#include "batch_export_manifest.h"
+
+// Parses the manifest in place; the items (an stb_ds array) point into the text.
+// Skipped: empty lines, lines starting with '#', and a header line whose first column is 'slide'.
+// A line with more columns than expected is an error, because it usually means that a filename contains an
+// unquoted comma; guessing which column is which would silently export the wrong thing.
+bool parse_batch_export_manifest(char* text, batch_export_item_t** items_out) {
+    batch_export_item_t* items = NULL;
+    char* line = text;
+    // Spreadsheet programs may save CSV files as UTF-8 with a byte order mark.
+    if ((u8)line[0] == 0xEF && (u8)line[1] == 0xBB && (u8)line[2] == 0xBF) {
+        line += 3;
+    }
+    i32 line_number = 0;
+    bool is_header_allowed = true;
+    while (line && *line) {
+        ++line_number;
+        char* next_line = strchr(line, '\n');
+        if (next_line) {
+            *next_line++ = '\0';
+        }
+        size_t len = strlen(line);
+        if (len > 0 && line[len-1] == '\r') {
+            line[len-1] = '\0';
+        }
+        char* fields[BATCH_EXPORT_MANIFEST_COLUMNS] = {0};
+        i32 field_count = split_csv_line(line, fields, COUNT(fields));
+        if (fields[0][0] == '\0' || fields[0][0] == '#') {
+            line = next_line;
+            continue;
+        }
+        if (is_header_allowed) {
+            is_header_allowed = false;
+            if (strcasecmp(fields[0], "slide") == 0) {
+                line = next_line;
+                continue;
+            }
+        }
+        if (field_count > BATCH_EXPORT_MANIFEST_COLUMNS) {
+            console_print_error("Batch export: line %d of the manifest has %d columns (expected at most %d: slide,roi,output,mpp,quality); "
+                                "filenames containing commas must be quoted\n", line_number, field_count, BATCH_EXPORT_MANIFEST_COLUMNS);
+            arrfree(items);
+            *items_out = NULL;
+            return false;
+        }
+        batch_export_item_t item = {0};
+        item.line_number = line_number;
+        item.slide = fields[0];
+        item.roi = field_count > 1 ? fields[1] : "";
+        item.output = field_count > 2 ? fields[2] : "";
+        item.mpp = field_count > 3 ? (float)atof(fields[3]) : 0.0f;
+        item.quality = field_count > 4 ? atoi(fields[4]) : 0;
+        arrput(items, item);
+        line = next_line;
+    }
+    *items_out = items;
+    return true;
+}
@@ -0,0 +1,46 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One line of a batch export manifest (see --manifest):
+//     slide,roi,output[,mpp][,quality]
+// The strings point into the text of the manifest. Missing columns are empty (or 0 for mpp and quality).
+typedef struct batch_export_item_t {
+	i32 line_number;
+	const char* slide;
+	const char* roi;
+	const char* output;
+	float mpp;
+	i32 quality;
+} batch_export_item_t;
+
+#define BATCH_EXPORT_MANIFEST_COLUMNS 5
+
+bool parse_batch_export_manifest(char* text, batch_export_item_t** items_out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -27,6 +27,26 @@
 #include "gui.h" // for global data, TODO: refactor
 #include "stringutils.h"
 #include "tiff_write.h"
+#include "batch_export_manifest.h"
+
+// Parses e.g. 'zstd:9' into tiff_export_compression and tiff_export_compression_level.
+static bool parse_export_compression_option(const char* option) {
+	const char* names[] = {"jpeg", "deflate", "zstd", "webp", "webp-lossless"};
+	const char* separator = strchr(option, ':');
+	size_t name_length = separator ? (size_t)(separator - option) : strlen(option);
+	for (i32 i = 0; i < COUNT(names); ++i) {
+		if (strlen(names[i]) == name_length && strncasecmp(option, names[i], name_length) == 0) {
+			bool has_level = (i == EXPORT_COMPRESSION_DEFLATE || i == EXPORT_COMPRESSION_ZSTD);
+			if (separator && !has_level) {
+				return false;
+			}
+			tiff_export_compression = i;
+			tiff_export_compression_level = separator ? atoi(separator + 1) : 0;
+			return true;
+		}
+	}
+	return false;
+}
 
 app_command_t app_parse_commandline(int argc, const char** argv) {
 	app_command_t app_command = {};
@@ -44,6 +64,7 @@ app_command_t app_parse_commandline(int argc, const char** argv) {
 			app_command.headless = true;
 			app_command.command = COMMAND_EXPORT;
 			app_command.export_command.with_annotations = false;
+			app_command.export_command.burn_in_line_width = 2.0f;
 			// TODO: allow use as conversion utility without need for ROI
 			app_command.export_command.error = COMMAND_EXPORT_ERROR_NO_ROI;
 			// slidescape 1.tiff --export --roi "Annotation 0"
@@ -64,6 +85,21 @@ app_command_t app_parse_commandline(int argc, const char** argv) {
 					app_command.export_command.with_annotations = false;
 				} else if (strcmp(arg, "--with-annotations") == 0) {
 					app_command.export_command.with_annotations = true;
+				} else if (strcmp(arg, "--burn-in-annotations") == 0) {
+					app_command.export_command.burn_in_annotations = true;
+				} else if (strcmp(arg, "--burn-in-line-width") == 0) {
+					if (arg_index < argc) {
+						++arg_index;
+						arg = args[arg_index];
+						app_command.export_command.burn_in_line_width = ATLEAST((float)atof(arg), 0.0f);
+					}
+				} else if (strcmp(arg, "--burn-in-fill") == 0) {
+					// --burn-in-fill 0.3: also fill closed annotations, at the given opacity
+					if (arg_index < argc) {
+						++arg_index;
+						arg = args[arg_index];
+						app_command.export_command.burn_in_fill_opacity = CLAMP((float)atof(arg), 0.0f, 1.0f);
+					}
 				} else if (strcmp(arg, "--quality") == 0) {
 					if (arg_index < argc) {
 						++arg_index;
@@ -76,11 +112,24 @@ app_command_t app_parse_commandline(int argc, const char** argv) {
 						}
 					}
 				} else if (strcmp(arg, "--mpp") == 0) {
+                    // --mpp 0.5, or a list of resolutions to export the same region at: --mpp 0.25,0.5,1.0
                     if (arg_index < argc) {
                         ++arg_index;
                         arg = args[arg_index];
-                        tiff_export_mpp = atof(arg);
-                        tiff_export_match_input_resolution = false;
+                        arrsetlen(app_command.export_command.target_mpps, 0);
+                        for (const char* value = arg; value; value = strchr(value, ',')) {
+                            if (*value == ',') ++value;
+                            float mpp = (float)atof(value);
+                            if (mpp > 0.0f) {
+                                arrput(app_command.export_command.target_mpps, mpp);
+                            } else {
+                                console_print_error("Invalid resolution '%s' in --mpp, ignoring\n", value);
+                            }
+                        }
+                        if (arrlen(app_command.export_command.target_mpps) > 0) {
+                            tiff_export_mpp = app_command.export_command.target_mpps[0];
+                            tiff_export_match_input_resolution = false;
+                        }
                     }
                 } else if (strcmp(arg, "--tile-size") == 0) {
                     if (arg_index < argc) {
@@ -94,6 +143,42 @@ app_command_t app_parse_commandline(int argc, const char** argv) {
 						arg = args[arg_index];
 						global_export_region_filename_postfix = arg;
 					}
+				} else if (strcmp(arg, "--compression") == 0) {
+					// --compression jpeg | deflate[:level] | zstd[:level] | webp | webp-lossless
+					if (arg_index < argc) {
+						++arg_index;
+						arg = args[arg_index];
+						if (!parse_export_compression_option(arg)) {
+							console_print_error("Invalid compression setting '%s', defaulting to %s\n", arg,
+							                    get_export_compression_name((export_compression_enum)tiff_export_compression));
+						}
+					}
+				} else if (strcmp(arg, "--manifest") == 0) {
+					// slidescape --export --manifest rois.csv --jobs 4 --report report.csv
+					if (arg_index < argc) {
+						++arg_index;
+						arg = args[arg_index];
+						app_command.export_command.manifest = arg;
+						app_command.export_command.error = COMMAND_EXPORT_ERROR_NONE;
+					}
+				} else if (strcmp(arg, "--report") == 0) {
+					if (arg_index < argc) {
+						++arg_index;
+						arg = args[arg_index];
+						app_command.export_command.report_filename = arg;
+					}
+				} else if (strcmp(arg, "--jobs") == 0) {
+					if (arg_index < argc) {
+						++arg_index;
+						arg = args[arg_index];
+						app_command.export_command.max_parallel_exports = atoi(arg);
+					}
+				} else if (strcmp(arg, "--memory-budget") == 0) {
+					if (arg_index < argc) {
+						++arg_index;
+						arg = args[arg_index];
+						app_command.export_command.memory_budget_in_mb = atoi(arg);
+					}
 				} else {
 					--arg_index; // not recognized, try again one level up
 					break;
@@ -101,6 +186,8 @@ app_command_t app_parse_commandline(int argc, const char** argv) {
 			}
 		} else  if (strcmp(arg, "--verbose") == 0) {
 			is_verbose_mode = true;
+		} else if (strcmp(arg, "--no-mmap") == 0) {
+			use_memory_mapped_files = false;
 		} else if (strcmp(arg, "--headless") == 0) {
 			app_command.headless = true;
 		} else if (strcmp(arg, "--overlay") == 0) {
@@ -200,6 +287,514 @@ void export_region_get_name_hint(app_state_t* app_state, char* output_buffer, si
 	snprintf(output_buffer, output_size-1, "%s%s", name_hint, filename_extension_hint);
 };
 
+// Sets up the annotations to draw into the exported pixels (--burn-in-annotations). Only the annotations in or near the
+// region are kept, binned into cells of about one output tile (at the finest resolution that is exported).
+static bool prepare_burn_in_annotations(app_state_t* app_state, bounds2f world_bounds, float finest_mpp, annotation_raster_t* raster) {
+	app_command_t* command = &app_state->command;
+	float bin_size = (float)tiff_export_tile_width * finest_mpp;
+	if (!annotation_raster_init(raster, &app_state->scene.annotation_set, world_bounds, bin_size,
+	                            command->export_command.burn_in_line_width, command->export_command.burn_in_fill_opacity)) {
+		console_print_error("Could not prepare the annotations for burning in\n");
+		return false;
+	}
+	console_print_verbose("Burning in %d annotations\n", raster->shape_count);
+	return true;
+}
+
+// Exports a region for --export, at each of the resolutions given with --mpp. If there are several, the outputs are
+// named after the resolution (e.g. slide_region_0.5mpp.tiff) and produced from one pass over the source.
+static bool export_region_from_commandline(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i pixel_bounds,
+                                           u32 export_flags, i64 memory_budget) {
+	char filename_hint[512];
+	export_region_get_name_hint(app_state, filename_hint, sizeof(filename_hint));
+
+	float* target_mpps = app_state->command.export_command.target_mpps;
+	i32 target_count = (i32)arrlen(target_mpps);
+	bool is_single_resolution = (tiff_export_match_input_resolution || target_count <= 1);
+
+	annotation_raster_t annotation_raster = {};
+	annotation_raster_t* burn_in_annotations = NULL;
+	if (app_state->command.export_command.burn_in_annotations) {
+		float finest_mpp = tiff_export_match_input_resolution ? image->mpp_x : tiff_export_mpp;
+		for (i32 i = 0; i < target_count && !is_single_resolution; ++i) {
+			finest_mpp = MIN(finest_mpp, target_mpps[i]);
+		}
+		if (!prepare_burn_in_annotations(app_state, world_bounds, finest_mpp, &annotation_raster)) {
+			return false;
+		}
+		burn_in_annotations = &annotation_raster;
+	}
+
+	export_options_t options = {};
+	options.tile_width = tiff_export_tile_width;
+	options.photometric_interpretation = tiff_export_desired_color_space;
+	options.quality = tiff_export_jpeg_quality;
+	options.compression = (export_compression_enum)tiff_export_compression;
+	options.compression_level = tiff_export_compression_level;
+	options.flags = export_flags;
+	options.need_resize = !tiff_export_match_input_resolution;
+	options.target_mpp = V2F(tiff_export_mpp, tiff_export_mpp);
+	options.memory_budget = memory_budget;
+	options.burn_in_annotations = burn_in_annotations;
+
+	if (is_single_resolution) {
+		bool success = export_cropped_bigtiff_with_resample(app_state, image, world_bounds, pixel_bounds, filename_hint, &options, NULL);
+		annotation_raster_destroy(&annotation_raster);
+		return success;
+	}
+
+	const char* extension = strrchr(filename_hint, '.');
+	size_t stem_length = extension ? (size_t)(extension - filename_hint) : strlen(filename_hint);
+	char** filenames = (char**)calloc(target_count, sizeof(char*));
+	v2f* mpps = (v2f*)calloc(target_count, sizeof(v2f));
+	for (i32 i = 0; i < target_count; ++i) {
+		filenames[i] = (char*)malloc(sizeof(filename_hint) + 32);
+		snprintf(filenames[i], sizeof(filename_hint) + 32, "%.*s_%gmpp%s", (int)stem_length, filename_hint,
+		         target_mpps[i], extension ? extension : "");
+		mpps[i] = V2F(target_mpps[i], target_mpps[i]);
+	}
+	bool success = export_cropped_bigtiff_at_multiple_resolutions(app_state, image, world_bounds, pixel_bounds,
+	                                                              (const char**)filenames, mpps, target_count, &options);
+	for (i32 i = 0; i < target_count; ++i) {
+		free(filenames[i]);
+	}
+	free(filenames);
+	free(mpps);
+	annotation_raster_destroy(&annotation_raster);
+	return success;
+}
+
+// Batch export: many regions of many slides in one process, driven by a CSV manifest.
+// Each line of the manifest describes one export:
+//     slide,roi,output[,mpp][,quality]
+// - roi: the name of an annotation; 'group:<name>' for every annotation in that group; empty for the whole slide.
+// - output: the output filename (numbered when exporting a group); if empty, derived from the slide filename.
+// - mpp, quality: optional per-line overrides of --mpp and --quality.
+// A header line starting with 'slide', empty lines and lines starting with '#' are skipped.
+//
+// Slides are opened (and their annotations loaded) on the main thread, one at a time, while the exports themselves
+// run as tasks on the thread pool. Several exports can be in flight at once, limited by --jobs and --memory-budget.
+
+typedef struct batch_export_slide_t {
+	image_t* image;
+	i32 jobs_in_flight; // only touched by the main thread
+	bool are_all_jobs_submitted;
+} batch_export_slide_t;
+
+typedef struct batch_export_job_t {
+	app_state_t* app_state;
+	batch_export_item_t* item;
+	batch_export_slide_t* slide;
+	char roi_name[256];
+	char output_filename[512];
+	bounds2f world_bounds;
+	bounds2i pixel_bounds;
+	bool need_resize;
+	v2f target_mpp;
+	i32 quality;
+	u32 export_flags;
+	i64 memory_budget;
+	i64 memory_estimate;
+	annotation_raster_t annotation_raster; // for --burn-in-annotations; built while the slide's annotations are loaded
+	bool burn_in_annotations;
+	bool success;
+	float seconds;
+	const char* error;
+	volatile i32 is_finished;
+	semaphore_handle_t finished_semaphore; // posted when the job is finished
+} batch_export_job_t;
+
+typedef struct batch_export_state_t {
+	app_state_t* app_state;
+	batch_export_job_t** jobs; // array
+	batch_export_job_t** jobs_in_flight; // array
+	batch_export_slide_t** slides_in_flight; // array
+	i64 memory_in_flight;
+	i64 memory_budget;
+	i32 max_parallel_exports;
+	i32 finished_count;
+	i32 failed_count;
+	semaphore_handle_t job_finished_semaphore; // posted once by each submitted job
+	i32 submitted_count;
+	i32 posts_consumed;
+} batch_export_state_t;
+
+static batch_export_item_t* load_batch_export_manifest(const char* filename, mem_t** file_out) {
+	mem_t* file = platform_read_entire_file(filename);
+	if (!file) {
+		console_print_error("Batch export: could not read manifest '%s'\n", filename);
+		return NULL;
+	}
+	batch_export_item_t* items = NULL;
+	if (!parse_batch_export_manifest((char*)file->data, &items)) {
+		free(file);
+		return NULL;
+	}
+	if (!items) {
+		console_print_error("Batch export: manifest '%s' has no entries\n", filename);
+		free(file);
+		return NULL;
+	}
+	*file_out = file; // the items point into the file contents
+	return items;
+}
+
+// The output filename for an exported region. For annotation groups, each region gets a number (starting at 1).
+static void batch_export_get_output_filename(batch_export_item_t* item, i32 number, char* buffer, size_t buffer_size) {
+	char base[512];
+	if (item->output[0] != '\0') {
+		copy_cstring(base, item->output, sizeof(base));
+	} else {
+		copy_cstring(base, item->slide, sizeof(base));
+		size_t len = strlen(base);
+		while (len > 0 && (base[len-1] == '/' || base[len-1] == '\\')) base[--len] = '\0'; // directory (DICOM, MRXS)
+		const char* name = one_past_last_slash(base, (i32)len);
+		char* ext = strrchr(base, '.');
+		if (ext && ext > name) *ext = '\0';
+		snprintf(base + strlen(base), sizeof(base) - strlen(base), "%s.tiff", global_export_region_filename_postfix);
+	}
+	if (number <= 0) {
+		copy_cstring(buffer, base, buffer_size);
+		return;
+	}
+	const char* name = one_past_last_slash(base, (i32)strlen(base));
+	char* ext = strrchr(base, '.');
+	if (ext && ext > name) {
+		*ext = '\0';
+		snprintf(buffer, buffer_size, "%s_%d.%s", base, number, ext + 1);
+	} else {
+		snprintf(buffer, buffer_size, "%s_%d", base, number);
+	}
+}
+
+static void batch_export_job_func(i32 logical_thread_index, void* userdata) {
+	batch_export_job_t* job = *(batch_export_job_t**)userdata;
+	i64 start = get_clock();
+	export_options_t options = {};
+	options.tile_width = tiff_export_tile_width;
+	options.photometric_interpretation = tiff_export_desired_color_space;
+	options.quality = job->quality;
+	options.compression = (export_compression_enum)tiff_export_compression;
+	options.compression_level = tiff_export_compression_level;
+	options.flags = job->export_flags;
+	options.need_resize = job->need_resize;
+	options.target_mpp = job->target_mpp;
+	options.memory_budget = job->memory_budget;
+	options.burn_in_annotations = job->burn_in_annotations ? &job->annotation_raster : NULL;
+	job->success = export_cropped_bigtiff_with_resample(job->app_state, job->slide->image, job->world_bounds, job->pixel_bounds,
+	                                                    job->output_filename, &options, NULL);
+	if (job->burn_in_annotations) {
+		annotation_raster_destroy(&job->annotation_raster);
+	}
+	job->seconds = get_seconds_elapsed(start, get_clock());
+	if (!job->success) {
+		job->error = "export failed";
+	}
+	atomic_increment(&job->is_finished);
+	platform_semaphore_post(job->finished_semaphore);
+}
+
+static void batch_export_report_job(batch_export_state_t* state, batch_export_job_t* job) {
+	++state->finished_count;
+	if (job->success) {
+		console_print("[%d] %s | %s -> %s (%.2f s)\n", state->finished_count,
+		              job->item->slide, job->roi_name, job->output_filename, job->seconds);
+	} else {
+		++state->failed_count;
+		console_print_error("[%d] FAILED: %s | %s (manifest line %d): %s\n", state->finished_count,
+		                    job->item->slide, job->roi_name, job->item->line_number, job->error);
+	}
+}
+
+// Collects the exports that have finished, and closes the slides that no longer have exports in flight.
+static void batch_export_reap_finished(batch_export_state_t* state) {
+	for (i32 i = 0; i < arrlen(state->jobs_in_flight); ) {
+		batch_export_job_t* job = state->jobs_in_flight[i];
+		if (job->is_finished) {
+			state->memory_in_flight -= job->memory_estimate;
+			--job->slide->jobs_in_flight;
+			batch_export_report_job(state, job);
+			arrdelswap(state->jobs_in_flight, i);
+		} else {
+			++i;
+		}
+	}
+	for (i32 i = 0; i < arrlen(state->slides_in_flight); ) {
+		batch_export_slide_t* slide = state->slides_in_flight[i];
+		if (slide->are_all_jobs_submitted && slide->jobs_in_flight == 0) {
+			image_destroy(slide->image);
+			free(slide->image);
+			free(slide);
+			arrdelswap(state->slides_in_flight, i);
+		} else {
+			++i;
+		}
+	}
+}
+
+// Blocks until the next submitted job is finished.
+static void batch_export_wait_for_job(batch_export_state_t* state) {
+	ASSERT(state->posts_consumed < state->submitted_count);
+	platform_semaphore_wait(state->job_finished_semaphore);
+	++state->posts_consumed;
+}
+
+static void batch_export_submit_job(batch_export_state_t* state, batch_export_job_t* job) {
+	// Wait for a free slot. A single export that is larger than the whole budget still runs, but on its own.
+	for (;;) {
+		batch_export_reap_finished(state);
+		i32 in_flight = (i32)arrlen(state->jobs_in_flight);
+		bool has_slot = in_flight < state->max_parallel_exports;
+		bool fits_budget = in_flight == 0 || state->memory_in_flight + job->memory_estimate <= state->memory_budget;
+		if (has_slot && fits_budget) break;
+		batch_export_wait_for_job(state);
+	}
+	state->memory_in_flight += job->memory_estimate;
+	++job->slide->jobs_in_flight;
+	arrput(state->jobs_in_flight, job);
+	job->finished_semaphore = state->job_finished_semaphore;
+	++state->submitted_count;
+	if (!thread_pool_submit_task(&global_thread_pool, batch_export_job_func, &job, sizeof(job))) {
+		batch_export_job_func(0, &job);
+	}
+}
+
+static bounds2i export_get_pixel_bounds_for_world_bounds(image_t* image, bounds2f world_bounds) {
+	// TODO: MRXS backend: don't rely on origin_offset, pad the image with empty tiles instead
+	bounds2f source_bounds = world_bounds;
+	source_bounds.min = v2f_subtract(source_bounds.min, image->origin_offset);
+	source_bounds.max = v2f_subtract(source_bounds.max, image->origin_offset);
+	return world_bounds_to_pixel_bounds(&source_bounds, image->mpp_x, image->mpp_y);
+}
+
+static batch_export_job_t* batch_export_create_job(batch_export_state_t* state, batch_export_item_t* item, batch_export_slide_t* slide,
+                                                   const char* roi_name, i32 number) {
+	batch_export_job_t* job = (batch_export_job_t*)calloc(1, sizeof(batch_export_job_t));
+	job->app_state = state->app_state;
+	job->item = item;
+	job->slide = slide;
+	copy_cstring(job->roi_name, roi_name, sizeof(job->roi_name));
+	batch_export_get_output_filename(item, number, job->output_filename, sizeof(job->output_filename));
+	job->quality = (item->quality > 0 && item->quality <= 100) ? item->quality : tiff_export_jpeg_quality;
+	if (item->mpp > 0.0f) {
+		job->need_resize = true;
+		job->target_mpp = V2F(item->mpp, item->mpp);
+	} else if (!tiff_export_match_input_resolution) {
+		job->need_resize = true;
+		job->target_mpp = V2F(tiff_export_mpp, tiff_export_mpp);
+	} else if (slide) {
+		job->target_mpp = V2F(slide->image->mpp_x, slide->image->mpp_y);
+	}
+	// Annotations are written from the main thread (where the annotation set lives), see below.
+	job->export_flags = EXPORT_FLAGS_PUSH_ANNOTATION_COORDINATES_INWARD | EXPORT_FLAGS_RELEASE_PAGE_CACHE;
+	arrput(state->jobs, job);
+	return job;
+}
+
+static void batch_export_finish_job_early(batch_export_state_t* state, batch_export_job_t* job, const char* error) {
+	job->error = error;
+	job->is_finished = true;
+	batch_export_report_job(state, job);
+}
+
+static void batch_export_prepare_job(batch_export_state_t* state, batch_export_job_t* job, bounds2f world_bounds) {
+	image_t* image = job->slide->image;
+	job->world_bounds = world_bounds;
+	job->pixel_bounds = export_get_pixel_bounds_for_world_bounds(image, world_bounds);
+	i32 width = job->pixel_bounds.right - job->pixel_bounds.left;
+	i32 height = job->pixel_bounds.bottom - job->pixel_bounds.top;
+	if (job->need_resize && image->is_mpp_known) {
+		width = (i32)((float)width * image->mpp_x / job->target_mpp.x);
+		height = (i32)((float)height * image->mpp_y / job->target_mpp.y);
+	}
+	// Each export gets an equal share of the budget, so that the exports running at the same time fit in it together.
+	job->memory_budget = state->memory_budget / state->max_parallel_exports;
+	job->memory_estimate = estimate_bigtiff_export_memory_usage(ATLEAST(1, width), ATLEAST(1, height), tiff_export_tile_width,
+	                                                            job->memory_budget);
+	if (state->app_state->command.export_command.burn_in_annotations) {
+		float finest_mpp = job->need_resize ? job->target_mpp.x : image->mpp_x;
+		job->burn_in_annotations = prepare_burn_in_annotations(state->app_state, world_bounds, finest_mpp, &job->annotation_raster);
+	}
+}
+
+static void write_batch_export_report(batch_export_state_t* state, const char* filename) {
+	FILE* fp = fopen(filename, "w");
+	if (!fp) {
+		console_print_error("Batch export: could not write report '%s'\n", filename);
+		return;
+	}
+	fprintf(fp, "line,slide,roi,output,status,seconds,error\n");
+	for (i32 i = 0; i < arrlen(state->jobs); ++i) {
+		batch_export_job_t* job = state->jobs[i];
+		const char* fields[] = {job->item->slide, job->roi_name, job->output_filename};
+		fprintf(fp, "%d,", job->item->line_number);
+		for (i32 field_index = 0; field_index < COUNT(fields); ++field_index) {
+			fputc('"', fp);
+			for (const char* c = fields[field_index]; *c; ++c) {
+				if (*c == '"') fputc('"', fp);
+				fputc(*c, fp);
+			}
+			fputs("\",", fp);
+		}
+		fprintf(fp, "%s,%.3f,%s\n", job->success ? "ok" : "failed", job->seconds, job->error ? job->error : "");
+	}
+	fclose(fp);
+}
+
+static image_t* batch_export_open_slide(app_state_t* app_state, const char* filename, file_info_t* file) {
+	*file = viewer_get_file_info(filename);
+	if (!file->is_valid) {
+		return NULL;
+	}
+	image_t* image = NULL;
+	if (file->is_directory) {
+		directory_info_t directory = viewer_get_directory_info(filename);
+		if (directory.is_valid && (directory.contains_dicom_files || directory.contains_mrxs_files)) {
+			file->type = directory.contains_dicom_files ? VIEWER_FILE_TYPE_DICOM : VIEWER_FILE_TYPE_MRXS;
+			image = load_image_from_file(app_state, file, &directory, 0);
+		}
+		viewer_directory_info_destroy(&directory);
+	} else if (file->is_image) {
+		image = load_image_from_file(app_state, file, NULL, 0);
+	}
+	if (image && !image->is_valid) {
+		image_destroy(image);
+		free(image);
+		image = NULL;
+	}
+	return image;
+}
+
+static int app_command_execute_batch_export(app_state_t* app_state) {
+	app_command_t* command = &app_state->command;
+	mem_t* manifest_file = NULL;
+	batch_export_item_t* items = load_batch_export_manifest(command->export_command.manifest, &manifest_file);
+	if (!items) {
+		return 1;
+	}
+
+	batch_export_state_t state = {};
+	state.app_state = app_state;
+	state.job_finished_semaphore = platform_semaphore_create(NULL);
+	state.max_parallel_exports = command->export_command.max_parallel_exports > 0 ? command->export_command.max_parallel_exports : 2;
+	i32 memory_budget_in_mb = command->export_command.memory_budget_in_mb > 0 ? command->export_command.memory_budget_in_mb : 2048;
+	state.memory_budget = (i64)memory_budget_in_mb * MEGABYTES(1);
+	console_print("Batch export: %d manifest entries, up to %d exports at a time, memory budget %d MB\n",
+	              (i32)arrlen(items), state.max_parallel_exports, memory_budget_in_mb);
+	if (arrlen(command->export_command.target_mpps) > 1) {
+		console_print_error("Batch export: only one resolution per manifest entry is supported; using --mpp %g\n", tiff_export_mpp);
+	}
+
+	i64 start = get_clock();
+	annotation_set_t* annotation_set = &app_state->scene.annotation_set;
+	bool* is_item_handled = (bool*)calloc(arrlen(items), sizeof(bool));
+	for (i32 first_index = 0; first_index < arrlen(items); ++first_index) {
+		if (is_item_handled[first_index]) continue;
+		const char* slide_filename = items[first_index].slide;
+
+		// Open the slide once, for all of the manifest entries that refer to it.
+		file_info_t file = {};
+		i64 open_start = get_clock();
+		image_t* image = batch_export_open_slide(app_state, slide_filename, &file);
+		batch_export_slide_t* slide = NULL;
+		if (image) {
+			slide = (batch_export_slide_t*)calloc(1, sizeof(batch_export_slide_t));
+			slide->image = image;
+			arrput(state.slides_in_flight, slide);
+			console_print_verbose("Batch export: opened '%s' in %.2f s\n", slide_filename, get_seconds_elapsed(open_start, get_clock()));
+			unload_and_reinit_annotations(annotation_set);
+			annotation_set->mpp = V2F(image->mpp_x, image->mpp_y);
+			load_associated_annotations(app_state, &file);
+		}
+
+		for (i32 item_index = first_index; item_index < arrlen(items); ++item_index) {
+			batch_export_item_t* item = items + item_index;
+			if (is_item_handled[item_index] || strcmp(item->slide, slide_filename) != 0) continue;
+			is_item_handled[item_index] = true;
+
+			if (!slide) {
+				batch_export_job_t* job = batch_export_create_job(&state, item, NULL, item->roi, 0);
+				batch_export_finish_job_early(&state, job, "could not open slide");
+				continue;
+			}
+
+			if (item->roi[0] == '\0') {
+				// Whole slide
+				bounds2i pixel_bounds = BOUNDS2I(0, 0, image->width_in_pixels, image->height_in_pixels);
+				bounds2f world_bounds = pixel_bounds_to_world_bounds(pixel_bounds, image->mpp_x, image->mpp_y);
+				world_bounds.min = v2f_add(world_bounds.min, image->origin_offset);
+				world_bounds.max = v2f_add(world_bounds.max, image->origin_offset);
+				batch_export_job_t* job = batch_export_create_job(&state, item, slide, "(whole slide)", 0);
+				batch_export_prepare_job(&state, job, world_bounds);
+				batch_export_submit_job(&state, job);
+				continue;
+			}
+
+			bool is_group = (strncmp(item->roi, "group:", 6) == 0);
+			const char* group_name = item->roi + 6;
+			i32 match_count = 0;
+			for (i32 i = 0; i < annotation_set->active_annotation_count; ++i) {
+				annotation_t* annotation = get_active_annotation(annotation_set, i);
+				bool is_match = false;
+				if (is_group) {
+					is_match = annotation->group_id >= 0 && annotation->group_id < annotation_set->active_group_count &&
+					           strcmp(get_active_annotation_group(annotation_set, annotation->group_id)->name, group_name) == 0;
+				} else {
+					is_match = strncmp(annotation->name, item->roi, COUNT(annotation->name)-1) == 0;
+				}
+				if (!is_match) continue;
+				++match_count;
+				batch_export_job_t* job = batch_export_create_job(&state, item, slide, is_group ? annotation->name : item->roi,
+				                                                  is_group ? match_count : 0);
+				batch_export_prepare_job(&state, job, bounds_for_annotation(annotation));
+				if (command->export_command.with_annotations) {
+					export_annotations_for_region(annotation_set, job->world_bounds, job->output_filename, job->export_flags);
+				}
+				batch_export_submit_job(&state, job);
+				if (!is_group) break;
+			}
+			if (match_count == 0) {
+				batch_export_job_t* job = batch_export_create_job(&state, item, slide, item->roi, 0);
+				batch_export_finish_job_early(&state, job, is_group ? "annotation group not found" : "annotation not found");
+			}
+		}
+		if (slide) {
+			slide->are_all_jobs_submitted = true;
+		}
+		unload_and_reinit_annotations(annotation_set);
+	}
+
+	for (;;) {
+		batch_export_reap_finished(&state);
+		if (arrlen(state.jobs_in_flight) == 0) break; // the slides are closed along with their last job
+		batch_export_wait_for_job(&state);
+	}
+	// A job may be reaped before it has posted; the semaphore can only go once every post has been consumed.
+	while (state.posts_consumed < state.submitted_count) {
+		batch_export_wait_for_job(&state);
+	}
+	platform_semaphore_destroy(state.job_finished_semaphore);
+
+	float seconds = get_seconds_elapsed(start, get_clock());
+	i32 job_count = (i32)arrlen(state.jobs);
+	console_print("Batch export: %d of %d exports succeeded, %d failed (%.1f s)\n",
+	              job_count - state.failed_count, job_count, state.failed_count, seconds);
+	if (command->export_command.report_filename) {
+		write_batch_export_report(&state, command->export_command.report_filename);
+	}
+
+	for (i32 i = 0; i < job_count; ++i) {
+		free(state.jobs[i]);
+	}
+	arrfree(state.jobs);
+	arrfree(state.jobs_in_flight);
+	arrfree(state.slides_in_flight);
+	free(is_item_handled);
+	arrfree(items);
+	free(manifest_file);
+	return state.failed_count > 0 ? 1 : 0;
+}
+
 int app_command_execute(app_state_t* app_state) {
 	app_command_t* command = &app_state->command;
 	if (command->command == COMMAND_NONE) {
@@ -207,9 +802,13 @@ int app_command_execute(app_state_t* app_state) {
 			return app_load_commandline_inputs(app_state) ? 0 : 1;
 		}
 	} else if (command->command == COMMAND_EXPORT) {
+		if (command->export_command.manifest) {
+			return app_command_execute_batch_export(app_state);
+		}
 		for (i32 i = 0; i < arrlen(command->inputs); ++i) {
 			console_print("input: %s\n", command->inputs[i]);
 		}
+		i64 memory_budget = (i64)command->export_command.memory_budget_in_mb * MEGABYTES(1); // 0: use the default
 
 		for (i32 input_index = 0; input_index < arrlen(command->inputs); ++input_index) {
 			const char* filename = command->inputs[input_index];
@@ -222,7 +821,7 @@ int app_command_execute(app_state_t* app_state) {
 						if (command->export_command.with_annotations) {
 							export_flags |= EXPORT_FLAGS_ALSO_EXPORT_ANNOTATIONS;
 						}
-						export_flags |= EXPORT_FLAGS_PUSH_ANNOTATION_COORDINATES_INWARD;
+						export_flags |= EXPORT_FLAGS_PUSH_ANNOTATION_COORDINATES_INWARD | EXPORT_FLAGS_RELEASE_PAGE_CACHE;
 
 						annotation_set_t* annotation_set = &app_state->scene.annotation_set;
 						bool want_roi = true;
@@ -247,19 +846,9 @@ int app_command_execute(app_state_t* app_state) {
 
 							if (found_roi) {
 								bounds2f world_bounds = bounds_for_annotation(roi_annotation);
-								// TODO: MRXS backend: don't rely on origin_offset, pad the image with empty tiles instead
-								bounds2f source_bounds = world_bounds;
-								source_bounds.min = v2f_subtract(source_bounds.min, image->origin_offset);
-								source_bounds.max = v2f_subtract(source_bounds.max, image->origin_offset);
-								bounds2i pixel_bounds = world_bounds_to_pixel_bounds(&source_bounds, image->mpp_x, image->mpp_y);
-
-								char filename_hint[512];
-								export_region_get_name_hint(app_state, filename_hint, sizeof(filename_hint));
-								export_cropped_bigtiff_with_resample(app_state, image, world_bounds, pixel_bounds,
-								                                     filename_hint, tiff_export_tile_width,
-								                                     tiff_export_desired_color_space,
-								                                     tiff_export_jpeg_quality, export_flags, !tiff_export_match_input_resolution,
-								                                     V2F(tiff_export_mpp, tiff_export_mpp));
+								bounds2i pixel_bounds = export_get_pixel_bounds_for_world_bounds(image, world_bounds);
+
+								export_region_from_commandline(app_state, image, world_bounds, pixel_bounds, export_flags, memory_budget);
 							} else {
 								if (command->export_command.use_first_roi) {
 									console_print_error("ROI export failed: could not find an annotation to use as ROI\n");
@@ -276,13 +865,7 @@ int app_command_execute(app_state_t* app_state) {
 							world_bounds.min = v2f_add(world_bounds.min, image->origin_offset);
 							world_bounds.max = v2f_add(world_bounds.max, image->origin_offset);
 
-							char filename_hint[512];
-							export_region_get_name_hint(app_state, filename_hint, sizeof(filename_hint));
-							export_cropped_bigtiff_with_resample(app_state, image, world_bounds, pixel_bounds,
-							                                     filename_hint, tiff_export_tile_width,
-							                                     tiff_export_desired_color_space,
-							                                     tiff_export_jpeg_quality, export_flags, !tiff_export_match_input_resolution,
-							                                     V2F(tiff_export_mpp, tiff_export_mpp));
+							export_region_from_commandline(app_state, image, world_bounds, pixel_bounds, export_flags, memory_budget);
 						}
 
 
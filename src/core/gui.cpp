@@ -748,10 +748,20 @@ void draw_export_region_dialog(app_state_t* app_state) {
 
 				if (desired_region_export_format == 0) {
 					if (ImGui::TreeNodeEx("Encoding options", ImGuiTreeNodeFlags_NoTreePushOnOpen | ImGuiTreeNodeFlags_NoAutoOpenOnLog)) {
-						ImGui::SliderInt("JPEG encoding quality", &tiff_export_jpeg_quality, 0, 100);
-						bool prefer_rgb = tiff_export_desired_color_space == TIFF_PHOTOMETRIC_RGB;
-						if (ImGui::Checkbox("Use RGB encoding (instead of YCbCr)", &prefer_rgb)) {
-							tiff_export_desired_color_space = prefer_rgb ? TIFF_PHOTOMETRIC_RGB : TIFF_PHOTOMETRIC_YCBCR;
+						const char* compression_names[] = {"JPEG", "Deflate (lossless)", "Zstd (lossless)", "WebP", "WebP (lossless)"};
+						ImGui::Combo("Compression", &tiff_export_compression, compression_names, COUNT(compression_names));
+						if (tiff_export_compression == EXPORT_COMPRESSION_JPEG || tiff_export_compression == EXPORT_COMPRESSION_WEBP) {
+							ImGui::SliderInt("Encoding quality", &tiff_export_jpeg_quality, 0, 100);
+						} else if (tiff_export_compression == EXPORT_COMPRESSION_DEFLATE) {
+							ImGui::SliderInt("Compression level", &tiff_export_compression_level, 0, 12, tiff_export_compression_level == 0 ? "default" : "%d");
+						} else if (tiff_export_compression == EXPORT_COMPRESSION_ZSTD) {
+							ImGui::SliderInt("Compression level", &tiff_export_compression_level, 0, 22, tiff_export_compression_level == 0 ? "default" : "%d");
+						}
+						if (tiff_export_compression == EXPORT_COMPRESSION_JPEG) {
+							bool prefer_rgb = tiff_export_desired_color_space == TIFF_PHOTOMETRIC_RGB;
+							if (ImGui::Checkbox("Use RGB encoding (instead of YCbCr)", &prefer_rgb)) {
+								tiff_export_desired_color_space = prefer_rgb ? TIFF_PHOTOMETRIC_RGB : TIFF_PHOTOMETRIC_YCBCR;
+							}
 						}
 					}
 
@@ -924,14 +934,18 @@ void draw_export_region_dialog(app_state_t* app_state) {
 								export_flags |= EXPORT_FLAGS_PUSH_ANNOTATION_COORDINATES_INWARD;
 							}
 						}
-						u32 export_tile_width = (image->tile_width == image->tile_height) ? image->tile_width : WSI_TILE_DIM;
+						export_options_t options = {};
+						options.tile_width = (image->tile_width == image->tile_height) ? image->tile_width : WSI_TILE_DIM;
+						options.photometric_interpretation = tiff_export_desired_color_space;
+						options.quality = tiff_export_jpeg_quality;
+						options.compression = (export_compression_enum)tiff_export_compression;
+						options.compression_level = tiff_export_compression_level;
+						options.flags = export_flags;
+						options.need_resize = !tiff_export_match_input_resolution;
+						options.target_mpp = V2F(tiff_export_mpp, tiff_export_mpp);
 						// Export TIFF by resampling level 0 and reconstructing the pyramid.
 						begin_export_cropped_bigtiff_with_resample(app_state, image, scene->crop_bounds,
-						                                           scene->selection_pixel_bounds,
-						                                           filename_buffer, export_tile_width,
-						                                           tiff_export_desired_color_space,
-						                                           tiff_export_jpeg_quality, export_flags, !tiff_export_match_input_resolution,
-						                                           V2F(tiff_export_mpp, tiff_export_mpp));
+						                                           scene->selection_pixel_bounds, filename_buffer, &options);
 						gui_add_modal_progress_bar_popup("Exporting region...", &global_tiff_export_progress, false);
 					} break;
 					default: {
@@ -1527,6 +1541,12 @@ void gui_draw(app_state_t* app_state, input_t* input, i32 client_width, i32 clie
 
 				ImGui::NewLine();
 
+				general_options_changed |= ImGui::Checkbox("Memory-map local slide files", &use_memory_mapped_files);
+				if (ImGui::IsItemHovered()) {
+					ImGui::SetTooltip("Read compressed tiles directly from the page cache (applies to slides opened afterwards).\n"
+					                  "Files on network drives are always read normally.");
+				}
+
 				ImGui::Checkbox("Enable Vsync", &is_vsync_enabled);
 				if (prev_is_vsync_enabled != is_vsync_enabled) {
 					set_swap_interval(is_vsync_enabled ? 1 : 0);
@@ -149,6 +149,8 @@ extern bool tiff_export_match_input_resolution INIT(= true);
 extern float tiff_export_mpp INIT(= 0.25f);
 extern i32 tiff_export_tile_width INIT(= 512);
 extern i32 tiff_export_jpeg_quality INIT(= 90);
+extern i32 tiff_export_compression INIT(= 0); // export_compression_enum (0 = JPEG)
+extern i32 tiff_export_compression_level INIT(= 0); // Deflate and Zstd only; 0 = default level
 
 #undef INIT
 #undef extern
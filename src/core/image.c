@@ -20,6 +20,7 @@
 #include "platform.h"
 #include "image.h"
 #include "jpeg_decoder.h"
+#include "dicom_wsi.h"
 #include "isyntax_reader.h" // for isyntax_cache_t
 #include "isyntax_streamer.h"
 
@@ -106,7 +107,7 @@ static void image_change_resolution(image_t* image, float mpp_x, float mpp_y) {
 
             // If this downsampling level is 'backed' by a corresponding image pyramid level (not guaranteed),
             // then we also need to update the dimension info for the backend-specific data structure
-            if (level_image->exists) {
+            if (level_image->exists && !level_image->is_virtual) {
                 i32 pyramid_image_index = level_image->pyramid_image_index;
                 if (image->backend == IMAGE_BACKEND_TIFF) {
                     ASSERT(pyramid_image_index < tiff->ifd_count);
@@ -134,6 +135,108 @@ static void image_change_resolution(image_t* image, float mpp_x, float mpp_y) {
 }
 
 
+// libjpeg(-turbo) can downscale by at most 1/8 in the DCT domain.
+#define VIRTUAL_LEVEL_MAX_SCALE_SHIFT 3
+
+static bool image_level_supports_scaled_decode(image_t* image, level_image_t* level_image) {
+    if (!level_image->exists || level_image->is_virtual || level_image->needs_indexing) {
+        return false;
+    }
+    if (image->backend == IMAGE_BACKEND_TIFF) {
+        tiff_ifd_t* ifd = image->tiff.level_images_ifd + level_image->pyramid_image_index;
+        return tiff_can_decode_tile_scaled(&image->tiff, ifd);
+    } else if (image->backend == IMAGE_BACKEND_DICOM) {
+        return dicom_wsi_can_decode_tile_scaled(&image->dicom, level_image->pyramid_image_index);
+    }
+    return false;
+}
+
+// Fill the gaps in the pyramid (and add a few levels on top, if the highest level is still large) with
+// virtual levels. Their tiles are assembled from 2x2, 4x4 or 8x8 tiles of the nearest finer real level,
+// each decoded at 1/2, 1/4 or 1/8 scale, so zoomed-out views don't need full-resolution decodes.
+static void image_init_virtual_levels(image_t* image) {
+    i32 real_level_count = image->level_count;
+    for (i32 level = 1; level < IMAGE_PYRAMID_MAX_LEVELS; ++level) {
+        level_image_t* level_image = image->level_images + level;
+        if (level < real_level_count && level_image->exists) {
+            continue;
+        }
+
+        i32 source_level = -1;
+        for (i32 candidate = level - 1; candidate >= 0 && level - candidate <= VIRTUAL_LEVEL_MAX_SCALE_SHIFT; --candidate) {
+            level_image_t* candidate_image = image->level_images + candidate;
+            if (candidate_image->exists && !candidate_image->is_virtual) {
+                if (image_level_supports_scaled_decode(image, candidate_image)) {
+                    source_level = candidate;
+                }
+                break; // only the nearest real level is worth decoding from
+            }
+        }
+        level_image_t* previous_level = image->level_images + level - 1;
+        if (level >= real_level_count) {
+            bool previous_fits_in_one_tile = previous_level->width_in_pixels <= previous_level->tile_width &&
+                                             previous_level->height_in_pixels <= previous_level->tile_height;
+            if (source_level < 0 || !previous_level->exists || previous_fits_in_one_tile) {
+                break;
+            }
+        } else if (source_level < 0) {
+            continue;
+        }
+
+        level_image_t* source = image->level_images + source_level;
+        i32 scale = 1 << (level - source_level);
+        if (source->tile_width % scale != 0 || source->tile_height % scale != 0) {
+            if (level >= real_level_count) break;
+            continue;
+        }
+
+        level_image_t virtual_level = {0};
+        virtual_level.exists = true;
+        virtual_level.is_virtual = true;
+        virtual_level.virtual_source_level = source_level;
+        virtual_level.pyramid_image_index = source->pyramid_image_index;
+        virtual_level.downsample_factor = source->downsample_factor * (float)scale;
+        virtual_level.width_in_pixels = (source->width_in_pixels + scale - 1) / scale;
+        virtual_level.height_in_pixels = (source->height_in_pixels + scale - 1) / scale;
+        virtual_level.tile_width = source->tile_width;
+        virtual_level.tile_height = source->tile_height;
+        virtual_level.width_in_tiles = (u32)((virtual_level.width_in_pixels + virtual_level.tile_width - 1) / virtual_level.tile_width);
+        virtual_level.height_in_tiles = (u32)((virtual_level.height_in_pixels + virtual_level.tile_height - 1) / virtual_level.tile_height);
+        virtual_level.tile_count = (u64)virtual_level.width_in_tiles * virtual_level.height_in_tiles;
+        virtual_level.um_per_pixel_x = source->um_per_pixel_x * (float)scale;
+        virtual_level.um_per_pixel_y = source->um_per_pixel_y * (float)scale;
+        virtual_level.x_tile_side_in_um = virtual_level.um_per_pixel_x * (float)virtual_level.tile_width;
+        virtual_level.y_tile_side_in_um = virtual_level.um_per_pixel_y * (float)virtual_level.tile_height;
+        virtual_level.origin_offset = source->origin_offset;
+        virtual_level.tiles = (tile_t*) calloc(1, virtual_level.tile_count * sizeof(tile_t));
+        for (i32 tile_index = 0; tile_index < virtual_level.tile_count; ++tile_index) {
+            tile_t* tile = virtual_level.tiles + tile_index;
+            tile->tile_index = tile_index;
+            tile->tile_x = tile_index % virtual_level.width_in_tiles;
+            tile->tile_y = tile_index / virtual_level.width_in_tiles;
+            // The virtual tile is empty only if all of the source tiles it covers are empty.
+            bool is_empty = true;
+            for (i32 dy = 0; dy < scale && is_empty; ++dy) {
+                i32 source_tile_y = tile->tile_y * scale + dy;
+                if (source_tile_y >= source->height_in_tiles) break;
+                for (i32 dx = 0; dx < scale; ++dx) {
+                    i32 source_tile_x = tile->tile_x * scale + dx;
+                    if (source_tile_x >= source->width_in_tiles) break;
+                    if (!get_tile(source, source_tile_x, source_tile_y)->is_empty) {
+                        is_empty = false;
+                        break;
+                    }
+                }
+            }
+            tile->is_empty = is_empty;
+        }
+        *level_image = virtual_level;
+        image->level_count = MAX(image->level_count, level + 1);
+        console_print_verbose("Level %d is missing from the image; using a virtual level (1/%d scale decoding of level %d)\n",
+                              level, scale, source_level);
+    }
+}
+
 // TODO: write 'drivers' / interfaces to be queried, instead of this copy-pasta
 
 bool init_image_from_tiff(image_t* image, tiff_t tiff, bool is_overlay, image_t* parent_image) {
@@ -213,15 +316,10 @@ bool init_image_from_tiff(image_t* image, tiff_t tiff, bool is_overlay, image_t*
                     ASSERT(level_image->x_tile_side_in_um > 0);
                     ASSERT(level_image->y_tile_side_in_um > 0);
                     level_image->tiles = (tile_t*) calloc(1, ifd->tile_count * sizeof(tile_t));
-                    ASSERT(ifd->tile_byte_counts != NULL);
-                    ASSERT(ifd->tile_offsets != NULL);
-                    // mark the empty tiles, so that we can skip loading them later on
+                    // Note: empty tiles are not marked here, because that would require reading all of the tile offsets
+                    // up front. Instead, the tile loader reports them as empty the first time they are requested.
                     for (i32 tile_index = 0; tile_index < level_image->tile_count; ++tile_index) {
                         tile_t* tile = level_image->tiles + tile_index;
-                        u64 tile_byte_count = ifd->tile_byte_counts[tile_index];
-                        if (tile_byte_count == 0) {
-                            tile->is_empty = true;
-                        }
                         // Facilitate some introspection by storing self-referential information
                         // in the tile_t struct. This is needed for some specific cases where we
                         // pass around pointers to tile_t structs without caring exactly where they
@@ -246,10 +344,9 @@ bool init_image_from_tiff(image_t* image, tiff_t tiff, bool is_overlay, image_t*
                 }
                 DUMMY_STATEMENT;
             }
-        } else if (tiff.is_ndpi) {
-            DUMMY_STATEMENT;
+            image_init_virtual_levels(image);
         } else {
-            // The image is NOT tiled
+            // The image is NOT tiled (this includes NDPI files that cannot be decoded per tile)
             memset(image->level_images, 0, sizeof(image->level_images));
             image->level_count = 1;
             level_image_t* level_image = image->level_images + 0;
@@ -259,10 +356,11 @@ bool init_image_from_tiff(image_t* image, tiff_t tiff, bool is_overlay, image_t*
             level_image->downsample_factor = ifd->downsample_factor;
             level_image->width_in_pixels = ifd->image_width;
             level_image->height_in_pixels = ifd->image_height;
-            level_image->tile_count = 1;
-            level_image->width_in_tiles = 1;
+            // Strips are exposed as virtual tiles (see tiff_post_init())
+            level_image->tile_count = ifd->tile_count;
+            level_image->width_in_tiles = ifd->width_in_tiles;
             ASSERT(level_image->width_in_tiles > 0);
-            level_image->height_in_tiles = 1;
+            level_image->height_in_tiles = ifd->height_in_tiles;
             level_image->tile_width = ifd->tile_width;
             level_image->tile_height = ifd->tile_height;
             level_image->um_per_pixel_x = ifd->um_per_pixel_x;
@@ -271,13 +369,15 @@ bool init_image_from_tiff(image_t* image, tiff_t tiff, bool is_overlay, image_t*
             level_image->y_tile_side_in_um = ifd->y_tile_side_in_um;
             ASSERT(level_image->x_tile_side_in_um > 0);
             ASSERT(level_image->y_tile_side_in_um > 0);
-            level_image->tiles = (tile_t*) calloc(1, sizeof(tile_t)); // only 1 tile in this case
+            level_image->tiles = (tile_t*) calloc(1, level_image->tile_count * sizeof(tile_t));
             ASSERT(ifd->strip_byte_counts != NULL);
             ASSERT(ifd->strip_offsets != NULL);
-            tile_t* tile = level_image->tiles + 0;
-            tile->tile_index = 0;
-            tile->tile_x = 0;
-            tile->tile_y = 0;
+            for (i32 tile_index = 0; tile_index < level_image->tile_count; ++tile_index) {
+                tile_t* tile = level_image->tiles + tile_index;
+                tile->tile_index = tile_index;
+                tile->tile_x = tile_index % level_image->width_in_tiles;
+                tile->tile_y = tile_index / level_image->width_in_tiles;
+            }
         }
 
 
@@ -609,6 +709,7 @@ bool init_image_from_dicom(image_t* image, dicom_series_t* dicom, bool is_overla
 
 
         }
+        image_init_virtual_levels(image);
     }
 
     /*isyntax_image_t* macro_image = isyntax->images + isyntax->macro_image_index;
@@ -1130,6 +1231,15 @@ bool image_read_region(image_t* image, i32 level, i32 x, i32 y, i32 w, i32 h, vo
 			i32 width_in_tiles_to_read = tiles_within_level_bounds.right - tiles_within_level_bounds.left;
 			i32 height_in_tiles_to_read = tiles_within_level_bounds.bottom - tiles_within_level_bounds.top;
 
+			// Tiles of which only a small part is needed (e.g. a sliver along the edge of the region) are not requested
+			// through the tile cache; instead, only the part that is needed is decoded, directly into the region.
+			bool can_decode_partially = !invert_colors && tile_loader_can_decode_tile_region(image, level);
+			u8* decode_partially = NULL;
+			if (width_in_tiles_to_read > 0 && height_in_tiles_to_read > 0) {
+				decode_partially = calloc(width_in_tiles_to_read * height_in_tiles_to_read, sizeof(u8));
+			}
+#define DECODE_PARTIALLY(tile_x, tile_y) decode_partially[((tile_y) - tiles_within_level_bounds.min.y) * width_in_tiles_to_read + ((tile_x) - tiles_within_level_bounds.min.x)]
+
 			if (width_in_tiles_to_read > 0 && height_in_tiles_to_read > 0) {
 				load_tile_task_t *wishlist = calloc(width_in_tiles_to_read * height_in_tiles_to_read, sizeof(load_tile_task_t));
 				i32 tiles_to_load = 0;
@@ -1163,6 +1273,15 @@ bool image_read_region(image_t* image, i32 level, i32 x, i32 y, i32 w, i32 h, vo
 						if (tile_cache_tile_is_busy(image, level, tile->tile_index)) {
 							continue; // another read_region() or viewer request is already loading it
 						}
+						if (can_decode_partially) {
+							bounds2i tile_bounds = BOUNDS2I(tile_x * tile_width, tile_y * tile_height, (tile_x + 1) * tile_width, (tile_y + 1) * tile_height);
+							bounds2i needed = clip_bounds2i(BOUNDS2I(x, y, x + w, y + h), tile_bounds);
+							i64 needed_area = (i64)(needed.right - needed.left) * (needed.bottom - needed.top);
+							if (needed_area * 4 <= (i64)tile_width * tile_height) {
+								DECODE_PARTIALLY(tile_x, tile_y) = true;
+								continue;
+							}
+						}
 						wishlist[tiles_to_load++] = (load_tile_task_t) {
 								.resource_id = image->resource_id,
 								.image = image,
@@ -1216,6 +1335,9 @@ bool image_read_region(image_t* image, i32 level, i32 x, i32 y, i32 w, i32 h, vo
 						for (i32 tile_y = tiles_within_level_bounds.min.y; tile_y < tiles_within_level_bounds.max.y; ++tile_y) {
 							for (i32 tile_x = tiles_within_level_bounds.min.x; tile_x < tiles_within_level_bounds.max.x; ++tile_x) {
 								tile_t *tile = get_tile(level_image, tile_x, tile_y);
+								if (DECODE_PARTIALLY(tile_x, tile_y)) {
+									continue;
+								}
 								if (!tile->is_empty && !tile_cache_tile_has_cpu_pixels(image, level, tile->tile_index)) {
 									all_tiles_ready = false;
 									if (!tile_cache_tile_is_busy(image, level, tile->tile_index)) {
@@ -1279,6 +1401,36 @@ bool image_read_region(image_t* image, i32 level, i32 x, i32 y, i32 w, i32 h, vo
 			// Allocate memory for tile pixels (will reuse for consecutive libisyntax_tile_read() calls)
 //			uint32_t* tile_pixels = (uint32_t*)malloc(tile_width * tile_height * sizeof(uint32_t));
 
+			// Decode the parts of the tiles that were not requested through the tile cache.
+			u8* partial_tile_pixels = NULL;
+			for (i32 tile_y = tiles_within_level_bounds.min.y; tile_y < tiles_within_level_bounds.max.y; ++tile_y) {
+				for (i32 tile_x = tiles_within_level_bounds.min.x; tile_x < tiles_within_level_bounds.max.x; ++tile_x) {
+					if (!DECODE_PARTIALLY(tile_x, tile_y)) {
+						continue;
+					}
+					i32 src_x = (tile_x == start_tile_x) ? x_remainder : 0;
+					i32 src_y = (tile_y == start_tile_y) ? y_remainder : 0;
+					i32 dest_x = (tile_x == start_tile_x) ? 0 : (tile_x - start_tile_x) * tile_width - x_remainder;
+					i32 dest_y = (tile_y == start_tile_y) ? 0 : (tile_y - start_tile_y) * tile_height - y_remainder;
+					i32 copy_width = (tile_x == end_tile_x) ? x_remainder_last - src_x + 1 : tile_width - src_x;
+					i32 copy_height = (tile_y == end_tile_y) ? y_remainder_last - src_y + 1 : tile_height - src_y;
+					if (!partial_tile_pixels) {
+						partial_tile_pixels = (u8*)malloc((size_t)tile_width * tile_height * BYTES_PER_PIXEL);
+					}
+					tile_t* tile = get_tile(level_image, tile_x, tile_y);
+					if (tile_loader_decode_tile_region(threadlocal_logical_thread_index, image, level, tile->tile_index,
+					                                   src_x, src_y, copy_width, copy_height, partial_tile_pixels)) {
+						u32* pixels = (u32*)partial_tile_pixels;
+						for (int64_t i = 0; i < copy_height; ++i) {
+							int64_t dest_index = (dest_y + i) * w + dest_x;
+							int64_t src_index = (src_y + i) * tile_width + src_x;
+							memcpy(((u32*)intermediate_pixel_buffer) + dest_index, pixels + src_index, copy_width * sizeof(uint32_t));
+						}
+					}
+				}
+			}
+			if (partial_tile_pixels) free(partial_tile_pixels);
+
 			// Read tiles and copy the relevant portion of each tile to the region
             platform_mutex_lock(&image->lock);
 			for (i32 tile_y = start_tile_y; tile_y <= end_tile_y; ++tile_y) {
@@ -1320,6 +1472,8 @@ bool image_read_region(image_t* image, i32 level, i32 x, i32 y, i32 w, i32 h, vo
 				}
 			}
             platform_mutex_unlock(&image->lock);
+			if (decode_partially) free(decode_partially);
+#undef DECODE_PARTIALLY
 
 
 
@@ -1432,6 +1586,31 @@ bool image_read_region(image_t* image, i32 level, i32 x, i32 y, i32 w, i32 h, vo
     return success;
 }
 
+// Drops the pages of the memory-mapped slide file(s) that are resident in this process. Long reads (e.g. exporting a
+// whole slide) otherwise keep every page they touched mapped in, so the RSS grows with the size of the region read.
+void image_drop_resident_source_pages(image_t* image) {
+    if (image->type != IMAGE_TYPE_WSI) {
+        return;
+    }
+    if (image->backend == IMAGE_BACKEND_TIFF) {
+        mapped_file_advise(&image->tiff.mapped_file, 0, image->tiff.mapped_file.size, FILE_ACCESS_DONE);
+    } else if (image->backend == IMAGE_BACKEND_ISYNTAX) {
+        mapped_file_advise(&image->isyntax.mapped_file, 0, image->isyntax.mapped_file.size, FILE_ACCESS_DONE);
+    } else if (image->backend == IMAGE_BACKEND_DICOM) {
+        for (i32 i = 0; i < arrlen(image->dicom.instances); ++i) {
+            mapped_file_t* mapped_file = &image->dicom.instances[i].mapped_file;
+            mapped_file_advise(mapped_file, 0, mapped_file->size, FILE_ACCESS_DONE);
+        }
+    } else if (image->backend == IMAGE_BACKEND_MRXS) {
+        if (image->mrxs.dat_mapped_files) {
+            for (i32 i = 0; i < image->mrxs.dat_count; ++i) {
+                mapped_file_t* mapped_file = image->mrxs.dat_mapped_files + i;
+                mapped_file_advise(mapped_file, 0, mapped_file->size, FILE_ACCESS_DONE);
+            }
+        }
+    }
+}
+
 void do_level_image_indexing(image_t* image, level_image_t* level_image, i32 scale) {
     if (image->backend == IMAGE_BACKEND_DICOM) {
         if (dicom_instance_index_pixel_data(image->dicom.wsi.level_instances[scale])) {
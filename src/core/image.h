@@ -139,6 +139,8 @@ typedef struct {
     v2f origin_offset;
     i32 pyramid_image_index;
     bool exists;
+    bool is_virtual; // not stored in the file, synthesized by DCT-scaled decoding of virtual_source_level
+    i32 virtual_source_level;
     bool needs_indexing; //TODO: implement
     bool indexing_job_submitted;
 } level_image_t;
@@ -229,6 +231,7 @@ bool init_image_from_stbi(image_t* image, simple_image_t* simple, bool is_overla
 void init_image_from_openslide(image_t* image, wsi_t* wsi, bool is_overlay);
 void unload_openslide_wsi(wsi_t* wsi);
 bool image_read_region(image_t* image, i32 level, i32 x, i32 y, i32 w, i32 h, void* dest, pixel_format_enum desired_pixel_format);
+void image_drop_resident_source_pages(image_t* image);
 void begin_level_image_indexing(image_t* image, level_image_t* level_image, i32 scale);
 void image_destroy(image_t* image);
 
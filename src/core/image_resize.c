@@ -56,9 +56,13 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "common.h"
 #include "image.h"
 #include "image_resize.h"
+#include "intrinsics.h"
 
 #include <math.h>
 
+// Toggle to force the scalar code paths (e.g. for comparing against the SIMD versions).
+bool disable_simd_image_resize = false;
+
 image_buffer_t create_bgra_image_buffer(i32 width, i32 height) {
     image_buffer_t result = {};
     result.width = width;
@@ -212,6 +216,121 @@ static inline u8 clip8(int in) {
     return clip8_lookups[in >> PRECISION_BITS];
 }
 
+// SIMD versions of the resampling passes for 4-channel images. Each pixel is widened into one register of four
+// 32-bit accumulators, and the arithmetic is the same as in the scalar loops (same fixed-point coefficients, same
+// rounding), so the results are bit-identical. The shift and clamp done by clip8() map to two saturating packs.
+#if defined(__SSE4_1__) || defined(__ARM_NEON)
+#define RESAMPLE_SIMD 1
+#if defined(__SSE4_1__)
+#define RS_VEC                          __m128i
+#define RS_SET1(x)                      _mm_set1_epi32(x)
+#define RS_MADD(ss, p, k)               _mm_add_epi32((ss), _mm_mullo_epi32((p), _mm_set1_epi32(k)))
+#define RS_WIDEN_PIXEL(p32)             _mm_cvtepu8_epi32(_mm_cvtsi32_si128((i32)(p32)))
+
+static inline void rs_widen_4_pixels(const u8* src, RS_VEC* p0, RS_VEC* p1, RS_VEC* p2, RS_VEC* p3) {
+    __m128i pixels = _mm_loadu_si128((const __m128i*)src);
+    *p0 = _mm_cvtepu8_epi32(pixels);
+    *p1 = _mm_cvtepu8_epi32(_mm_srli_si128(pixels, 4));
+    *p2 = _mm_cvtepu8_epi32(_mm_srli_si128(pixels, 8));
+    *p3 = _mm_cvtepu8_epi32(_mm_srli_si128(pixels, 12));
+}
+
+static inline u32 rs_pack_pixel(RS_VEC ss) {
+    __m128i v = _mm_srai_epi32(ss, PRECISION_BITS);
+    v = _mm_packs_epi32(v, v);
+    v = _mm_packus_epi16(v, v);
+    return (u32)_mm_cvtsi128_si32(v);
+}
+
+static inline void rs_pack_4_pixels(u8* dest, RS_VEC ss0, RS_VEC ss1, RS_VEC ss2, RS_VEC ss3) {
+    __m128i v01 = _mm_packs_epi32(_mm_srai_epi32(ss0, PRECISION_BITS), _mm_srai_epi32(ss1, PRECISION_BITS));
+    __m128i v23 = _mm_packs_epi32(_mm_srai_epi32(ss2, PRECISION_BITS), _mm_srai_epi32(ss3, PRECISION_BITS));
+    _mm_storeu_si128((__m128i*)dest, _mm_packus_epi16(v01, v23));
+}
+#else
+#define RS_VEC                          int32x4_t
+#define RS_SET1(x)                      vdupq_n_s32(x)
+#define RS_MADD(ss, p, k)               vmlaq_n_s32((ss), (p), (k))
+#define RS_WIDEN_PIXEL(p32)             vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(p32))))))
+
+static inline void rs_widen_4_pixels(const u8* src, RS_VEC* p0, RS_VEC* p1, RS_VEC* p2, RS_VEC* p3) {
+    uint8x16_t pixels = vld1q_u8(src);
+    uint16x8_t lo = vmovl_u8(vget_low_u8(pixels));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(pixels));
+    *p0 = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lo)));
+    *p1 = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lo)));
+    *p2 = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(hi)));
+    *p3 = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(hi)));
+}
+
+static inline u32 rs_pack_pixel(RS_VEC ss) {
+    int16x4_t v = vqmovn_s32(vshrq_n_s32(ss, PRECISION_BITS));
+    uint8x8_t u = vqmovun_s16(vcombine_s16(v, v));
+    return vget_lane_u32(vreinterpret_u32_u8(u), 0);
+}
+
+static inline void rs_pack_4_pixels(u8* dest, RS_VEC ss0, RS_VEC ss1, RS_VEC ss2, RS_VEC ss3) {
+    int16x8_t v01 = vcombine_s16(vqmovn_s32(vshrq_n_s32(ss0, PRECISION_BITS)), vqmovn_s32(vshrq_n_s32(ss1, PRECISION_BITS)));
+    int16x8_t v23 = vcombine_s16(vqmovn_s32(vshrq_n_s32(ss2, PRECISION_BITS)), vqmovn_s32(vshrq_n_s32(ss3, PRECISION_BITS)));
+    vst1q_u8(dest, vcombine_u8(vqmovun_s16(v01), vqmovun_s16(v23)));
+}
+#endif
+
+static void image_resample_horizontal_8bit_bgra_simd(image_buffer_t* out, image_buffer_t* in, i32 offset, i32 ksize, i32* bounds, i32* kk) {
+    for (i32 yy = 0; yy < out->height; yy++) {
+        u8* in_row = in->pixels + (yy + offset) * in->width * 4;
+        u8* out_row = out->pixels + yy * out->width * 4;
+        for (i32 xx = 0; xx < out->width; xx++) {
+            i32 xmin = bounds[xx * 2 + 0];
+            i32 xmax = bounds[xx * 2 + 1];
+            i32* k = &kk[xx * ksize];
+            RS_VEC ss = RS_SET1(1 << (PRECISION_BITS - 1));
+            for (i32 x = 0; x < xmax; x++) {
+                u32 pixel;
+                memcpy(&pixel, in_row + (x + xmin) * 4, sizeof(pixel));
+                ss = RS_MADD(ss, RS_WIDEN_PIXEL(pixel), k[x]);
+            }
+            u32 v = rs_pack_pixel(ss);
+            memcpy(out_row + xx * sizeof(v), &v, sizeof(v));
+        }
+    }
+}
+
+static void image_resample_vertical_8bit_bgra_simd(image_buffer_t* out, image_buffer_t* in, i32 ksize, i32* bounds, i32* kk) {
+    for (i32 yy = 0; yy < out->height; yy++) {
+        i32* k = &kk[yy * ksize];
+        i32 ymin = bounds[yy * 2 + 0];
+        i32 ymax = bounds[yy * 2 + 1];
+        u8* out_row = out->pixels + yy * out->width * 4;
+        i32 xx = 0;
+        // Four adjacent output pixels at a time: the source rows are read contiguously.
+        for (; xx + 4 <= out->width; xx += 4) {
+            RS_VEC ss0 = RS_SET1(1 << (PRECISION_BITS - 1));
+            RS_VEC ss1 = ss0, ss2 = ss0, ss3 = ss0;
+            for (i32 y = 0; y < ymax; y++) {
+                RS_VEC p0, p1, p2, p3;
+                rs_widen_4_pixels(in->pixels + ((y + ymin) * in->width + xx) * 4, &p0, &p1, &p2, &p3);
+                ss0 = RS_MADD(ss0, p0, k[y]);
+                ss1 = RS_MADD(ss1, p1, k[y]);
+                ss2 = RS_MADD(ss2, p2, k[y]);
+                ss3 = RS_MADD(ss3, p3, k[y]);
+            }
+            rs_pack_4_pixels(out_row + xx * 4, ss0, ss1, ss2, ss3);
+        }
+        for (; xx < out->width; xx++) {
+            RS_VEC ss = RS_SET1(1 << (PRECISION_BITS - 1));
+            for (i32 y = 0; y < ymax; y++) {
+                u32 pixel;
+                memcpy(&pixel, in->pixels + ((y + ymin) * in->width + xx) * 4, sizeof(pixel));
+                ss = RS_MADD(ss, RS_WIDEN_PIXEL(pixel), k[y]);
+            }
+            u32 v = rs_pack_pixel(ss);
+            memcpy(out_row + xx * sizeof(v), &v, sizeof(v));
+        }
+    }
+}
+#endif
+
 static i32 precompute_coeffs(i32 in_size, float in0, float in1, i32 out_size, filter_t *filter, i32 **boundsp, float **kkp) {
     /* prepare for horizontal stretch */
     float filterscale = (in1 - in0) / out_size;
@@ -349,6 +468,12 @@ void image_resample_horizontal_8bit(image_buffer_t* out, image_buffer_t* in, i32
             }
         }
     } else {
+#if RESAMPLE_SIMD
+        if (!disable_simd_image_resize) {
+            image_resample_horizontal_8bit_bgra_simd(out, in, offset, ksize, bounds, kk);
+            return;
+        }
+#endif
         for (yy = 0; yy < out->height; yy++) {
             for (xx = 0; xx < out->width; xx++) {
                 u32 v;
@@ -426,6 +551,12 @@ void image_resample_vertical_8bit(image_buffer_t* out, image_buffer_t* in, i32 o
             }
         }
     } else {
+#if RESAMPLE_SIMD
+        if (!disable_simd_image_resize) {
+            image_resample_vertical_8bit_bgra_simd(out, in, ksize, bounds, kk);
+            return;
+        }
+#endif
         for (yy = 0; yy < out->height; yy++) {
             k = &kk[yy * ksize];
             ymin = bounds[yy * 2 + 0];
@@ -566,7 +697,50 @@ bool image_shrink_2x2(image_buffer_t* in, image_buffer_t* out, rect2i box) {
                 memcpy(out->pixels + y * out->stride_in_bytes + x * sizeof(v), &v, sizeof(v));
             }
         } else {  // bands == 4
-            for (x = 0; x < box.w / xscale; x++) {
+            x = 0;
+#if defined(__SSE2__)
+            // Four output pixels at a time. The sums are widened to 16 bits, so the rounding is the same as below.
+            if (!disable_simd_image_resize) {
+                __m128i zero = _mm_setzero_si128();
+                __m128i rounding = _mm_set1_epi16((i16)amend);
+                for (; x + 4 <= box.w / xscale; x += 4) {
+                    int xx = box.x + x * xscale;
+                    __m128i a0 = _mm_loadu_si128((const __m128i*)(line0 + xx * 4));
+                    __m128i a1 = _mm_loadu_si128((const __m128i*)(line0 + xx * 4 + 16));
+                    __m128i b0 = _mm_loadu_si128((const __m128i*)(line1 + xx * 4));
+                    __m128i b1 = _mm_loadu_si128((const __m128i*)(line1 + xx * 4 + 16));
+                    // Vertical sums, two pixels per register
+                    __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+                    __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+                    __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+                    __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+                    // Horizontal sums: add the left and right pixel of each pair
+                    __m128i t0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+                    __m128i t1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+                    t0 = _mm_srli_epi16(_mm_add_epi16(t0, rounding), 2);
+                    t1 = _mm_srli_epi16(_mm_add_epi16(t1, rounding), 2);
+                    _mm_storeu_si128((__m128i*)(out->pixels + y * out->stride_in_bytes + x * 4), _mm_packus_epi16(t0, t1));
+                }
+            }
+#elif defined(__ARM_NEON)
+            if (!disable_simd_image_resize) {
+                for (; x + 4 <= box.w / xscale; x += 4) {
+                    int xx = box.x + x * xscale;
+                    // De-interleave into even and odd pixels, so that each pair is in the same lane.
+                    uint32x4x2_t a = vld2q_u32((const u32*)(line0 + xx * 4));
+                    uint32x4x2_t b = vld2q_u32((const u32*)(line1 + xx * 4));
+                    uint8x16_t a_even = vreinterpretq_u8_u32(a.val[0]), a_odd = vreinterpretq_u8_u32(a.val[1]);
+                    uint8x16_t b_even = vreinterpretq_u8_u32(b.val[0]), b_odd = vreinterpretq_u8_u32(b.val[1]);
+                    uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a_even), vget_low_u8(a_odd)),
+                                              vaddl_u8(vget_low_u8(b_even), vget_low_u8(b_odd)));
+                    uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a_even), vget_high_u8(a_odd)),
+                                              vaddl_u8(vget_high_u8(b_even), vget_high_u8(b_odd)));
+                    // vrshrn adds the rounding term (2) before shifting
+                    vst1q_u8(out->pixels + y * out->stride_in_bytes + x * 4, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+                }
+            }
+#endif
+            for (; x < box.w / xscale; x++) {
                 int xx = box.x + x * xscale;
                 u32 v;
                 ss0 = line0[xx * 4 + 0] + line0[xx * 4 + 4] + line1[xx * 4 + 0] + line1[xx * 4 + 4];
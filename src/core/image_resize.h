@@ -48,6 +48,8 @@ void destroy_image_buffer(image_buffer_t* image_buffer);
 bool image_resample_lanczos3(image_buffer_t* in, image_buffer_t* out, rect2f box);
 bool image_shrink_2x2(image_buffer_t* in, image_buffer_t* out, rect2i box);
 
+extern bool disable_simd_image_resize;
+
 void debug_test_resample();
 void debug_test_shrink2x2();
 
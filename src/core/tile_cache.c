@@ -26,6 +26,56 @@ typedef enum tile_cache_completion_event_kind_t {
 } tile_cache_completion_event_kind_t;
 
 #define TILE_CACHE_VIEWER_WISHLIST_MAX 128
+#define TILE_CACHE_PIXEL_POOL_MAX 64
+
+// Tile-sized pixel buffers that were handed back after a texture upload, so that the tile loaders
+// don't need to go through malloc()/free() for every tile. Pooled buffers are ordinary heap
+// allocations, so code paths that don't know about the pool may still simply free() them.
+typedef struct tile_cache_pixel_pool_t {
+	platform_mutex_t lock;
+	i32 count;
+	u8* buffers[TILE_CACHE_PIXEL_POOL_MAX];
+	size_t buffer_sizes[TILE_CACHE_PIXEL_POOL_MAX];
+} tile_cache_pixel_pool_t;
+
+static tile_cache_pixel_pool_t tile_cache_pixel_pool = { .lock = PLATFORM_MUTEX_INITIALIZER };
+
+u8* tile_cache_alloc_pixel_memory(size_t size) {
+	u8* result = NULL;
+	platform_mutex_lock(&tile_cache_pixel_pool.lock);
+	for (i32 i = tile_cache_pixel_pool.count - 1; i >= 0; --i) {
+		if (tile_cache_pixel_pool.buffer_sizes[i] == size) {
+			result = tile_cache_pixel_pool.buffers[i];
+			i32 last = --tile_cache_pixel_pool.count;
+			tile_cache_pixel_pool.buffers[i] = tile_cache_pixel_pool.buffers[last];
+			tile_cache_pixel_pool.buffer_sizes[i] = tile_cache_pixel_pool.buffer_sizes[last];
+			break;
+		}
+	}
+	platform_mutex_unlock(&tile_cache_pixel_pool.lock);
+	if (!result) {
+		result = (u8*)malloc(size);
+	}
+	return result;
+}
+
+void tile_cache_recycle_pixel_memory(u8* pixels, size_t size) {
+	if (!pixels) {
+		return;
+	}
+	bool recycled = false;
+	platform_mutex_lock(&tile_cache_pixel_pool.lock);
+	if (tile_cache_pixel_pool.count < TILE_CACHE_PIXEL_POOL_MAX) {
+		i32 index = tile_cache_pixel_pool.count++;
+		tile_cache_pixel_pool.buffers[index] = pixels;
+		tile_cache_pixel_pool.buffer_sizes[index] = size;
+		recycled = true;
+	}
+	platform_mutex_unlock(&tile_cache_pixel_pool.lock);
+	if (!recycled) {
+		free(pixels);
+	}
+}
 
 static int tile_cache_priority_compare(const void* a, const void* b) {
 	return ((load_tile_task_t*)b)->priority - ((load_tile_task_t*)a)->priority;
@@ -140,6 +190,10 @@ void tile_cache_destroy(tile_cache_t* cache) {
 	}
 	completion_queue_destroy(&cache->result_queue);
 	free(cache);
+
+	// The worker threads release their own scratch buffers when they exit; the thread tearing down the cache may have
+	// been decoding tiles for it as well.
+	tile_loader_release_thread_resources(threadlocal_logical_thread_index);
 }
 
 tile_cache_tile_t* tile_cache_get_tile_state(image_t* image, i32 level, i32 tile_index) {
@@ -77,6 +77,7 @@ typedef struct tile_cache_result_t {
 	bool8 failed;
 	bool8 stale;
 	bool8 upload_from_cached_pixels;
+	bool8 pixel_memory_is_pooled; // allocated with tile_cache_alloc_pixel_memory(), may be recycled
 } tile_cache_result_t;
 
 typedef struct tile_cache_tile_t {
@@ -140,6 +141,8 @@ void tile_cache_store_cpu_pixels(image_t* image, i32 level, i32 tile_index, u8*
 void tile_cache_release_cpu_pixels_if_unpinned(image_t* image, i32 level, i32 tile_index);
 i32 tile_cache_request_viewer_tiles(image_t* image, tile_cache_viewer_request_t* request);
 bool tile_cache_task_is_stale(image_t* image, i32 level, i32 tile_index, i32 generation);
+u8* tile_cache_alloc_pixel_memory(size_t size);
+void tile_cache_recycle_pixel_memory(u8* pixels, size_t size);
 
 #ifdef __cplusplus
 }
@@ -22,6 +22,7 @@
 #include "mrxs.h"
 #include "tile_cache.h"
 #include "tiff.h"
+#include "jpeg_decoder.h"
 
 static work_queue_callback_t* remote_tiff_load_tile_batch_func;
 static work_queue_callback_t* slide_score_load_tile_batch_func;
@@ -34,6 +35,18 @@ void tile_loader_set_slide_score_batch_callback(work_queue_callback_t* callback)
 	slide_score_load_tile_batch_func = callback;
 }
 
+// Frees the buffers and decoder state that the tile loaders keep per thread. Must be called from the thread itself,
+// while it isn't decoding.
+void tile_loader_release_thread_resources(i32 logical_thread_index) {
+	tiff_release_scratch_buffers(logical_thread_index);
+	jpeg_decoder_release_thread_context(); // thread-local
+}
+
+// Registered with thread_pool_set_thread_exit_callback().
+void tile_loader_thread_exit_callback(int logical_thread_index, void* userdata) {
+	tile_loader_release_thread_resources(logical_thread_index);
+}
+
 static void tile_loader_get_tile_xy(image_t* image, i32 level, i32 tile_index, i32* out_tile_x, i32* out_tile_y) {
 	level_image_t* level_image = image->level_images + level;
 	*out_tile_x = tile_index % level_image->width_in_tiles;
@@ -46,6 +59,143 @@ static void tile_loader_post_stale_result(load_tile_task_t* task) {
 	}
 }
 
+// Assembles a tile of a virtual pyramid level from the scale x scale block of tiles that it covers in the
+// source level, each of which is decoded at 1/scale of its size. Returns false if nothing could be decoded.
+static bool tile_loader_decode_virtual_tile(i32 logical_thread_index, image_t* image, i32 level, i32 tile_x, i32 tile_y,
+                                            u8* pixel_memory, u8 background_byte) {
+	level_image_t* level_image = image->level_images + level;
+	ASSERT(level_image->is_virtual);
+	level_image_t* source = image->level_images + level_image->virtual_source_level;
+	i32 scale = 1 << (level - level_image->virtual_source_level);
+	i32 part_width = source->tile_width / scale;
+	i32 part_height = source->tile_height / scale;
+	i32 pitch = level_image->tile_width * BYTES_PER_PIXEL;
+
+	i32 decoded_count = 0;
+	for (i32 dy = 0; dy < scale; ++dy) {
+		i32 source_tile_y = tile_y * scale + dy;
+		if (source_tile_y >= source->height_in_tiles) break;
+		for (i32 dx = 0; dx < scale; ++dx) {
+			i32 source_tile_x = tile_x * scale + dx;
+			if (source_tile_x >= source->width_in_tiles) break;
+			tile_t* source_tile = get_tile(source, source_tile_x, source_tile_y);
+			if (source_tile->is_empty) {
+				continue;
+			}
+			u8* dest = pixel_memory + (size_t)(dy * part_height) * pitch + (dx * part_width) * BYTES_PER_PIXEL;
+			bool success = false;
+			if (image->backend == IMAGE_BACKEND_TIFF) {
+				tiff_t* tiff = &image->tiff;
+				tiff_ifd_t* source_ifd = tiff->level_images_ifd + source->pyramid_image_index;
+				success = tiff_decode_tile_scaled_to_buffer(logical_thread_index, tiff, source_ifd, source_tile->tile_index,
+				                                            scale, dest, pitch, part_width, part_height);
+			} else if (image->backend == IMAGE_BACKEND_DICOM) {
+				success = dicom_wsi_decode_tile_scaled_to_bgra(&image->dicom, source->pyramid_image_index, source_tile->tile_index,
+				                                               scale, dest, pitch, part_width, part_height);
+			}
+			if (success) {
+				++decoded_count;
+			} else {
+				console_print_verbose("thread %d: virtual level %d: could not decode source tile (%d, %d) of level %d\n",
+				                      logical_thread_index, level, source_tile_x, source_tile_y, level_image->virtual_source_level);
+			}
+		}
+	}
+
+	// The source tiles along the right and bottom edges may contain padding beyond the image bounds.
+	i64 valid_width = level_image->width_in_pixels - (i64)tile_x * level_image->tile_width;
+	i64 valid_height = level_image->height_in_pixels - (i64)tile_y * level_image->tile_height;
+	if (valid_width < level_image->tile_width) {
+		for (i32 row = 0; row < level_image->tile_height; ++row) {
+			memset(pixel_memory + (size_t)row * pitch + valid_width * BYTES_PER_PIXEL, background_byte,
+			       (level_image->tile_width - valid_width) * BYTES_PER_PIXEL);
+		}
+	}
+	if (valid_height < level_image->tile_height) {
+		memset(pixel_memory + (size_t)valid_height * pitch, background_byte, (level_image->tile_height - valid_height) * pitch);
+	}
+	return decoded_count > 0;
+}
+
+// Whether tiles of this level can be partially decoded (only the MCU rows and columns intersecting a region).
+bool tile_loader_can_decode_tile_region(image_t* image, i32 level) {
+	level_image_t* level_image = image->level_images + level;
+	if (!level_image->exists || level_image->is_virtual || level_image->needs_indexing) {
+		return false;
+	}
+	if (image->backend == IMAGE_BACKEND_TIFF) {
+		tiff_ifd_t* ifd = image->tiff.level_images_ifd + level_image->pyramid_image_index;
+		return tiff_can_decode_tile_region(&image->tiff, ifd);
+	} else if (image->backend == IMAGE_BACKEND_DICOM) {
+		return dicom_wsi_can_decode_tile_scaled(&image->dicom, level_image->pyramid_image_index); // i.e. JPEG
+	} else if (image->backend == IMAGE_BACKEND_MRXS) {
+		return mrxs_can_decode_tile_region(&image->mrxs, level);
+	}
+	return false;
+}
+
+// Decodes the part of a tile that intersects the region (in pixels, relative to the tile) into a tile-sized buffer.
+// Pixels outside of the region are left untouched, or may be partially overwritten (up to the MCU boundaries).
+bool tile_loader_decode_tile_region(i32 logical_thread_index, image_t* image, i32 level, i32 tile_index,
+                                    i32 region_x, i32 region_y, i32 region_width, i32 region_height, u8* pixel_memory) {
+	level_image_t* level_image = image->level_images + level;
+	i32 pitch = level_image->tile_width * BYTES_PER_PIXEL;
+	if (image->backend == IMAGE_BACKEND_TIFF) {
+		tiff_t* tiff = &image->tiff;
+		tiff_ifd_t* level_ifd = tiff->level_images_ifd + level_image->pyramid_image_index;
+		i32 tile_x = 0;
+		i32 tile_y = 0;
+		tile_loader_get_tile_xy(image, level, tile_index, &tile_x, &tile_y);
+		return tiff_decode_tile_region_to_buffer(logical_thread_index, tiff, level_ifd, tile_index, level, tile_x, tile_y,
+		                                         region_x, region_y, region_width, region_height, pixel_memory);
+	} else if (image->backend == IMAGE_BACKEND_DICOM) {
+		return dicom_wsi_decode_tile_region_to_bgra(&image->dicom, level_image->pyramid_image_index, tile_index, pixel_memory, pitch,
+		                                            level_image->tile_width, level_image->tile_height,
+		                                            region_x, region_y, region_width, region_height);
+	} else if (image->backend == IMAGE_BACKEND_MRXS) {
+		return mrxs_decode_tile_region_to_bgra(&image->mrxs, level, tile_index, pixel_memory, pitch,
+		                                       region_x, region_y, region_width, region_height);
+	}
+	return false;
+}
+
+// Returns a malloc'd copy of a tile's JPEG stream as stored in the source, or NULL if the tile is not stored as JPEG.
+// If the stream relies on shared tables (TIFF JPEGTables), these are returned as well; the pointer is borrowed.
+u8* tile_loader_copy_jpeg_tile(image_t* image, i32 level, i32 tile_index, u64* size,
+                               u8** jpeg_tables, u64* jpeg_tables_length, bool* is_YCbCr) {
+	level_image_t* level_image = image->level_images + level;
+	if (!level_image->exists || level_image->is_virtual || level_image->needs_indexing) {
+		return NULL;
+	}
+	*jpeg_tables = NULL;
+	*jpeg_tables_length = 0;
+	if (image->backend == IMAGE_BACKEND_TIFF) {
+		tiff_t* tiff = &image->tiff;
+		tiff_ifd_t* level_ifd = tiff->level_images_ifd + level_image->pyramid_image_index;
+		if (level_ifd->compression != TIFF_COMPRESSION_JPEG) {
+			return NULL;
+		}
+		u8* data = tiff_copy_compressed_tile(tiff, level_ifd, tile_index, size);
+		if (data) {
+			*jpeg_tables = level_ifd->jpeg_tables;
+			*jpeg_tables_length = level_ifd->jpeg_tables_length;
+			*is_YCbCr = (level_ifd->color_space == TIFF_PHOTOMETRIC_YCBCR);
+		}
+		return data;
+	} else if (image->backend == IMAGE_BACKEND_DICOM) {
+		i64 data_size = 0;
+		u8* data = dicom_wsi_copy_jpeg_tile(&image->dicom, level_image->pyramid_image_index, tile_index, &data_size);
+		jpeg_stream_info_t info = {0};
+		if (data && jpeg_read_stream_info(data, (u32)data_size, &info)) {
+			*size = data_size;
+			*is_YCbCr = info.is_YCbCr;
+			return data;
+		}
+		if (data) free(data);
+	}
+	return NULL;
+}
+
 i32 tile_loader_submit_requests(image_t* image, load_tile_task_t* wishlist, i32 tiles_to_load) {
 	i32 tasks_waiting = thread_pool_get_task_count(&global_thread_pool);
 	i32 max_acceptable_tasks = thread_pool_get_task_capacity(&global_thread_pool);
@@ -187,25 +337,42 @@ void load_tile_func(i32 logical_thread_index, void* userdata) {
 	float tile_world_pos_y_end = (tile_y + 1) * level_image->y_tile_side_in_um;
 	float tile_x_excess = tile_world_pos_x_end - image->width_in_um;
 	float tile_y_excess = tile_world_pos_y_end - image->height_in_um;
+	// Edge tiles only need to be decoded as far as the image extends.
+	i32 valid_width = (i32)MIN((i64)level_image->tile_width, level_image->width_in_pixels - (i64)tile_x * level_image->tile_width);
+	i32 valid_height = (i32)MIN((i64)level_image->tile_height, level_image->height_in_pixels - (i64)tile_y * level_image->tile_height);
+	bool is_edge_tile = valid_width < (i32)level_image->tile_width || valid_height < (i32)level_image->tile_height;
 
 	size_t pixel_memory_size = level_image->tile_width * level_image->tile_height * BYTES_PER_PIXEL;
-	u8* temp_memory = (u8*)malloc(pixel_memory_size);
+	u8* temp_memory = tile_cache_alloc_pixel_memory(pixel_memory_size);
+	bool temp_memory_is_pooled = true;
 
 	u32 image_background_color = image->is_background_black ? 0 : 0xFFFFFFFF;
 	u8 image_background_byte = image->is_background_black ? 0 : 0xFF;
 	memset(temp_memory, image_background_byte, pixel_memory_size);
 
 	bool failed = false;
-	bool is_empty = false; // we might 'discover' that the tile is empty for OpenSlide backend
+	bool is_empty = false; // we might 'discover' that the tile is empty (OpenSlide and TIFF backends)
 	ASSERT(image->type == IMAGE_TYPE_WSI);
-	if (image->backend == IMAGE_BACKEND_TIFF) {
+	if (level_image->is_virtual) {
+		if (!tile_loader_decode_virtual_tile(logical_thread_index, image, level, tile_x, tile_y, temp_memory, image_background_byte)) {
+			failed = true;
+		}
+	} else if (image->backend == IMAGE_BACKEND_TIFF) {
 		tiff_t* tiff = &image->tiff;
 		tiff_ifd_t* level_ifd = tiff->level_images_ifd + level_image->pyramid_image_index;
-		u8* pixels = tiff_decode_tile(logical_thread_index, tiff, level_ifd, tile_index, level, tile_x, tile_y);
-		if (pixels) {
-			free(temp_memory);
-			temp_memory = pixels;
-		} else {
+		u64 tile_offset = 0;
+		u64 tile_byte_count = 0;
+		if (level_ifd->is_tiled && tiff_get_tile_location(tiff, level_ifd, tile_index, &tile_offset, &tile_byte_count) &&
+		    (tile_offset == 0 || tile_byte_count == 0)) {
+			// The tile offsets are loaded lazily, so this is where we 'discover' that a TIFF tile is empty.
+			failed = true;
+			is_empty = true;
+		} else if (is_edge_tile && valid_width > 0 && valid_height > 0) {
+			if (!tiff_decode_tile_region_to_buffer(logical_thread_index, tiff, level_ifd, tile_index, level, tile_x, tile_y,
+			                                       0, 0, valid_width, valid_height, temp_memory)) {
+				failed = true;
+			}
+		} else if (!tiff_decode_tile_to_buffer(logical_thread_index, tiff, level_ifd, tile_index, level, tile_x, tile_y, temp_memory)) {
 			failed = true;
 		}
 
@@ -248,19 +415,26 @@ void load_tile_func(i32 logical_thread_index, void* userdata) {
 			failed = true;
 			is_empty = true;
 		}
+	} else if (image->backend == IMAGE_BACKEND_DICOM && is_edge_tile && valid_width > 0 && valid_height > 0 &&
+	           tile_loader_can_decode_tile_region(image, level)) {
+		if (!tile_loader_decode_tile_region(logical_thread_index, image, level, tile_index, 0, 0, valid_width, valid_height, temp_memory)) {
+			failed = true;
+		}
 	} else if (image->backend == IMAGE_BACKEND_DICOM) {
 		u8* pixels = dicom_wsi_decode_tile_to_bgra(&image->dicom, level_image->pyramid_image_index, tile_index);
 		if (pixels) {
-			free(temp_memory);
+			tile_cache_recycle_pixel_memory(temp_memory, pixel_memory_size);
 			temp_memory = pixels;
+			temp_memory_is_pooled = false;
 		} else {
 			failed = true;
 		}
 	} else if (image->backend == IMAGE_BACKEND_MRXS) {
 		u8* pixels = mrxs_decode_tile_to_bgra(&image->mrxs, level, tile_index);
 		if (pixels) {
-			free(temp_memory);
+			tile_cache_recycle_pixel_memory(temp_memory, pixel_memory_size);
 			temp_memory = pixels;
+			temp_memory_is_pooled = false;
 		} else {
 			failed = true;
 		}
@@ -282,7 +456,11 @@ void load_tile_func(i32 logical_thread_index, void* userdata) {
 	}
 
 	if (failed && temp_memory != NULL) {
-		free(temp_memory);
+		if (temp_memory_is_pooled) {
+			tile_cache_recycle_pixel_memory(temp_memory, pixel_memory_size);
+		} else {
+			free(temp_memory);
+		}
 		temp_memory = NULL;
 	}
 
@@ -297,9 +475,12 @@ void load_tile_func(i32 logical_thread_index, void* userdata) {
 	completion_task.want_cpu_residency = task->need_cpu_residency;
 	completion_task.failed = failed;
 	completion_task.is_empty = is_empty;
+	completion_task.pixel_memory_is_pooled = temp_memory_is_pooled;
 
 	if (!tile_cache_post_load_result(image, &completion_task)) {
-		if (completion_task.pixel_memory) {
+		if (completion_task.pixel_memory_is_pooled) {
+			tile_cache_recycle_pixel_memory(completion_task.pixel_memory, pixel_memory_size);
+		} else if (completion_task.pixel_memory) {
 			free(completion_task.pixel_memory);
 		}
 	}
@@ -75,8 +75,15 @@ typedef struct load_tile_task_batch_t {
 
 void load_tile_func(i32 logical_thread_index, void* userdata);
 i32 tile_loader_submit_requests(image_t* image, load_tile_task_t* wishlist, i32 tiles_to_load);
+bool tile_loader_can_decode_tile_region(image_t* image, i32 level);
+bool tile_loader_decode_tile_region(i32 logical_thread_index, image_t* image, i32 level, i32 tile_index,
+                                    i32 region_x, i32 region_y, i32 region_width, i32 region_height, u8* pixel_memory);
+u8* tile_loader_copy_jpeg_tile(image_t* image, i32 level, i32 tile_index, u64* size,
+                               u8** jpeg_tables, u64* jpeg_tables_length, bool* is_YCbCr);
 void tile_loader_set_remote_tiff_batch_callback(work_queue_callback_t* callback);
 void tile_loader_set_slide_score_batch_callback(work_queue_callback_t* callback);
+void tile_loader_release_thread_resources(i32 logical_thread_index);
+void tile_loader_thread_exit_callback(int logical_thread_index, void* userdata);
 
 #ifdef __cplusplus
 }
@@ -328,7 +328,11 @@ static bool viewer_process_loaded_tile(app_state_t* app_state, image_t* image, t
 			tile_cache_store_cpu_pixels(image, task->level, task->tile_index, task->pixel_memory);
 		}
 		if (need_free_pixel_memory) {
-			free(task->pixel_memory);
+			if (task->pixel_memory_is_pooled) {
+				tile_cache_recycle_pixel_memory(task->pixel_memory, (size_t)task->tile_width * task->tile_height * BYTES_PER_PIXEL);
+			} else {
+				free(task->pixel_memory);
+			}
 		}
 	} else {
 		// TODO: handle possible I/O errors? Don't just assume the tile was empty!
@@ -218,6 +218,14 @@ struct app_command_t {
 		bool use_first_roi;
 		bool with_annotations;
 		command_export_error_enum error;
+		const char* manifest; // batch export, see app_command_execute_batch_export()
+		const char* report_filename;
+		i32 max_parallel_exports;
+		i32 memory_budget_in_mb;
+		float* target_mpps; // array; with more than one, the region is exported at each resolution (--mpp 0.25,0.5,1)
+		bool burn_in_annotations; // draw the annotations into the exported pixels
+		float burn_in_line_width; // in pixels of the exported base level
+		float burn_in_fill_opacity;
 	} export_command;
 	const char** inputs; // array
 	const char** overlay_inputs; // array
@@ -279,6 +287,7 @@ bool app_get_slide_score_api_key_filename(char* buffer, size_t buffer_size);
 void app_read_slide_score_api_key(char* buffer, size_t buffer_size);
 bool app_write_slide_score_api_key(const char* api_key);
 image_t* load_image_from_file(app_state_t* app_state, file_info_t* file, directory_info_t* directory, u32 filetype_hint);
+bool load_associated_annotations(app_state_t* app_state, file_info_t* file);
 bool was_button_pressed(button_state_t* button);
 bool was_button_released(button_state_t* button);
 bool was_key_pressed(input_t* input, i32 keycode);
@@ -189,6 +189,32 @@ void slide_score_load_tile_batch_func(i32 logical_thread_index, void* userdata)
 
 
 
+// Loads the annotation file (.xml, .geojson or .json) with the same name as the image, if there is one.
+bool load_associated_annotations(app_state_t* app_state, file_info_t* file) {
+	char temp_filename[512];
+	const char* prefix = (app_state->annotation_directory[0] != '\0') ? app_state->annotation_directory : file->filename_prefix;
+	bool were_annotations_loaded = false;
+
+	const char* annotation_extensions[] = { "xml", "geojson", "json" };
+	for (i32 extension_index = 0; extension_index < COUNT(annotation_extensions); ++extension_index) {
+		snprintf(temp_filename, sizeof(temp_filename), "%s%s", prefix, file->filename_in_directory);
+		replace_file_extension(temp_filename, sizeof(temp_filename), annotation_extensions[extension_index]);
+		if (file_exists(temp_filename)) {
+			if (were_annotations_loaded) {
+				console_print("Ignoring additional annotation file: '%s'\n", temp_filename);
+				continue;
+			}
+			console_print("Found annotations: '%s'\n", temp_filename);
+			if (load_annotations(app_state, temp_filename)) {
+				were_annotations_loaded = true;
+				// Don't hide annotations when first loading the slide, that might lead the user to believe that there are none.
+				app_state->scene.enable_annotations = true;
+			}
+		}
+	}
+	return were_annotations_loaded;
+}
+
 bool viewer_load_new_image(app_state_t* app_state, file_info_t* file, directory_info_t* directory, u32 filetype_hint) {
 	// assume it is an image file?
 	bool is_base_image = filetype_hint != FILETYPE_HINT_OVERLAY;
@@ -208,29 +234,7 @@ bool viewer_load_new_image(app_state_t* app_state, file_info_t* file, directory_
             annotation_set->mpp = V2F(image->mpp_x, image->mpp_y);
 
             // Check if there is an associated annotation file.
-            char temp_filename[512];
-            temp_filename[0] = '\0';
-            const char* prefix = (app_state->annotation_directory[0] != '\0') ? app_state->annotation_directory : file->filename_prefix;
-            snprintf(temp_filename, sizeof(temp_filename), "%s%s", prefix, file->filename_in_directory);
-            bool were_annotations_loaded = false;
-
-			const char* annotation_extensions[] = { "xml", "geojson", "json" };
-			for (i32 extension_index = 0; extension_index < COUNT(annotation_extensions); ++extension_index) {
-				snprintf(temp_filename, sizeof(temp_filename), "%s%s", prefix, file->filename_in_directory);
-				replace_file_extension(temp_filename, sizeof(temp_filename), annotation_extensions[extension_index]);
-				if (file_exists(temp_filename)) {
-					if (were_annotations_loaded) {
-						console_print("Ignoring additional annotation file: '%s'\n", temp_filename);
-						continue;
-					}
-					console_print("Found annotations: '%s'\n", temp_filename);
-					if (load_annotations(app_state, temp_filename)) {
-						were_annotations_loaded = true;
-						// Don't hide annotations when first loading the slide, that might lead the user to believe that there are none.
-						app_state->scene.enable_annotations = true;
-					}
-				}
-			}
+            bool were_annotations_loaded = load_associated_annotations(app_state, file);
 
             if (app_state->remember_annotation_groups_as_template && !were_annotations_loaded && app_state->scene.annotation_set_template.is_valid) {
                 annotation_set_init_from_template(annotation_set, &app_state->scene.annotation_set_template);
@@ -73,12 +73,24 @@ void tiff_load_tile_batch_func(i32 logical_thread_index, void* userdata) {
 					continue;
 				}
 				tiff_ifd_t* level_ifd = tiff->level_images_ifd + level_image->pyramid_image_index;
-				u64 tile_offset = level_ifd->tile_offsets[tile_index];
-				u64 chunk_size = level_ifd->tile_byte_counts[tile_index];
-
-				// It doesn't make sense to ask for empty tiles, this should never happen!
-				ASSERT(tile_offset != 0);
-				ASSERT(chunk_size != 0);
+				u64 tile_offset = 0;
+				u64 chunk_size = 0;
+				if (!tiff_get_tile_location(tiff, level_ifd, tile_index, &tile_offset, &chunk_size) ||
+				    tile_offset == 0 || chunk_size == 0) {
+					// Empty (or unreadable) tile: report it, so that it won't be requested again.
+					tile_cache_result_t completion_task = {};
+					completion_task.resource_id = task->resource_id;
+					completion_task.tile_width = level_image->tile_width;
+					completion_task.tile_height = level_image->tile_height;
+					completion_task.level = level;
+					completion_task.tile_index = tile_index;
+					completion_task.want_gpu_residency = task->need_gpu_residency;
+					completion_task.want_cpu_residency = task->need_cpu_residency;
+					completion_task.failed = true;
+					completion_task.is_empty = true;
+					tile_cache_post_load_result(image, &completion_task);
+					continue;
+				}
 
 				active_tasks[active_count] = task;
 				chunk_offsets[active_count] = tile_offset;
@@ -43,6 +43,7 @@ static void viewer_register_options(ini_t* ini, app_state_t* app_state) {
 	ini_begin_section(ini, "Backends");
 	ini_register_bool(ini, "use_builtin_tiff_backend", &app_state->use_builtin_tiff_backend);
 	ini_register_bool(ini, "use_native_mrxs_backend", &global_use_native_mrxs_backend);
+	ini_register_bool(ini, "use_memory_mapped_files", &use_memory_mapped_files);
 }
 
 void viewer_init_options(app_state_t* app_state) {
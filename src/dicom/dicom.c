@@ -1472,6 +1472,8 @@ bool dicom_open_from_directory(dicom_series_t* dicom, directory_info_t* director
 		if (!instance->file_handle) {
 			console_print_error("Error: Could not reopen file for asynchronous I/O: '%s'\n", instance->filename);
 			success = false;
+		} else if (use_memory_mapped_files) {
+			mapped_file_open(&instance->mapped_file, instance->file_handle, FILE_ACCESS_RANDOM);
 		}
 	}
 
@@ -1658,6 +1660,7 @@ void dicom_instance_destroy(dicom_instance_t* instance) {
         if (optical_path->icc_profile) free(optical_path->icc_profile);
     }
     arrfree(instance->optical_paths);
+	mapped_file_close(&instance->mapped_file);
 	if (instance->file_handle) file_handle_close(instance->file_handle);
 }
 
@@ -370,6 +370,7 @@ typedef struct dicom_instance_t {
 	dicom_parser_callback_func_t* tag_handler_func;
 	char filename[512];
 	file_handle_t file_handle; // for simultaneous file access on multiple threads
+	mapped_file_t mapped_file; // only if use_memory_mapped_files is set and the file is local
 	i32 nesting_level;
 	dicom_parser_pos_t pos_stack[16]; // one per nesting level, for keeping track where we need to push/pop during parsing
 	dicom_tag_t nested_sequences[8]; // one for every two nesting levels (sequences only, not sequence items)
@@ -391,16 +391,22 @@ void dicom_wsi_interpret_nested_data_element(dicom_instance_t* instance, dicom_d
 	}
 }
 
-u8* dicom_wsi_decode_tile_to_bgra(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index) {
-	dicom_instance_t* instance = dicom_series->wsi.level_instances[instance_index];
-	ASSERT(instance);
-	if (!instance) return NULL;
+// Reads the (defragmented) encapsulated pixel data of one tile into the temporary memory arena.
+// If the file is memory-mapped and the frame consists of a single fragment, the data is used in place (read-only).
+static u8* dicom_wsi_read_tile_data(dicom_instance_t* instance, i32 tile_index, temp_memory_t* temp, i64* data_size) {
 	dicom_tile_t* dicom_tile = instance->tiles + tile_index;
 	size_t read_size = dicom_tile->data_size;
 	if (dicom_tile->data_size == DICOM_UNDEFINED_LENGTH) {
-		u8 temp[12];
-		size_t bytes_read = file_handle_read_at_offset(temp, instance->file_handle, dicom_tile->data_offset_in_file, 12);
-		dicom_data_element_t element = dicom_read_data_element(temp, 0, instance->encoding, bytes_read);
+		u8 temp_bytes[12];
+		size_t bytes_read = 0;
+		u8* mapped_header = mapped_file_get_bytes(&instance->mapped_file, dicom_tile->data_offset_in_file, 12);
+		if (mapped_header) {
+			memcpy(temp_bytes, mapped_header, 12);
+			bytes_read = 12;
+		} else {
+			bytes_read = file_handle_read_at_offset(temp_bytes, instance->file_handle, dicom_tile->data_offset_in_file, 12);
+		}
+		dicom_data_element_t element = dicom_read_data_element(temp_bytes, 0, instance->encoding, bytes_read);
 		if (element.tag.as_u32 == DICOM_Item) {
 			read_size = element.length; // TODO: bounds/sanity checks
 		} else {
@@ -412,14 +418,43 @@ u8* dicom_wsi_decode_tile_to_bgra(dicom_series_t* dicom_series, i32 instance_ind
 		ASSERT(!"unknown length");
 		return NULL;
 	}
-    temp_memory_t temp = begin_temp_memory_on_local_thread();
-	u8* compressed_tile_data = (u8*)arena_push_size(temp.arena, read_size);
-	file_handle_read_at_offset(compressed_tile_data, instance->file_handle, dicom_tile->data_offset_in_file, read_size);
+	u8* mapped = mapped_file_get_bytes(&instance->mapped_file, dicom_tile->data_offset_in_file, read_size);
+	if (mapped) {
+		dicom_data_element_t item = dicom_read_data_element(mapped, 0, DICOM_TRANSFER_SYNTAX_IMPLICIT_VR_LITTLE_ENDIAN, read_size);
+		if (item.tag.as_u32 == DICOM_Item && item.data_offset + (i64)item.length == (i64)read_size) {
+			*data_size = item.length;
+			return mapped + item.data_offset;
+		}
+	}
+	u8* compressed_tile_data = (u8*)arena_push_size(temp->arena, read_size);
+	if (mapped) {
+		memcpy(compressed_tile_data, mapped, read_size);
+	} else {
+		file_handle_read_at_offset(compressed_tile_data, instance->file_handle, dicom_tile->data_offset_in_file, read_size);
+	}
 
 	// TODO: handle native pixel data instead of encapsulated
-	i64 data_size = dicom_defragment_encapsulated_pixel_data_frame(compressed_tile_data, read_size);
+	*data_size = dicom_defragment_encapsulated_pixel_data_frame(compressed_tile_data, read_size);
+	return compressed_tile_data;
+}
+
+static void dicom_wsi_report_unsupported_compression(dicom_instance_t* instance) {
+	const char* method = "unknown";
+	if (instance->lossy_image_compression_method >= 1) {
+		method = dicom_lossy_image_compression_method_strings[instance->lossy_image_compression_method - 1];
+	}
+	console_print_error("DICOM tile decode: unsupported lossy image compression method (%s)\n", method);
+}
+
+u8* dicom_wsi_decode_tile_to_bgra(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index) {
+	dicom_instance_t* instance = dicom_series->wsi.level_instances[instance_index];
+	ASSERT(instance);
+	if (!instance) return NULL;
+    temp_memory_t temp = begin_temp_memory_on_local_thread();
+	i64 data_size = 0;
+	u8* compressed_tile_data = dicom_wsi_read_tile_data(instance, tile_index, &temp, &data_size);
     u8* result = NULL;
-	if (data_size > 0) {
+	if (compressed_tile_data && data_size > 0) {
 		if (instance->lossy_image_compression_method == DICOM_LOSSY_IMAGE_COMPRESSION_METHOD_ISO_10918_1) {
 			// JPEG compression
 			i32 width = 0;
@@ -434,13 +469,81 @@ u8* dicom_wsi_decode_tile_to_bgra(dicom_series_t* dicom_series, i32 instance_ind
 				result = NULL;
 			}
 		} else {
-            const char* method = "unknown";
-            if (instance->lossy_image_compression_method >= 1) {
-                method = dicom_lossy_image_compression_method_strings[instance->lossy_image_compression_method - 1];
-            }
-            console_print_error("DICOM tile decode: unsupported lossy image compression method (%s)\n", method);
+            dicom_wsi_report_unsupported_compression(instance);
         }
 	}
     release_temp_memory(&temp);
 	return result;
 }
+
+bool dicom_wsi_can_decode_tile_scaled(dicom_series_t* dicom_series, i32 instance_index) {
+	dicom_instance_t* instance = dicom_series->wsi.level_instances[instance_index];
+	return instance && instance->lossy_image_compression_method == DICOM_LOSSY_IMAGE_COMPRESSION_METHOD_ISO_10918_1;
+}
+
+// Decodes a tile at 1/scale_denom of its size (scale_denom = 1, 2, 4 or 8) into a BGRA destination rectangle.
+// Downscaling happens in the DCT domain, so this is much cheaper than a full decode.
+bool dicom_wsi_decode_tile_scaled_to_bgra(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index, i32 scale_denom,
+                                          u8* dest, i32 dest_pitch, i32 max_width, i32 max_height) {
+	dicom_instance_t* instance = dicom_series->wsi.level_instances[instance_index];
+	ASSERT(instance);
+	if (!instance) return false;
+	if (instance->lossy_image_compression_method != DICOM_LOSSY_IMAGE_COMPRESSION_METHOD_ISO_10918_1) {
+		dicom_wsi_report_unsupported_compression(instance);
+		return false;
+	}
+	temp_memory_t temp = begin_temp_memory_on_local_thread();
+	i64 data_size = 0;
+	u8* compressed_tile_data = dicom_wsi_read_tile_data(instance, tile_index, &temp, &data_size);
+	bool success = false;
+	if (compressed_tile_data && data_size > 0) {
+		success = jpeg_decode_image_scaled(compressed_tile_data, data_size, dest, dest_pitch, max_width, max_height, scale_denom);
+	}
+	release_temp_memory(&temp);
+	return success;
+}
+
+// Decodes only the part of a tile that intersects the given region, at its own position in the BGRA destination.
+// The MCU rows and columns outside of the region are skipped.
+bool dicom_wsi_decode_tile_region_to_bgra(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index, u8* dest, i32 dest_pitch,
+                                          i32 max_width, i32 max_height, i32 region_x, i32 region_y, i32 region_width, i32 region_height) {
+	dicom_instance_t* instance = dicom_series->wsi.level_instances[instance_index];
+	ASSERT(instance);
+	if (!instance) return false;
+	if (instance->lossy_image_compression_method != DICOM_LOSSY_IMAGE_COMPRESSION_METHOD_ISO_10918_1) {
+		dicom_wsi_report_unsupported_compression(instance);
+		return false;
+	}
+	temp_memory_t temp = begin_temp_memory_on_local_thread();
+	i64 data_size = 0;
+	u8* compressed_tile_data = dicom_wsi_read_tile_data(instance, tile_index, &temp, &data_size);
+	bool success = false;
+	if (compressed_tile_data && data_size > 0) {
+		jpeg_region_t region = {region_x, region_y, region_width, region_height};
+		success = jpeg_decode_image_region(compressed_tile_data, data_size, dest, dest_pitch, max_width, max_height, region);
+	}
+	release_temp_memory(&temp);
+	return success;
+}
+
+// Returns a malloc'd copy of the JPEG stream of a tile, for passing it through unchanged when exporting.
+u8* dicom_wsi_copy_jpeg_tile(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index, i64* size) {
+	dicom_instance_t* instance = dicom_series->wsi.level_instances[instance_index];
+	if (!instance || instance->lossy_image_compression_method != DICOM_LOSSY_IMAGE_COMPRESSION_METHOD_ISO_10918_1) {
+		return NULL;
+	}
+	if (tile_index < 0 || tile_index >= instance->tile_count || !instance->tiles[tile_index].exists) {
+		return NULL;
+	}
+	temp_memory_t temp = begin_temp_memory_on_local_thread();
+	i64 data_size = 0;
+	u8* compressed_tile_data = dicom_wsi_read_tile_data(instance, tile_index, &temp, &data_size);
+	u8* result = NULL;
+	if (compressed_tile_data && data_size > 0) {
+		result = (u8*)malloc(data_size);
+		memcpy(result, compressed_tile_data, data_size);
+		*size = data_size;
+	}
+	release_temp_memory(&temp);
+	return result;
+}
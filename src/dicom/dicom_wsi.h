@@ -29,6 +29,12 @@ extern "C" {
 void dicom_wsi_interpret_top_level_data_element(dicom_instance_t *instance, dicom_data_element_t element);
 void dicom_wsi_interpret_nested_data_element(dicom_instance_t* instance, dicom_data_element_t element);
 u8* dicom_wsi_decode_tile_to_bgra(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index);
+bool dicom_wsi_can_decode_tile_scaled(dicom_series_t* dicom_series, i32 instance_index);
+bool dicom_wsi_decode_tile_scaled_to_bgra(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index, i32 scale_denom,
+                                          u8* dest, i32 dest_pitch, i32 max_width, i32 max_height);
+bool dicom_wsi_decode_tile_region_to_bgra(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index, u8* dest, i32 dest_pitch,
+                                          i32 max_width, i32 max_height, i32 region_x, i32 region_y, i32 region_width, i32 region_height);
+u8* dicom_wsi_copy_jpeg_tile(dicom_series_t* dicom_series, i32 instance_index, i32 tile_index, i64* size);
 
 #ifdef __cplusplus
 }
@@ -2285,7 +2285,9 @@ void isyntax_load_tile(isyntax_t* isyntax, isyntax_image_t* wsi, i32 scale, i32
 		icoeff_t* idwt = arena_push_size(temp_memory.arena, idwt_buffer_size);
 		memset(idwt, 0, idwt_buffer_size);
 		invalid_edges |= isyntax_idwt_tile_for_color_channel(isyntax, wsi, scale, tile_x, tile_y, color, idwt);
-		elapsed_idwt += get_seconds_elapsed(start_idwt, get_clock());
+		i64 end_idwt = get_clock();
+		elapsed_idwt += get_seconds_elapsed(start_idwt, end_idwt);
+		atomic_add_i64(&isyntax->total_idwt_ticks, end_idwt - start_idwt);
 		ASSERT(idwt);
 		switch(color) {
 			case 0: Y = idwt; break;
@@ -2419,7 +2421,9 @@ void isyntax_load_tile(isyntax_t* isyntax, isyntax_image_t* wsi, i32 scale, i32
             ASSERT(!"unknown pixel format!");
             break;
     }
-	isyntax->total_rgb_transform_time += get_seconds_elapsed(start, get_clock());
+	i64 end = get_clock();
+	isyntax->total_rgb_transform_time += get_seconds_elapsed(start, end);
+	atomic_add_i64(&isyntax->total_color_conversion_ticks, end - start);
 
 	//		float elapsed_rgb = get_seconds_elapsed(start, get_clock());
 	//	console_print_verbose("load: scale=%d x=%d y=%d  idwt time =%g  rgb transform time=%g  malloc time=%g\n", scale, tile_x, tile_y, elapsed_idwt, elapsed_rgb, elapsed_malloc);
@@ -3615,6 +3619,8 @@ bool isyntax_open(isyntax_t* isyntax, const char* filename, enum libisyntax_open
 			if (!isyntax->file_handle) {
 				console_print_error("Error: Could not reopen file for asynchronous I/O\n");
 				success = false;
+			} else if (use_memory_mapped_files) {
+				mapped_file_open(&isyntax->mapped_file, isyntax->file_handle, FILE_ACCESS_RANDOM);
 			}
 		}
 	}
@@ -3703,5 +3709,6 @@ void isyntax_destroy(isyntax_t* isyntax) {
 	if (isyntax->cache) {
 		libisyntax_cache_destroy(isyntax->cache);
 	}
+	mapped_file_close(&isyntax->mapped_file);
 	file_handle_close(isyntax->file_handle);
 }
@@ -238,7 +238,8 @@ typedef struct isyntax_data_chunk_t {
 	i32 codeblock_count_per_color;
 	i32 scale;
 	i32 level_count;
-	u8* data;
+	u8* volatile data; // only set after the read has completed
+	bool volatile is_submitted_for_loading;
 } isyntax_data_chunk_t;
 
 typedef struct isyntax_tile_channel_t {
@@ -373,6 +374,7 @@ typedef struct isyntax_t {
 	enum libisyntax_open_flags_t open_flags;
 	i64 filesize;
 	file_handle_t file_handle;
+	mapped_file_t mapped_file; // only if use_memory_mapped_files is set and the file is local
 	isyntax_image_t images[16];
 	i32 image_count;
 	isyntax_block_header_template_t block_header_templates[64];
@@ -399,6 +401,11 @@ typedef struct isyntax_t {
     bool is_block_allocator_owned;
 	float loading_time;
 	float total_rgb_transform_time;
+	// Time spent in each decoding stage (in get_clock() ticks, summed over all threads), see libisyntax_get_timings()
+	volatile i64 total_io_ticks;
+	volatile i64 total_hulsken_ticks;
+	volatile i64 total_idwt_ticks;
+	volatile i64 total_color_conversion_ticks;
 	i32 data_model_major_version; // <100 (usually 5) for iSyntax format v1, >= 100 for iSyntax format v2
 	i32 data_model_minor_version;
 	char barcode[64];
@@ -0,0 +1,353 @@
+/*
+  BSD 2-Clause License
+
+  Copyright (c) 2019-2026, Pieter Valkema
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Headless iSyntax decoding benchmark.
+// Measures random access tile reads, a sequential sweep over the whole slide and region reads through libisyntax,
+// and reports throughput, latency percentiles and a breakdown of where the decoding time was spent.
+//
+// Usage: isyntax_bench <slide.isyntax> [--mode all|random|sequential|region] [--threads N] [--cache-size N]
+//                      [--samples N] [--regions N] [--region-size N] [--seed N] [--no-mmap]
+
+#include "common.h"
+#include "platform.h"
+#include "stringutils.h"
+
+#include "libisyntax.h"
+#include "isyntax.h"
+
+#include <stdarg.h>
+
+void console_print(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stdout, fmt, args);
+    va_end(args);
+}
+
+void console_print_verbose(const char* fmt, ...) {
+    if (!is_verbose_mode) return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stdout, fmt, args);
+    va_end(args);
+}
+
+void console_print_error(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+u8* download_remote_chunk(const char* hostname, i32 portno, const char* filename, i64 offset, i64 size, i32* bytes_read, i32 thread_id) {
+    return NULL;
+}
+
+enum bench_mode_enum {
+    BENCH_MODE_RANDOM = 0x1,
+    BENCH_MODE_SEQUENTIAL = 0x2,
+    BENCH_MODE_REGION = 0x4,
+    BENCH_MODE_ALL = 0x7,
+};
+
+typedef struct bench_options_t {
+    const char* filename;
+    u32 modes;
+    i32 thread_count;
+    i32 cache_size;
+    i32 samples_per_level;
+    i32 regions_per_level;
+    i32 region_size;
+    u64 seed;
+} bench_options_t;
+
+typedef struct bench_slide_t {
+    isyntax_t* isyntax;
+    isyntax_cache_t* cache;
+    const isyntax_image_t* wsi;
+    i32 level_count;
+    i32 tile_width;
+    i32 tile_height;
+} bench_slide_t;
+
+static u64 bench_random_state;
+
+static u32 bench_random(void) {
+    // xorshift64*
+    bench_random_state ^= bench_random_state >> 12;
+    bench_random_state ^= bench_random_state << 25;
+    bench_random_state ^= bench_random_state >> 27;
+    return (u32)((bench_random_state * 2685821657736338717ULL) >> 32);
+}
+
+static int float_compare_func(const void* a, const void* b) {
+    float x = *(const float*)a;
+    float y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+static float percentile(float* sorted_values, i32 count, float fraction) {
+    if (count <= 0) return 0.0f;
+    i32 index = (i32)(fraction * (float)(count - 1) + 0.5f);
+    return sorted_values[CLAMP(index, 0, count - 1)];
+}
+
+static void print_latencies(const char* label, i32 level, i32 count, float* latencies, float elapsed, const char* unit) {
+    qsort(latencies, count, sizeof(float), float_compare_func);
+    float per_second = elapsed > 0.0f ? (float)count / elapsed : 0.0f;
+    printf("%-10s level %2d: %6d %-7s %9.1f %s/s   p50 %8.3f ms   p99 %8.3f ms\n", label, level, count, unit,
+           per_second, unit, percentile(latencies, count, 0.5f) * 1000.0f, percentile(latencies, count, 0.99f) * 1000.0f);
+}
+
+static void print_timings(bench_slide_t* slide, float elapsed) {
+    libisyntax_timings_t timings = {0};
+    libisyntax_get_timings(slide->isyntax, &timings);
+    printf("           wall %.3f s; summed over threads: I/O %.3f s, Hulsken %.3f s, IDWT %.3f s, color conversion %.3f s\n\n",
+           elapsed, timings.io_seconds, timings.hulsken_seconds, timings.idwt_seconds, timings.color_conversion_seconds);
+}
+
+// Every benchmark starts from a freshly opened slide, so that coefficients cached by an earlier run don't skew it.
+static bool bench_open_slide(bench_options_t* options, bench_slide_t* slide) {
+    memset(slide, 0, sizeof(*slide));
+    if (libisyntax_open(options->filename, (enum libisyntax_open_flags_t)0, &slide->isyntax) != LIBISYNTAX_OK) {
+        console_print_error("isyntax_bench: could not open '%s'\n", options->filename);
+        return false;
+    }
+    if (libisyntax_cache_create("isyntax_bench cache", options->cache_size, &slide->cache) != LIBISYNTAX_OK ||
+        libisyntax_cache_inject(slide->cache, slide->isyntax) != LIBISYNTAX_OK) {
+        console_print_error("isyntax_bench: could not create the tile cache\n");
+        libisyntax_close(slide->isyntax);
+        return false;
+    }
+    slide->wsi = libisyntax_get_wsi_image(slide->isyntax);
+    slide->level_count = libisyntax_image_get_level_count(slide->wsi);
+    slide->tile_width = libisyntax_get_tile_width(slide->isyntax);
+    slide->tile_height = libisyntax_get_tile_height(slide->isyntax);
+    return true;
+}
+
+static void bench_close_slide(bench_slide_t* slide) {
+    libisyntax_cache_destroy(slide->cache);
+    libisyntax_close(slide->isyntax);
+}
+
+static bool bench_random_tiles(bench_options_t* options) {
+    bench_slide_t slide;
+    if (!bench_open_slide(options, &slide)) return false;
+    printf("Random access tile reads (%d per level)\n", options->samples_per_level);
+
+    u32* pixels = (u32*)malloc(slide.tile_width * slide.tile_height * sizeof(u32));
+    float* latencies = (float*)malloc(options->samples_per_level * sizeof(float));
+    i64 start = get_clock();
+    for (i32 level_index = slide.level_count - 1; level_index >= 0; --level_index) {
+        const isyntax_level_t* level = libisyntax_image_get_level(slide.wsi, level_index);
+        i32 width_in_tiles = libisyntax_level_get_width_in_tiles(level);
+        i32 height_in_tiles = libisyntax_level_get_height_in_tiles(level);
+        i64 level_start = get_clock();
+        i32 count = 0;
+        for (i32 attempt = 0; count < options->samples_per_level && attempt < options->samples_per_level * 16; ++attempt) {
+            i32 tile_x = bench_random() % width_in_tiles;
+            i32 tile_y = bench_random() % height_in_tiles;
+            if (!level->tiles[tile_y * width_in_tiles + tile_x].exists) {
+                continue; // empty tiles are trivial to 'decode', don't let them skew the statistics
+            }
+            i64 tile_start = get_clock();
+            libisyntax_tile_read(slide.isyntax, slide.cache, level_index, tile_x, tile_y, pixels, LIBISYNTAX_PIXEL_FORMAT_RGBA);
+            latencies[count++] = get_seconds_elapsed(tile_start, get_clock());
+        }
+        print_latencies("random", level_index, count, latencies, get_seconds_elapsed(level_start, get_clock()), "tiles");
+    }
+    print_timings(&slide, get_seconds_elapsed(start, get_clock()));
+
+    free(latencies);
+    free(pixels);
+    bench_close_slide(&slide);
+    return true;
+}
+
+typedef struct bench_sequential_t {
+    i64 last_clock;
+    i64 level_start_clock[16];
+    i64 level_end_clock[16];
+    i32 tile_counts[16];
+    float* latencies[16];
+    i32 capacities[16];
+} bench_sequential_t;
+
+static void bench_sequential_callback(void* userdata, int32_t level, int64_t tile_x, int64_t tile_y, const uint32_t* pixels_buffer) {
+    bench_sequential_t* bench = (bench_sequential_t*)userdata;
+    i64 now = get_clock();
+    if (level >= 0 && level < COUNT(bench->tile_counts)) {
+        // Latency here is the time between consecutive tiles becoming available.
+        if (bench->tile_counts[level] == 0) {
+            bench->level_start_clock[level] = bench->last_clock;
+        }
+        if (bench->tile_counts[level] == bench->capacities[level]) {
+            bench->capacities[level] = MAX(256, bench->capacities[level] * 2);
+            bench->latencies[level] = (float*)realloc(bench->latencies[level], bench->capacities[level] * sizeof(float));
+        }
+        bench->latencies[level][bench->tile_counts[level]++] = get_seconds_elapsed(bench->last_clock, now);
+        bench->level_end_clock[level] = now;
+    }
+    bench->last_clock = now;
+}
+
+static bool bench_sequential_sweep(bench_options_t* options) {
+    bench_slide_t slide;
+    if (!bench_open_slide(options, &slide)) return false;
+    printf("Sequential sweep over all tiles\n");
+
+    bench_sequential_t bench = {0};
+    i64 start = get_clock();
+    bench.last_clock = start;
+    libisyntax_read_all_tiles(slide.isyntax, slide.cache, LIBISYNTAX_PIXEL_FORMAT_RGBA, bench_sequential_callback, &bench);
+    float elapsed = get_seconds_elapsed(start, get_clock());
+
+    i32 total_tile_count = 0;
+    for (i32 level_index = MIN(slide.level_count, COUNT(bench.tile_counts)) - 1; level_index >= 0; --level_index) {
+        // NOTE: levels are interleaved during the sweep, so the per-level rate is measured over the span of the level.
+        float level_elapsed = get_seconds_elapsed(bench.level_start_clock[level_index], bench.level_end_clock[level_index]);
+        print_latencies("sequential", level_index, bench.tile_counts[level_index], bench.latencies[level_index], level_elapsed, "tiles");
+        total_tile_count += bench.tile_counts[level_index];
+        free(bench.latencies[level_index]);
+    }
+    printf("           total: %d tiles, %.1f tiles/s\n", total_tile_count, elapsed > 0.0f ? (float)total_tile_count / elapsed : 0.0f);
+    print_timings(&slide, elapsed);
+    bench_close_slide(&slide);
+    return true;
+}
+
+static bool bench_region_reads(bench_options_t* options) {
+    bench_slide_t slide;
+    if (!bench_open_slide(options, &slide)) return false;
+    printf("Region reads (%d per level, %dx%d pixels)\n", options->regions_per_level, options->region_size, options->region_size);
+
+    i64 region_size = options->region_size;
+    u32* pixels = (u32*)malloc(region_size * region_size * sizeof(u32));
+    float* latencies = (float*)malloc(options->regions_per_level * sizeof(float));
+    i64 start = get_clock();
+    for (i32 level_index = slide.level_count - 1; level_index >= 0; --level_index) {
+        const isyntax_level_t* level = libisyntax_image_get_level(slide.wsi, level_index);
+        i32 level_width = libisyntax_level_get_width(level);
+        i32 level_height = libisyntax_level_get_height(level);
+        i64 level_start = get_clock();
+        for (i32 i = 0; i < options->regions_per_level; ++i) {
+            i64 x = level_width > region_size ? bench_random() % (level_width - region_size) : 0;
+            i64 y = level_height > region_size ? bench_random() % (level_height - region_size) : 0;
+            i64 region_start = get_clock();
+            libisyntax_read_region(slide.isyntax, slide.cache, level_index, x, y, region_size, region_size, pixels, LIBISYNTAX_PIXEL_FORMAT_RGBA);
+            latencies[i] = get_seconds_elapsed(region_start, get_clock());
+        }
+        print_latencies("region", level_index, options->regions_per_level, latencies, get_seconds_elapsed(level_start, get_clock()), "regions");
+    }
+    print_timings(&slide, get_seconds_elapsed(start, get_clock()));
+
+    free(latencies);
+    free(pixels);
+    bench_close_slide(&slide);
+    return true;
+}
+
+static void print_usage(void) {
+    printf("Usage: isyntax_bench <slide.isyntax> [options]\n"
+           "  --mode M          all (default), random, sequential or region\n"
+           "  --threads N       number of threads (default: number of logical CPUs)\n"
+           "  --cache-size N    number of tiles in the coefficient cache (default: 2000)\n"
+           "  --samples N       random tile reads per level (default: 200)\n"
+           "  --regions N       region reads per level (default: 20)\n"
+           "  --region-size N   width and height of each region in pixels (default: 1024)\n"
+           "  --seed N          seed for the random tile and region positions (default: 1)\n"
+           "  --no-mmap         read the file with pread() instead of memory-mapping it\n");
+}
+
+int main(int argc, const char** argv) {
+    bench_options_t options = {0};
+    options.modes = BENCH_MODE_ALL;
+    options.cache_size = 2000;
+    options.samples_per_level = 200;
+    options.regions_per_level = 20;
+    options.region_size = 1024;
+    options.seed = 1;
+
+    for (i32 i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool has_value = (i + 1 < argc);
+        if (strcmp(arg, "--mode") == 0 && has_value) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "all") == 0) options.modes = BENCH_MODE_ALL;
+            else if (strcmp(mode, "random") == 0) options.modes = BENCH_MODE_RANDOM;
+            else if (strcmp(mode, "sequential") == 0) options.modes = BENCH_MODE_SEQUENTIAL;
+            else if (strcmp(mode, "region") == 0) options.modes = BENCH_MODE_REGION;
+            else {
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(arg, "--threads") == 0 && has_value) {
+            options.thread_count = atoi(argv[++i]);
+        } else if (strcmp(arg, "--cache-size") == 0 && has_value) {
+            options.cache_size = ATLEAST(atoi(argv[++i]), 1);
+        } else if (strcmp(arg, "--samples") == 0 && has_value) {
+            options.samples_per_level = ATLEAST(atoi(argv[++i]), 1);
+        } else if (strcmp(arg, "--regions") == 0 && has_value) {
+            options.regions_per_level = ATLEAST(atoi(argv[++i]), 1);
+        } else if (strcmp(arg, "--region-size") == 0 && has_value) {
+            options.region_size = ATLEAST(atoi(argv[++i]), 1);
+        } else if (strcmp(arg, "--seed") == 0 && has_value) {
+            options.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--no-mmap") == 0) {
+            use_memory_mapped_files = false;
+        } else if (arg[0] != '-' && !options.filename) {
+            options.filename = arg;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (!options.filename) {
+        print_usage();
+        return 1;
+    }
+    bench_random_state = options.seed ? options.seed : 1;
+
+    // The thread pool is sized from the system info when libisyntax initializes, so override it beforehand.
+    init_global_system_info(false);
+    if (options.thread_count > 0) {
+        global_system_info.suggested_total_thread_count = MIN(options.thread_count, MAX_THREAD_COUNT);
+    }
+    if (libisyntax_init() != LIBISYNTAX_OK) {
+        console_print_error("isyntax_bench: libisyntax_init() failed\n");
+        return 1;
+    }
+    printf("isyntax_bench: %s (%d threads, cache size %d)\n\n", options.filename,
+           global_system_info.suggested_total_thread_count, options.cache_size);
+
+    bool success = true;
+    if (success && (options.modes & BENCH_MODE_RANDOM)) success = bench_random_tiles(&options);
+    if (success && (options.modes & BENCH_MODE_SEQUENTIAL)) success = bench_sequential_sweep(&options);
+    if (success && (options.modes & BENCH_MODE_REGION)) success = bench_region_reads(&options);
+    return success ? 0 : 1;
+}
@@ -26,6 +26,7 @@
 */
 
 #include "common.h"
+#include "intrinsics.h"
 #include "isyntax_reader.h"
 
 #define LOG(msg, ...) console_print(msg, ##__VA_ARGS__)
@@ -99,6 +100,29 @@ static void tile_list_insert_list_first(isyntax_tile_list_t* target_list, isynta
     isyntax_tile_t* _iter = _list.head; _iter; _iter = _iter->cache_next
 
 
+static void isyntax_tile_free_coefficients(isyntax_cache_t* cache, isyntax_tile_t* tile) {
+    for (int i = 0; i < 3; ++i) {
+        if (tile->has_ll) {
+            block_free(cache->ll_coeff_block_allocator, tile->color_channels[i].coeff_ll);
+            tile->color_channels[i].coeff_ll = NULL;
+        }
+        if (tile->has_h) {
+            block_free(cache->h_coeff_block_allocator, tile->color_channels[i].coeff_h);
+            tile->color_channels[i].coeff_h = NULL;
+        }
+    }
+    tile->has_ll = false;
+    tile->has_h = false;
+}
+
+static void isyntax_cache_trim(isyntax_cache_t* cache, int target_cache_size) {
+    while (cache->cache_list.count > target_cache_size) {
+        isyntax_tile_t* tile = cache->cache_list.tail;
+        tile_list_remove(&cache->cache_list, tile);
+        isyntax_tile_free_coefficients(cache, tile);
+    }
+}
+
 static void isyntax_openslide_load_tile_coefficients_ll_or_h(isyntax_cache_t* cache,
                                                              isyntax_t* isyntax, isyntax_tile_t* tile,
                                                              int codeblock_index, bool is_ll) {
@@ -118,19 +142,30 @@ static void isyntax_openslide_load_tile_coefficients_ll_or_h(isyntax_cache_t* ca
         }
         // TODO(avirodov): fancy allocators, for multiple sequential blocks (aka chunk). Or let OS do the caching.
         // Adding 7 safety bytes so bitstream_lsb_read() won't access out of bounds in isyntax_hulsken_decompress().
-        u8* codeblock_data = malloc(codeblock->block_size + 7);
-        size_t bytes_read = file_handle_read_at_offset(codeblock_data, isyntax->file_handle,
-                                                       codeblock->block_data_offset, codeblock->block_size);
-        if (!(bytes_read > 0)) {
-            console_print_error("Error: could not read iSyntax data at offset %lld (read size %lld)\n",
-                                codeblock->block_data_offset, codeblock->block_size);
+        // If the file is memory-mapped, the codeblock is decompressed in place (if the safety bytes are within the file).
+        i64 start_io = get_clock();
+        u8* codeblock_data = mapped_file_get_bytes(&isyntax->mapped_file, codeblock->block_data_offset, codeblock->block_size + 7);
+        bool need_free_codeblock_data = false;
+        if (!codeblock_data) {
+            codeblock_data = malloc(codeblock->block_size + 7);
+            need_free_codeblock_data = true;
+            size_t bytes_read = file_handle_read_at_offset(codeblock_data, isyntax->file_handle,
+                                                           codeblock->block_data_offset, codeblock->block_size);
+            if (!(bytes_read > 0)) {
+                console_print_error("Error: could not read iSyntax data at offset %lld (read size %lld)\n",
+                                    codeblock->block_data_offset, codeblock->block_size);
+            }
         }
 
+        i64 start_hulsken = get_clock();
         isyntax_hulsken_decompress(codeblock_data, codeblock->block_size,
                                    isyntax->block_width, isyntax->block_height,
                                    codeblock->coefficient, wsi->compressor_version,
                                    is_ll ? tile->color_channels[color].coeff_ll : tile->color_channels[color].coeff_h);
-        free(codeblock_data);
+        i64 end_hulsken = get_clock();
+        atomic_add_i64(&isyntax->total_io_ticks, start_hulsken - start_io);
+        atomic_add_i64(&isyntax->total_hulsken_ticks, end_hulsken - start_hulsken);
+        if (need_free_codeblock_data) free(codeblock_data);
     }
 
     if (is_ll) {
@@ -323,8 +358,98 @@ static void isyntax_make_tile_lists_by_scale(isyntax_t* isyntax, int start_scale
     }
 }
 
-void isyntax_tile_read(isyntax_t* isyntax, isyntax_cache_t* cache, int scale, int tile_x, int tile_y,
-                       uint32_t* pixels_buffer, enum isyntax_pixel_format_t pixel_format) {
+// Batched work for isyntax_tiles_read().
+// Each stage (coefficient loading, or the IDWT for a single scale) is a flat list of independent items. The calling
+// thread claims items itself, and additionally hands out helper tasks to the thread pool that claim items from the
+// same list. The caller never executes unrelated tasks while waiting, because it is still holding the cache mutex.
+// Instead, once no items are left to claim, it blocks on the cache's semaphore, which is posted by whichever thread
+// completes the last item. (Batches on the same cache cannot overlap, because they run under the cache mutex.)
+// The batch is refcounted: helper tasks that only start after all items are done may still safely look at it.
+typedef enum isyntax_batch_stage_enum {
+    ISYNTAX_BATCH_STAGE_LOAD_COEFFICIENTS = 0,
+    ISYNTAX_BATCH_STAGE_IDWT = 1,
+} isyntax_batch_stage_enum;
+
+typedef struct isyntax_batch_t {
+    isyntax_t* isyntax;
+    isyntax_cache_t* cache;
+    isyntax_batch_stage_enum stage;
+    isyntax_tile_t** tiles;
+    uint32_t** pixels_buffers; // IDWT stage only; NULL entries for tiles that are only needed for their children
+    enum isyntax_pixel_format_t pixel_format;
+    i32 item_count;
+    i32 volatile next_item;
+    i32 volatile completed_item_count;
+    i32 volatile refcount;
+} isyntax_batch_t;
+
+static void isyntax_batch_release(isyntax_batch_t* batch) {
+    if (atomic_decrement(&batch->refcount) == 0) {
+        free(batch);
+    }
+}
+
+static void isyntax_batch_do_work(isyntax_batch_t* batch) {
+    for (;;) {
+        i32 item_index = atomic_increment(&batch->next_item) - 1;
+        if (item_index >= batch->item_count) {
+            break;
+        }
+        isyntax_tile_t* tile = batch->tiles[item_index];
+        if (batch->stage == ISYNTAX_BATCH_STAGE_LOAD_COEFFICIENTS) {
+            isyntax_openslide_load_tile_coefficients(batch->cache, batch->isyntax, tile);
+        } else {
+            isyntax_openslide_idwt(batch->cache, batch->isyntax, tile,
+                                   batch->pixels_buffers[item_index], batch->pixel_format);
+        }
+        write_barrier;
+        if (atomic_increment(&batch->completed_item_count) == batch->item_count) {
+            platform_semaphore_post(batch->cache->batch_completed_semaphore);
+        }
+    }
+}
+
+static void isyntax_batch_task_func(i32 logical_thread_index, void* userdata) {
+    isyntax_batch_t* batch = *(isyntax_batch_t**) userdata;
+    isyntax_batch_do_work(batch);
+    isyntax_batch_release(batch);
+}
+
+static void isyntax_run_batch(isyntax_t* isyntax, isyntax_cache_t* cache, isyntax_batch_stage_enum stage,
+                              isyntax_tile_t** tiles, uint32_t** pixels_buffers, i32 item_count,
+                              enum isyntax_pixel_format_t pixel_format) {
+    if (item_count <= 0) {
+        return;
+    }
+    isyntax_batch_t* batch = calloc(1, sizeof(isyntax_batch_t));
+    batch->isyntax = isyntax;
+    batch->cache = cache;
+    batch->stage = stage;
+    batch->tiles = tiles;
+    batch->pixels_buffers = pixels_buffers;
+    batch->pixel_format = pixel_format;
+    batch->item_count = item_count;
+    batch->refcount = 1; // reference held by the calling thread
+
+    thread_pool_t* pool = isyntax->work_submission_pool ? isyntax->work_submission_pool : &global_thread_pool;
+    i32 helper_count = MIN(item_count - 1, thread_pool_get_worker_thread_count(pool));
+    for (i32 i = 0; i < helper_count; ++i) {
+        atomic_increment(&batch->refcount);
+        if (!thread_pool_submit_task(pool, isyntax_batch_task_func, &batch, sizeof(batch))) {
+            atomic_decrement(&batch->refcount); // chicken out; the calling thread will do the remaining work
+            break;
+        }
+    }
+
+    isyntax_batch_do_work(batch);
+    platform_semaphore_wait(cache->batch_completed_semaphore); // posted exactly once per batch
+    read_barrier;
+    isyntax_batch_release(batch);
+}
+
+void isyntax_tiles_read(isyntax_t* isyntax, isyntax_cache_t* cache, int scale, int tile_count,
+                        const int64_t* tiles_x, const int64_t* tiles_y, uint32_t** pixels_buffers,
+                        enum isyntax_pixel_format_t pixel_format) {
     // TODO(avirodov): more granular locking (some notes below). This will require handling overlapping work, that is
     //  thread A needing tile 123 and started to load it, and thread B needing same tile 123 and needs to wait for A.
     // TODO(pvalkema): Can we safely lock the mutex later, after checking if the tile exists?
@@ -332,21 +457,11 @@ void isyntax_tile_read(isyntax_t* isyntax, isyntax_cache_t* cache, int scale, in
 
     isyntax_image_t* wsi = &isyntax->images[isyntax->wsi_image_index];
     isyntax_level_t* level = &wsi->levels[scale];
+    size_t tile_buffer_size = isyntax->tile_width * isyntax->tile_height * 4;
 
-	if (!(tile_x >= 0 && tile_x < level->width_in_tiles && tile_y >= 0 && tile_y < level->height_in_tiles)) {
-		// Read out of bounds -> set to all white
-		memset(pixels_buffer, 0xff, isyntax->tile_width * isyntax->tile_height * 4);
-        platform_mutex_unlock(&cache->mutex);
-		return;
-	}
-
-    isyntax_tile_t *tile = &level->tiles[level->width_in_tiles * tile_y + tile_x];
-    // printf("=== isyntax_openslide_load_tile scale=%d tile_x=%d tile_y=%d\n", scale, tile_x, tile_y);
-    if (!tile->exists) {
-        memset(pixels_buffer, 0xff, isyntax->tile_width * isyntax->tile_height * 4);
-        platform_mutex_unlock(&cache->mutex);
-        return;
-    }
+    temp_memory_t temp_memory = begin_temp_memory_on_local_thread();
+    isyntax_tile_t** requested_tiles = arena_push_array(temp_memory.arena, tile_count, isyntax_tile_t*);
+    i32* duplicate_of = arena_push_array(temp_memory.arena, tile_count, i32);
 
     // Need 3 lists:
     // 1. idwt list - those tiles will have to perform an idwt for their children to get ll coeffs. Primary cache bump.
@@ -358,37 +473,91 @@ void isyntax_tile_read(isyntax_t* isyntax, isyntax_cache_t* cache, int scale, in
     isyntax_tile_list_t children_list = {NULL, NULL, 0, "children_list"};
 
     // Lock.
-    // Make a list of all dependent tiles (including the required one).
+    // Make a list of all dependent tiles (including the requested ones).
     // Mark all dependent tiles as "reserved" so that they are not evicted by other threads as we load them.
     // Unlock.
-    {
-        tile_list_remove(&cache->cache_list, tile);
-        tile->cache_marked = true;
-        tile_list_insert_first(&idwt_list, tile);
-    }
-    isyntax_make_tile_lists_by_scale(isyntax, scale, &idwt_list, &coeff_list, &children_list, &cache->cache_list);
-
-    // Unmark visit status and reserve all nodes. todo(avirodov): reserve later when doing threading.
-    for (ITERATE_TILE_LIST(tile, idwt_list))     { tile->cache_marked = false; /*printf("@@@ idwt_list tile scale=%d x=%d y=%d\n", tile->tile_scale, tile->tile_x, tile->tile_y);*/ }
-    for (ITERATE_TILE_LIST(tile, coeff_list))    { tile->cache_marked = false; /*printf("@@@ coeff_list tile scale=%d x=%d y=%d\n", tile->tile_scale, tile->tile_x, tile->tile_y);*/ }
-    for (ITERATE_TILE_LIST(tile, children_list)) { tile->cache_marked = false; /*printf("@@@ children_list tile scale=%d x=%d y=%d\n", tile->tile_scale, tile->tile_x, tile->tile_y);*/ }
-
-    // IO+decode: For all dependent tiles, read and decode coefficients where missing (hh, and ll for top tiles).
-    // Assuming lists are sorted parents first.
-    // IDWT as needed, top to bottom. This should produce idwt for this tile as well, which should be last in idwt list.
-    // YCoCb->RGB for this tile only.
-    uint32_t* result = NULL;
-    for (ITERATE_TILE_LIST(tile, coeff_list)) {
-        isyntax_openslide_load_tile_coefficients(cache, isyntax, tile);
-    }
-    for (ITERATE_TILE_LIST(tile, idwt_list)) {
-        isyntax_openslide_load_tile_coefficients(cache, isyntax, tile);
-    }
-    for (ITERATE_TILE_LIST(tile, idwt_list)) {
-        if (tile == idwt_list.tail) {
-            isyntax_openslide_idwt(cache, isyntax, tile, pixels_buffer, pixel_format);
+    for (i32 i = 0; i < tile_count; ++i) {
+        requested_tiles[i] = NULL;
+        duplicate_of[i] = -1;
+        int64_t tile_x = tiles_x[i];
+        int64_t tile_y = tiles_y[i];
+        if (!(tile_x >= 0 && tile_x < level->width_in_tiles && tile_y >= 0 && tile_y < level->height_in_tiles)) {
+            // Read out of bounds -> set to all white
+            memset(pixels_buffers[i], 0xff, tile_buffer_size);
+            continue;
+        }
+        isyntax_tile_t* tile = &level->tiles[level->width_in_tiles * tile_y + tile_x];
+        if (!tile->exists) {
+            memset(pixels_buffers[i], 0xff, tile_buffer_size);
+            continue;
+        }
+        requested_tiles[i] = tile;
+        if (tile->cache_marked) {
+            // The same tile was requested more than once; only decode it once.
+            for (i32 j = 0; j < i; ++j) {
+                if (requested_tiles[j] == tile) {
+                    duplicate_of[i] = j;
+                    break;
+                }
+            }
         } else {
-            isyntax_openslide_idwt(cache, isyntax, tile, /*pixels_buffer=*/NULL, /*pixel_format=*/0);
+            tile_list_remove(&cache->cache_list, tile);
+            tile->cache_marked = true;
+            tile_list_insert_first(&idwt_list, tile);
+        }
+    }
+
+    if (idwt_list.count > 0) {
+        isyntax_make_tile_lists_by_scale(isyntax, scale, &idwt_list, &coeff_list, &children_list, &cache->cache_list);
+
+        // Unmark visit status and reserve all nodes. todo(avirodov): reserve later when doing threading.
+        for (ITERATE_TILE_LIST(tile, idwt_list))     { tile->cache_marked = false; }
+        for (ITERATE_TILE_LIST(tile, coeff_list))    { tile->cache_marked = false; }
+        for (ITERATE_TILE_LIST(tile, children_list)) { tile->cache_marked = false; }
+
+        // IO+decode: For all dependent tiles, read and decode coefficients where missing (hh, and ll for top tiles).
+        // The tiles are independent of each other, so this can all happen in parallel.
+        i32 load_count = coeff_list.count + idwt_list.count;
+        isyntax_tile_t** load_tiles = arena_push_array(temp_memory.arena, load_count, isyntax_tile_t*);
+        i32 load_index = 0;
+        for (ITERATE_TILE_LIST(tile, coeff_list)) { load_tiles[load_index++] = tile; }
+        for (ITERATE_TILE_LIST(tile, idwt_list))  { load_tiles[load_index++] = tile; }
+        ASSERT(load_index == load_count);
+        isyntax_run_batch(isyntax, cache, ISYNTAX_BATCH_STAGE_LOAD_COEFFICIENTS, load_tiles, NULL, load_count, 0);
+
+        // IDWT as needed, top to bottom. Tiles at the same scale only write the LL coefficients of their own
+        // children, so all tiles within one scale can be transformed in parallel. At the requested scale, this
+        // produces the pixels for the requested tiles. YCoCb->RGB is done for the requested tiles only.
+        isyntax_tile_t** idwt_tiles = arena_push_array(temp_memory.arena, idwt_list.count, isyntax_tile_t*);
+        uint32_t** idwt_pixels_buffers = arena_push_array(temp_memory.arena, idwt_list.count, uint32_t*);
+        for (i32 idwt_scale = wsi->max_scale; idwt_scale >= scale; --idwt_scale) {
+            i32 idwt_count = 0;
+            if (idwt_scale == scale) {
+                for (i32 i = 0; i < tile_count; ++i) {
+                    if (requested_tiles[i] && duplicate_of[i] < 0) {
+                        idwt_tiles[idwt_count] = requested_tiles[i];
+                        idwt_pixels_buffers[idwt_count] = pixels_buffers[i];
+                        ++idwt_count;
+                    }
+                }
+            } else {
+                for (ITERATE_TILE_LIST(tile, idwt_list)) {
+                    if (tile->tile_scale == idwt_scale) {
+                        idwt_tiles[idwt_count] = tile;
+                        idwt_pixels_buffers[idwt_count] = NULL;
+                        ++idwt_count;
+                    }
+                }
+            }
+            ASSERT(idwt_count <= idwt_list.count);
+            isyntax_run_batch(isyntax, cache, ISYNTAX_BATCH_STAGE_IDWT, idwt_tiles, idwt_pixels_buffers, idwt_count,
+                              pixel_format);
+        }
+
+        for (i32 i = 0; i < tile_count; ++i) {
+            if (duplicate_of[i] >= 0) {
+                memcpy(pixels_buffers[i], pixels_buffers[duplicate_of[i]], tile_buffer_size);
+            }
         }
     }
 
@@ -405,24 +574,155 @@ void isyntax_tile_read(isyntax_t* isyntax, isyntax_cache_t* cache, int scale, in
     // Cache trim. Since we have the result already, it is possible that tiles from this run will be trimmed here
     // if cache is small or work happened on other threads.
     // TODO(avirodov): later will need to skip tiles that are reserved by other threads.
-    while (cache->cache_list.count > cache->target_cache_size) {
-        isyntax_tile_t* tile = cache->cache_list.tail;
-        tile_list_remove(&cache->cache_list, tile);
-        for (int i = 0; i < 3; ++i) {
-            if (tile->has_ll) {
-                block_free(cache->ll_coeff_block_allocator, tile->color_channels[i].coeff_ll);
-                tile->color_channels[i].coeff_ll = NULL;
+    isyntax_cache_trim(cache, cache->target_cache_size);
+
+    // Prevent iSyntax streamer from calling isyntax_begin_first_load()
+    if (!wsi->first_load_complete) {
+        wsi->first_load_complete = true;
+    }
+
+    release_temp_memory(&temp_memory);
+    platform_mutex_unlock(&cache->mutex);
+}
+
+void isyntax_tile_read(isyntax_t* isyntax, isyntax_cache_t* cache, int scale, int tile_x, int tile_y,
+                       uint32_t* pixels_buffer, enum isyntax_pixel_format_t pixel_format) {
+    int64_t tile_x_64 = tile_x;
+    int64_t tile_y_64 = tile_y;
+    isyntax_tiles_read(isyntax, cache, scale, 1, &tile_x_64, &tile_y_64, &pixels_buffer, pixel_format);
+}
+
+// Sequential whole-slide decoding.
+// All tiles are decoded exactly once, each level row by row. A row of tiles at some scale can be decoded as soon as
+// the parent rows covering it (and its vertical neighbors) have been decoded, because that is when the LL coefficients
+// become available. Rows are pulled in on demand from the top of the pyramid downwards, so each level only needs to
+// keep a band of about three rows of coefficients in memory. Coefficients are released as soon as the rows that
+// depend on them are done.
+typedef struct isyntax_stream_state_t {
+    isyntax_t* isyntax;
+    isyntax_cache_t* cache;
+    enum isyntax_pixel_format_t pixel_format;
+    libisyntax_tile_callback_t callback;
+    void* userdata;
+    i32 next_row[16]; // next row to decode, per scale (see isyntax_image_t::levels)
+    isyntax_tile_t** batch_tiles;
+    uint32_t** batch_pixels_buffers;
+    i32 batch_capacity;
+} isyntax_stream_state_t;
+
+static void isyntax_stream_free_row(isyntax_stream_state_t* state, isyntax_level_t* level, i32 tile_y) {
+    if (tile_y < 0 || tile_y >= level->height_in_tiles) {
+        return;
+    }
+    isyntax_tile_t* row = level->tiles + tile_y * level->width_in_tiles;
+    for (i32 tile_x = 0; tile_x < level->width_in_tiles; ++tile_x) {
+        isyntax_tile_free_coefficients(state->cache, row + tile_x);
+    }
+}
+
+static void isyntax_stream_rows_up_to(isyntax_stream_state_t* state, i32 scale, i32 last_row) {
+    isyntax_t* isyntax = state->isyntax;
+    isyntax_image_t* wsi = &isyntax->images[isyntax->wsi_image_index];
+    isyntax_level_t* level = &wsi->levels[scale];
+    last_row = MIN(last_row, level->height_in_tiles - 1);
+
+    while (state->next_row[scale] <= last_row) {
+        i32 tile_y = state->next_row[scale];
+
+        // The LL coefficients for this row and the next row are computed from the parent rows.
+        if (scale < wsi->max_scale) {
+            isyntax_stream_rows_up_to(state, scale + 1, (tile_y + 1) / 2);
+        }
+
+        // Load the remaining coefficients for this row and the next row (neighbors). Tiles that already have them
+        // (from the previous iteration) are skipped.
+        i32 load_count = 0;
+        for (i32 y = tile_y; y <= MIN(tile_y + 1, level->height_in_tiles - 1); ++y) {
+            isyntax_tile_t* row = level->tiles + y * level->width_in_tiles;
+            for (i32 tile_x = 0; tile_x < level->width_in_tiles; ++tile_x) {
+                isyntax_tile_t* tile = row + tile_x;
+                if (tile->exists && (!tile->has_h || (scale == wsi->max_scale && !tile->has_ll))) {
+                    if (load_count == state->batch_capacity) {
+                        isyntax_run_batch(isyntax, state->cache, ISYNTAX_BATCH_STAGE_LOAD_COEFFICIENTS,
+                                          state->batch_tiles, NULL, load_count, 0);
+                        load_count = 0;
+                    }
+                    state->batch_tiles[load_count++] = tile;
+                }
+            }
+        }
+        isyntax_run_batch(isyntax, state->cache, ISYNTAX_BATCH_STAGE_LOAD_COEFFICIENTS,
+                          state->batch_tiles, NULL, load_count, 0);
+
+        // Decode the row in batches; this also distributes the LL coefficients to the children.
+        isyntax_tile_t* row = level->tiles + tile_y * level->width_in_tiles;
+        for (i32 batch_start_x = 0; batch_start_x < level->width_in_tiles; batch_start_x += state->batch_capacity) {
+            i32 batch_end_x = MIN(batch_start_x + state->batch_capacity, level->width_in_tiles);
+            i32 batch_count = 0;
+            for (i32 tile_x = batch_start_x; tile_x < batch_end_x; ++tile_x) {
+                if (row[tile_x].exists) {
+                    state->batch_tiles[batch_count++] = row + tile_x;
+                }
             }
-            if (tile->has_h) {
-                block_free(cache->h_coeff_block_allocator, tile->color_channels[i].coeff_h);
-                tile->color_channels[i].coeff_h = NULL;
+            isyntax_run_batch(isyntax, state->cache, ISYNTAX_BATCH_STAGE_IDWT,
+                              state->batch_tiles, state->batch_pixels_buffers, batch_count, state->pixel_format);
+            for (i32 i = 0; i < batch_count; ++i) {
+                isyntax_tile_t* tile = state->batch_tiles[i];
+                state->callback(state->userdata, scale, tile->tile_x, tile->tile_y, state->batch_pixels_buffers[i]);
             }
         }
-        tile->has_ll = false;
-        tile->has_h = false;
+
+        // The previous row is no longer needed as a neighbor.
+        isyntax_stream_free_row(state, level, tile_y - 1);
+        if (tile_y == level->height_in_tiles - 1) {
+            isyntax_stream_free_row(state, level, tile_y);
+        }
+        state->next_row[scale] = tile_y + 1;
     }
+}
+
+void isyntax_stream_all_tiles(isyntax_t* isyntax, isyntax_cache_t* cache, enum isyntax_pixel_format_t pixel_format,
+                              libisyntax_tile_callback_t callback, void* userdata) {
+    platform_mutex_lock(&cache->mutex);
+
+    // The streaming pass manages the coefficients of all tiles by itself, so start from an empty cache.
+    isyntax_cache_trim(cache, 0);
+
+    isyntax_image_t* wsi = &isyntax->images[isyntax->wsi_image_index];
+    isyntax_stream_state_t state = {0};
+    state.isyntax = isyntax;
+    state.cache = cache;
+    state.pixel_format = pixel_format;
+    state.callback = callback;
+    state.userdata = userdata;
+    state.batch_capacity = 64;
+    state.batch_tiles = malloc(state.batch_capacity * sizeof(isyntax_tile_t*));
+    state.batch_pixels_buffers = malloc(state.batch_capacity * sizeof(uint32_t*));
+    size_t tile_pixel_count = isyntax->tile_width * isyntax->tile_height;
+    uint32_t* batch_pixels = malloc(state.batch_capacity * tile_pixel_count * sizeof(uint32_t));
+    for (i32 i = 0; i < state.batch_capacity; ++i) {
+        state.batch_pixels_buffers[i] = batch_pixels + i * tile_pixel_count;
+    }
+
+    // Pulling in the rows of the base level also decodes the levels above it. Rows at the bottom of the higher
+    // levels that are not needed for the base level are decoded afterwards.
+    for (i32 scale = 0; scale <= wsi->max_scale; ++scale) {
+        isyntax_level_t* level = &wsi->levels[scale];
+        isyntax_stream_rows_up_to(&state, scale, level->height_in_tiles - 1);
+    }
+
+    // Release LL coefficients that were distributed to children that are not decoded anymore.
+    for (i32 scale = 0; scale <= wsi->max_scale; ++scale) {
+        isyntax_level_t* level = &wsi->levels[scale];
+        for (i32 tile_y = 0; tile_y < level->height_in_tiles; ++tile_y) {
+            isyntax_stream_free_row(&state, level, tile_y);
+        }
+    }
+
+    free(batch_pixels);
+    free(state.batch_tiles);
+    free(state.batch_pixels_buffers);
 
-    // Prevent iSyntax streamer from calling isyntax_begin_first_load()
     if (!wsi->first_load_complete) {
         wsi->first_load_complete = true;
     }
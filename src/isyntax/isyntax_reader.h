@@ -14,6 +14,7 @@ typedef struct isyntax_tile_list_t {
 typedef struct isyntax_cache_t {
     isyntax_tile_list_t cache_list;
     platform_mutex_t mutex;
+    semaphore_handle_t batch_completed_semaphore; // posted when the last item of a batch is done, see isyntax_run_batch()
     // TODO(avirodov): int refcount;
     int target_cache_size;
     block_allocator_t* ll_coeff_block_allocator;
@@ -26,6 +27,14 @@ typedef struct isyntax_cache_t {
 // TODO(avirodov): can this ever fail?
 void isyntax_tile_read(isyntax_t* isyntax, isyntax_cache_t* cache, int scale, int tile_x, int tile_y,
                        uint32_t* pixels_buffer, enum isyntax_pixel_format_t pixel_format);
+// Reads a batch of tiles at the same scale. Shared parent/neighbor tiles are decoded only once, and independent work
+// (coefficient loading, and the IDWT of tiles within the same scale) is spread across the thread pool.
+void isyntax_tiles_read(isyntax_t* isyntax, isyntax_cache_t* cache, int scale, int tile_count,
+                        const int64_t* tiles_x, const int64_t* tiles_y, uint32_t** pixels_buffers,
+                        enum isyntax_pixel_format_t pixel_format);
+// Decodes every tile of the WSI in one sequential pass over the pyramid, calling back for each tile.
+void isyntax_stream_all_tiles(isyntax_t* isyntax, isyntax_cache_t* cache, enum isyntax_pixel_format_t pixel_format,
+                              libisyntax_tile_callback_t callback, void* userdata);
 
 void tile_list_init(isyntax_tile_list_t* list, const char* dbg_name);
 void tile_list_remove(isyntax_tile_list_t* list, isyntax_tile_t* tile);
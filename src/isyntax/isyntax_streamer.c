@@ -34,6 +34,12 @@
 
 static bool allow_load_tile_on_worker_threads = true; // disable to load tiles only on the main thread (e.g. for debugging)
 
+// Chunks that are close together in the file are read with a single read operation. This turns many small scattered
+// reads into a few large (nearly) sequential ones, which matters a lot on spinning disks and network file systems.
+#define ISYNTAX_COALESCED_READ_MAX_GAP (64 * 1024)
+#define ISYNTAX_COALESCED_READ_MAX_SIZE (16 * 1024 * 1024)
+#define ISYNTAX_COALESCED_READ_MAX_CHUNKS 24 // limited by the size of the task userdata
+
 static void submit_tile_completed(isyntax_streamer_t* streamer, void* tile_pixels, i32 scale, i32 tile_index, i32 tile_width, i32 tile_height) {
 
 	isyntax_streamer_tile_completed_task_t completion_task = {0};
@@ -52,47 +58,146 @@ static void submit_tile_completed(isyntax_streamer_t* streamer, void* tile_pixel
 
 }
 
-static i32 isyntax_load_all_tiles_in_level(isyntax_streamer_t* streamer, i32 scale) {
-	i32 tiles_loaded = 0;
-	i32 tile_index = 0;
+// The tiles of the first load that are transformed on the worker threads each post the semaphore once when they are
+// done, so that the first load can wait for them without polling. Every post is eventually consumed by a wait (see
+// isyntax_first_load_wait_for_all_tasks()), so that no task touches the semaphore after the first load has finished.
+typedef struct isyntax_first_load_sync_t {
+	semaphore_handle_t tile_loaded_semaphore;
+	i32 tasks_submitted;
+	i32 posts_consumed;
+} isyntax_first_load_sync_t;
+
+// Blocks until one of the tile tasks submitted by the first load is done.
+// Returns false if there are no outstanding tasks, i.e. there is nothing to wait for.
+static bool isyntax_first_load_wait_for_task(isyntax_streamer_t* streamer) {
+	isyntax_first_load_sync_t* sync = streamer->first_load_sync;
+	if (sync->posts_consumed >= sync->tasks_submitted) {
+		return false;
+	}
+	platform_semaphore_wait(sync->tile_loaded_semaphore);
+	++sync->posts_consumed;
+	return true;
+}
+
+static void isyntax_first_load_wait_for_all_tasks(isyntax_streamer_t* streamer) {
+	while (isyntax_first_load_wait_for_task(streamer)) {}
+}
+
+static void isyntax_first_load_tile(isyntax_streamer_t* streamer, i32 scale, i32 tile_x, i32 tile_y) {
 	isyntax_t* isyntax = streamer->isyntax;
 	isyntax_image_t* wsi = streamer->wsi;
 	isyntax_level_t* level = wsi->levels + scale;
-	for (i32 tile_y = 0; tile_y < level->height_in_tiles; ++tile_y) {
-		for (i32 tile_x = 0; tile_x < level->width_in_tiles; ++tile_x, ++tile_index) {
-			isyntax_tile_t* tile = level->tiles + tile_index;
-			if (!tile->exists) continue;
-			i32 tasks_waiting = thread_pool_get_task_count(isyntax->work_submission_pool);
-			if (allow_load_tile_on_worker_threads && thread_pool_get_idle_worker_thread_count(isyntax->work_submission_pool) > 0 && tasks_waiting < global_system_info.logical_cpu_count * 10) {
-				isyntax_begin_load_tile(streamer, scale, tile_x, tile_y);
-			} else if (!is_tile_streamer_frame_boundary_passed) {
-                u32* tile_pixels = (u32*)malloc(isyntax->tile_width * isyntax->tile_height * sizeof(u32));
-				isyntax_load_tile(isyntax, wsi, scale, tile_x, tile_y, isyntax->ll_coeff_block_allocator, tile_pixels, streamer->pixel_format);
-				if (tile_pixels) {
-					submit_tile_completed(streamer, tile_pixels, scale, tile_index, isyntax->tile_width, isyntax->tile_height);
+	i32 tile_index = tile_y * level->width_in_tiles + tile_x;
+	i32 tasks_waiting = thread_pool_get_task_count(isyntax->work_submission_pool);
+	if (allow_load_tile_on_worker_threads && thread_pool_get_idle_worker_thread_count(isyntax->work_submission_pool) > 0 &&
+	    tasks_waiting < global_system_info.logical_cpu_count * 10 && isyntax_begin_load_tile(streamer, scale, tile_x, tile_y)) {
+		++streamer->first_load_sync->tasks_submitted;
+	} else {
+		// NOTE: the tile must always be loaded here, because the tiles in the next level depend on it.
+		u32* tile_pixels = (u32*)malloc(isyntax->tile_width * isyntax->tile_height * sizeof(u32));
+		isyntax_load_tile(isyntax, wsi, scale, tile_x, tile_y, isyntax->ll_coeff_block_allocator, tile_pixels, streamer->pixel_format);
+		if (tile_pixels) {
+			submit_tile_completed(streamer, tile_pixels, scale, tile_index, isyntax->tile_width, isyntax->tile_height);
+		}
+	}
+}
+
+// A tile can be transformed as soon as the coefficients of its 3x3 neighborhood have been decompressed, and the
+// parent tiles of that neighborhood have finished their own transform (this is when they donate the LL coefficients).
+static bool isyntax_first_load_is_tile_ready(isyntax_image_t* wsi, i32 scale, i32 tile_x, i32 tile_y, i32 decompressed_rows) {
+	isyntax_level_t* level = wsi->levels + scale;
+	if (tile_y + 1 >= decompressed_rows && decompressed_rows < level->height_in_tiles) {
+		return false;
+	}
+	if (scale < wsi->max_scale) {
+		isyntax_level_t* parent_level = wsi->levels + scale + 1;
+		i32 parent_y0 = ATLEAST(tile_y - 1, 0) / 2;
+		i32 parent_y1 = ATMOST((tile_y + 1) / 2, parent_level->height_in_tiles - 1);
+		i32 parent_x0 = ATLEAST(tile_x - 1, 0) / 2;
+		i32 parent_x1 = ATMOST((tile_x + 1) / 2, parent_level->width_in_tiles - 1);
+		for (i32 parent_y = parent_y0; parent_y <= parent_y1; ++parent_y) {
+			for (i32 parent_x = parent_x0; parent_x <= parent_x1; ++parent_x) {
+				isyntax_tile_t* parent_tile = parent_level->tiles + parent_y * parent_level->width_in_tiles + parent_x;
+				if (parent_tile->exists && !parent_tile->is_loaded) {
+					return false;
 				}
 			}
-			++tiles_loaded;
 		}
 	}
+	return true;
+}
 
-	// TODO: more graceful multithreading
-	// Wait for all tiles to be finished loading
-	tile_index = 0;
+// Submits the tiles in a level that are ready to be transformed and have not been submitted yet.
+// Returns the number of tiles submitted; 'submitted' keeps track of which tiles were already handled.
+static i32 isyntax_first_load_submit_ready_tiles(isyntax_streamer_t* streamer, i32 scale, bool* submitted, i32 decompressed_rows) {
+	i32 tiles_submitted = 0;
+	i32 tile_index = 0;
+	isyntax_image_t* wsi = streamer->wsi;
+	isyntax_level_t* level = wsi->levels + scale;
 	for (i32 tile_y = 0; tile_y < level->height_in_tiles; ++tile_y) {
 		for (i32 tile_x = 0; tile_x < level->width_in_tiles; ++tile_x, ++tile_index) {
+			if (submitted[tile_index]) continue;
 			isyntax_tile_t* tile = level->tiles + tile_index;
-			if (!tile->exists) continue;
-			while (!tile->is_loaded) {
-				thread_pool_do_work(isyntax->work_submission_pool);
+			if (!tile->exists) {
+				submitted[tile_index] = true;
+				continue;
+			}
+			if (isyntax_first_load_is_tile_ready(wsi, scale, tile_x, tile_y, decompressed_rows)) {
+				isyntax_first_load_tile(streamer, scale, tile_x, tile_y);
+				submitted[tile_index] = true;
+				++tiles_submitted;
 			}
 		}
 	}
+	return tiles_submitted;
+}
 
-	level->is_fully_loaded = true;
+// Submits all tiles in the level, each as soon as the tiles it depends on in the level above are done. This way
+// the levels overlap and completed tiles keep being published, instead of waiting for the whole level above.
+static i32 isyntax_first_load_all_tiles_in_level(isyntax_streamer_t* streamer, i32 scale, bool* submitted) {
+	isyntax_t* isyntax = streamer->isyntax;
+	isyntax_level_t* level = streamer->wsi->levels + scale;
+	i32 tiles_loaded = 0;
+	for (;;) {
+		i32 tiles_submitted = isyntax_first_load_submit_ready_tiles(streamer, scale, submitted, level->height_in_tiles);
+		tiles_loaded += tiles_submitted;
+		bool all_submitted = true;
+		for (i32 i = 0; i < level->tile_count; ++i) {
+			if (!submitted[i]) {
+				all_submitted = false;
+				break;
+			}
+		}
+		if (all_submitted) break;
+		// Waiting for parent tiles: help out in the meantime, or else block until another tile is done.
+		if (!thread_pool_do_work(isyntax->work_submission_pool)) {
+			if (!isyntax_first_load_wait_for_task(streamer) && tiles_submitted == 0) {
+				// No progress and nothing in flight, so the remaining tiles can never become ready.
+				console_print_error("isyntax_first_load_all_tiles_in_level(): tiles at scale %d cannot be loaded\n", scale);
+				break;
+			}
+		}
+	}
 	return tiles_loaded;
 }
 
+static void isyntax_first_load_wait_for_level(isyntax_streamer_t* streamer, i32 scale) {
+	isyntax_t* isyntax = streamer->isyntax;
+	isyntax_level_t* level = streamer->wsi->levels + scale;
+	for (i32 tile_index = 0; tile_index < level->tile_count; ++tile_index) {
+		isyntax_tile_t* tile = level->tiles + tile_index;
+		if (!tile->exists) continue;
+		while (!tile->is_loaded) {
+			if (!thread_pool_do_work(isyntax->work_submission_pool)) {
+				if (!isyntax_first_load_wait_for_task(streamer)) {
+					break; // not submitted, so it won't load
+				}
+			}
+		}
+	}
+	level->is_fully_loaded = true;
+}
+
 
 // NOTE: The number of levels present in the highest data chunks depends on the highest scale:
 // Highest scale = 8  --> chunk contains levels 6, 7, 8 (most often this is the case)
@@ -113,6 +218,10 @@ static void isyntax_do_first_load(isyntax_streamer_t* streamer) {
 	i32 tiles_loaded = 0;
 	isyntax->total_rgb_transform_time = 0.0f;
 
+	isyntax_first_load_sync_t first_load_sync = {0};
+	first_load_sync.tile_loaded_semaphore = platform_semaphore_create(NULL);
+	streamer->first_load_sync = &first_load_sync;
+
 	i32 scale = wsi->max_scale;
 	isyntax_level_t* current_level = wsi->levels + scale;
 	i32 codeblocks_per_color = isyntax_get_chunk_codeblocks_per_color_for_level(scale, true); // most often 1 + 4 + 16 (for scale n, n-1, n-2) + 1 (LL block)
@@ -126,39 +235,78 @@ static void isyntax_do_first_load(isyntax_streamer_t* streamer) {
 	u8** data_chunks = arena_push_array(temp_memory.arena, current_level->tile_count, u8*);
 	memset(data_chunks, 0, current_level->tile_count * sizeof(u8*));
 
-	// Read codeblock data from disk
-	{
-		i64 start = get_clock();
+	// Keep track of which tiles have been submitted for loading, for each level in the chunk.
+	bool* submitted_tiles[3] = {0};
+	for (i32 i = 0; i < levels_in_chunk; ++i) {
+		isyntax_level_t* level = wsi->levels + (scale - i);
+		submitted_tiles[i] = arena_push_array(temp_memory.arena, level->tile_count, bool);
+		memset(submitted_tiles[i], 0, level->tile_count * sizeof(bool));
+	}
 
-		i32 tile_index = 0;
-		for (i32 tile_y = 0; tile_y < current_level->height_in_tiles; ++tile_y) {
-			for (i32 tile_x = 0; tile_x < current_level->width_in_tiles; ++tile_x, ++tile_index) {
+	// The top level is read and decompressed one row of chunks at a time. Top level tiles are transformed and
+	// published as soon as their neighbors are available, so that a coarse overview becomes visible early on,
+	// while the remaining I/O is still in progress.
+	i64 start_io = get_clock();
+	for (i32 tile_y = 0; tile_y < current_level->height_in_tiles; ++tile_y) {
+		i32 row_start_tile_index = tile_y * current_level->width_in_tiles;
+		i32 row_end_tile_index = row_start_tile_index + current_level->width_in_tiles;
+
+		// Read codeblock data from disk
+		// Chunks that are close together in the file are merged into larger reads.
+		i32 run_first_tile_index = -1;
+		i32 run_last_tile_index = -1;
+		u64 run_offset0 = 0;
+		u64 run_offset1 = 0;
+		for (i32 tile_index = row_start_tile_index; tile_index <= row_end_tile_index; ++tile_index) {
+			u64 offset0 = 0;
+			u64 offset1 = 0;
+			bool is_last = (tile_index == row_end_tile_index);
+			if (!is_last) {
 				isyntax_tile_t* tile = current_level->tiles + tile_index;
 				if (!tile->exists) continue;
 				isyntax_codeblock_t* top_chunk_codeblock = wsi->codeblocks + tile->codeblock_chunk_index;
-				u64 offset0 = top_chunk_codeblock->block_data_offset;
-//				console_print("loading chunk %d\n", tile->codeblock_chunk_index);
-
 				isyntax_codeblock_t* last_codeblock = wsi->codeblocks + tile->codeblock_chunk_index + chunk_codeblock_count - 1;
-				u64 offset1 = last_codeblock->block_data_offset + last_codeblock->block_size;
-				u64 read_size = offset1 - offset0;
-				arena_align(temp_memory.arena, 64);
-				data_chunks[tile_index] = (u8*) arena_push_size(temp_memory.arena, read_size);
-
-				size_t bytes_read = file_handle_read_at_offset(data_chunks[tile_index], isyntax->file_handle, offset0, read_size);
-				if (!(bytes_read > 0)) {
-					console_print_error("Error: could not read iSyntax data at offset %lld (read size %lld)\n", offset0, read_size);
+				offset0 = top_chunk_codeblock->block_data_offset;
+				offset1 = last_codeblock->block_data_offset + last_codeblock->block_size;
+				if (run_first_tile_index >= 0 && offset0 >= run_offset1 &&
+				    offset0 - run_offset1 <= ISYNTAX_COALESCED_READ_MAX_GAP &&
+				    offset1 - run_offset0 <= ISYNTAX_COALESCED_READ_MAX_SIZE) {
+					run_offset1 = offset1;
+					run_last_tile_index = tile_index;
+					continue;
 				}
 			}
+			// Flush the current run
+			if (run_first_tile_index >= 0) {
+				u64 read_size = run_offset1 - run_offset0;
+				size_t safety_bytes = 7; // for bitstream_lsb_read(), which might read past the end of the buffer
+				u8* run_data = mapped_file_get_bytes(&isyntax->mapped_file, run_offset0, read_size + safety_bytes);
+				if (run_data) {
+					mapped_file_advise(&isyntax->mapped_file, run_offset0, read_size, FILE_ACCESS_SEQUENTIAL);
+				} else {
+					arena_align(temp_memory.arena, 64);
+					run_data = (u8*) arena_push_size(temp_memory.arena, read_size + safety_bytes);
+					size_t bytes_read = file_handle_read_at_offset(run_data, isyntax->file_handle, run_offset0, read_size);
+					if (!(bytes_read > 0)) {
+						console_print_error("Error: could not read iSyntax data at offset %lld (read size %lld)\n", run_offset0, read_size);
+					}
+				}
+				for (i32 i = run_first_tile_index; i <= run_last_tile_index; ++i) {
+					isyntax_tile_t* run_tile = current_level->tiles + i;
+					if (!run_tile->exists) continue;
+					u64 chunk_offset = wsi->codeblocks[run_tile->codeblock_chunk_index].block_data_offset;
+					data_chunks[i] = run_data + (chunk_offset - run_offset0);
+				}
+			}
+			run_first_tile_index = tile_index;
+			run_last_tile_index = tile_index;
+			run_offset0 = offset0;
+			run_offset1 = offset1;
 		}
-		float elapsed = get_seconds_elapsed(start, get_clock());
-		console_print_verbose("I/O + decompress: scale=%d  time=%g\n", scale, elapsed);
-	}
 
-	// Decompress the top level tiles
-	i32 tile_index = 0;
-	for (i32 tile_y = 0; tile_y < current_level->height_in_tiles; ++tile_y) {
-		for (i32 tile_x = 0; tile_x < current_level->width_in_tiles; ++tile_x, ++tile_index) {
+		// Decompress the top level tiles in this row
+		for (i32 tile_x = 0; tile_x < current_level->width_in_tiles; ++tile_x) {
+			i32 tile_index = row_start_tile_index + tile_x;
 			isyntax_tile_t* tile = current_level->tiles + tile_index;
 			if (!tile->exists) continue;
 			isyntax_codeblock_t* top_chunk_codeblock = wsi->codeblocks + tile->codeblock_chunk_index;
@@ -186,10 +334,13 @@ static void isyntax_do_first_load(isyntax_streamer_t* streamer) {
 				color_channel->neighbors_loaded = isyntax_get_adjacent_tiles_mask(current_level, tile_x, tile_y);
 			}
 		}
-	}
 
-	// Transform and submit the top level tiles
-	tiles_loaded += isyntax_load_all_tiles_in_level(streamer, scale);
+		// Transform and submit the top level tiles of which all neighbors are now available
+		tiles_loaded += isyntax_first_load_submit_ready_tiles(streamer, scale, submitted_tiles[0], tile_y + 1);
+	}
+	tiles_loaded += isyntax_first_load_all_tiles_in_level(streamer, scale, submitted_tiles[0]);
+	console_print_verbose("I/O + decompress: scale=%d  time=%g\n", scale, get_seconds_elapsed(start_io, get_clock()));
+	i32 tile_index = 0;
 
 	// Decompress and transform the remaining levels in the data chunks.
 	if (levels_in_chunk >= 2) {
@@ -202,10 +353,8 @@ static void isyntax_do_first_load(isyntax_streamer_t* streamer) {
 				tile_index = tile_y * current_level->width_in_tiles + tile_x;
 				isyntax_tile_t* tile = current_level->tiles + tile_index;
 				if (!tile->exists) continue;
-				// LL blocks should already be available (these were 'donated' when we were loading the higher level)
-				ASSERT(tile->color_channels[0].coeff_ll != NULL);
-				ASSERT(tile->color_channels[1].coeff_ll != NULL);
-				ASSERT(tile->color_channels[2].coeff_ll != NULL);
+				// NOTE: the LL blocks are 'donated' by the higher level, which may still be in progress at this point.
+				// Only the H blocks are decompressed here; the transforms wait until the parent tiles are done.
 				isyntax_codeblock_t* top_chunk_codeblock = wsi->codeblocks + tile->codeblock_chunk_index;
 				u64 offset0 = top_chunk_codeblock->block_data_offset;
 
@@ -241,7 +390,7 @@ static void isyntax_do_first_load(isyntax_streamer_t* streamer) {
 			}
 		}
 		// Now do the inverse wavelet transforms
-		tiles_loaded += isyntax_load_all_tiles_in_level(streamer, scale);
+		tiles_loaded += isyntax_first_load_all_tiles_in_level(streamer, scale, submitted_tiles[1]);
 	}
 
 	// Now for the next level down (if present in the chunk)
@@ -256,10 +405,8 @@ static void isyntax_do_first_load(isyntax_streamer_t* streamer) {
 				tile_index = tile_y * current_level->width_in_tiles + tile_x;
 				isyntax_tile_t* tile = current_level->tiles + tile_index;
 				if (!tile->exists) continue;
-				// LL blocks should already be available (these were 'donated' when we were loading the higher level)
-				ASSERT(tile->color_channels[0].coeff_ll != NULL);
-				ASSERT(tile->color_channels[1].coeff_ll != NULL);
-				ASSERT(tile->color_channels[2].coeff_ll != NULL);
+				// NOTE: the LL blocks are 'donated' by the higher level, which may still be in progress at this point.
+				// Only the H blocks are decompressed here; the transforms wait until the parent tiles are done.
 				isyntax_codeblock_t* top_chunk_codeblock = wsi->codeblocks + tile->codeblock_chunk_index;
 				u64 offset0 = top_chunk_codeblock->block_data_offset;
 
@@ -294,9 +441,18 @@ static void isyntax_do_first_load(isyntax_streamer_t* streamer) {
 			}
 		}
 		// Now do the inverse wavelet transforms
-		tiles_loaded += isyntax_load_all_tiles_in_level(streamer, scale);
+		tiles_loaded += isyntax_first_load_all_tiles_in_level(streamer, scale, submitted_tiles[2]);
 	}
 
+	// The coefficients can only be released after all transforms have finished.
+	for (i32 i = 0; i < levels_in_chunk; ++i) {
+		isyntax_first_load_wait_for_level(streamer, wsi->max_scale - i);
+	}
+	// The tasks post the semaphore after marking their tile as loaded, so wait for those last posts as well.
+	isyntax_first_load_wait_for_all_tasks(streamer);
+	streamer->first_load_sync = NULL;
+	platform_semaphore_destroy(first_load_sync.tile_loaded_semaphore);
+
 	console_print("   iSyntax: loading the first %d tiles took %g seconds\n", tiles_loaded, get_seconds_elapsed(start_first_load, get_clock()));
 //	console_print("   total RGB transform time: %g seconds\n", total_rgb_transform_time);
 
@@ -347,10 +503,14 @@ void isyntax_load_tile_task_func(i32 logical_thread_index, void* userdata) {
 		submit_tile_completed(&task->streamer, tile_pixels, task->scale, task->tile_index,
 							  task->streamer.isyntax->tile_width, task->streamer.isyntax->tile_height);
 	}
+	if (task->streamer.first_load_sync) {
+		platform_semaphore_post(task->streamer.first_load_sync->tile_loaded_semaphore);
+	}
 	atomic_decrement(&task->streamer.isyntax->refcount); // release
 }
 
-void isyntax_begin_load_tile(isyntax_streamer_t* streamer, i32 scale, i32 tile_x, i32 tile_y) {
+// Returns true if a task was submitted.
+bool isyntax_begin_load_tile(isyntax_streamer_t* streamer, i32 scale, i32 tile_x, i32 tile_y) {
 	isyntax_t* isyntax = streamer->isyntax;
 	if (!isyntax->work_submission_pool) {
 		fatal_error("isyntax_begin_load_tile(): work_submission_pool not set");
@@ -371,9 +531,11 @@ void isyntax_begin_load_tile(isyntax_streamer_t* streamer, i32 scale, i32 tile_x
 		if (!thread_pool_submit_task(isyntax->work_submission_pool, isyntax_load_tile_task_func, &task, sizeof(task))) {
 			tile->is_submitted_for_loading = false; // chicken out
 			atomic_decrement(&isyntax->refcount);
+			return false;
 		};
+		return true;
 	}
-
+	return false;
 }
 
 void isyntax_first_load_task_func(i32 logical_thread_index, void* userdata) {
@@ -525,6 +687,137 @@ static int chunk_priority_compare_func (const void* a, const void* b) {
 
 #define MAX_CHUNKS_TO_LOAD 512
 
+typedef struct isyntax_chunk_read_task_t {
+	isyntax_t* isyntax;
+	isyntax_image_t* wsi;
+	i32 chunk_count;
+	i32 chunk_indices[ISYNTAX_COALESCED_READ_MAX_CHUNKS];
+} isyntax_chunk_read_task_t;
+
+static u64 isyntax_get_chunk_read_size(isyntax_image_t* wsi, isyntax_data_chunk_t* chunk) {
+	// TODO: use known cluster size instead of ad hoc computation here
+	isyntax_codeblock_t* last_codeblock = wsi->codeblocks + chunk->top_codeblock_index + (chunk->codeblock_count_per_color * 3) - 1;
+	u64 offset1 = last_codeblock->block_data_offset + last_codeblock->block_size;
+	return offset1 - chunk->offset;
+}
+
+// Reads a run of chunks (sorted by offset) with a single read, and gives each chunk its own copy of the data.
+static void isyntax_read_coalesced_chunks(isyntax_t* isyntax, isyntax_image_t* wsi, i32* chunk_indices, i32 chunk_count) {
+	size_t safety_bytes = 7; // allocate extra safety bytes at the end for bitstream_lsb_read(), which might read past the end of the buffer
+	isyntax_data_chunk_t* first_chunk = wsi->data_chunks + chunk_indices[0];
+	isyntax_data_chunk_t* last_chunk = wsi->data_chunks + chunk_indices[chunk_count - 1];
+	u64 offset0 = first_chunk->offset;
+	u64 offset1 = last_chunk->offset + isyntax_get_chunk_read_size(wsi, last_chunk);
+	u64 read_size = offset1 - offset0;
+
+	// If the file is memory-mapped, the chunks are copied straight out of the page cache.
+	u8* mapped_data = mapped_file_get_bytes(&isyntax->mapped_file, offset0, read_size);
+	if (mapped_data) {
+		mapped_file_advise(&isyntax->mapped_file, offset0, read_size, FILE_ACCESS_SEQUENTIAL);
+	}
+
+	if (chunk_count == 1) {
+		u8* data = (u8*)malloc(read_size + safety_bytes);
+		if (mapped_data) {
+			memcpy(data, mapped_data, read_size);
+		} else {
+			size_t bytes_read = file_handle_read_at_offset(data, isyntax->file_handle, offset0, read_size);
+			if (!(bytes_read > 0)) {
+				console_print_error("Error: could not read iSyntax data at offset %lld (read size %lld)\n", offset0, read_size);
+			}
+		}
+		write_barrier;
+		first_chunk->data = data;
+		return;
+	}
+
+	u8* run_data = mapped_data;
+	if (!mapped_data) {
+		run_data = (u8*)malloc(read_size);
+		size_t bytes_read = file_handle_read_at_offset(run_data, isyntax->file_handle, offset0, read_size);
+		if (!(bytes_read > 0)) {
+			console_print_error("Error: could not read iSyntax data at offset %lld (read size %lld)\n", offset0, read_size);
+		}
+	}
+	for (i32 i = 0; i < chunk_count; ++i) {
+		isyntax_data_chunk_t* chunk = wsi->data_chunks + chunk_indices[i];
+		u64 chunk_read_size = isyntax_get_chunk_read_size(wsi, chunk);
+		u8* data = (u8*)malloc(chunk_read_size + safety_bytes);
+		memcpy(data, run_data + (chunk->offset - offset0), chunk_read_size);
+		write_barrier;
+		chunk->data = data;
+	}
+	if (!mapped_data) free(run_data);
+}
+
+static void isyntax_chunk_read_task_func(i32 logical_thread_index, void* userdata) {
+	isyntax_chunk_read_task_t* task = (isyntax_chunk_read_task_t*) userdata;
+	isyntax_read_coalesced_chunks(task->isyntax, task->wsi, task->chunk_indices, task->chunk_count);
+	atomic_decrement(&task->isyntax->refcount); // release
+}
+
+// Groups the requested chunks into coalesced reads. While worker threads are idle, the reads are handed off to them
+// so that I/O runs ahead of (and in parallel with) decoding; the chunks are picked up by a later streamer iteration.
+// Otherwise, the reads happen here, until the time budget for this iteration runs out.
+static void isyntax_read_chunks(isyntax_t* isyntax, isyntax_image_t* wsi, isyntax_chunk_load_task_t* chunks_to_load, u32 chunks_to_load_count) {
+	// Sorting read operations by offset to improve read performance
+	qsort(chunks_to_load, chunks_to_load_count, sizeof(chunks_to_load[0]), chunk_index_compare_func);
+
+	i64 clock_io_start = get_clock();
+	isyntax_chunk_read_task_t task = {0};
+	task.isyntax = isyntax;
+	task.wsi = wsi;
+	u64 run_offset0 = 0;
+	u64 run_offset1 = 0;
+	for (u32 i = 0; i <= chunks_to_load_count; ++i) {
+		isyntax_data_chunk_t* chunk = NULL;
+		if (i < chunks_to_load_count) {
+			chunk = wsi->data_chunks + chunks_to_load[i].index;
+			if (chunk->data || chunk->is_submitted_for_loading) continue;
+			u64 offset0 = chunk->offset;
+			u64 offset1 = offset0 + isyntax_get_chunk_read_size(wsi, chunk);
+			if (task.chunk_count > 0 && task.chunk_count < ISYNTAX_COALESCED_READ_MAX_CHUNKS &&
+			    offset0 >= run_offset1 && offset0 - run_offset1 <= ISYNTAX_COALESCED_READ_MAX_GAP &&
+			    offset1 - run_offset0 <= ISYNTAX_COALESCED_READ_MAX_SIZE) {
+				chunk->is_submitted_for_loading = true;
+				task.chunk_indices[task.chunk_count++] = chunks_to_load[i].index;
+				run_offset1 = offset1;
+				continue;
+			}
+		}
+		// Flush the current run
+		if (task.chunk_count > 0) {
+			bool submitted = false;
+			if (thread_pool_get_idle_worker_thread_count(isyntax->work_submission_pool) > 0) {
+				atomic_increment(&isyntax->refcount); // retain; don't destroy isyntax while busy
+				submitted = thread_pool_submit_task(isyntax->work_submission_pool, isyntax_chunk_read_task_func, &task, sizeof(task));
+				if (!submitted) {
+					atomic_decrement(&isyntax->refcount); // chicken out
+				}
+			}
+			if (!submitted) {
+				float seconds_elapsed_io = get_seconds_elapsed(clock_io_start, get_clock());
+				if (seconds_elapsed_io > 0.2f) {
+					console_print_verbose("Loaded chunks until offset %lld before timing out\n", run_offset0);
+					for (i32 j = 0; j < task.chunk_count; ++j) {
+						wsi->data_chunks[task.chunk_indices[j]].is_submitted_for_loading = false;
+					}
+					break;
+				}
+				isyntax_read_coalesced_chunks(isyntax, wsi, task.chunk_indices, task.chunk_count);
+			}
+			task.chunk_count = 0;
+		}
+		if (chunk) {
+			chunk->is_submitted_for_loading = true;
+			task.chunk_indices[task.chunk_count++] = chunks_to_load[i].index;
+			run_offset0 = chunk->offset;
+			run_offset1 = run_offset0 + isyntax_get_chunk_read_size(wsi, chunk);
+		}
+	}
+}
+
+
 void isyntax_mark_tile_for_full_loading_and_set_adjacent_requirements(isyntax_load_region_t* region, isyntax_level_t* level, i32 tile_x, i32 tile_y) {
 	u32 adjacent = isyntax_get_adjacent_tiles_mask_only_existing(level, tile_x, tile_y);
 	i32 local_tile_x = tile_x - region->offset.x;
@@ -850,7 +1143,7 @@ void isyntax_stream_image_tiles(isyntax_streamer_t* streamer, isyntax_t* isyntax
 							if (req->need_h_coeff && !tile->has_h) {
 								u32 chunk_index = tile->data_chunk_index;
 								isyntax_data_chunk_t* chunk = wsi->data_chunks + chunk_index;
-								if (chunk->data == NULL) {
+								if (chunk->data == NULL && !chunk->is_submitted_for_loading) {
 									bool already_in_list = false;
 									for (i32 i = 0; i < chunks_to_load_count; ++i) {
 										if (chunks_to_load[i].index == chunk_index) {
@@ -876,36 +1169,7 @@ void isyntax_stream_image_tiles(isyntax_streamer_t* streamer, isyntax_t* isyntax
 //					console_print("Wanting to load %d chunks\n", chunks_to_load_count);
 //				}
 
-				// Sorting read operations by offset to improve read performance
-				qsort(chunks_to_load, chunks_to_load_count, sizeof(chunks_to_load[0]), chunk_index_compare_func);
-
-				i64 clock_io_start = get_clock();
-				i32 chunks_loaded = 0;
-				for (i32 i = 0; i < chunks_to_load_count; ++i) {
-					u32 chunk_index = chunks_to_load[i].index;
-					isyntax_data_chunk_t * chunk = wsi->data_chunks + chunk_index;
-					if (!chunk->data) {
-						// TODO: use known cluster size instead of ad hoc computation here
-						isyntax_codeblock_t* last_codeblock = wsi->codeblocks + chunk->top_codeblock_index + (chunk->codeblock_count_per_color * 3) - 1;
-						u64 offset1 = last_codeblock->block_data_offset + last_codeblock->block_size;
-						u64 read_size = offset1 - chunk->offset;
-						size_t safety_bytes = 7; // allocate extra safety bytes at the end for bitstream_lsb_read(), which might read past the end of the buffer
-						chunk->data = (u8*)malloc(read_size + safety_bytes);
-//				        console_print("loading chunk %d\n", chunk_index);
-
-						size_t bytes_read = file_handle_read_at_offset(chunk->data, isyntax->file_handle, chunk->offset, read_size);
-						if (!(bytes_read > 0)) {
-							console_print_error("Error: could not read iSyntax data at offset %lld (read size %lld)\n", chunk->offset, read_size);
-						}
-
-						++chunks_loaded;
-						float seconds_elapsed_io = get_seconds_elapsed(clock_io_start, get_clock());
-						if (seconds_elapsed_io > 0.2f) {
-					        console_print_verbose("Loaded %d chunks before timing out\n", i+1);
-					        break;
-						}
-					}
-				}
+				isyntax_read_chunks(isyntax, wsi, chunks_to_load, chunks_to_load_count);
 
 				// Flag all tiles in the target level as wanted for loading
 				// (We have prioritized loading at least 1 tile, but we don't mind loading more if we have the chunks available!)
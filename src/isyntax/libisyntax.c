@@ -291,6 +291,7 @@ isyntax_error_t libisyntax_cache_create(const char* debug_name_or_null, int32_t
     tile_list_init(&cache_ptr->cache_list, debug_name_or_null);
     cache_ptr->target_cache_size = cache_size;
     platform_mutex_init(&cache_ptr->mutex);
+    cache_ptr->batch_completed_semaphore = platform_semaphore_create(NULL);
 
     // Note: rest of initialization is deferred to the first injection, as that is where we will know the block size.
 
@@ -353,6 +354,7 @@ void libisyntax_cache_destroy(isyntax_cache_t* isyntax_cache) {
     }
 
     platform_mutex_destroy(&isyntax_cache->mutex);
+    platform_semaphore_destroy(isyntax_cache->batch_completed_semaphore);
     free(isyntax_cache);
 }
 
@@ -372,7 +374,37 @@ isyntax_error_t libisyntax_tile_read(isyntax_t* isyntax, isyntax_cache_t* isynta
     return LIBISYNTAX_OK;
 }
 
+isyntax_error_t libisyntax_read_tiles(isyntax_t* isyntax, isyntax_cache_t* isyntax_cache, int32_t level,
+                                      int32_t tile_count, const int64_t* tiles_x, const int64_t* tiles_y,
+                                      uint32_t** pixels_buffers, int32_t pixel_format) {
+    if (pixel_format <= _LIBISYNTAX_PIXEL_FORMAT_START || pixel_format >= _LIBISYNTAX_PIXEL_FORMAT_END) {
+        return LIBISYNTAX_INVALID_ARGUMENT;
+    }
+    if (tile_count < 0 || (tile_count > 0 && (tiles_x == NULL || tiles_y == NULL || pixels_buffers == NULL))) {
+        return LIBISYNTAX_INVALID_ARGUMENT;
+    }
+    if (tile_count == 0) {
+        return LIBISYNTAX_OK;
+    }
+    isyntax_tiles_read(isyntax, isyntax_cache, level, tile_count, tiles_x, tiles_y, pixels_buffers, pixel_format);
+    return LIBISYNTAX_OK;
+}
+
+isyntax_error_t libisyntax_read_all_tiles(isyntax_t* isyntax, isyntax_cache_t* isyntax_cache, int32_t pixel_format,
+                                          libisyntax_tile_callback_t callback, void* userdata) {
+    if (pixel_format <= _LIBISYNTAX_PIXEL_FORMAT_START || pixel_format >= _LIBISYNTAX_PIXEL_FORMAT_END) {
+        return LIBISYNTAX_INVALID_ARGUMENT;
+    }
+    if (callback == NULL) {
+        return LIBISYNTAX_INVALID_ARGUMENT;
+    }
+    isyntax_stream_all_tiles(isyntax, isyntax_cache, pixel_format, callback, userdata);
+    return LIBISYNTAX_OK;
+}
+
 #define PER_LEVEL_PADDING 3
+// Maximum number of tiles decoded in one libisyntax_read_tiles() call by libisyntax_read_region().
+#define READ_REGION_MAX_BATCH_TILES 64
 
 isyntax_error_t libisyntax_read_region(isyntax_t* isyntax, isyntax_cache_t* isyntax_cache, int32_t level,
                                        int64_t x, int64_t y, int64_t width, int64_t height, uint32_t* pixels_buffer,
@@ -430,37 +462,78 @@ isyntax_error_t libisyntax_read_region(isyntax_t* isyntax, isyntax_cache_t* isyn
         y_remainder_last = ((y + height - 1) % tile_height + tile_height) % tile_height;
     }
 
-    // Allocate memory for tile pixels (will reuse for consecutive libisyntax_tile_read() calls)
-    uint32_t* tile_pixels = (uint32_t*)malloc(tile_width * tile_height * sizeof(uint32_t));
-
-    // Read tiles and copy the relevant portion of each tile to the region
-    for (int64_t tile_y = start_tile_y; tile_y <= end_tile_y; ++tile_y) {
-        for (int64_t tile_x = start_tile_x; tile_x <= end_tile_x; ++tile_x) {
-            // Calculate the portion of the tile to be copied
-            int64_t src_x = (tile_x == start_tile_x) ? x_remainder : 0;
-            int64_t src_y = (tile_y == start_tile_y) ? y_remainder : 0;
-            int64_t dest_x = (tile_x == start_tile_x) ? 0 : (tile_x - start_tile_x) * tile_width - x_remainder;
-            int64_t dest_y = (tile_y == start_tile_y) ? 0 : (tile_y - start_tile_y) * tile_height - y_remainder;
-            int64_t copy_width = (tile_x == end_tile_x) ? x_remainder_last - src_x + 1 : tile_width - src_x;
-            int64_t copy_height = (tile_y == end_tile_y) ? y_remainder_last - src_y + 1 : tile_height - src_y;
-
-            // Read tile
-            CHECK_LIBISYNTAX_OK(libisyntax_tile_read(isyntax, isyntax_cache, level, tile_x, tile_y, tile_pixels, pixel_format));
-
-            // Copy the relevant portion of the tile to the region
-            for (int64_t i = 0; i < copy_height; ++i) {
-                int64_t dest_index = (dest_y + i) * width + dest_x;
-                int64_t src_index = (src_y + i) * tile_width + src_x;
-                memcpy((pixels_buffer) + dest_index,
-                       tile_pixels + src_index,
-                       copy_width * sizeof(uint32_t));
+    // Tiles are read in batches (rows of tiles, or parts of rows for very wide regions), so that shared parent tiles
+    // only need to be decoded once and the tiles within a batch can be decoded in parallel.
+    int64_t tiles_per_row = end_tile_x - start_tile_x + 1;
+    int32_t batch_capacity = (int32_t)MIN(tiles_per_row, READ_REGION_MAX_BATCH_TILES);
+    size_t tile_buffer_size = tile_width * tile_height * sizeof(uint32_t);
+    uint32_t* batch_pixels = (uint32_t*)malloc(batch_capacity * tile_buffer_size);
+    uint32_t** batch_pixels_buffers = (uint32_t**)malloc(batch_capacity * sizeof(uint32_t*));
+    int64_t* batch_tiles_x = (int64_t*)malloc(batch_capacity * sizeof(int64_t));
+    int64_t* batch_tiles_y = (int64_t*)malloc(batch_capacity * sizeof(int64_t));
+    for (int32_t i = 0; i < batch_capacity; ++i) {
+        batch_pixels_buffers[i] = batch_pixels + i * (tile_width * tile_height);
+    }
+
+    isyntax_error_t result = LIBISYNTAX_OK;
+    for (int64_t tile_y = start_tile_y; tile_y <= end_tile_y && result == LIBISYNTAX_OK; ++tile_y) {
+        for (int64_t batch_start_x = start_tile_x; batch_start_x <= end_tile_x; batch_start_x += batch_capacity) {
+            int32_t batch_count = (int32_t)MIN(end_tile_x - batch_start_x + 1, batch_capacity);
+            for (int32_t i = 0; i < batch_count; ++i) {
+                batch_tiles_x[i] = batch_start_x + i;
+                batch_tiles_y[i] = tile_y;
+            }
+
+            // Read tiles
+            result = libisyntax_read_tiles(isyntax, isyntax_cache, level, batch_count, batch_tiles_x, batch_tiles_y,
+                                           batch_pixels_buffers, pixel_format);
+            if (result != LIBISYNTAX_OK) {
+                break;
+            }
+
+            // Copy the relevant portion of each tile to the region
+            for (int32_t batch_index = 0; batch_index < batch_count; ++batch_index) {
+                int64_t tile_x = batch_tiles_x[batch_index];
+                uint32_t* tile_pixels = batch_pixels_buffers[batch_index];
+                // Calculate the portion of the tile to be copied
+                int64_t src_x = (tile_x == start_tile_x) ? x_remainder : 0;
+                int64_t src_y = (tile_y == start_tile_y) ? y_remainder : 0;
+                int64_t dest_x = (tile_x == start_tile_x) ? 0 : (tile_x - start_tile_x) * tile_width - x_remainder;
+                int64_t dest_y = (tile_y == start_tile_y) ? 0 : (tile_y - start_tile_y) * tile_height - y_remainder;
+                int64_t copy_width = (tile_x == end_tile_x) ? x_remainder_last - src_x + 1 : tile_width - src_x;
+                int64_t copy_height = (tile_y == end_tile_y) ? y_remainder_last - src_y + 1 : tile_height - src_y;
+
+                for (int64_t i = 0; i < copy_height; ++i) {
+                    int64_t dest_index = (dest_y + i) * width + dest_x;
+                    int64_t src_index = (src_y + i) * tile_width + src_x;
+                    memcpy((pixels_buffer) + dest_index,
+                           tile_pixels + src_index,
+                           copy_width * sizeof(uint32_t));
+                }
             }
         }
     }
 
-    free(tile_pixels);
+    free(batch_pixels);
+    free(batch_pixels_buffers);
+    free(batch_tiles_x);
+    free(batch_tiles_y);
 
-    return LIBISYNTAX_OK;
+    return result;
+}
+
+void libisyntax_get_timings(const isyntax_t* isyntax, libisyntax_timings_t* out_timings) {
+    out_timings->io_seconds = get_seconds_elapsed(0, isyntax->total_io_ticks);
+    out_timings->hulsken_seconds = get_seconds_elapsed(0, isyntax->total_hulsken_ticks);
+    out_timings->idwt_seconds = get_seconds_elapsed(0, isyntax->total_idwt_ticks);
+    out_timings->color_conversion_seconds = get_seconds_elapsed(0, isyntax->total_color_conversion_ticks);
+}
+
+void libisyntax_reset_timings(isyntax_t* isyntax) {
+    isyntax->total_io_ticks = 0;
+    isyntax->total_hulsken_ticks = 0;
+    isyntax->total_idwt_ticks = 0;
+    isyntax->total_color_conversion_ticks = 0;
 }
 
 // TODO(pvalkema): remove this / only support returning compressed JPEG buffer and leave decompression to caller?
@@ -119,10 +119,36 @@ void            libisyntax_cache_destroy(isyntax_cache_t* isyntax_cache);
 isyntax_error_t libisyntax_tile_read(isyntax_t* isyntax, isyntax_cache_t* isyntax_cache,
                                      int32_t level, int64_t tile_x, int64_t tile_y,
                                      uint32_t* pixels_buffer, int32_t pixel_format);
+// Reads multiple tiles of the same level in one call. tiles_x[i], tiles_y[i] is decoded into pixels_buffers[i]; each
+// buffer should be [tile_width * tile_height * 4]. Tiles that share parents are decoded together, so this is faster
+// than calling `libisyntax_tile_read()` for each tile separately. Out of bounds tiles are filled with white.
+isyntax_error_t libisyntax_read_tiles(isyntax_t* isyntax, isyntax_cache_t* isyntax_cache, int32_t level,
+                                      int32_t tile_count, const int64_t* tiles_x, const int64_t* tiles_y,
+                                      uint32_t** pixels_buffers, int32_t pixel_format);
 isyntax_error_t libisyntax_read_region(isyntax_t* isyntax, isyntax_cache_t* isyntax_cache, int32_t level,
                                        int64_t x, int64_t y, int64_t width, int64_t height, uint32_t* pixels_buffer,
                                        int32_t pixel_format);
 
+// Decodes every tile of the slide in a single sequential pass, for example for converting a whole slide. Each tile is
+// decoded exactly once and passed to the callback (on the calling thread); the pixels are only valid during the call.
+// Tiles arrive level by level in row order, interleaved such that parent rows always come before their children.
+// Only a band of a few rows of coefficients per level is kept in memory. The cache is emptied before starting.
+typedef void (*libisyntax_tile_callback_t)(void* userdata, int32_t level, int64_t tile_x, int64_t tile_y,
+                                           const uint32_t* pixels_buffer);
+isyntax_error_t libisyntax_read_all_tiles(isyntax_t* isyntax, isyntax_cache_t* isyntax_cache, int32_t pixel_format,
+                                          libisyntax_tile_callback_t callback, void* userdata);
+
+
+//== Timing API ==
+// Accumulated time spent in each stage of decoding tiles, summed over all threads (so this may exceed wall clock time).
+typedef struct libisyntax_timings_t {
+    double io_seconds;
+    double hulsken_seconds;
+    double idwt_seconds;
+    double color_conversion_seconds;
+} libisyntax_timings_t;
+void libisyntax_get_timings(const isyntax_t* isyntax, libisyntax_timings_t* out_timings);
+void libisyntax_reset_timings(isyntax_t* isyntax);
 
 isyntax_error_t libisyntax_read_label_image(isyntax_t* isyntax, int32_t* width, int32_t* height,
                                                    uint32_t** pixels_buffer, int32_t pixel_format);
@@ -538,32 +538,45 @@ bool mrxs_read_nonhier_first_entry(mem_t* index_dat, mrxs_nonhier_entry_t* out_e
     return false;
 }
 
+// Returns the bytes of an entry in one of the .dat files. If the .dat file is memory-mapped, this points straight into
+// the mapping (read-only); otherwise the bytes are read into temporary memory. Returns NULL if the read fails.
+static u8* mrxs_read_dat_entry(mrxs_t* mrxs, u32 file, u32 offset, u32 length, temp_memory_t* temp) {
+    if (!mrxs->dat_file_handles || file >= (u32)mrxs->dat_count || !mrxs->dat_file_handles[file]) {
+        return NULL;
+    }
+    if (mrxs->dat_mapped_files) {
+        u8* mapped = mapped_file_get_bytes(mrxs->dat_mapped_files + file, offset, length);
+        if (mapped) {
+            return mapped;
+        }
+    }
+    u8* data = (u8*)arena_push_size(temp->arena, length);
+    size_t bytes_read = file_handle_read_at_offset(data, mrxs->dat_file_handles[file], offset, length);
+    return (bytes_read == length) ? data : NULL;
+}
+
 bool mrxs_load_slide_position_file(mrxs_t* mrxs) {
     mrxs_nonhier_entry_t entry = mrxs->stitching_intensity_layer_entry;
     bool success = false;
     if (entry.length == 0 || !mrxs->dat_file_handles) {
         return false;
     }
-    file_handle_t file_handle = mrxs->dat_file_handles[entry.file];
-    if (file_handle) {
-        temp_memory_t temp = begin_temp_memory_on_local_thread();
-        u8* compressed_data = (u8*)arena_push_size(temp.arena, entry.length);
-        size_t bytes_read = file_handle_read_at_offset(compressed_data, file_handle, entry.offset, entry.length);
-        if (bytes_read == entry.length) {
-            size_t out_len = 0;
-            int flags = TINFL_FLAG_PARSE_ZLIB_HEADER;
-            mrxs_slide_position_t* position_file = tinfl_decompress_mem_to_heap(compressed_data, entry.length, &out_len, flags);
-            ASSERT(sizeof(mrxs_slide_position_t) == 9);
-            if (out_len % sizeof(mrxs_slide_position_t) == 0) {
-                mrxs->camera_positions = position_file;
-                mrxs->camera_position_count = out_len / sizeof(mrxs_slide_position_t);
-                success = true;
-            } else {
-                libc_free(position_file); // error: length not a multiple
-            }
+    temp_memory_t temp = begin_temp_memory_on_local_thread();
+    u8* compressed_data = mrxs_read_dat_entry(mrxs, entry.file, entry.offset, entry.length, &temp);
+    if (compressed_data) {
+        size_t out_len = 0;
+        int flags = TINFL_FLAG_PARSE_ZLIB_HEADER;
+        mrxs_slide_position_t* position_file = tinfl_decompress_mem_to_heap(compressed_data, entry.length, &out_len, flags);
+        ASSERT(sizeof(mrxs_slide_position_t) == 9);
+        if (out_len % sizeof(mrxs_slide_position_t) == 0) {
+            mrxs->camera_positions = position_file;
+            mrxs->camera_position_count = out_len / sizeof(mrxs_slide_position_t);
+            success = true;
+        } else {
+            libc_free(position_file); // error: length not a multiple
         }
-        release_temp_memory(&temp);
     }
+    release_temp_memory(&temp);
 
     /*if (success) {
         for (i32 i = 0; i < mrxs->camera_position_count; ++i) {
@@ -812,6 +825,9 @@ bool mrxs_open_from_directory(mrxs_t* mrxs, file_info_t* file, directory_info_t*
 	if (success) {
 		ASSERT(mrxs->dat_filenames && mrxs->dat_count > 0);
 		mrxs->dat_file_handles = malloc(mrxs->dat_count * sizeof(file_handle_t));
+		if (use_memory_mapped_files) {
+			mrxs->dat_mapped_files = calloc(mrxs->dat_count, sizeof(mapped_file_t));
+		}
 		//TODO: measure performance, maybe move to worker threads?
 		for (i32 i = 0; i < mrxs->dat_count; ++i) {
 			const char* dat_filename = mrxs->dat_filenames[i];
@@ -825,6 +841,9 @@ bool mrxs_open_from_directory(mrxs_t* mrxs, file_info_t* file, directory_info_t*
 				break;
 			}
 			mrxs->dat_file_handles[i] = file_handle;
+			if (mrxs->dat_mapped_files) {
+				mapped_file_open(mrxs->dat_mapped_files + i, file_handle, FILE_ACCESS_RANDOM);
+			}
 		}
 
         console_print_verbose("Opening file handles to %d dat files took %g seconds.\n", mrxs->dat_count, get_seconds_elapsed(clock_index_loaded, get_clock()));
@@ -907,25 +926,21 @@ u8* mrxs_decode_simple_image_to_rgba(mrxs_t* mrxs, mrxs_simple_image_t* image) {
     }
 
     u8* result = NULL;
-    file_handle_t file_handle = mrxs->dat_file_handles[image->entry.file];
-    if (file_handle) {
-        temp_memory_t temp = begin_temp_memory_on_local_thread();
-        u8* compressed_data = (u8*)arena_push_size(temp.arena, image->entry.length);
-        size_t bytes_read = file_handle_read_at_offset(compressed_data, file_handle, image->entry.offset, image->entry.length);
-        if (bytes_read == image->entry.length) {
-            i32 width = 0;
-            i32 height = 0;
-            i32 channels_in_file = 0;
-            result = stbi_load_from_memory(compressed_data, image->entry.length, &width, &height, &channels_in_file, 4);
-            if (!result || width != image->width || height != image->height) {
-                if (result) {
-                    stbi_image_free(result);
-                    result = NULL;
-                }
+    temp_memory_t temp = begin_temp_memory_on_local_thread();
+    u8* compressed_data = mrxs_read_dat_entry(mrxs, image->entry.file, image->entry.offset, image->entry.length, &temp);
+    if (compressed_data) {
+        i32 width = 0;
+        i32 height = 0;
+        i32 channels_in_file = 0;
+        result = stbi_load_from_memory(compressed_data, image->entry.length, &width, &height, &channels_in_file, 4);
+        if (!result || width != image->width || height != image->height) {
+            if (result) {
+                stbi_image_free(result);
+                result = NULL;
             }
         }
-        release_temp_memory(&temp);
     }
+    release_temp_memory(&temp);
     return result;
 }
 
@@ -938,23 +953,52 @@ static u8* mrxs_decode_stored_tile_to_bgra(mrxs_t* mrxs, i32 level, i32 stored_t
     if (stored_tile_index >= 0 && stored_tile_index < mrxs_level->width_in_tiles * mrxs_level->height_in_tiles) {
         mrxs_tile_t* tile = mrxs_level->tiles + stored_tile_index;
         mrxs_hier_entry_t hier_entry = tile->hier_entry;
-        if (mrxs->dat_file_handles && hier_entry.length > 0 && hier_entry.file < mrxs->dat_count) {
-            file_handle_t file_handle = mrxs->dat_file_handles[hier_entry.file];
-            if (file_handle) {
-                temp_memory_t temp = begin_temp_memory_on_local_thread();
-                u8* compressed_tile_data = (u8*)arena_push_size(temp.arena, hier_entry.length);
-                size_t bytes_read = file_handle_read_at_offset(compressed_tile_data, file_handle, hier_entry.offset, hier_entry.length);
-                if (bytes_read == hier_entry.length) {
-                    result = mrxs_decode_image_to_bgra(compressed_tile_data, hier_entry.length, mrxs_level->image_format,
-                                                       mrxs_level->tile_width, mrxs_level->tile_height);
-                }
-                release_temp_memory(&temp);
+        if (hier_entry.length > 0) {
+            temp_memory_t temp = begin_temp_memory_on_local_thread();
+            u8* compressed_tile_data = mrxs_read_dat_entry(mrxs, hier_entry.file, hier_entry.offset, hier_entry.length, &temp);
+            if (compressed_tile_data) {
+                result = mrxs_decode_image_to_bgra(compressed_tile_data, hier_entry.length, mrxs_level->image_format,
+                                                   mrxs_level->tile_width, mrxs_level->tile_height);
             }
+            release_temp_memory(&temp);
         }
     }
     return result;
 }
 
+// Stored tiles can be decoded partially, if they do not need to be composited from overlapping camera tiles.
+bool mrxs_can_decode_tile_region(mrxs_t* mrxs, i32 level) {
+    if (!(level >= 0 && level < mrxs->level_count)) {
+        return false;
+    }
+    bool uses_stored_tiles = !mrxs->has_overlapping_tiles || !mrxs->cameras;
+    return uses_stored_tiles && mrxs->levels[level].image_format == MRXS_IMAGE_FORMAT_JPEG;
+}
+
+// Decodes only the part of a tile that intersects the given region, at its own position in the BGRA destination.
+bool mrxs_decode_tile_region_to_bgra(mrxs_t* mrxs, i32 level, i32 tile_index, u8* dest, i32 dest_pitch,
+                                     i32 region_x, i32 region_y, i32 region_width, i32 region_height) {
+    if (!mrxs_can_decode_tile_region(mrxs, level)) {
+        return false;
+    }
+    bool success = false;
+    mrxs_level_t* mrxs_level = mrxs->levels + level;
+    if (tile_index >= 0 && tile_index < mrxs_level->width_in_tiles * mrxs_level->height_in_tiles) {
+        mrxs_hier_entry_t hier_entry = mrxs_level->tiles[tile_index].hier_entry;
+        if (hier_entry.length > 0) {
+            temp_memory_t temp = begin_temp_memory_on_local_thread();
+            u8* compressed_tile_data = mrxs_read_dat_entry(mrxs, hier_entry.file, hier_entry.offset, hier_entry.length, &temp);
+            if (compressed_tile_data) {
+                jpeg_region_t region = {region_x, region_y, region_width, region_height};
+                success = jpeg_decode_image_region(compressed_tile_data, hier_entry.length, dest, dest_pitch,
+                                                   mrxs_level->tile_width, mrxs_level->tile_height, region);
+            }
+            release_temp_memory(&temp);
+        }
+    }
+    return success;
+}
+
 void mrxs_init_runtime_cache(mrxs_t* mrxs) {
     if (!mrxs->decoded_tile_cache_mutex_initialized) {
         platform_mutex_init(&mrxs->decoded_tile_cache_mutex);
@@ -1499,6 +1543,12 @@ void mrxs_destroy(mrxs_t* mrxs) {
 		}
 		free(mrxs->dat_file_handles);
 	}
+	if (mrxs->dat_mapped_files) {
+		for (i32 i = 0; i < mrxs->dat_count; ++i) {
+			mapped_file_close(mrxs->dat_mapped_files + i);
+		}
+		free(mrxs->dat_mapped_files);
+	}
 	memrw_destroy(&mrxs->string_pool);
 	if (mrxs->dat_filenames) {
 		free(mrxs->dat_filenames);
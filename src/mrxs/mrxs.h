@@ -190,6 +190,7 @@ typedef struct mrxs_t {
     const char* index_dat_filename;
     const char** dat_filenames; // NOTE: need free
 	file_handle_t* dat_file_handles; // NOTE: need free
+	mapped_file_t* dat_mapped_files; // NOTE: need free; only mapped if use_memory_mapped_files is set and the files are local
     i32 dat_count;
     i32 hier_count;
     i32 nonhier_count;
@@ -246,6 +247,9 @@ bool mrxs_open_from_directory(mrxs_t* mrxs, file_info_t* file, directory_info_t*
 void mrxs_init_runtime_cache(mrxs_t* mrxs);
 u8* mrxs_decode_simple_image_to_rgba(mrxs_t* mrxs, mrxs_simple_image_t* image);
 u8* mrxs_decode_tile_to_bgra(mrxs_t* mrxs, i32 level, i32 tile_index);
+bool mrxs_can_decode_tile_region(mrxs_t* mrxs, i32 level);
+bool mrxs_decode_tile_region_to_bgra(mrxs_t* mrxs, i32 level, i32 tile_index, u8* dest, i32 dest_pitch,
+                                     i32 region_x, i32 region_y, i32 region_width, i32 region_height);
 void mrxs_set_thread_pool(mrxs_t* mrxs, thread_pool_t* thread_pool);
 void mrxs_destroy(mrxs_t* mrxs);
 
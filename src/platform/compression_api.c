@@ -0,0 +1,278 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "platform.h"
+#include "intrinsics.h"
+
+#include "compression_api.h"
+#include "webp_api.h"
+
+// Not declared in the header section of stb_image_write.h (the implementation is compiled in phasecorrelate.c).
+unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len, int quality);
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+zstd_encoder_api zstd_encoder;
+libdeflate_api libdeflate;
+
+#ifdef _WIN32
+typedef HMODULE library_handle_t;
+#define GET_PROC(api, proc, name) if (!(*(void**)&api.proc = (void*) GetProcAddress(library_handle, name))) goto failed;
+#else
+typedef void* library_handle_t;
+#define GET_PROC(api, proc, name) if (!(*(void**)&api.proc = dlsym(library_handle, name))) goto failed;
+#endif
+
+static library_handle_t load_first_library(const char** library_filenames, i32 library_filename_count) {
+	library_handle_t library_handle = NULL;
+	for (i32 i = 0; i < library_filename_count && !library_handle; ++i) {
+#ifdef _WIN32
+		library_handle = LoadLibraryA(library_filenames[i]);
+#else
+		library_handle = dlopen(library_filenames[i], RTLD_LAZY);
+#endif
+	}
+	return library_handle;
+}
+
+static bool zstd_encoder_load_library(void) {
+#ifdef _WIN32
+	const char* library_filenames[] = { "libzstd.dll", "zstd.dll" };
+#elif defined(__APPLE__)
+	const char* library_filenames[] = { "libzstd.dylib", "libzstd.1.dylib", "/opt/homebrew/opt/zstd/lib/libzstd.dylib",
+	                                     "/usr/local/opt/zstd/lib/libzstd.dylib", "/opt/local/lib/libzstd.dylib" };
+#else
+	const char* library_filenames[] = { "libzstd.so.1", "libzstd.so", "/usr/local/lib/libzstd.so" };
+#endif
+	library_handle_t library_handle = load_first_library(library_filenames, COUNT(library_filenames));
+	if (library_handle) {
+		GET_PROC(zstd_encoder, compress, "ZSTD_compress");
+		GET_PROC(zstd_encoder, compressBound, "ZSTD_compressBound");
+		GET_PROC(zstd_encoder, isError, "ZSTD_isError");
+		console_print_verbose("libzstd initialized\n");
+		return true;
+	}
+	failed:
+	memset(&zstd_encoder, 0, sizeof(zstd_encoder));
+	console_print("Zstd compression not available: could not load libzstd (not installed?)\n");
+	return false;
+}
+
+static bool libdeflate_load_library(void) {
+#ifdef _WIN32
+	const char* library_filenames[] = { "libdeflate.dll", "deflate.dll" };
+#elif defined(__APPLE__)
+	const char* library_filenames[] = { "libdeflate.dylib", "libdeflate.0.dylib", "/opt/homebrew/opt/libdeflate/lib/libdeflate.dylib",
+	                                     "/usr/local/opt/libdeflate/lib/libdeflate.dylib", "/opt/local/lib/libdeflate.dylib" };
+#else
+	const char* library_filenames[] = { "libdeflate.so.0", "libdeflate.so", "/usr/local/lib/libdeflate.so" };
+#endif
+	library_handle_t library_handle = load_first_library(library_filenames, COUNT(library_filenames));
+	if (library_handle) {
+		GET_PROC(libdeflate, alloc_compressor, "libdeflate_alloc_compressor");
+		GET_PROC(libdeflate, zlib_compress, "libdeflate_zlib_compress");
+		GET_PROC(libdeflate, zlib_compress_bound, "libdeflate_zlib_compress_bound");
+		GET_PROC(libdeflate, free_compressor, "libdeflate_free_compressor");
+		console_print_verbose("libdeflate initialized\n");
+		return true;
+	}
+	failed:
+	memset(&libdeflate, 0, sizeof(libdeflate));
+	console_print_verbose("libdeflate not available, falling back to the built-in Deflate encoder (slower)\n");
+	return false;
+}
+
+#undef GET_PROC
+
+static platform_mutex_t compression_init_mutex = PLATFORM_MUTEX_INITIALIZER;
+static volatile bool zstd_encoder_init_attempted;
+static volatile bool zstd_encoder_available;
+static volatile bool libdeflate_init_attempted;
+static volatile bool libdeflate_available;
+
+bool init_zstd_encoder(void) {
+	if (!zstd_encoder_init_attempted) {
+		platform_mutex_lock(&compression_init_mutex);
+		if (!zstd_encoder_init_attempted) {
+			zstd_encoder_available = zstd_encoder_load_library();
+			write_barrier;
+			zstd_encoder_init_attempted = true;
+		}
+		platform_mutex_unlock(&compression_init_mutex);
+	}
+	return zstd_encoder_available;
+}
+
+bool init_libdeflate(void) {
+	if (!libdeflate_init_attempted) {
+		platform_mutex_lock(&compression_init_mutex);
+		if (!libdeflate_init_attempted) {
+			libdeflate_available = libdeflate_load_library();
+			write_barrier;
+			libdeflate_init_attempted = true;
+		}
+		platform_mutex_unlock(&compression_init_mutex);
+	}
+	return libdeflate_available;
+}
+
+const char* get_export_compression_name(export_compression_enum compression) {
+	switch (compression) {
+		case EXPORT_COMPRESSION_JPEG: return "JPEG";
+		case EXPORT_COMPRESSION_DEFLATE: return "Deflate";
+		case EXPORT_COMPRESSION_ZSTD: return "Zstd";
+		case EXPORT_COMPRESSION_WEBP: return "WebP";
+		case EXPORT_COMPRESSION_WEBP_LOSSLESS: return "WebP (lossless)";
+		default: return "unknown";
+	}
+}
+
+// Deflate and Zstd tiles are stored as RGB with the horizontal predictor (TIFF Predictor = 2): each sample is replaced
+// by its difference with the same sample of the pixel to the left, which makes smooth image content compress better.
+static void convert_bgra_to_rgb_with_horizontal_differencing(u8* bgra, u8* rgb, i32 width, i32 height) {
+	for (i32 y = 0; y < height; ++y) {
+		u8* src = bgra + (size_t)y * width * 4;
+		u8* dest = rgb + (size_t)y * width * 3;
+		u8 prev_r = 0, prev_g = 0, prev_b = 0;
+		for (i32 x = 0; x < width; ++x) {
+			u8 r = src[2], g = src[1], b = src[0];
+			dest[0] = r - prev_r;
+			dest[1] = g - prev_g;
+			dest[2] = b - prev_b;
+			prev_r = r, prev_g = g, prev_b = b;
+			src += 4;
+			dest += 3;
+		}
+	}
+}
+
+static u8* encode_deflate(u8* data, size_t size, i32 compression_level, u64* compressed_size) {
+	if (compression_level <= 0) {
+		compression_level = 6;
+	}
+	u8* compressed = NULL;
+	if (init_libdeflate()) {
+		void* compressor = libdeflate.alloc_compressor(CLAMP(compression_level, 1, 12));
+		if (compressor) {
+			size_t capacity = libdeflate.zlib_compress_bound(compressor, size);
+			compressed = (u8*)malloc(capacity);
+			*compressed_size = libdeflate.zlib_compress(compressor, data, size, compressed, capacity);
+			libdeflate.free_compressor(compressor);
+			if (*compressed_size == 0) {
+				free(compressed);
+				compressed = NULL;
+			}
+		}
+	} else {
+		int out_len = 0;
+		compressed = stbi_zlib_compress(data, (int)size, &out_len, CLAMP(compression_level, 1, 9));
+		*compressed_size = (u64)out_len;
+	}
+	return compressed;
+}
+
+static u8* encode_zstd(u8* data, size_t size, i32 compression_level, u64* compressed_size) {
+	if (!init_zstd_encoder()) {
+		return NULL;
+	}
+	if (compression_level == 0) {
+		compression_level = 3; // ZSTD_CLEVEL_DEFAULT
+	}
+	size_t capacity = zstd_encoder.compressBound(size);
+	u8* compressed = (u8*)malloc(capacity);
+	size_t result = zstd_encoder.compress(compressed, capacity, data, size, ATMOST(22, compression_level));
+	if (zstd_encoder.isError(result)) {
+		free(compressed);
+		return NULL;
+	}
+	*compressed_size = result;
+	return compressed;
+}
+
+static u8* encode_webp(u8* bgra_pixels, i32 width, i32 height, bool lossless, i32 quality, u64* compressed_size) {
+	if (!init_webp()) {
+		return NULL;
+	}
+	// The tile is stored without alpha channel (SamplesPerPixel = 3). Parts of the tile that are not covered by the
+	// image may still be transparent, so make a copy with opaque alpha in that case (libwebp would keep the alpha).
+	size_t pixels_size = (size_t)width * height * 4;
+	u8* opaque_pixels = NULL;
+	for (size_t i = 3; i < pixels_size; i += 4) {
+		if (bgra_pixels[i] != 255) {
+			opaque_pixels = (u8*)malloc(pixels_size);
+			memcpy(opaque_pixels, bgra_pixels, pixels_size);
+			for (size_t j = 3; j < pixels_size; j += 4) {
+				opaque_pixels[j] = 255;
+			}
+			bgra_pixels = opaque_pixels;
+			break;
+		}
+	}
+	u8* webp_output = NULL;
+	size_t webp_size = 0;
+	if (lossless) {
+		webp_size = webp.EncodeLosslessBGRA(bgra_pixels, width, height, width * 4, &webp_output);
+	} else {
+		webp_size = webp.EncodeBGRA(bgra_pixels, width, height, width * 4, (float)quality, &webp_output);
+	}
+	if (opaque_pixels) {
+		free(opaque_pixels);
+	}
+	u8* compressed = NULL;
+	if (webp_size > 0) {
+		compressed = (u8*)malloc(webp_size);
+		memcpy(compressed, webp_output, webp_size);
+		*compressed_size = webp_size;
+	}
+	if (webp_output) {
+		webp.Free(webp_output);
+	}
+	return compressed;
+}
+
+// Encodes a tile for the non-JPEG export encodings (JPEG tiles are encoded by jpeg_encode_tile(), because they share
+// their tables through the JPEGTables tag). Returns a malloc'ed buffer, or NULL if encoding failed.
+u8* encode_export_tile(u8* bgra_pixels, i32 width, i32 height, export_compression_enum compression, i32 quality, i32 compression_level,
+					   u64* compressed_size) {
+	*compressed_size = 0;
+	switch (compression) {
+		case EXPORT_COMPRESSION_DEFLATE:
+		case EXPORT_COMPRESSION_ZSTD: {
+			size_t rgb_size = (size_t)width * height * 3;
+			u8* rgb = (u8*)malloc(rgb_size);
+			convert_bgra_to_rgb_with_horizontal_differencing(bgra_pixels, rgb, width, height);
+			u8* compressed = (compression == EXPORT_COMPRESSION_DEFLATE) ? encode_deflate(rgb, rgb_size, compression_level, compressed_size)
+																		  : encode_zstd(rgb, rgb_size, compression_level, compressed_size);
+			free(rgb);
+			return compressed;
+		}
+		case EXPORT_COMPRESSION_WEBP:
+		case EXPORT_COMPRESSION_WEBP_LOSSLESS: {
+			return encode_webp(bgra_pixels, width, height, (compression == EXPORT_COMPRESSION_WEBP_LOSSLESS), quality, compressed_size);
+		}
+		default: {
+			ASSERT(!"encode_export_tile(): unsupported compression");
+			return NULL;
+		}
+	}
+}
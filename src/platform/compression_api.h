@@ -0,0 +1,64 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// libzstd and libdeflate are loaded at runtime (like libwebp), for writing Zstd- and Deflate-compressed TIFFs.
+// Only the encoders come from these libraries: decoding uses the bundled zstd decoder and miniz.
+typedef struct zstd_encoder_api {
+	size_t (*compress)(void* dst, size_t dst_capacity, const void* src, size_t src_size, int compression_level);
+	size_t (*compressBound)(size_t src_size);
+	unsigned (*isError)(size_t code);
+} zstd_encoder_api;
+
+typedef struct libdeflate_api {
+	void* (*alloc_compressor)(int compression_level);
+	size_t (*zlib_compress)(void* compressor, const void* in, size_t in_nbytes, void* out, size_t out_nbytes_avail);
+	size_t (*zlib_compress_bound)(void* compressor, size_t in_nbytes);
+	void (*free_compressor)(void* compressor);
+} libdeflate_api;
+
+// How the tiles of an exported BigTIFF are compressed. JPEG and lossy WebP use the quality setting; Deflate and Zstd
+// use a compression level instead (0 for the default) and are written with the horizontal predictor.
+typedef enum export_compression_enum {
+	EXPORT_COMPRESSION_JPEG = 0,
+	EXPORT_COMPRESSION_DEFLATE,
+	EXPORT_COMPRESSION_ZSTD,
+	EXPORT_COMPRESSION_WEBP,
+	EXPORT_COMPRESSION_WEBP_LOSSLESS,
+} export_compression_enum;
+
+bool init_zstd_encoder(void);
+bool init_libdeflate(void);
+
+extern zstd_encoder_api zstd_encoder;
+extern libdeflate_api libdeflate;
+
+const char* get_export_compression_name(export_compression_enum compression);
+u8* encode_export_tile(u8* bgra_pixels, i32 width, i32 height, export_compression_enum compression, i32 quality, i32 compression_level,
+                       u64* compressed_size);
+
+#ifdef __cplusplus
+}
+#endif
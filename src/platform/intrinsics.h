@@ -72,6 +72,10 @@ static inline i32 atomic_subtract(volatile i32* x, i32 amount) {
 	return InterlockedAdd((volatile long*)x, (long)(-amount));
 }
 
+static inline i64 atomic_add_i64(volatile i64* x, i64 amount) {
+	return InterlockedAdd64((volatile LONG64*)x, (LONG64)amount);
+}
+
 static inline bool atomic_compare_exchange(volatile i32* destination, i32 exchange, i32 comparand) {
 	i32 read_value = InterlockedCompareExchange((volatile long*)destination, exchange, comparand);
 	return (read_value == comparand);
@@ -106,6 +110,10 @@ static inline i32 atomic_subtract(volatile i32* x, i32 amount) {
     return OSAtomicAdd32(-amount, x);
 }
 
+static inline i64 atomic_add_i64(volatile i64* x, i64 amount) {
+    return OSAtomicAdd64(amount, (volatile int64_t*)x);
+}
+
 static inline bool atomic_compare_exchange(volatile i32* destination, i32 exchange, i32 comparand) {
 	bool result = OSAtomicCompareAndSwap32(comparand, exchange, destination);
 	return result;
@@ -136,6 +144,10 @@ static inline i32 atomic_subtract(volatile i32* x, i32 amount) {
     return __sync_sub_and_fetch(x, amount);
 }
 
+static inline i64 atomic_add_i64(volatile i64* x, i64 amount) {
+    return __sync_add_and_fetch(x, amount);
+}
+
 static inline bool atomic_compare_exchange(volatile i32* destination, i32 exchange, i32 comparand) {
     i32 read_value = __sync_val_compare_and_swap(destination, comparand, exchange);
     return (read_value == comparand);
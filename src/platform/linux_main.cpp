@@ -637,6 +637,7 @@ int main(int argc, const char** argv)
 	// Initialize multithreading stuff
 	global_completion_queue = completion_queue_create(1024); // Message queue for completed tasks
 	init_thread_pool(&global_thread_pool, 1024, true, true, NULL);
+	thread_pool_set_thread_exit_callback(&global_thread_pool, tile_loader_thread_exit_callback);
 
     if (app_command.headless) {
         is_openslide_available = init_openslide();
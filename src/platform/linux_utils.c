@@ -25,9 +25,23 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for sync_file_range()
+#endif
+
 #include "common.h"
 #include "platform.h"
 
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#if APPLE
+#include <sys/param.h>
+#include <sys/mount.h>
+#else
+#include <sys/vfs.h>
+#endif
+
 int platform_stat(const char* filename, struct stat* st) {
 	return stat(filename, st);
 }
@@ -104,3 +118,160 @@ size_t file_handle_read_at_offset(void* dest, file_handle_t file_handle, u64 off
 	size_t bytes_read = pread(file_handle, dest, bytes_to_read, offset);
 	return bytes_read;
 }
+
+// Opens (and truncates) a file for positional writes with file_handle_write_at_offset(), which may be called
+// from multiple threads at once as long as the written ranges don't overlap.
+file_handle_t open_file_handle_for_writing(const char* filename) {
+	file_handle_t fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		console_print_error("Error: Could not open '%s' for writing\n", filename);
+		return 0;
+	} else {
+		return fd;
+	}
+}
+
+size_t file_handle_write_at_offset(const void* src, file_handle_t file_handle, u64 offset, size_t bytes_to_write) {
+	size_t total_written = 0;
+	while (total_written < bytes_to_write) {
+		ssize_t written = pwrite(file_handle, (const u8*)src + total_written, bytes_to_write - total_written, (off_t)(offset + total_written));
+		if (written <= 0) {
+			if (written < 0 && errno == EINTR) continue;
+			break;
+		}
+		total_written += (size_t)written;
+	}
+	return total_written;
+}
+
+// Reserves disk space for [offset, offset + size), so that later writes into that range don't need to extend the file
+// (and the file is less fragmented). This is only a hint: returns false if the filesystem doesn't support it.
+bool file_handle_preallocate(file_handle_t file_handle, u64 offset, u64 size) {
+#if APPLE
+	// F_PEOFPOSMODE allocates from the physical end of the file, which is where the output grows.
+	fstore_t store = {.fst_flags = F_ALLOCATECONTIG, .fst_posmode = F_PEOFPOSMODE, .fst_offset = 0, .fst_length = (off_t)size};
+	if (fcntl(file_handle, F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		if (fcntl(file_handle, F_PREALLOCATE, &store) == -1) {
+			return false;
+		}
+	}
+	return true;
+#else
+	return posix_fallocate(file_handle, (off_t)offset, (off_t)size) == 0;
+#endif
+}
+
+bool file_handle_set_size(file_handle_t file_handle, u64 size) {
+	return ftruncate(file_handle, (off_t)size) == 0;
+}
+
+// Starts writing [offset, offset + size) back to disk, without waiting for it.
+void file_handle_start_writeback(file_handle_t file_handle, u64 offset, u64 size) {
+#if APPLE
+	// No per-range equivalent; the page cache is left to the kernel.
+#else
+	sync_file_range(file_handle, (off64_t)offset, (off64_t)size, SYNC_FILE_RANGE_WRITE);
+#endif
+}
+
+// Evicts [offset, offset + size) from the page cache. Pages that are still dirty or being written back are skipped,
+// so this should be called on a range some time after file_handle_start_writeback().
+void file_handle_drop_cached_range(file_handle_t file_handle, u64 offset, u64 size) {
+#if APPLE
+	// No per-range equivalent; the page cache is left to the kernel.
+#else
+	posix_fadvise(file_handle, (off_t)offset, (off_t)size, POSIX_FADV_DONTNEED);
+#endif
+}
+
+i64 get_peak_memory_usage(void) {
+	struct rusage usage = {0};
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#if APPLE
+	return (i64)usage.ru_maxrss; // bytes
+#else
+	return (i64)usage.ru_maxrss * 1024; // kilobytes
+#endif
+}
+
+bool file_handle_is_on_network_filesystem(file_handle_t file_handle) {
+	struct statfs fs = {0};
+	if (fstatfs(file_handle, &fs) != 0) {
+		return true; // unknown; assume the worst
+	}
+#if APPLE
+	return !(fs.f_flags & MNT_LOCAL);
+#else
+	switch ((u32)fs.f_type) {
+		case 0x6969:     // NFS
+		case 0x517B:     // SMB
+		case 0xFE534D42: // SMB2
+		case 0xFF534D42: // CIFS
+		case 0x01021997: // 9P
+		case 0x00C36400: // Ceph
+		case 0x5346414F: // AFS
+		case 0x73757245: // Coda
+		case 0x0BD00BD0: // Lustre
+		case 0x47504653: // GPFS
+		case 0x65735546: // FUSE (e.g. sshfs)
+			return true;
+		default:
+			return false;
+	}
+#endif
+}
+
+// Pages of a mapped file that are not resident yet are read from disk when they are first touched. That is
+// only a good idea for local storage: on a network filesystem, a stalled connection would stall the decoder threads
+// (or raise SIGBUS if the file changes underneath us), so we stick to pread() there.
+bool mapped_file_open(mapped_file_t* mapped_file, file_handle_t file_handle, file_access_hint_enum access_hint) {
+	memset(mapped_file, 0, sizeof(*mapped_file));
+	if (!file_handle || file_handle_is_on_network_filesystem(file_handle)) {
+		return false;
+	}
+	struct stat st = {0};
+	if (fstat(file_handle, &st) != 0 || st.st_size <= 0 || (u64)st.st_size > SIZE_MAX) {
+		return false;
+	}
+	void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, file_handle, 0);
+	if (data == MAP_FAILED) {
+		console_print_verbose("mmap() failed, falling back to regular file reads\n");
+		return false;
+	}
+	mapped_file->data = (u8*)data;
+	mapped_file->size = (u64)st.st_size;
+	madvise(data, (size_t)st.st_size, (access_hint == FILE_ACCESS_SEQUENTIAL) ? MADV_SEQUENTIAL : MADV_RANDOM);
+	return true;
+}
+
+// Hints how part of the mapping is about to be read. For sequential access, readahead of the range is started right
+// away (MADV_WILLNEED does not change the advice for the mapping as a whole, so the mapping is not split up).
+// FILE_ACCESS_DONE unmaps the resident pages of the range from the process; for a read-only file mapping that is
+// safe even while other threads are reading from it, they just fault the pages in again from the page cache.
+void mapped_file_advise(mapped_file_t* mapped_file, u64 offset, u64 size, file_access_hint_enum access_hint) {
+	if (!mapped_file->data || offset >= mapped_file->size) {
+		return;
+	}
+	size = MIN(size, mapped_file->size - offset);
+	// madvise() needs a page-aligned start address
+	u64 aligned_offset = offset & ~((u64)sysconf(_SC_PAGE_SIZE) - 1);
+	u8* start = mapped_file->data + aligned_offset;
+	size_t length = (size_t)(size + (offset - aligned_offset));
+	int advice = MADV_RANDOM;
+	if (access_hint == FILE_ACCESS_SEQUENTIAL) {
+		advice = MADV_WILLNEED;
+	} else if (access_hint == FILE_ACCESS_DONE) {
+		advice = MADV_DONTNEED;
+	}
+	madvise(start, length, advice);
+}
+
+void mapped_file_close(mapped_file_t* mapped_file) {
+	if (mapped_file->data) {
+		munmap(mapped_file->data, (size_t)mapped_file->size);
+	}
+	memset(mapped_file, 0, sizeof(*mapped_file));
+}
@@ -116,6 +116,21 @@ typedef void platform_once_callback_t(void);
 
 typedef struct directory_listing_t directory_listing_t;
 
+// Read-only memory mapping of an entire file, so that decoders can read compressed data in place.
+typedef enum file_access_hint_enum {
+	FILE_ACCESS_RANDOM,     // e.g. individual tiles (no readahead)
+	FILE_ACCESS_SEQUENTIAL, // e.g. long runs of data that are read front to back
+	FILE_ACCESS_DONE,       // not needed again soon: resident pages may be dropped (they are re-read if touched)
+} file_access_hint_enum;
+
+typedef struct mapped_file_t {
+	u8* data; // NULL if the file is not mapped
+	u64 size;
+#if WINDOWS
+	HANDLE mapping_handle;
+#endif
+} mapped_file_t;
+
 // Inline procedures as wrappers for system routines
 #if WINDOWS
 
@@ -139,6 +154,12 @@ static inline void platform_semaphore_wait(semaphore_handle_t semaphore) {
 
 #endif
 
+// Creates a semaphore with an initial count of 0 (implemented in work_queue.c). On macOS, a unique number is appended to the name.
+// Pass NULL for a semaphore that is private to its creator: on Windows, a named semaphore is shared with every other
+// semaphore of the same name, including those in other processes.
+semaphore_handle_t platform_semaphore_create(const char* name);
+void platform_semaphore_destroy(semaphore_handle_t semaphore);
+
 u8* platform_alloc(size_t size);
 mem_t* platform_allocate_mem_buffer(size_t capacity);
 mem_t* platform_read_entire_file(const char* filename);
@@ -159,12 +180,32 @@ void file_stream_close(file_stream_t file_stream);
 file_handle_t open_file_handle_for_simultaneous_access(const char* filename);
 void file_handle_close(file_handle_t file_handle);
 size_t file_handle_read_at_offset(void* dest, file_handle_t file_handle, u64 offset, size_t bytes_to_read);
+file_handle_t open_file_handle_for_writing(const char* filename);
+size_t file_handle_write_at_offset(const void* src, file_handle_t file_handle, u64 offset, size_t bytes_to_write);
+bool file_handle_preallocate(file_handle_t file_handle, u64 offset, u64 size);
+bool file_handle_set_size(file_handle_t file_handle, u64 size);
+void file_handle_start_writeback(file_handle_t file_handle, u64 offset, u64 size);
+void file_handle_drop_cached_range(file_handle_t file_handle, u64 offset, u64 size);
+bool file_handle_is_on_network_filesystem(file_handle_t file_handle);
+bool mapped_file_open(mapped_file_t* mapped_file, file_handle_t file_handle, file_access_hint_enum access_hint);
+void mapped_file_advise(mapped_file_t* mapped_file, u64 offset, u64 size, file_access_hint_enum access_hint);
+void mapped_file_close(mapped_file_t* mapped_file);
+
+// Returns a pointer into the mapping if [offset, offset + size) is mapped, or NULL (the caller should then fall back
+// to file_handle_read_at_offset()). The bytes are read-only.
+static inline u8* mapped_file_get_bytes(mapped_file_t* mapped_file, u64 offset, u64 size) {
+	if (mapped_file->data && offset <= mapped_file->size && size <= mapped_file->size - offset) {
+		return mapped_file->data + offset;
+	}
+	return NULL;
+}
 
 
 bool file_exists(const char* filename);
 bool is_directory(const char* path);
 
 system_info_t get_system_info(bool verbose);
+i64 get_peak_memory_usage(void); // peak resident set size of the process, in bytes
 
 void platform_call_once(platform_once_t* once, platform_once_callback_t* callback);
 void init_global_system_info(bool verbose);
@@ -189,6 +230,7 @@ extern const char** g_argv;
 extern system_info_t global_system_info;
 
 extern bool is_verbose_mode INIT(= false);
+extern bool use_memory_mapped_files INIT(= true); // local slides only; network filesystems always use regular reads
 
 
 #undef INIT
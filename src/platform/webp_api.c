@@ -0,0 +1,113 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "platform.h"
+#include "intrinsics.h"
+
+#include "webp_api.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+webp_api webp;
+
+static platform_mutex_t webp_init_mutex = PLATFORM_MUTEX_INITIALIZER;
+static volatile bool webp_init_attempted;
+static volatile bool webp_available;
+
+static bool webp_load_library(void) {
+#ifdef _WIN32
+	const char* library_filenames[] = { "libwebp.dll", "libwebp-7.dll", "webp.dll" };
+	HMODULE library_handle = NULL;
+	for (i32 i = 0; i < COUNT(library_filenames) && !library_handle; ++i) {
+		library_handle = LoadLibraryA(library_filenames[i]);
+	}
+#define GET_PROC(proc, name) if (!(*(void**)&webp.proc = (void*) GetProcAddress(library_handle, name))) goto failed;
+#else
+#if defined(__APPLE__)
+	const char* library_filenames[] = { "libwebp.dylib", "libwebp.7.dylib", "/opt/homebrew/opt/webp/lib/libwebp.dylib",
+	                                     "/usr/local/opt/webp/lib/libwebp.dylib", "/opt/local/lib/libwebp.dylib" };
+#else
+	const char* library_filenames[] = { "libwebp.so.7", "libwebp.so", "/usr/local/lib/libwebp.so" };
+#endif
+	void* library_handle = NULL;
+	for (i32 i = 0; i < COUNT(library_filenames) && !library_handle; ++i) {
+		library_handle = dlopen(library_filenames[i], RTLD_LAZY);
+	}
+#define GET_PROC(proc, name) if (!(*(void**)&webp.proc = dlsym(library_handle, name))) goto failed;
+#endif
+
+	if (library_handle) {
+		GET_PROC(GetInfo, "WebPGetInfo");
+		GET_PROC(DecodeBGRAInto, "WebPDecodeBGRAInto");
+		GET_PROC(EncodeBGRA, "WebPEncodeBGRA");
+		GET_PROC(EncodeLosslessBGRA, "WebPEncodeLosslessBGRA");
+		GET_PROC(Free, "WebPFree");
+#undef GET_PROC
+		console_print_verbose("libwebp initialized\n");
+		return true;
+	}
+	failed:
+	memset(&webp, 0, sizeof(webp));
+	if (library_handle) {
+		// Too old, or not libwebp after all: don't keep it loaded.
+#ifdef _WIN32
+		FreeLibrary(library_handle);
+#else
+		dlclose(library_handle);
+#endif
+		console_print("WebP not available: libwebp is missing required functions (too old?)\n");
+	} else {
+		console_print("WebP not available: could not load libwebp (not installed?)\n");
+	}
+	return false;
+}
+
+bool init_webp(void) {
+	if (!webp_init_attempted) {
+		platform_mutex_lock(&webp_init_mutex);
+		if (!webp_init_attempted) {
+			webp_available = webp_load_library();
+			write_barrier;
+			webp_init_attempted = true;
+		}
+		platform_mutex_unlock(&webp_init_mutex);
+	}
+	return webp_available;
+}
+
+bool webp_decode_bgra_into(const u8* data, size_t data_size, u8* dest, i32 width, i32 height, i32 stride) {
+	if (!init_webp()) {
+		return false;
+	}
+	int image_width = 0;
+	int image_height = 0;
+	if (!webp.GetInfo(data, data_size, &image_width, &image_height)) {
+		console_print_error("WebP decoding failed: invalid bitstream\n");
+		return false;
+	}
+	if (image_width != width || image_height > height) {
+		console_print_error("WebP decoding failed: unexpected dimensions (%d x %d, expected %d x %d)\n", image_width, image_height, width, height);
+		return false;
+	}
+	return webp.DecodeBGRAInto(data, data_size, dest, (size_t)stride * image_height, stride) != NULL;
+}
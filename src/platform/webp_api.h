@@ -0,0 +1,44 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// libwebp is loaded at runtime (like OpenSlide), so that WebP-compressed TIFFs can be viewed when the library
+// is installed, without making it a hard dependency.
+typedef struct webp_api {
+	int (*GetInfo)(const u8* data, size_t data_size, int* width, int* height);
+	u8* (*DecodeBGRAInto)(const u8* data, size_t data_size, u8* output_buffer, size_t output_buffer_size, int output_stride);
+	size_t (*EncodeBGRA)(const u8* bgra, int width, int height, int stride, float quality_factor, u8** output);
+	size_t (*EncodeLosslessBGRA)(const u8* bgra, int width, int height, int stride, u8** output);
+	void (*Free)(void* ptr);
+} webp_api;
+
+bool init_webp(void);
+bool webp_decode_bgra_into(const u8* data, size_t data_size, u8* dest, i32 width, i32 height, i32 stride);
+
+extern webp_api webp;
+
+#ifdef __cplusplus
+}
+#endif
@@ -1401,6 +1401,7 @@ static DWORD WINAPI thread_proc(void* parameter) {
 void win32_init_multithreading() {
 	global_completion_queue = completion_queue_create(1024); // Message queue for completed tasks
 	init_thread_pool(&global_thread_pool, 1024, true, true, NULL);
+	thread_pool_set_thread_exit_callback(&global_thread_pool, tile_loader_thread_exit_callback);
 }
 
 void win32_init_main_window(app_state_t* app_state) {
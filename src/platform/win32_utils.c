@@ -28,6 +28,8 @@
 #include "common.h"
 #include "win32_utils.h"
 
+#include <psapi.h>
+
 wchar_t* win32_string_widen(const char* s, size_t len, wchar_t* buffer) {
 	int characters_written = MultiByteToWideChar(CP_UTF8, 0, s, -1, buffer, len);
 	if (characters_written > 0) {
@@ -181,6 +183,127 @@ size_t file_handle_read_at_offset(void* dest, file_handle_t file_handle, u64 off
 	return bytes_read;
 }
 
+// Opens (and truncates) a file for positional writes with file_handle_write_at_offset(), which may be called
+// from multiple threads at once as long as the written ranges don't overlap.
+file_handle_t open_file_handle_for_writing(const char* filename) {
+	size_t filename_len = strlen(filename) + 1;
+	wchar_t* wide_filename = win32_string_widen(filename, filename_len, (wchar_t*) alloca(2 * filename_len));
+	HANDLE handle = CreateFileW(wide_filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		win32_diagnostic("CreateFileW");
+		return 0;
+	}
+	return handle;
+}
+
+size_t file_handle_write_at_offset(const void* src, file_handle_t file_handle, u64 offset, size_t bytes_to_write) {
+	size_t total_written = 0;
+	while (total_written < bytes_to_write) {
+		// Passing an OVERLAPPED structure makes the write positional (the shared file pointer is not used).
+		u64 write_offset = offset + total_written;
+		OVERLAPPED overlapped = {0};
+		overlapped.Offset = (DWORD)write_offset;
+		overlapped.OffsetHigh = (DWORD)(write_offset >> 32);
+		DWORD chunk_size = (DWORD)MIN(bytes_to_write - total_written, (size_t)MEGABYTES(256));
+		DWORD written = 0;
+		if (!WriteFile(file_handle, (const u8*)src + total_written, chunk_size, &written, &overlapped) || written == 0) {
+			win32_diagnostic("WriteFile");
+			break;
+		}
+		total_written += written;
+	}
+	return total_written;
+}
+
+// Reserves disk space for [offset, offset + size). This is only a hint.
+bool file_handle_preallocate(file_handle_t file_handle, u64 offset, u64 size) {
+	FILE_ALLOCATION_INFO info = {0};
+	info.AllocationSize.QuadPart = (LONGLONG)(offset + size);
+	return SetFileInformationByHandle(file_handle, FileAllocationInfo, &info, sizeof(info));
+}
+
+bool file_handle_set_size(file_handle_t file_handle, u64 size) {
+	FILE_END_OF_FILE_INFO info = {0};
+	info.EndOfFile.QuadPart = (LONGLONG)size;
+	return SetFileInformationByHandle(file_handle, FileEndOfFileInfo, &info, sizeof(info));
+}
+
+void file_handle_start_writeback(file_handle_t file_handle, u64 offset, u64 size) {
+	// No per-range equivalent; the cache manager already writes back lazily on its own.
+}
+
+void file_handle_drop_cached_range(file_handle_t file_handle, u64 offset, u64 size) {
+	// No per-range equivalent; the cache manager trims the system cache on its own.
+}
+
+i64 get_peak_memory_usage(void) {
+	PROCESS_MEMORY_COUNTERS counters = {0};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return (i64)counters.PeakWorkingSetSize;
+}
+
+bool file_handle_is_on_network_filesystem(file_handle_t file_handle) {
+	// Files on network shares (including mapped network drives) resolve to a \\?\UNC\server\share\... path.
+	wchar_t path[MAX_PATH + 8];
+	DWORD len = GetFinalPathNameByHandleW(file_handle, path, COUNT(path), FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+	if (len == 0 || len >= COUNT(path)) {
+		return true; // unknown; assume the worst
+	}
+	return (wcsncmp(path, L"\\\\?\\UNC\\", 8) == 0);
+}
+
+bool mapped_file_open(mapped_file_t* mapped_file, file_handle_t file_handle, file_access_hint_enum access_hint) {
+	memset(mapped_file, 0, sizeof(*mapped_file));
+	if (!file_handle || file_handle_is_on_network_filesystem(file_handle)) {
+		return false;
+	}
+	LARGE_INTEGER file_size = {0};
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart <= 0) {
+		return false;
+	}
+	HANDLE mapping_handle = CreateFileMappingW(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping_handle) {
+		win32_diagnostic_verbose("CreateFileMappingW");
+		return false;
+	}
+	void* data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		win32_diagnostic_verbose("MapViewOfFile");
+		CloseHandle(mapping_handle);
+		return false;
+	}
+	mapped_file->data = (u8*)data;
+	mapped_file->size = (u64)file_size.QuadPart;
+	mapped_file->mapping_handle = mapping_handle;
+	return true;
+}
+
+// There is no equivalent of madvise(MADV_RANDOM) on Windows; for sequential access we can at least start the reads early.
+void mapped_file_advise(mapped_file_t* mapped_file, u64 offset, u64 size, file_access_hint_enum access_hint) {
+#if _WIN32_WINNT >= 0x0602
+	if (mapped_file->data && offset < mapped_file->size && access_hint == FILE_ACCESS_SEQUENTIAL) {
+		WIN32_MEMORY_RANGE_ENTRY range = {mapped_file->data + offset, (SIZE_T)MIN(size, mapped_file->size - offset)};
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+#endif
+	if (mapped_file->data && offset < mapped_file->size && access_hint == FILE_ACCESS_DONE) {
+		// VirtualUnlock() on pages that are not locked removes them from the working set (the call then 'fails').
+		VirtualUnlock(mapped_file->data + offset, (SIZE_T)MIN(size, mapped_file->size - offset));
+	}
+}
+
+void mapped_file_close(mapped_file_t* mapped_file) {
+	if (mapped_file->data) {
+		UnmapViewOfFile(mapped_file->data);
+	}
+	if (mapped_file->mapping_handle) {
+		CloseHandle(mapped_file->mapping_handle);
+	}
+	memset(mapped_file, 0, sizeof(*mapped_file));
+}
+
 int platform_stat(const char* filename, struct stat* st) {
 	size_t filename_len = strlen(filename) + 1;
 	wchar_t* wide_filename = win32_string_widen(filename, filename_len, (wchar_t*) alloca(2 * filename_len));
@@ -38,30 +38,53 @@
 #include <pthread.h>
 #endif
 
-work_queue_t work_queue_create(const char* semaphore_name, i32 entry_count) {
-	work_queue_t queue = {0};
-
-	queue.logical_thread_index = threadlocal_logical_thread_index;
-
+semaphore_handle_t platform_semaphore_create(const char* name) {
+	semaphore_handle_t semaphore = NULL;
 	i32 semaphore_initial_count = 0;
 #if WINDOWS
 	LONG maximum_count = 1e6; // realistically, we'd only get up to the number of worker threads, though
-	queue.semaphore = CreateSemaphoreExA(0, semaphore_initial_count, maximum_count, semaphore_name, 0, SEMAPHORE_ALL_ACCESS);
+	semaphore = CreateSemaphoreExA(0, semaphore_initial_count, maximum_count, name, 0, SEMAPHORE_ALL_ACCESS);
 #elif APPLE
-	// Prevent name collisions by appending a unique number
+	// Prevent name collisions by appending a unique number (sem_init() is not supported, so even private semaphores need a name)
 	char semaphore_name_unique[64];
 	static volatile i32 sem_id = 0;
-	snprintf(semaphore_name_unique, sizeof(semaphore_name_unique), "%s%lld", semaphore_name, atomic_increment(&sem_id));
-	queue.semaphore = sem_open(semaphore_name_unique, O_CREAT, 0644, semaphore_initial_count);
+	if (name) {
+		snprintf(semaphore_name_unique, sizeof(semaphore_name_unique), "%s%d", name, atomic_increment(&sem_id));
+	} else {
+		snprintf(semaphore_name_unique, sizeof(semaphore_name_unique), "/sem%d_%d", (i32)getpid(), atomic_increment(&sem_id));
+	}
+	semaphore = sem_open(semaphore_name_unique, O_CREAT, 0644, semaphore_initial_count);
 	sem_unlink(semaphore_name_unique);
 #else
-	queue.semaphore = calloc(1, sizeof(sem_t));
-	i32 rc = sem_init(queue.semaphore, 0, 0);
+	semaphore = calloc(1, sizeof(sem_t));
+	i32 rc = sem_init(semaphore, 0, semaphore_initial_count);
 	if (rc != 0) {
 		perror("sem_init");
 		fatal_error("failed to initialize semaphore");
 	}
 #endif
+	return semaphore;
+}
+
+void platform_semaphore_destroy(semaphore_handle_t semaphore) {
+	if (!semaphore) {
+		return;
+	}
+#if WINDOWS
+	CloseHandle(semaphore);
+#elif APPLE
+	sem_close(semaphore);
+#else
+	sem_destroy(semaphore);
+	free(semaphore);
+#endif
+}
+
+work_queue_t work_queue_create(const char* semaphore_name, i32 entry_count) {
+	work_queue_t queue = {0};
+
+	queue.logical_thread_index = threadlocal_logical_thread_index;
+	queue.semaphore = platform_semaphore_create(semaphore_name);
 	queue.owns_semaphore = true;
 	queue.entry_count = entry_count + 1; // add safety margin to detect when queue is about to overflow
 	queue.entries = calloc(1, (entry_count + 1) * sizeof(work_queue_entry_t));
@@ -98,14 +121,7 @@ void work_queue_destroy(work_queue_t* queue) {
 		memset(queue, 0, sizeof(work_queue_t));
 		return;
 	}
-#if WINDOWS
-	CloseHandle(queue->semaphore);
-#elif APPLE
-	sem_close(queue->semaphore);
-#else
-	sem_destroy(queue->semaphore);
-	free(queue->semaphore);
-#endif
+	platform_semaphore_destroy(queue->semaphore);
 	queue->semaphore = NULL;
 	memset(queue, 0, sizeof(work_queue_t));
 }
@@ -485,6 +501,9 @@ static void* worker_thread(void* parameter) {
 
 	}
 
+	if (pool->thread_exit_callback) {
+		pool->thread_exit_callback(logical_thread_index, NULL);
+	}
 	destroy_thread_memory();
 	return 0;
 }
@@ -559,6 +578,15 @@ void init_thread_pool(thread_pool_t* pool, i32 work_queue_max_entry_count, bool
 
 }
 
+// The callback runs on each worker thread as it shuts down (see thread_pool_destroy()).
+void thread_pool_set_thread_exit_callback(thread_pool_t* pool, thread_pool_thread_exit_callback_t* thread_exit_callback) {
+	if (!pool) {
+		return;
+	}
+	pool->thread_exit_callback = thread_exit_callback;
+	write_barrier;
+}
+
 bool thread_pool_submit_task(thread_pool_t* pool, work_queue_callback_t callback, void* userdata, size_t userdata_size) {
 	if (!pool || !pool->initialized) {
 		return false;
@@ -92,6 +92,7 @@ typedef struct work_queue_t {
 
 
 typedef void (thread_pool_thread_init_callback_t)(int logical_thread_index, void* userdata);
+typedef void (thread_pool_thread_exit_callback_t)(int logical_thread_index, void* userdata);
 struct thread_pool_t {
 	work_queue_t* queue;
 	work_queue_t* high_priority_queue;
@@ -103,6 +104,7 @@ struct thread_pool_t {
 	i32 active_worker_thread_count;
 	bool need_init_async_io_events;
 	thread_pool_thread_init_callback_t* thread_init_callback;
+	thread_pool_thread_exit_callback_t* thread_exit_callback; // lets worker threads release per-thread resources
 #if WINDOWS
 	HANDLE* thread_handles;
 #else
@@ -136,6 +138,7 @@ task_group_t task_group_create_child(task_group_t* parent);
 void dummy_work_queue_callback(int logical_thread_index, void* userdata);
 void test_multithreading_work_queue();
 void init_thread_pool(thread_pool_t* pool, i32 work_queue_max_entry_count, bool need_high_priority_queue, bool need_init_async_io_events, thread_pool_thread_init_callback_t thread_init_callback);
+void thread_pool_set_thread_exit_callback(thread_pool_t* pool, thread_pool_thread_exit_callback_t* thread_exit_callback);
 work_queue_t* thread_pool_get_queue(thread_pool_t* pool);
 work_queue_t* thread_pool_get_high_priority_queue(thread_pool_t* pool);
 i32 thread_pool_get_task_count(thread_pool_t* pool);
@@ -0,0 +1,628 @@
+/*
+  Slidescape, a whole-slide image viewer for digital pathology.
+  Copyright (C) 2019-2026  Pieter Valkema
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Headless export benchmark.
+// Runs export_cropped_bigtiff_with_resample() over a few regions of a slide, at the native resolution and resampled,
+// at several thread counts; export_cropped_bigtiff_at_multiple_resolutions(), against separate exports; and an export
+// with synthetic annotations burned in, against the same export without them. Reports
+// throughput, the time spent in each stage of the export and the peak memory use, and fails if the throughput or
+// memory use cross the given thresholds (so that it can run as a regression test).
+// Without a slide, a synthetic JPEG-compressed tiled TIFF is generated first.
+//
+// Usage: export_bench [slide] [--size N] [--threads N,N,...] [--memory-budget MB] [--quick]
+//                     [--min-throughput MB/s] [--max-peak-memory MB] [--output-dir DIR]
+
+#define STB_SPRINTF_IMPLEMENTATION // normally implemented by ImGui, but the benchmark doesn't have that
+#include "common.h"
+#include "platform.h"
+#include "mathutils.h"
+#include "stringutils.h"
+
+#include "viewer.h"
+#include "image.h"
+#include "image_loader.h"
+#include "jpeg_decoder.h"
+#include "tiff.h"
+#include "tiff_write.h"
+
+#include <stdarg.h>
+
+// The export's own messages would interleave with the results, so they are only shown in verbose mode.
+void console_print(const char* fmt, ...) {
+    if (!is_verbose_mode) return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stdout, fmt, args);
+    va_end(args);
+}
+
+void console_print_verbose(const char* fmt, ...) {
+    if (!is_verbose_mode) return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stdout, fmt, args);
+    va_end(args);
+}
+
+void console_print_error(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+u8* download_remote_chunk(const char* hostname, i32 portno, const char* filename, i64 offset, i64 size, i32* bytes_read, i32 thread_id) {
+    return NULL;
+}
+
+// The export reports its progress through these (normally owned by the GUI).
+float global_tiff_export_progress;
+i32 global_tiff_export_progress_console_dots_written;
+
+// Annotations are never exported by the benchmark, but tiff_write.c links against these.
+annotation_set_t create_offsetted_annotation_set_for_area(annotation_set_t* annotation_set, bounds2f area, bool push_coordinates_inward) {
+    annotation_set_t result = {0};
+    return result;
+}
+
+void save_asap_xml_annotations(annotation_set_t* annotation_set, const char* filename_out) {}
+
+void destroy_annotation_set(annotation_set_t* annotation_set) {}
+
+#define BENCH_MAX_THREAD_COUNTS 8
+
+typedef struct bench_options_t {
+    const char* filename;
+    const char* output_dir;
+    i32 synthetic_size;
+    i32 thread_counts[BENCH_MAX_THREAD_COUNTS];
+    i32 thread_count_count;
+    i64 memory_budget;
+    float min_throughput; // input MB/s, 0 = no threshold
+    float max_peak_memory; // MB, 0 = no threshold
+} bench_options_t;
+
+typedef struct bench_region_t {
+    const char* name;
+    bounds2i pixel_bounds;
+} bench_region_t;
+
+// Synthetic slide
+
+static u32 hash_u32(u32 x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+// Something that compresses roughly like tissue: a light background, patches of stroma and scattered nuclei, with noise.
+static void generate_synthetic_tile(u8* bgra, i32 tile_size, i32 tile_x0, i32 tile_y0) {
+    for (i32 y = 0; y < tile_size; ++y) {
+        for (i32 x = 0; x < tile_size; ++x) {
+            u32 gx = (u32)(tile_x0 + x);
+            u32 gy = (u32)(tile_y0 + y);
+            u32 cell_hash = hash_u32((gx >> 5) * 7919U + (gy >> 5) * 104729U);
+            i32 dx = (i32)(gx & 31) - 8 - (i32)(cell_hash & 15);
+            i32 dy = (i32)(gy & 31) - 8 - (i32)((cell_hash >> 4) & 15);
+            bool is_nucleus = (cell_hash >> 24) < 96 && dx * dx + dy * dy < 12 + (i32)((cell_hash >> 8) & 31);
+            bool is_stroma = (hash_u32((gx >> 8) * 31U + (gy >> 8) * 1009U) & 3) != 0;
+            i32 noise = (i32)(hash_u32(gx * 73856093U ^ gy * 19349663U) & 15) - 8;
+            i32 r = 240, g = 236, b = 240;
+            if (is_nucleus) {
+                r = 90, g = 60, b = 150;
+            } else if (is_stroma) {
+                r = 225 - (i32)((gx + gy) & 15), g = 150, b = 190;
+            }
+            u8* p = bgra + ((size_t)y * tile_size + x) * 4;
+            p[0] = (u8)CLAMP(b + noise, 0, 255);
+            p[1] = (u8)CLAMP(g + noise, 0, 255);
+            p[2] = (u8)CLAMP(r + noise, 0, 255);
+            p[3] = 255;
+        }
+    }
+}
+
+static void write_u16(FILE* fp, u16 value) {
+    fwrite(&value, sizeof(value), 1, fp);
+}
+
+static void write_u32(FILE* fp, u32 value) {
+    fwrite(&value, sizeof(value), 1, fp);
+}
+
+static void write_ifd_entry(FILE* fp, u16 tag, u16 type, u32 count, u32 value) {
+    write_u16(fp, tag);
+    write_u16(fp, type);
+    write_u32(fp, count);
+    if (type == TIFF_UINT16 && count <= 2) {
+        write_u16(fp, (u16)(value & 0xFFFF));
+        write_u16(fp, (u16)(value >> 16));
+    } else {
+        write_u32(fp, value);
+    }
+}
+
+// Writes a single-level tiled TIFF with JPEG-compressed YCbCr tiles at 0.25 mpp (the tiles share a JPEGTables tag,
+// like the tiles that the export itself writes).
+static bool write_synthetic_slide(const char* filename, i32 size) {
+    const i32 tile_size = 512;
+    const i32 quality = 85;
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        console_print_error("export_bench: could not create '%s'\n", filename);
+        return false;
+    }
+    i32 width_in_tiles = (size + tile_size - 1) / tile_size;
+    u32 tile_count = (u32)(width_in_tiles * width_in_tiles);
+    u32* tile_offsets = (u32*)malloc(tile_count * sizeof(u32));
+    u32* tile_bytecounts = (u32*)malloc(tile_count * sizeof(u32));
+    u8* pixels = (u8*)malloc((size_t)tile_size * tile_size * 4);
+
+    fwrite("II", 2, 1, fp);
+    write_u16(fp, 42);
+    write_u32(fp, 0); // offset of the first IFD, filled in at the end
+    u32 offset = 8;
+    for (u32 i = 0; i < tile_count; ++i) {
+        i32 tile_x = (i32)i % width_in_tiles;
+        i32 tile_y = (i32)i / width_in_tiles;
+        generate_synthetic_tile(pixels, tile_size, tile_x * tile_size, tile_y * tile_size);
+        u8* jpeg_buffer = NULL;
+        u64 jpeg_size = 0;
+        jpeg_encode_tile(pixels, tile_size, tile_size, quality, NULL, NULL, &jpeg_buffer, &jpeg_size, false);
+        fwrite(jpeg_buffer, jpeg_size, 1, fp);
+        libc_free(jpeg_buffer);
+        tile_offsets[i] = offset;
+        tile_bytecounts[i] = (u32)jpeg_size;
+        offset += (u32)jpeg_size;
+    }
+
+    u8* tables_buffer = NULL;
+    u64 tables_size = 0;
+    jpeg_encode_tile(NULL, tile_size, tile_size, quality, &tables_buffer, &tables_size, NULL, NULL, false);
+    u32 tables_offset = offset;
+    fwrite(tables_buffer, tables_size, 1, fp);
+    libc_free(tables_buffer);
+    offset += (u32)tables_size;
+    if (offset % 2) {
+        fputc(0, fp);
+        ++offset;
+    }
+
+    u32 offsets_offset = offset;
+    fwrite(tile_offsets, sizeof(u32), tile_count, fp);
+    u32 bytecounts_offset = offsets_offset + tile_count * sizeof(u32);
+    fwrite(tile_bytecounts, sizeof(u32), tile_count, fp);
+    u32 bits_per_sample_offset = bytecounts_offset + tile_count * sizeof(u32);
+    write_u16(fp, 8); write_u16(fp, 8); write_u16(fp, 8); write_u16(fp, 0);
+    u32 resolution_offset = bits_per_sample_offset + 8;
+    write_u32(fp, 40000); write_u32(fp, 1); // pixels per centimeter (= 0.25 mpp)
+
+    u32 ifd_offset = resolution_offset + 8;
+    u16 entry_count = 15;
+    write_u16(fp, entry_count);
+    write_ifd_entry(fp, TIFF_TAG_IMAGE_WIDTH, TIFF_UINT32, 1, (u32)size);
+    write_ifd_entry(fp, TIFF_TAG_IMAGE_LENGTH, TIFF_UINT32, 1, (u32)size);
+    write_ifd_entry(fp, TIFF_TAG_BITS_PER_SAMPLE, TIFF_UINT16, 3, bits_per_sample_offset);
+    write_ifd_entry(fp, TIFF_TAG_COMPRESSION, TIFF_UINT16, 1, TIFF_COMPRESSION_JPEG);
+    write_ifd_entry(fp, TIFF_TAG_PHOTOMETRIC_INTERPRETATION, TIFF_UINT16, 1, TIFF_PHOTOMETRIC_YCBCR);
+    write_ifd_entry(fp, TIFF_TAG_SAMPLES_PER_PIXEL, TIFF_UINT16, 1, 3);
+    write_ifd_entry(fp, TIFF_TAG_X_RESOLUTION, TIFF_RATIONAL, 1, resolution_offset);
+    write_ifd_entry(fp, TIFF_TAG_Y_RESOLUTION, TIFF_RATIONAL, 1, resolution_offset);
+    write_ifd_entry(fp, TIFF_TAG_RESOLUTION_UNIT, TIFF_UINT16, 1, 3 /*RESUNIT_CENTIMETER*/);
+    write_ifd_entry(fp, TIFF_TAG_TILE_WIDTH, TIFF_UINT16, 1, tile_size);
+    write_ifd_entry(fp, TIFF_TAG_TILE_LENGTH, TIFF_UINT16, 1, tile_size);
+    write_ifd_entry(fp, TIFF_TAG_TILE_OFFSETS, TIFF_UINT32, tile_count, offsets_offset);
+    write_ifd_entry(fp, TIFF_TAG_TILE_BYTE_COUNTS, TIFF_UINT32, tile_count, bytecounts_offset);
+    write_ifd_entry(fp, TIFF_TAG_JPEG_TABLES, TIFF_UNDEFINED, (u32)tables_size, tables_offset);
+    write_ifd_entry(fp, TIFF_TAG_YCBCRSUBSAMPLING, TIFF_UINT16, 2, 2 | (2 << 16));
+    write_u32(fp, 0); // no next IFD
+
+    fseek(fp, 4, SEEK_SET);
+    write_u32(fp, ifd_offset);
+    bool success = (ferror(fp) == 0);
+    fclose(fp);
+
+    free(pixels);
+    free(tile_offsets);
+    free(tile_bytecounts);
+    return success;
+}
+
+// Benchmark
+
+// The settings of a headless export, as used for all the benchmarked exports.
+static export_options_t bench_export_options(bench_options_t* options, bool need_resize, v2f target_mpp) {
+    export_options_t export_options = {0};
+    export_options.tile_width = 512;
+    export_options.photometric_interpretation = TIFF_PHOTOMETRIC_YCBCR;
+    export_options.quality = 90;
+    export_options.compression = EXPORT_COMPRESSION_JPEG;
+    export_options.flags = EXPORT_FLAGS_RELEASE_PAGE_CACHE;
+    export_options.need_resize = need_resize;
+    export_options.target_mpp = target_mpp;
+    export_options.memory_budget = options->memory_budget;
+    return export_options;
+}
+
+static bool bench_export_region(bench_options_t* options, app_state_t* app_state, image_t* image, bench_region_t* region,
+                                bool need_resize, i32 thread_count) {
+    // The main thread takes part in the export, so it counts as one of the threads.
+    *thread_pool_get_active_worker_thread_count_ptr(&global_thread_pool) = thread_count - 1;
+
+    char output_filename[512];
+    snprintf(output_filename, sizeof(output_filename), "%s/export_bench_%s.tiff", options->output_dir, region->name);
+    bounds2f world_bounds = pixel_bounds_to_world_bounds(region->pixel_bounds, image->mpp_x, image->mpp_y);
+    v2f target_mpp = need_resize ? V2F(image->mpp_x * 1.6f, image->mpp_y * 1.6f) : V2F(image->mpp_x, image->mpp_y);
+
+    export_stats_t stats = {0};
+    export_options_t export_options = bench_export_options(options, need_resize, target_mpp);
+    global_tiff_export_progress = 0.0f;
+    global_tiff_export_progress_console_dots_written = 0;
+    bool success = export_cropped_bigtiff_with_resample(app_state, image, world_bounds, region->pixel_bounds, output_filename,
+                                                        &export_options, &stats);
+    remove(output_filename);
+    if (!success) {
+        console_print_error("export_bench: export of region '%s' failed\n", region->name);
+        return false;
+    }
+
+    i64 region_width = region->pixel_bounds.right - region->pixel_bounds.left;
+    i64 region_height = region->pixel_bounds.bottom - region->pixel_bounds.top;
+    float input_megabytes = (float)(region_width * region_height * BYTES_PER_PIXEL) / (float)MEGABYTES(1);
+    float output_megabytes = (float)stats.output_bytes / (float)MEGABYTES(1);
+    float input_throughput = stats.total_seconds > 0.0f ? input_megabytes / stats.total_seconds : 0.0f;
+    float output_throughput = stats.total_seconds > 0.0f ? output_megabytes / stats.total_seconds : 0.0f;
+    float peak_memory = (float)get_peak_memory_usage() / (float)MEGABYTES(1);
+
+    printf("\r%-6s %-9s %2d threads: %7.3f s   in %7.1f MB/s   out %6.1f MB/s   peak %6.0f MB\n",
+           region->name, need_resize ? "resampled" : "native", thread_count, stats.total_seconds,
+           input_throughput, output_throughput, peak_memory);
+    printf("       %d tiles (%d copied); summed over threads: read %.3f s, resample %.3f s, encode %.3f s, write %.3f s\n",
+           stats.tile_count, stats.copied_tile_count, stats.read_seconds, stats.resample_seconds,
+           stats.encode_seconds, stats.write_seconds);
+
+    bool within_thresholds = true;
+    if (options->min_throughput > 0.0f && input_throughput < options->min_throughput) {
+        console_print_error("export_bench: throughput %.1f MB/s is below the threshold of %.1f MB/s\n",
+                            input_throughput, options->min_throughput);
+        within_thresholds = false;
+    }
+    if (options->max_peak_memory > 0.0f && peak_memory > options->max_peak_memory) {
+        console_print_error("export_bench: peak memory use of %.0f MB is above the threshold of %.0f MB\n",
+                            peak_memory, options->max_peak_memory);
+        within_thresholds = false;
+    }
+    return within_thresholds;
+}
+
+// Exports the region at 1x, 2x and 4x the source mpp in one pass over the source, and compares that against three
+// separate exports (which each decode the source again). This only compares the time taken; that the outputs are the
+// same is checked in tests/test_tiff_export.cpp.
+static bool bench_export_region_at_multiple_resolutions(bench_options_t* options, app_state_t* app_state, image_t* image,
+                                                        bench_region_t* region, i32 thread_count) {
+    *thread_pool_get_active_worker_thread_count_ptr(&global_thread_pool) = thread_count - 1;
+
+    enum { TARGET_COUNT = 3 };
+    char output_filenames[TARGET_COUNT][512];
+    char separate_output_filenames[TARGET_COUNT][512]; // so that the separate exports don't overwrite the one-pass outputs
+    const char* filenames[TARGET_COUNT];
+    v2f target_mpps[TARGET_COUNT];
+    for (i32 i = 0; i < TARGET_COUNT; ++i) {
+        snprintf(output_filenames[i], sizeof(output_filenames[i]), "%s/export_bench_%s_%dx.tiff", options->output_dir, region->name, 1 << i);
+        snprintf(separate_output_filenames[i], sizeof(separate_output_filenames[i]), "%s/export_bench_%s_%dx_separate.tiff",
+                 options->output_dir, region->name, 1 << i);
+        filenames[i] = output_filenames[i];
+        target_mpps[i] = V2F(image->mpp_x * (float)(1 << i), image->mpp_y * (float)(1 << i));
+    }
+    bounds2f world_bounds = pixel_bounds_to_world_bounds(region->pixel_bounds, image->mpp_x, image->mpp_y);
+
+    global_tiff_export_progress = 0.0f;
+    global_tiff_export_progress_console_dots_written = 0;
+    i64 start = get_clock();
+    export_options_t export_options = bench_export_options(options, true, target_mpps[0]);
+    bool success = export_cropped_bigtiff_at_multiple_resolutions(app_state, image, world_bounds, region->pixel_bounds,
+                                                                  filenames, target_mpps, TARGET_COUNT, &export_options);
+    float one_pass_seconds = get_seconds_elapsed(start, get_clock());
+
+    start = get_clock();
+    for (i32 i = 0; i < TARGET_COUNT; ++i) {
+        export_options.target_mpp = target_mpps[i];
+        success &= export_cropped_bigtiff_with_resample(app_state, image, world_bounds, region->pixel_bounds, separate_output_filenames[i],
+                                                        &export_options, NULL);
+    }
+    float separate_seconds = get_seconds_elapsed(start, get_clock());
+    for (i32 i = 0; i < TARGET_COUNT; ++i) {
+        remove(filenames[i]);
+        remove(separate_output_filenames[i]);
+    }
+    if (!success) {
+        console_print_error("export_bench: multi-resolution export of region '%s' failed\n", region->name);
+        return false;
+    }
+
+    float peak_memory = (float)get_peak_memory_usage() / (float)MEGABYTES(1);
+    printf("\r%-6s 1x,2x,4x  %2d threads: %7.3f s   (%.3f s as separate exports)               peak %6.0f MB\n",
+           region->name, thread_count, one_pass_seconds, separate_seconds, peak_memory);
+
+    if (options->max_peak_memory > 0.0f && peak_memory > options->max_peak_memory) {
+        console_print_error("export_bench: peak memory use of %.0f MB is above the threshold of %.0f MB\n",
+                            peak_memory, options->max_peak_memory);
+        return false;
+    }
+    return true;
+}
+
+// Scattered cell outlines (polygons) and some rectangles, about one annotation per 96x96 pixels (~29000 on the default
+// synthetic slide), in two groups.
+typedef struct bench_annotations_t {
+    annotation_set_t set;
+    annotation_group_t groups[2];
+    v2f* coordinates;
+} bench_annotations_t;
+
+static void create_bench_annotations(bench_annotations_t* annotations, image_t* image) {
+    const i32 cell_size = 96;
+    const i32 polygon_vertex_count = 24;
+    i32 cells_x = (i32)image->width_in_pixels / cell_size;
+    i32 cells_y = (i32)image->height_in_pixels / cell_size;
+    i32 count = cells_x * cells_y;
+    memset(annotations, 0, sizeof(*annotations));
+    annotations->groups[0].color = RGBA(0, 200, 0, 255);
+    annotations->groups[1].color = RGBA(250, 200, 0, 255);
+    annotations->set.stored_groups = annotations->groups;
+    annotations->set.stored_group_count = COUNT(annotations->groups);
+    annotations->set.stored_annotations = (annotation_t*)calloc(count, sizeof(annotation_t));
+    annotations->set.active_annotation_indices = (i32*)calloc(count, sizeof(i32));
+    annotations->coordinates = (v2f*)malloc((size_t)count * polygon_vertex_count * sizeof(v2f));
+    for (i32 i = 0; i < count; ++i) {
+        u32 hash = hash_u32((u32)i * 2654435761U);
+        float center_x = ((float)(i % cells_x) + 0.25f + (float)(hash & 127) / 256.0f) * (float)cell_size * image->mpp_x;
+        float center_y = ((float)(i / cells_x) + 0.25f + (float)((hash >> 7) & 127) / 256.0f) * (float)cell_size * image->mpp_y;
+        float radius = (10.0f + (float)((hash >> 14) & 31)) * image->mpp_x;
+        annotation_t* annotation = annotations->set.stored_annotations + i;
+        annotation->coordinates = annotations->coordinates + (size_t)i * polygon_vertex_count;
+        annotation->group_id = (i32)((hash >> 20) & 1);
+        if ((hash >> 21) % 8 == 0) {
+            annotation->type = ANNOTATION_RECTANGLE;
+            annotation->coordinate_count = 4;
+            annotation->coordinates[0] = V2F(center_x - radius, center_y - radius);
+            annotation->coordinates[1] = V2F(center_x + radius, center_y - radius);
+            annotation->coordinates[2] = V2F(center_x + radius, center_y + radius);
+            annotation->coordinates[3] = V2F(center_x - radius, center_y + radius);
+        } else {
+            annotation->type = ANNOTATION_POLYGON;
+            annotation->coordinate_count = polygon_vertex_count;
+            for (i32 j = 0; j < polygon_vertex_count; ++j) {
+                float angle = (float)j * (2.0f * (float)M_PI / (float)polygon_vertex_count);
+                float wobble = 1.0f + 0.15f * sinf(angle * 3.0f + (float)(hash & 7));
+                annotation->coordinates[j] = V2F(center_x + radius * wobble * cosf(angle), center_y + radius * wobble * sinf(angle));
+            }
+        }
+        annotations->set.active_annotation_indices[i] = i;
+    }
+    annotations->set.stored_annotation_count = count;
+    annotations->set.active_annotation_count = count;
+    annotations->set.mpp = V2F(image->mpp_x, image->mpp_y);
+}
+
+static void destroy_bench_annotations(bench_annotations_t* annotations) {
+    free(annotations->set.stored_annotations);
+    free(annotations->set.active_annotation_indices);
+    free(annotations->coordinates);
+    memset(annotations, 0, sizeof(*annotations));
+}
+
+// Exports the region with the annotations burned in (outlines and a translucent fill), against the same export without.
+static bool bench_export_region_with_annotations(bench_options_t* options, app_state_t* app_state, image_t* image,
+                                                 bench_region_t* region, bench_annotations_t* annotations, i32 thread_count) {
+    *thread_pool_get_active_worker_thread_count_ptr(&global_thread_pool) = thread_count - 1;
+
+    char output_filename[512];
+    snprintf(output_filename, sizeof(output_filename), "%s/export_bench_%s_annotations.tiff", options->output_dir, region->name);
+    bounds2f world_bounds = pixel_bounds_to_world_bounds(region->pixel_bounds, image->mpp_x, image->mpp_y);
+    v2f target_mpp = V2F(image->mpp_x, image->mpp_y);
+
+    export_stats_t plain_stats = {0};
+    export_options_t export_options = bench_export_options(options, false, target_mpp);
+    global_tiff_export_progress = 0.0f;
+    global_tiff_export_progress_console_dots_written = 0;
+    bool success = export_cropped_bigtiff_with_resample(app_state, image, world_bounds, region->pixel_bounds, output_filename,
+                                                        &export_options, &plain_stats);
+
+    i64 setup_start = get_clock();
+    annotation_raster_t raster = {0};
+    success &= annotation_raster_init(&raster, &annotations->set, world_bounds, 512.0f * image->mpp_x, 2.0f, 0.25f);
+    float setup_seconds = get_seconds_elapsed(setup_start, get_clock());
+    export_stats_t stats = {0};
+    global_tiff_export_progress = 0.0f;
+    global_tiff_export_progress_console_dots_written = 0;
+    export_options.burn_in_annotations = &raster;
+    success &= export_cropped_bigtiff_with_resample(app_state, image, world_bounds, region->pixel_bounds, output_filename,
+                                                    &export_options, &stats);
+    i32 shape_count = raster.shape_count;
+    annotation_raster_destroy(&raster);
+    remove(output_filename);
+    if (!success) {
+        console_print_error("export_bench: export of region '%s' with annotations failed\n", region->name);
+        return false;
+    }
+
+    float peak_memory = (float)get_peak_memory_usage() / (float)MEGABYTES(1);
+    printf("\r%-6s annotated %2d threads: %7.3f s   (%.3f s without)   %d annotations   peak %6.0f MB\n",
+           region->name, thread_count, stats.total_seconds + setup_seconds, plain_stats.total_seconds, shape_count, peak_memory);
+    printf("       setup %.3f s; summed over threads: drawing annotations %.3f s, read %.3f s, encode %.3f s\n",
+           setup_seconds, stats.annotation_seconds, stats.read_seconds, stats.encode_seconds);
+
+    if (options->max_peak_memory > 0.0f && peak_memory > options->max_peak_memory) {
+        console_print_error("export_bench: peak memory use of %.0f MB is above the threshold of %.0f MB\n",
+                            peak_memory, options->max_peak_memory);
+        return false;
+    }
+    return true;
+}
+
+static bool parse_thread_counts(bench_options_t* options, const char* list) {
+    options->thread_count_count = 0;
+    const char* s = list;
+    while (*s && options->thread_count_count < BENCH_MAX_THREAD_COUNTS) {
+        i32 thread_count = atoi(s);
+        if (thread_count <= 0) {
+            return false;
+        }
+        options->thread_counts[options->thread_count_count++] = thread_count;
+        while (*s && *s != ',') ++s;
+        if (*s == ',') ++s;
+    }
+    return options->thread_count_count > 0;
+}
+
+static void print_usage(void) {
+    printf("Usage: export_bench [slide] [options]\n"
+           "  --size N                width and height of the synthetic slide (default: 16384)\n"
+           "  --threads N,N,...       thread counts to run the exports with (default: 1 and the number of logical CPUs)\n"
+           "  --memory-budget MB      memory budget for each export (default: 1024)\n"
+           "  --quick                 small synthetic slide and thread counts 1 and 2, for running under ctest\n"
+           "  --min-throughput MB/s   fail if an export reads less than this many MB/s of decoded input pixels\n"
+           "  --max-peak-memory MB    fail if the peak memory use of the process exceeds this\n"
+           "  --output-dir DIR        where to write the synthetic slide and the exported files (default: .)\n"
+           "  --verbose               print more information from the export\n");
+}
+
+int main(int argc, const char** argv) {
+    bench_options_t options = {0};
+    options.output_dir = ".";
+    options.synthetic_size = 16384;
+
+    for (i32 i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool has_value = (i + 1 < argc);
+        if (strcmp(arg, "--size") == 0 && has_value) {
+            i32 size = atoi(argv[++i]);
+            options.synthetic_size = ATLEAST(size, 512);
+        } else if (strcmp(arg, "--threads") == 0 && has_value) {
+            if (!parse_thread_counts(&options, argv[++i])) {
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(arg, "--memory-budget") == 0 && has_value) {
+            options.memory_budget = (i64)atoi(argv[++i]) * MEGABYTES(1);
+        } else if (strcmp(arg, "--quick") == 0) {
+            options.synthetic_size = 4096;
+            parse_thread_counts(&options, "1,2");
+        } else if (strcmp(arg, "--min-throughput") == 0 && has_value) {
+            options.min_throughput = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--max-peak-memory") == 0 && has_value) {
+            options.max_peak_memory = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--output-dir") == 0 && has_value) {
+            options.output_dir = argv[++i];
+        } else if (strcmp(arg, "--verbose") == 0) {
+            is_verbose_mode = true;
+        } else if (arg[0] != '-' && !options.filename) {
+            options.filename = arg;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    init_global_system_info(false);
+    i32 logical_cpu_count = global_system_info.logical_cpu_count;
+    if (options.thread_count_count == 0) {
+        options.thread_counts[options.thread_count_count++] = 1;
+        if (logical_cpu_count > 1) {
+            options.thread_counts[options.thread_count_count++] = logical_cpu_count;
+        }
+    }
+    i32 max_thread_count = 1;
+    for (i32 i = 0; i < options.thread_count_count; ++i) {
+        options.thread_counts[i] = MIN(options.thread_counts[i], MAX_THREAD_COUNT);
+        max_thread_count = MAX(max_thread_count, options.thread_counts[i]);
+    }
+    global_system_info.suggested_total_thread_count = max_thread_count;
+    init_thread_pool(&global_thread_pool, 1024, true, false, NULL);
+    thread_pool_set_thread_exit_callback(&global_thread_pool, tile_loader_thread_exit_callback);
+
+    char synthetic_filename[512];
+    const char* filename = options.filename;
+    if (!filename) {
+        snprintf(synthetic_filename, sizeof(synthetic_filename), "%s/export_bench_source.tiff", options.output_dir);
+        i64 start = get_clock();
+        if (!write_synthetic_slide(synthetic_filename, options.synthetic_size)) {
+            return 1;
+        }
+        printf("export_bench: generated a %dx%d synthetic slide in %.3f s\n", options.synthetic_size, options.synthetic_size,
+               get_seconds_elapsed(start, get_clock()));
+        filename = synthetic_filename;
+    }
+
+    file_info_t file = viewer_get_file_info(filename);
+    image_t* image = file.is_valid ? image_load_from_file(&file, NULL, NULL) : NULL;
+    if (!image || !image->is_valid) {
+        console_print_error("export_bench: could not open '%s'\n", filename);
+        return 1;
+    }
+    if (!image->is_mpp_known) {
+        image->mpp_x = image->mpp_y = 0.25f; // needed for the resampled exports
+        image->is_mpp_known = true;
+    }
+    printf("export_bench: %s (%dx%d pixels, %g mpp), thread counts:", filename, (i32)image->width_in_pixels,
+           (i32)image->height_in_pixels, image->mpp_x);
+    for (i32 i = 0; i < options.thread_count_count; ++i) {
+        printf(" %d", options.thread_counts[i]);
+    }
+    printf("\n\n");
+
+    // A whole-slide export (tile-aligned, so source tiles may be copied as they are) and an unaligned crop.
+    i32 width = (i32)image->width_in_pixels;
+    i32 height = (i32)image->height_in_pixels;
+    bench_region_t regions[] = {
+        {"full", BOUNDS2I(0, 0, width, height)},
+        {"crop", BOUNDS2I(width / 8 + 101, height / 8 + 57, width - width / 8, height - height / 8)},
+    };
+
+    app_state_t* app_state = (app_state_t*)calloc(1, sizeof(app_state_t));
+    bool success = true;
+    for (i32 region_index = 0; region_index < COUNT(regions); ++region_index) {
+        for (i32 resize = 0; resize <= 1; ++resize) {
+            for (i32 i = 0; i < options.thread_count_count; ++i) {
+                success &= bench_export_region(&options, app_state, image, regions + region_index, resize, options.thread_counts[i]);
+            }
+        }
+    }
+    // Exporting at several resolutions at once is mostly done for ROIs, so only the crop is benchmarked.
+    for (i32 i = 0; i < options.thread_count_count; ++i) {
+        success &= bench_export_region_at_multiple_resolutions(&options, app_state, image, regions + 1, options.thread_counts[i]);
+    }
+    bench_annotations_t annotations;
+    create_bench_annotations(&annotations, image);
+    for (i32 i = 0; i < options.thread_count_count; ++i) {
+        success &= bench_export_region_with_annotations(&options, app_state, image, regions + 1, &annotations, options.thread_counts[i]);
+    }
+    destroy_bench_annotations(&annotations);
+
+    image_destroy(image);
+    thread_pool_destroy(&global_thread_pool);
+    if (!options.filename) {
+        remove(synthetic_filename);
+    }
+    printf("\nexport_bench: %s\n", success ? "passed" : "FAILED");
+    return success ? 0 : 1;
+}
@@ -27,6 +27,7 @@
 
 #include "common.h"
 #include "platform.h" // for console_print_error
+#include "intrinsics.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -810,6 +811,203 @@ int LZWDecodeCompat(PseudoTIFF* tif, uint8* op0, size_t occ0, uint16 s)
 }
 #endif /* LZW_COMPAT */
 
+/*
+ * Fast decoder for a complete strip or tile held in memory (MSB-first codes only).
+ *
+ * Instead of walking the linked code table backwards for every code, each table
+ * entry refers to a span of the output that has already been decoded: a new entry
+ * is always the previous string followed by the first byte of the current string,
+ * and in the output those bytes are adjacent. Decoding a code therefore becomes a
+ * single forward copy, which for the (common) short strings is done with two
+ * unaligned 8-byte moves.
+ *
+ * The common case is table-driven, so that it runs as straight-line code for groups
+ * of up to four codes per refill of the bit buffer:
+ * - literals are table entries too (pointing into a 256-byte identity table), so
+ *   they are copied like any other string;
+ * - the entry for the next free code is filled in before that code can be read,
+ *   so a KwKwK code decodes like any other code. Only its last byte (the first byte
+ *   of the string itself) is not in the output yet; it is stored afterwards, through
+ *   a pointer that is selected without branching;
+ * - the code width is looked up from free_ent, and once the table is full, new
+ *   entries go into a spare slot that is never read;
+ * - codes beyond the table are flagged, and decoded as a literal in the meantime (the
+ *   output is discarded in that case).
+ * The clear and end-of-information codes and the last bytes of the input and output
+ * go through the careful path, one code at a time.
+ */
+
+#define LZW_SPARE_SLOT (MAXCODE(BITS_MAX)+1)
+#define LZW_SHORT_STRING 16
+#define LZW_GROUP_SIZE 4
+
+typedef struct lzw_string_t {
+	const uint8* start;
+	uint32 length;
+} lzw_string_t;
+
+/* Code width, indexed by (free_ent + 1) >> 9; widths change one code early (see note above). */
+static const uint8 lzw_code_width[] = { 9, 10, 11, 11, 12, 12, 12, 12, 12 };
+
+int LZWDecodeFast(const uint8* input, size_t input_size, uint8* output, size_t output_size)
+{
+	static const char module[] = "LZWDecodeFast";
+	uint8 literals[256 + LZW_SHORT_STRING];
+	lzw_string_t table[LZW_SPARE_SLOT+1];
+	const uint8* ip = input;
+	const uint8* ip_end = input + input_size;
+	uint8* op = output;
+	uint8* op_end = output + output_size;
+	uint64 bitbuf = 0;
+	long bitcount = 0;
+	uint32 free_ent = CODE_FIRST;
+	const uint8* prev = NULL;
+	uint32 prev_length = 0;
+	uint32 corrupted = 0;
+	uint8 unused_byte;
+
+	for (int i = 0; i < 256; ++i) {
+		literals[i] = (uint8)i;
+		table[i].start = literals + i;
+		table[i].length = 1;
+	}
+	memset(literals + 256, 0, LZW_SHORT_STRING);
+	table[CODE_CLEAR] = table[0]; /* looked up before the code is recognized */
+	table[CODE_EOI] = table[0];
+
+	for (;;) {
+		/* Fast path. Every code has at least LZW_SHORT_STRING bytes of room in the output (a longer string is only
+		 * taken if a full group still fits after it), and 8 bytes can be loaded from the input. */
+		while (prev != NULL && ip_end - ip >= 8 && op_end - op >= LZW_GROUP_SIZE * LZW_SHORT_STRING) {
+			if (bitcount < 56) {
+				uint64 next;
+				memcpy(&next, ip, 8);
+				next = bswap_64(next);
+				long refill_bytes = (63 - bitcount) >> 3;
+				bitbuf = (bitbuf << (refill_bytes * 8)) | (next >> (64 - refill_bytes * 8));
+				ip += refill_bytes;
+				bitcount += refill_bytes * 8;
+			}
+			int group_done = 1;
+			for (int k = 0; k < LZW_GROUP_SIZE; ++k) {
+				lzw_string_t* entry = table + free_ent;
+				entry->start = prev;
+				entry->length = prev_length + 1;
+
+				long nbits = lzw_code_width[(free_ent + 1) >> 9];
+				uint32 code = (uint32)(bitbuf >> (bitcount - nbits)) & (uint32)MAXCODE(nbits);
+				uint32 out_of_table = code > free_ent;
+				corrupted |= out_of_table;
+				code = out_of_table ? 0 : code;
+				const uint8* src = table[code].start;
+				uint32 len = table[code].length;
+				if (code - CODE_CLEAR < 2 ||
+				    (len > LZW_SHORT_STRING && (size_t)(op_end - op) < len + LZW_GROUP_SIZE * LZW_SHORT_STRING)) {
+					group_done = 0;
+					break; /* leave this code to the careful path */
+				}
+				bitcount -= nbits;
+
+				/* A string ends at or before op, except for the KwKwK string, whose last byte is op[0]. */
+				uint32 is_kwkwk = code == free_ent;
+				uint64 lo, hi;
+				memcpy(&lo, src, 8);
+				if (len <= LZW_SHORT_STRING) {
+					memcpy(&hi, src + 8, 8); /* load both halves before storing */
+					memcpy(op, &lo, 8);
+					memcpy(op + 8, &hi, 8);
+				} else {
+					memcpy(op, src, len - is_kwkwk);
+				}
+				*(is_kwkwk ? op + len - 1 : &unused_byte) = (uint8)lo;
+
+				free_ent += (free_ent < LZW_SPARE_SLOT);
+				prev = op;
+				prev_length = len;
+				op += len;
+			}
+			if (!group_done)
+				break;
+		}
+
+		/* Careful path: one code, with all checks. */
+		if (op >= op_end)
+			break;
+		while (bitcount <= 56 && ip < ip_end) {
+			bitbuf = (bitbuf << 8) | *ip++;
+			bitcount += 8;
+		}
+		long nbits = lzw_code_width[(free_ent + 1) >> 9];
+		if (bitcount < nbits) {
+			TIFFWarningExt(NULL, module, "Strip not terminated with EOI code");
+			break;
+		}
+		uint32 code = (uint32)(bitbuf >> (bitcount - nbits)) & (uint32)MAXCODE(nbits);
+		bitcount -= nbits;
+
+		if (code == CODE_EOI)
+			break;
+		if (code == CODE_CLEAR) {
+			free_ent = CODE_FIRST;
+			prev = NULL;
+			continue;
+		}
+		if (code > free_ent || (code == free_ent && prev == NULL)) {
+			corrupted = 1;
+			break;
+		}
+
+		if (prev != NULL) {
+			table[free_ent].start = prev;
+			table[free_ent].length = prev_length + 1;
+		}
+		const uint8* src = table[code].start;
+		uint32 len = table[code].length;
+		size_t remaining = (size_t)(op_end - op);
+		if (len > remaining) {
+			memcpy(op, src, remaining); /* string is truncated by the end of the output */
+			op = op_end;
+			break;
+		}
+		if (code == free_ent) {
+			memcpy(op, src, len - 1);
+			op[len - 1] = src[0];
+		} else {
+			memcpy(op, src, len);
+		}
+		if (prev != NULL) {
+			free_ent += (free_ent < LZW_SPARE_SLOT);
+		}
+		prev = op;
+		prev_length = len;
+		op += len;
+	}
+
+	if (corrupted) {
+		TIFFErrorExt(NULL, module, "Corrupted LZW table");
+		return (0);
+	}
+	if (op < op_end) {
+		TIFFErrorExt(NULL, module, "Not enough data (short %llu bytes)", (unsigned long long)(op_end - op));
+		return (0);
+	}
+	return (1);
+}
+
+/*
+ * Free the state allocated by LZWSetupDecode().
+ */
+void LZWCleanupDecode(PseudoTIFF* tif)
+{
+	LZWCodecState* sp = DecoderState(tif);
+	if (sp == NULL)
+		return;
+	if (sp->dec_codetab)
+		free(sp->dec_codetab);
+	free(tif->tif_data);
+	tif->tif_data = NULL;
+}
+
 /*
  * LZW Encoding.
  */
@@ -28,6 +28,8 @@ int LZWSetupDecode(PseudoTIFF* tif);
 int LZWPreDecode(PseudoTIFF* tif, uint16 s);
 int LZWDecode(PseudoTIFF* tif, uint8* op0, size_t occ0, uint16 s);
 int LZWDecodeCompat(PseudoTIFF* tif, uint8* op0, size_t occ0, uint16 s);
+void LZWCleanupDecode(PseudoTIFF* tif);
+int LZWDecodeFast(const uint8* input, size_t input_size, uint8* output, size_t output_size);
 
 #ifdef __cplusplus
 }
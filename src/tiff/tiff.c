@@ -23,8 +23,12 @@
 
 #include "tiff.h"
 #include "tif_lzw.h"
+#include "intrinsics.h"
 #include "remote.h"
 #include "jpeg_decoder.h"
+#include "webp_api.h"
+#include "miniz.h"
+#include "zstd/zstd.h"
 
 u32 get_tiff_field_size(u16 data_type) {
 	u32 size = 0;
@@ -329,6 +333,232 @@ tiff_rational_t float_to_tiff_rational(double x) {
 	return result;
 }
 
+// Tile offsets and byte counts are loaded one page at a time, the first time a tile in that page is accessed.
+// Pages are published with a barrier, so that readers never need to take the lock once the page is there.
+// The lock only guards the publishing: pages are read (possibly remotely) outside of it.
+static platform_mutex_t tiff_tile_offset_page_mutex = PLATFORM_MUTEX_INITIALIZER;
+
+static void tiff_init_tile_offset_pages(tiff_ifd_t* ifd) {
+	ifd->tile_offset_page_count = (ifd->tile_count + TIFF_TILE_OFFSET_PAGE_ENTRIES - 1) >> TIFF_TILE_OFFSET_PAGE_SHIFT;
+	ifd->tile_offset_pages = (tiff_tile_offset_page_t**) calloc(ATLEAST(1, ifd->tile_offset_page_count), sizeof(tiff_tile_offset_page_t*));
+}
+
+#if !IS_SERVER
+// Copies bytes from the local file, from the memory mapping if there is one.
+static bool tiff_read_at_offset(tiff_t* tiff, void* dest, u64 offset, u64 size) {
+	u8* mapped = mapped_file_get_bytes(&tiff->mapped_file, offset, size);
+	if (mapped) {
+		memcpy(dest, mapped, size);
+		return true;
+	}
+	return file_handle_read_at_offset(dest, tiff->file_handle, offset, size) == size;
+}
+#endif
+
+// Reads the integers [first, first + count) of an array-valued tag, widened to u64 and converted to native byte order.
+static bool tiff_read_tag_integer_range(tiff_t* tiff, tiff_tag_t* tag, u64 first, u64 count, u64* dest) {
+	u64 bytesize = get_tiff_field_size(tag->data_type);
+	u64 read_size = count * bytesize;
+	if (first + count > tag->data_count || (bytesize != 2 && bytesize != 4 && bytesize != 8)) {
+		return false;
+	}
+	u8* raw = (u8*)dest; // the raw values are widened in place, back to front
+	if (!tag->data_is_offset) {
+		memcpy(raw, tag->data + first * bytesize, read_size);
+	} else {
+		u64 file_offset = tag->offset + first * bytesize;
+		if (!tiff->is_remote) {
+#if IS_SERVER
+			return false; // the server sends the raw file ranges instead
+#else
+			if (!tiff_read_at_offset(tiff, raw, file_offset, read_size)) {
+				return false;
+			}
+#endif
+		} else {
+			i32 bytes_read = 0;
+			u8* read_buffer = download_remote_chunk(tiff->location.hostname, tiff->location.portno, tiff->location.filename,
+			                                        file_offset, read_size, &bytes_read, 0);
+			bool ok = false;
+			if (read_buffer && bytes_read > 0) {
+				i64 content_offset = find_end_of_http_headers(read_buffer, bytes_read);
+				if (bytes_read - content_offset >= (i64)read_size) {
+					memcpy(raw, read_buffer + content_offset, read_size);
+					ok = true;
+				}
+			}
+			if (read_buffer) free(read_buffer);
+			if (!ok) return false;
+		}
+	}
+	// Inlined tag data has already been converted to native byte order when the tag was read.
+	bool swap = tag->data_is_offset && DATA_ENDIAN_DIFFERS(tiff->is_big_endian);
+	switch (bytesize) {
+		case 8: {
+			if (swap) {
+				for (u64 i = 0; i < count; ++i) {
+					dest[i] = bswap_64(dest[i]);
+				}
+			}
+		} break;
+		case 4: {
+			for (u64 i = count; i-- > 0; ) {
+				u32 value = ((u32*)raw)[i];
+				dest[i] = swap ? bswap_32(value) : value;
+			}
+		} break;
+		case 2: {
+			for (u64 i = count; i-- > 0; ) {
+				u16 value = ((u16*)raw)[i];
+				dest[i] = swap ? bswap_16(value) : value;
+			}
+		} break;
+		default: break;
+	}
+	return true;
+}
+
+static tiff_tile_offset_page_t* tiff_load_tile_offset_page(tiff_t* tiff, tiff_ifd_t* ifd, u64 page_index) {
+	u64 first = page_index << TIFF_TILE_OFFSET_PAGE_SHIFT;
+	u64 count = MIN(TIFF_TILE_OFFSET_PAGE_ENTRIES, ifd->tile_count - first);
+	tiff_tile_offset_page_t* page = (tiff_tile_offset_page_t*) malloc(sizeof(tiff_tile_offset_page_t));
+	if (!page) return NULL;
+	if (!tiff_read_tag_integer_range(tiff, &ifd->tile_offsets_tag, first, count, page->offsets) ||
+	    !tiff_read_tag_integer_range(tiff, &ifd->tile_byte_counts_tag, first, count, page->byte_counts)) {
+		console_print_error("Error: could not read tile offsets %llu-%llu of IFD %llu\n", first, first + count - 1, ifd->ifd_index);
+		free(page);
+		return NULL;
+	}
+	return page;
+}
+
+bool tiff_get_tile_location(tiff_t* tiff, tiff_ifd_t* ifd, u64 tile_index, u64* tile_offset, u64* tile_byte_count) {
+	if (tile_index >= ifd->tile_count || !ifd->tile_offset_pages) {
+		return false;
+	}
+	u64 page_index = tile_index >> TIFF_TILE_OFFSET_PAGE_SHIFT;
+	tiff_tile_offset_page_t* page = ((tiff_tile_offset_page_t* volatile*)ifd->tile_offset_pages)[page_index];
+	read_barrier;
+	if (!page) {
+		tiff_tile_offset_page_t* loaded_page = tiff_load_tile_offset_page(tiff, ifd, page_index);
+		if (!loaded_page) {
+			return false;
+		}
+		// Another thread may have loaded the same page in the meantime; in that case, keep theirs.
+		platform_mutex_lock(&tiff_tile_offset_page_mutex);
+		page = ifd->tile_offset_pages[page_index];
+		if (!page) {
+			page = loaded_page;
+			loaded_page = NULL;
+			write_barrier;
+			((tiff_tile_offset_page_t* volatile*)ifd->tile_offset_pages)[page_index] = page;
+		}
+		platform_mutex_unlock(&tiff_tile_offset_page_mutex);
+		if (loaded_page) {
+			free(loaded_page);
+		}
+	}
+	u64 index_in_page = tile_index & (TIFF_TILE_OFFSET_PAGE_ENTRIES - 1);
+	*tile_offset = page->offsets[index_in_page];
+	*tile_byte_count = page->byte_counts[index_in_page];
+	return true;
+}
+
+// Prepares tiled access to an NDPI level, by parsing the header of its JPEG stream. The restart intervals
+// listed in the McuStarts tag must not span multiple MCU rows; otherwise the level is decoded as a whole.
+static bool tiff_ndpi_init_tiling(tiff_t* tiff, tiff_ifd_t* ifd) {
+	if (ifd->compression != TIFF_COMPRESSION_JPEG || ifd->strip_count != 1 || !ifd->strip_offsets || !ifd->strip_byte_counts ||
+	    !ifd->ndpi_optimization_markers || ifd->ndpi_optimization_count == 0) {
+		return false;
+	}
+	u64 strip_size = ifd->strip_byte_counts[0];
+	u64 header_length = ifd->ndpi_optimization_markers[0]; // the first restart interval starts right after the header
+	if (header_length < 4 || header_length > 65536 || header_length >= strip_size) {
+		return false;
+	}
+	u8* header = (u8*)malloc(header_length);
+	if (file_read_at_offset(header, tiff->fp, ifd->strip_offsets[0], header_length) != header_length) {
+		free(header);
+		return false;
+	}
+
+	u32 sof_dimensions_offset = 0;
+	u32 max_h_samp = 1;
+	u32 max_v_samp = 1;
+	u32 restart_interval = 0;
+	u64 scan_start = 0;
+	u64 pos = 2; // skip SOI
+	while (pos + 4 <= header_length && header[pos] == 0xFF) {
+		u8 marker = header[pos + 1];
+		u32 segment_length = ((u32)header[pos + 2] << 8) | header[pos + 3];
+		if (pos + 2 + segment_length > header_length) {
+			break;
+		}
+		u8* segment = header + pos + 4;
+		if (marker == 0xC0 || marker == 0xC1) {
+			// baseline or extended sequential DCT
+			sof_dimensions_offset = (u32)pos + 5;
+			u32 component_count = segment[5];
+			if (segment_length < 8 + 3 * component_count) break;
+			for (u32 i = 0; i < component_count; ++i) {
+				u8 sampling_factors = segment[6 + i * 3 + 1];
+				max_h_samp = MAX(max_h_samp, (u32)(sampling_factors >> 4));
+				max_v_samp = MAX(max_v_samp, (u32)(sampling_factors & 0xF));
+			}
+		} else if (marker == 0xDD && segment_length == 4) {
+			restart_interval = ((u32)segment[0] << 8) | segment[1];
+		} else if (marker == 0xDA) {
+			scan_start = pos + 2 + segment_length;
+			break;
+		} else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			break; // progressive, lossless or arithmetic coding: not supported
+		}
+		pos += 2 + segment_length;
+	}
+	if (sof_dimensions_offset == 0 || restart_interval == 0 || scan_start != header_length) {
+		free(header);
+		return false;
+	}
+
+	tiff_ndpi_tiling_t tiling = {0};
+	tiling.jpeg_header = header;
+	tiling.jpeg_header_length = (u32)header_length;
+	tiling.sof_dimensions_offset = sof_dimensions_offset;
+	tiling.mcu_width = 8 * max_h_samp;
+	tiling.mcu_height = 8 * max_v_samp;
+	tiling.restart_interval = restart_interval;
+	tiling.interval_width = restart_interval * tiling.mcu_width;
+	u32 mcus_per_row = (ifd->image_width + tiling.mcu_width - 1) / tiling.mcu_width;
+	tiling.intervals_per_row = mcus_per_row / restart_interval;
+	tiling.mcu_row_count = (ifd->image_height + tiling.mcu_height - 1) / tiling.mcu_height;
+	tiling.intervals_per_tile = ATLEAST(1, TIFF_VIRTUAL_TILE_SIZE / tiling.interval_width);
+	tiling.mcu_rows_per_tile = ATLEAST(1, TIFF_VIRTUAL_TILE_SIZE / tiling.mcu_height);
+	u32 tile_width = tiling.intervals_per_tile * tiling.interval_width;
+	if (mcus_per_row % restart_interval != 0 || tile_width > 65535 ||
+	    (u64)tiling.intervals_per_row * tiling.mcu_row_count != ifd->ndpi_optimization_count) {
+		console_print_verbose("NDPI: IFD %d cannot be decoded per tile\n", (i32)ifd->ifd_index);
+		free(header);
+		return false;
+	}
+	for (u64 i = 1; i < ifd->ndpi_optimization_count; ++i) {
+		u64 start = ifd->ndpi_optimization_markers[i];
+		if (start <= ifd->ndpi_optimization_markers[i - 1] + 2 || start >= strip_size) {
+			free(header);
+			return false;
+		}
+	}
+
+	ifd->ndpi_tiling = (tiff_ndpi_tiling_t*)malloc(sizeof(tiff_ndpi_tiling_t));
+	*ifd->ndpi_tiling = tiling;
+	ifd->tile_width = tile_width;
+	ifd->tile_height = tiling.mcu_rows_per_tile * tiling.mcu_height;
+	ifd->width_in_tiles = (tiling.intervals_per_row + tiling.intervals_per_tile - 1) / tiling.intervals_per_tile;
+	ifd->height_in_tiles = (tiling.mcu_row_count + tiling.mcu_rows_per_tile - 1) / tiling.mcu_rows_per_tile;
+	ifd->tile_count = (u64)ifd->width_in_tiles * ifd->height_in_tiles;
+	ifd->is_tiled = true; // virtually
+	return true;
+}
+
 bool tiff_read_ifd(tiff_t* tiff, tiff_ifd_t* ifd, u64* next_ifd_offset) {
 	bool is_bigtiff = tiff->is_bigtiff;
 	bool is_big_endian = tiff->is_big_endian;
@@ -503,7 +733,7 @@ bool tiff_read_ifd(tiff_t* tiff, tiff_ifd_t* ifd, u64* next_ifd_offset) {
 					free(tags);
 					return false; // failed
 				}
-			}
+			} break;
 			case TIFF_TAG_X_RESOLUTION: {
 				tiff_rational_t resolution = tiff_read_field_rational(tiff, tag);
 				ifd->x_resolution = resolution;
@@ -551,12 +781,15 @@ bool tiff_read_ifd(tiff_t* tiff, tiff_ifd_t* ifd, u64* next_ifd_offset) {
 			} break;
 			case TIFF_TAG_TILE_OFFSETS: {
 				// TODO: to be sure, need check PlanarConfiguration==1 to check how to interpret the data count?
-				ifd->tile_count = tag->data_count;
-				ifd->tile_offsets = tiff_read_field_integers(tiff, tag);
-				if (ifd->tile_offsets == NULL) {
+				// Note: the offsets themselves are read lazily, see tiff_get_tile_location().
+				u64 bytesize = get_tiff_field_size(tag->data_type);
+				if (bytesize != 2 && bytesize != 4 && bytesize != 8) {
+					console_print("Error: unexpected data type (%d) for the TIFF TileOffsets tag\n", tag->data_type);
 					free(tags);
 					return false; // failed
 				}
+				ifd->tile_count = tag->data_count;
+				ifd->tile_offsets_tag = *tag;
 			} break;
 			case TIFF_TAG_TILE_BYTE_COUNTS: {
 				// Note: is it OK to assume that the TileByteCounts will always come after the TileOffsets?
@@ -566,11 +799,13 @@ bool tiff_read_ifd(tiff_t* tiff, tiff_ifd_t* ifd, u64* next_ifd_offset) {
 					free(tags);
 					return false; // failed;
 				}
-				ifd->tile_byte_counts = tiff_read_field_integers(tiff, tag);
-				if (ifd->tile_byte_counts == NULL) {
+				u64 bytesize = get_tiff_field_size(tag->data_type);
+				if (bytesize != 2 && bytesize != 4 && bytesize != 8) {
+					console_print("Error: unexpected data type (%d) for the TIFF TileByteCounts tag\n", tag->data_type);
 					free(tags);
 					return false; // failed
 				}
+				ifd->tile_byte_counts_tag = *tag;
 			} break;
 			case TIFF_TAG_SAMPLE_FORMAT: {
 				u16* formats = tiff_read_field_u16(tiff, tag);
@@ -661,13 +896,22 @@ bool tiff_read_ifd(tiff_t* tiff, tiff_ifd_t* ifd, u64* next_ifd_offset) {
             case NDPI_TAG_ALWAYS_1: {
                 ifd->is_ndpi = true;
                 tiff->is_ndpi = true;
-            }
+            } break;
             case NDPI_TAG_SOURCE_LENS: {
-                // objective power
+                // objective power; -1 means that this is the macro image
+                if (tag->data_type == TIFF_FLOAT) {
+                    float source_lens;
+                    memcpy(&source_lens, tag->data, sizeof(float));
+                    if (source_lens < 0.0f) {
+                        ifd->subimage_type = TIFF_MACRO_SUBIMAGE;
+                        tiff->macro_image = ifd;
+                        tiff->macro_image_index = ifd->ifd_index;
+                    }
+                }
             } break;
             case NDPI_TAG_OPTIMISATION_FILE: {
-                ifd->ndpi_optimization_markers = (u32*)tiff_read_field_integers(tiff, tag);
-                ifd->ndpi_optimization_count = tag->data_count;
+                ifd->ndpi_optimization_markers = tiff_read_field_integers(tiff, tag);
+                ifd->ndpi_optimization_count = ifd->ndpi_optimization_markers ? tag->data_count : 0;
             } break;
 			default: {
 			} break;
@@ -678,12 +922,15 @@ bool tiff_read_ifd(tiff_t* tiff, tiff_ifd_t* ifd, u64* next_ifd_offset) {
 
 	free(tags);
 
-    if (ifd->is_ndpi) {
-        DUMMY_STATEMENT;
-    }
-
 	if (ifd->tile_count > 0) {
 		ifd->is_tiled = true;
+		if (ifd->tile_byte_counts_tag.data_count != ifd->tile_count) {
+			console_print("Error: TIFF TileByteCounts tag is missing\n");
+			return false;
+		}
+		tiff_init_tile_offset_pages(ifd);
+	} else if (ifd->is_ndpi && ifd->subimage_type != TIFF_MACRO_SUBIMAGE) {
+		tiff_ndpi_init_tiling(tiff, ifd);
 	}
 
 	if (ifd->tile_width > 0) {
@@ -890,8 +1137,23 @@ void tiff_post_init(tiff_t* tiff) {
 		main_image->downsample_factor = 1.0f;
 		main_image->um_per_pixel_x = tiff->mpp_x;
 		main_image->um_per_pixel_y = tiff->mpp_y;
-		main_image->tile_width = main_image->image_width;
-		main_image->tile_height = main_image->image_height;
+		// Expose the strips as virtual tiles, so that only the strips covering a tile need to be decoded.
+		if (main_image->rows_per_strip == 0 || main_image->rows_per_strip > main_image->image_height) {
+			main_image->rows_per_strip = main_image->image_height; // the whole image is one strip
+		}
+		main_image->tile_width = MIN(TIFF_VIRTUAL_TILE_SIZE, main_image->image_width);
+		main_image->tile_height = MIN(TIFF_VIRTUAL_TILE_SIZE, main_image->image_height);
+		if (main_image->tile_width > 0 && main_image->tile_height > 0) {
+			main_image->width_in_tiles = (main_image->image_width + main_image->tile_width - 1) / main_image->tile_width;
+			main_image->height_in_tiles = (main_image->image_height + main_image->tile_height - 1) / main_image->tile_height;
+			main_image->tile_count = (u64)main_image->width_in_tiles * main_image->height_in_tiles;
+		}
+		if (main_image->rows_per_strip > 0) {
+			u64 expected_strip_count = (main_image->image_height + main_image->rows_per_strip - 1) / main_image->rows_per_strip;
+			if (main_image->strip_count < expected_strip_count) {
+				console_print_error("TIFF: image has %llu strips, expected %llu\n", main_image->strip_count, expected_strip_count);
+			}
+		}
 		main_image->x_tile_side_in_um = main_image->um_per_pixel_x * (float)main_image->tile_width;
 		main_image->y_tile_side_in_um = main_image->um_per_pixel_y * (float)main_image->tile_height;
 	}
@@ -980,6 +1242,8 @@ bool32 open_tiff_file(tiff_t* tiff, const char* filename) {
 			if (!tiff->file_handle) {
 				console_print_error("Failed to reopen WSI for simultaneous access\n");
 				success = false;
+			} else if (use_memory_mapped_files) {
+				mapped_file_open(&tiff->mapped_file, tiff->file_handle, FILE_ACCESS_RANDOM);
 			}
 #endif
 		}
@@ -1040,6 +1304,8 @@ memrw_t* tiff_serialize(tiff_t* tiff, memrw_t* buffer) {
 			.tile_width = ifd->tile_width,
 			.tile_height = ifd->tile_height,
 			.tile_count = ifd->tile_count,
+			.tile_offsets_tag = ifd->tile_offsets_tag,
+			.tile_byte_counts_tag = ifd->tile_byte_counts_tag,
 			.image_description_length = ifd->image_description_length,
 			.jpeg_tables_length = ifd->jpeg_tables_length,
 			.compression = ifd->compression,
@@ -1059,18 +1325,15 @@ memrw_t* tiff_serialize(tiff_t* tiff, memrw_t* buffer) {
 		uncompressed_size += ifd->image_description_length;
 #endif
 		uncompressed_size += ifd->jpeg_tables_length;
-		uncompressed_size += ifd->tile_count * sizeof(ifd->tile_offsets[0]);
-		uncompressed_size += ifd->tile_count * sizeof(ifd->tile_byte_counts[0]);
 	}
 	uncompressed_size += tiff->ifd_count * sizeof(tiff_serial_ifd_t);
 
-	// blocks: need separate blocks for each IFD's image descriptions, tile offsets, tile byte counts, jpeg tables
+	// blocks: need separate blocks for each IFD's image descriptions and jpeg tables
+	// (tile offsets and byte counts are not sent: the client reads them from the file in pages, when needed)
 #if INCLUDE_IMAGE_DESCRIPTION
 	uncompressed_size += tiff->ifd_count * sizeof(serial_block_t);
 #endif
 	uncompressed_size += tiff->ifd_count * sizeof(serial_block_t);
-	uncompressed_size += tiff->ifd_count * sizeof(serial_block_t);
-	uncompressed_size += tiff->ifd_count * sizeof(serial_block_t);
 
 	// block: terminator (end of stream marker)
 	uncompressed_size += sizeof(serial_block_t);
@@ -1090,14 +1353,6 @@ memrw_t* tiff_serialize(tiff_t* tiff, memrw_t* buffer) {
 		memrw_push_tiff_block(buffer, SERIAL_BLOCK_TIFF_IMAGE_DESCRIPTION, i, ifd->image_description_length);
 		memrw_push_back(buffer, ifd->image_description, ifd->image_description_length);
 #endif
-		u64 tile_offsets_size = ifd->tile_count * sizeof(ifd->tile_offsets[0]);
-		memrw_push_tiff_block(buffer, SERIAL_BLOCK_TIFF_TILE_OFFSETS, i, tile_offsets_size);
-		memrw_push_back(buffer, ifd->tile_offsets, tile_offsets_size);
-
-		u64 tile_byte_counts_size = ifd->tile_count * sizeof(ifd->tile_byte_counts[0]);
-		memrw_push_tiff_block(buffer, SERIAL_BLOCK_TIFF_TILE_BYTE_COUNTS, i, tile_byte_counts_size);
-		memrw_push_back(buffer, ifd->tile_byte_counts, tile_byte_counts_size);
-
 		memrw_push_tiff_block(buffer, SERIAL_BLOCK_TIFF_JPEG_TABLES, i, ifd->jpeg_tables_length);
 		memrw_push_back(buffer, ifd->jpeg_tables, ifd->jpeg_tables_length);
 
@@ -1245,10 +1500,44 @@ bool32 tiff_deserialize(tiff_t* tiff, u8* buffer, u64 buffer_size) {
 	POP_BLOCK();
 	if (block->block_type != SERIAL_BLOCK_TIFF_IFDS) goto failed;
 	u64 serial_ifds_block_size = tiff->ifd_count * sizeof(tiff_serial_ifd_t);
-	if (block->length != serial_ifds_block_size) goto failed;
+	bool is_legacy_ifd_layout = false;
+	if (block->length != serial_ifds_block_size) {
+		// Older servers send IFDs without the tile offset tags, followed by the complete tile offset arrays.
+		if (block->length != tiff->ifd_count * sizeof(tiff_serial_ifd_legacy_t)) goto failed;
+		is_legacy_ifd_layout = true;
+	}
 
-	POP_DATA(serial_ifds_block_size);
+	POP_DATA(block->length);
 	tiff_serial_ifd_t* serial_ifds = (tiff_serial_ifd_t*) data;
+	if (is_legacy_ifd_layout) {
+		tiff_serial_ifd_legacy_t* legacy_ifds = (tiff_serial_ifd_legacy_t*) data;
+		serial_ifds = (tiff_serial_ifd_t*) alloca(serial_ifds_block_size);
+		for (i32 i = 0; i < tiff->ifd_count; ++i) {
+			tiff_serial_ifd_legacy_t* legacy = legacy_ifds + i;
+			serial_ifds[i] = (tiff_serial_ifd_t) {
+				.image_width = legacy->image_width,
+				.image_height = legacy->image_height,
+				.tile_width = legacy->tile_width,
+				.tile_height = legacy->tile_height,
+				.tile_count = legacy->tile_count,
+				// no tile offset tags: the pages are filled in from the SERIAL_BLOCK_TIFF_TILE_OFFSETS blocks below
+				.image_description_length = legacy->image_description_length,
+				.jpeg_tables_length = legacy->jpeg_tables_length,
+				.compression = legacy->compression,
+				.color_space = legacy->color_space,
+				.level_magnification = legacy->level_magnification,
+				.width_in_tiles = legacy->width_in_tiles,
+				.height_in_tiles = legacy->height_in_tiles,
+				.um_per_pixel_x = legacy->um_per_pixel_x,
+				.um_per_pixel_y = legacy->um_per_pixel_y,
+				.x_tile_side_in_um = legacy->x_tile_side_in_um,
+				.y_tile_side_in_um = legacy->y_tile_side_in_um,
+				.chroma_subsampling_horizontal = legacy->chroma_subsampling_horizontal,
+				.chroma_subsampling_vertical = legacy->chroma_subsampling_vertical,
+				.subimage_type = legacy->subimage_type,
+			};
+		}
+	}
 
 	// TODO: maybe not use a stretchy_buffer here?
 	tiff->ifds = (tiff_ifd_t*) calloc(1, sizeof(tiff_ifd_t) * tiff->ifd_count); // allocate space for the IFD's
@@ -1264,8 +1553,10 @@ bool32 tiff_deserialize(tiff_t* tiff, u8* buffer, u64 buffer_size) {
 		ifd->tile_width = serial_ifd->tile_width;
 		ifd->tile_height = serial_ifd->tile_height;
 		ifd->tile_count = serial_ifd->tile_count;
-		ifd->tile_offsets = NULL; // set later
-		ifd->tile_byte_counts = NULL; // set later
+		ifd->is_tiled = ifd->tile_count > 0; // strips are not sent, so only tiled IFDs have tiles
+		ifd->tile_offsets_tag = serial_ifd->tile_offsets_tag;
+		ifd->tile_byte_counts_tag = serial_ifd->tile_byte_counts_tag;
+		tiff_init_tile_offset_pages(ifd); // pages are loaded later, or filled in by legacy SERIAL_BLOCK_TIFF_TILE_OFFSETS blocks
 		ifd->image_description = NULL; // set later
 		ifd->image_description_length = serial_ifd->image_description_length;
 		ifd->jpeg_tables = NULL; // set later
@@ -1317,21 +1608,24 @@ bool32 tiff_deserialize(tiff_t* tiff, u8* buffer, u64 buffer_size) {
 				referenced_ifd->image_description[block->length] = '\0';
 				referenced_ifd->image_description_length = block->length;
 			} break;
-			case SERIAL_BLOCK_TIFF_TILE_OFFSETS: {
-				if (referenced_ifd->tile_offsets) {
-					console_print_error("tiff_deserialize(): IFD %u already has tile offsets\n", block->index);
-					goto failed;
-				}
-				referenced_ifd->tile_offsets = (u64*) malloc(block->length);
-				memcpy(referenced_ifd->tile_offsets, block_content, block->length);
-			} break;
+			case SERIAL_BLOCK_TIFF_TILE_OFFSETS:
 			case SERIAL_BLOCK_TIFF_TILE_BYTE_COUNTS: {
-				if (referenced_ifd->tile_byte_counts) {
-					console_print_error("tiff_deserialize(): IFD %u already has tile byte counts\n", block->index);
+				// Sent by older servers: the complete arrays, which we split into (already loaded) pages.
+				if (block->length != referenced_ifd->tile_count * sizeof(u64)) {
+					console_print_error("tiff_deserialize(): IFD %u has a tile offsets block of unexpected size\n", block->index);
 					goto failed;
 				}
-				referenced_ifd->tile_byte_counts = (u64*) malloc(block->length);
-				memcpy(referenced_ifd->tile_byte_counts, block_content, block->length);
+				bool is_offsets = block->block_type == SERIAL_BLOCK_TIFF_TILE_OFFSETS;
+				for (u64 page_index = 0; page_index < referenced_ifd->tile_offset_page_count; ++page_index) {
+					tiff_tile_offset_page_t* page = referenced_ifd->tile_offset_pages[page_index];
+					if (!page) {
+						page = (tiff_tile_offset_page_t*) calloc(1, sizeof(tiff_tile_offset_page_t));
+						referenced_ifd->tile_offset_pages[page_index] = page;
+					}
+					u64 first = page_index << TIFF_TILE_OFFSET_PAGE_SHIFT;
+					u64 count = MIN(TIFF_TILE_OFFSET_PAGE_ENTRIES, referenced_ifd->tile_count - first);
+					memcpy(is_offsets ? page->offsets : page->byte_counts, (u64*)block_content + first, count * sizeof(u64));
+				}
 			} break;
 			case SERIAL_BLOCK_TIFF_JPEG_TABLES: {
 				if (referenced_ifd->jpeg_tables) {
@@ -1372,12 +1666,27 @@ bool32 tiff_deserialize(tiff_t* tiff, u8* buffer, u64 buffer_size) {
 
 }
 
+static platform_mutex_t tiff_strip_cache_mutex = PLATFORM_MUTEX_INITIALIZER;
+
+static void tiff_destroy_strip_cache(tiff_ifd_t* ifd) {
+	tiff_strip_cache_t* cache = ifd->strip_cache;
+	if (cache) {
+		for (i32 i = 0; i < cache->entry_count; ++i) {
+			if (cache->entries[i].pixels) free(cache->entries[i].pixels);
+		}
+		free(cache->entries);
+		free(cache);
+		ifd->strip_cache = NULL;
+	}
+}
+
 void tiff_destroy(tiff_t* tiff) {
 	if (tiff->fp) {
 		file_stream_close(tiff->fp);
 		tiff->fp = NULL;
 	}
 #if !IS_SERVER
+	mapped_file_close(&tiff->mapped_file);
 #if WINDOWS
 	if (tiff->file_handle) {
 		CloseHandle(tiff->file_handle);
@@ -1391,14 +1700,25 @@ void tiff_destroy(tiff_t* tiff) {
 
 	for (i32 i = 0; i < tiff->ifd_count; ++i) {
 		tiff_ifd_t* ifd = tiff->ifds + i;
-		if (ifd->tile_offsets) free(ifd->tile_offsets);
-		if (ifd->tile_byte_counts) free(ifd->tile_byte_counts);
+		tiff_destroy_strip_cache(ifd);
+		if (ifd->strip_offsets) free(ifd->strip_offsets);
+		if (ifd->strip_byte_counts) free(ifd->strip_byte_counts);
+		if (ifd->tile_offset_pages) {
+			for (u64 page_index = 0; page_index < ifd->tile_offset_page_count; ++page_index) {
+				if (ifd->tile_offset_pages[page_index]) free(ifd->tile_offset_pages[page_index]);
+			}
+			free(ifd->tile_offset_pages);
+		}
 		if (ifd->image_description) free(ifd->image_description);
 		if (ifd->xmp) free(ifd->xmp);
 		if (ifd->software) free(ifd->software);
 		if (ifd->jpeg_tables) free(ifd->jpeg_tables);
 		if (ifd->reference_black_white) free(ifd->reference_black_white);
         if (ifd->ndpi_optimization_markers) free(ifd->ndpi_optimization_markers);
+		if (ifd->ndpi_tiling) {
+			free(ifd->ndpi_tiling->jpeg_header);
+			free(ifd->ndpi_tiling);
+		}
 	}
 	// TODO: fix this, choose either stretchy_buffer or regular malloc, not both...
 	if (tiff->is_remote) {
@@ -1452,497 +1772,902 @@ static inline u32 lookup_color_from_lut(u8 index) {
 	return color;
 }
 
-// from libtiff: horizontal predictor decoder
-static int horAcc8(u32 stride, uint8* cp0, u32 cc) {
-    unsigned char* cp = (unsigned char*) cp0;
-    if((cc%stride)!=0) {
-//        TIFFErrorExt(tif->tif_clientdata, "horAcc8",
-//                     "%s", "(cc%stride)!=0");
-        return 0;
-    }
-    if (cc > stride) {
-        /*
-         * Pipeline the most common cases.
-         */
-        if (stride == 3)  {
-            unsigned int cr = cp[0];
-            unsigned int cg = cp[1];
-            unsigned int cb = cp[2];
-            cc -= 3;
-            cp += 3;
-            while (cc>0) {
-                cp[0] = (unsigned char) ((cr += cp[0]) & 0xff);
-                cp[1] = (unsigned char) ((cg += cp[1]) & 0xff);
-                cp[2] = (unsigned char) ((cb += cp[2]) & 0xff);
-                cc -= 3;
-                cp += 3;
-            }
-        } else if (stride == 4)  {
-            unsigned int cr = cp[0];
-            unsigned int cg = cp[1];
-            unsigned int cb = cp[2];
-            unsigned int ca = cp[3];
-            cc -= 4;
-            cp += 4;
-            while (cc>0) {
-                cp[0] = (unsigned char) ((cr += cp[0]) & 0xff);
-                cp[1] = (unsigned char) ((cg += cp[1]) & 0xff);
-                cp[2] = (unsigned char) ((cb += cp[2]) & 0xff);
-                cp[3] = (unsigned char) ((ca += cp[3]) & 0xff);
-                cc -= 4;
-                cp += 4;
-            }
-        } else  {
-            cc -= stride;
-            do {
-                for (i32 i = 0; i < stride; ++i) {
-                    cp[stride] = (unsigned char) ((cp[stride] + *cp) & 0xff);
-                    cp++;
-                }
-                cc -= stride;
-            } while (cc>0);
-        }
-    }
-    return 1;
-}
-
-
-u8* tiff_decode_tile(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 level, i32 tile_x, i32 tile_y) {
+// Horizontal differencing predictor (Predictor=2): every sample stores the difference with the same sample
+// of the pixel to its left, so undoing it is a running sum per channel along the scanline.
+// The SIMD version computes the prefix sum of a whole register of pixels with log2(n) shifted adds, then adds
+// the last pixel of the previous register (broadcast using the same shifts) to carry the sum across registers.
+#if defined(__SSE2__) || defined(__ARM_NEON)
+#if defined(__SSE2__)
+#define PRED_VEC             __m128i
+#define PRED_LOAD(p)         _mm_loadu_si128((const __m128i*)(p))
+#define PRED_STORE(p, x)     _mm_storeu_si128((__m128i*)(p), (x))
+#define PRED_ZERO()          _mm_setzero_si128()
+#define PRED_SHL(x, n)       _mm_slli_si128((x), (n))
+#define PRED_SHR(x, n)       _mm_srli_si128((x), (n))
+#define PRED_AND(x, y)       _mm_and_si128((x), (y))
+#define PRED_OR(x, y)        _mm_or_si128((x), (y))
+#define PRED_SELECT(m, x, y) _mm_or_si128(_mm_and_si128((m), (x)), _mm_andnot_si128((m), (y)))
+#define PRED_ADD8(x, y)      _mm_add_epi8((x), (y))
+#define PRED_ADD16(x, y)     _mm_add_epi16((x), (y))
+#else
+#define PRED_VEC             uint8x16_t
+#define PRED_LOAD(p)         vld1q_u8((const u8*)(p))
+#define PRED_STORE(p, x)     vst1q_u8((u8*)(p), (x))
+#define PRED_ZERO()          vdupq_n_u8(0)
+#define PRED_SHL(x, n)       vextq_u8(vdupq_n_u8(0), (x), 16 - (n))
+#define PRED_SHR(x, n)       vextq_u8((x), vdupq_n_u8(0), (n))
+#define PRED_AND(x, y)       vandq_u8((x), (y))
+#define PRED_OR(x, y)        vorrq_u8((x), (y))
+#define PRED_SELECT(m, x, y) vbslq_u8((m), (x), (y))
+#define PRED_ADD8(x, y)      vaddq_u8((x), (y))
+#define PRED_ADD16(x, y)     vreinterpretq_u8_u16(vaddq_u16(vreinterpretq_u16_u8(x), vreinterpretq_u16_u8(y)))
+#endif
 
-	u16 compression = level_ifd->compression;
-	u8* jpeg_tables = level_ifd->jpeg_tables;
-	u64 jpeg_tables_length = level_ifd->jpeg_tables_length;
+// Loading 16 bytes at offset (16 - n) gives a mask that selects the first n bytes of a register.
+static const u8 predictor_byte_masks[32] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
 
-	u64 tile_offset = 0;
-	u64 compressed_tile_size_in_bytes = 0;
-	u8* compressed_tile_data = NULL;
-	u8** compressed_strip_data = NULL;
-	bool failed = false;
+// Shift schedules: for a pixel of B bytes and K pixels per register, shifting by B, 2B, 4B, ... (while < K*B).
+#define PRED_STEPS_1(v, OP) v = OP(v, PRED_SHL(v, 1)); v = OP(v, PRED_SHL(v, 2)); v = OP(v, PRED_SHL(v, 4)); v = OP(v, PRED_SHL(v, 8));
+#define PRED_STEPS_2(v, OP) v = OP(v, PRED_SHL(v, 2)); v = OP(v, PRED_SHL(v, 4)); v = OP(v, PRED_SHL(v, 8));
+#define PRED_STEPS_3(v, OP) v = OP(v, PRED_SHL(v, 3)); v = OP(v, PRED_SHL(v, 6));
+#define PRED_STEPS_4(v, OP) v = OP(v, PRED_SHL(v, 4)); v = OP(v, PRED_SHL(v, 8));
+#define PRED_STEPS_6(v, OP) v = OP(v, PRED_SHL(v, 6));
+#define PRED_STEPS_8(v, OP) v = OP(v, PRED_SHL(v, 8));
+
+// Defines a function that undoes the predictor for as many whole registers as fit in the row,
+// and returns the number of bytes processed. Bytes past the K*B processed bytes are stored back unchanged.
+#define DEFINE_PREDICTOR_SIMD(name, B, K, ADD, STEPS) \
+static u32 name(u8* row, u32 byte_count) { \
+	PRED_VEC keep_mask = PRED_LOAD(predictor_byte_masks + 16 - (K) * (B)); \
+	PRED_VEC pixel_mask = PRED_LOAD(predictor_byte_masks + 16 - (B)); \
+	PRED_VEC carry = PRED_ZERO(); \
+	u32 i = 0; \
+	for (; i + 16 <= byte_count; i += (K) * (B)) { \
+		PRED_VEC raw = PRED_LOAD(row + i); \
+		PRED_VEC x = raw; \
+		STEPS(x, ADD) \
+		x = ADD(x, carry); \
+		PRED_VEC last = PRED_AND(PRED_SHR(x, ((K) - 1) * (B)), pixel_mask); \
+		STEPS(last, PRED_OR) \
+		carry = last; \
+		PRED_STORE(row + i, PRED_SELECT(keep_mask, x, raw)); \
+	} \
+	return i; \
+}
 
-	if (level_ifd->is_tiled) {
-		tile_offset = level_ifd->tile_offsets[tile_index];
-		compressed_tile_size_in_bytes = level_ifd->tile_byte_counts[tile_index];
+DEFINE_PREDICTOR_SIMD(horizontal_predictor_simd_8_1, 1, 16, PRED_ADD8, PRED_STEPS_1)
+DEFINE_PREDICTOR_SIMD(horizontal_predictor_simd_8_2, 2, 8, PRED_ADD8, PRED_STEPS_2)
+DEFINE_PREDICTOR_SIMD(horizontal_predictor_simd_8_3, 3, 4, PRED_ADD8, PRED_STEPS_3)
+DEFINE_PREDICTOR_SIMD(horizontal_predictor_simd_8_4, 4, 4, PRED_ADD8, PRED_STEPS_4)
+DEFINE_PREDICTOR_SIMD(horizontal_predictor_simd_16_2, 2, 8, PRED_ADD16, PRED_STEPS_2)
+DEFINE_PREDICTOR_SIMD(horizontal_predictor_simd_16_4, 4, 4, PRED_ADD16, PRED_STEPS_4)
+DEFINE_PREDICTOR_SIMD(horizontal_predictor_simd_16_6, 6, 2, PRED_ADD16, PRED_STEPS_6)
+DEFINE_PREDICTOR_SIMD(horizontal_predictor_simd_16_8, 8, 2, PRED_ADD16, PRED_STEPS_8)
+#endif
 
-		// Some tiles apparently contain no data (not even an empty/dummy JPEG stream like some other tiles have).
-		// We need to check for this situation and chicken out if this is the case.
-		if (tile_offset == 0 || compressed_tile_size_in_bytes == 0) {
-#if DO_DEBUG
-			console_print("thread %d: tile level %d, tile %d (%d, %d) appears to be empty\n", logical_thread_index, level, tile_index, tile_x, tile_y);
+// Undoes horizontal differencing in place for one scanline of 8- or 16-bit samples (16-bit samples in native byte order).
+bool tiff_undo_horizontal_predictor(u8* row, u32 pixel_count, u32 samples_per_pixel, u32 bytes_per_sample) {
+	u32 pixel_size = samples_per_pixel * bytes_per_sample;
+	u32 byte_count = pixel_count * pixel_size;
+	if (pixel_size == 0 || (bytes_per_sample != 1 && bytes_per_sample != 2)) {
+		return false;
+	}
+	u32 i = 0;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+	if (bytes_per_sample == 1) {
+		switch (pixel_size) {
+			case 1: i = horizontal_predictor_simd_8_1(row, byte_count); break;
+			case 2: i = horizontal_predictor_simd_8_2(row, byte_count); break;
+			case 3: i = horizontal_predictor_simd_8_3(row, byte_count); break;
+			case 4: i = horizontal_predictor_simd_8_4(row, byte_count); break;
+			default: break;
+		}
+	} else {
+		switch (pixel_size) {
+			case 2: i = horizontal_predictor_simd_16_2(row, byte_count); break;
+			case 4: i = horizontal_predictor_simd_16_4(row, byte_count); break;
+			case 6: i = horizontal_predictor_simd_16_6(row, byte_count); break;
+			case 8: i = horizontal_predictor_simd_16_8(row, byte_count); break;
+			default: break;
+		}
+	}
 #endif
-			return NULL;
+	// Scalar version, for the remainder of the row or in case SIMD isn't available
+	// (the first pixel of the row is stored as-is).
+	if (i == 0) {
+		i = pixel_size;
+	}
+	if (bytes_per_sample == 1) {
+		for (; i < byte_count; ++i) {
+			row[i] = (u8)(row[i] + row[i - pixel_size]);
+		}
+	} else {
+		u16* samples = (u16*)row;
+		u32 stride = samples_per_pixel;
+		u32 sample_count = byte_count / 2;
+		for (i /= 2; i < sample_count; ++i) {
+			samples[i] = (u16)(samples[i] + samples[i - stride]);
 		}
+	}
+	return true;
+}
 
-		// TODO: optimize allocation
-		compressed_tile_data = (u8*)malloc(compressed_tile_size_in_bytes);
 
-		if (!tiff->is_remote) {
-			file_handle_read_at_offset(compressed_tile_data, tiff->file_handle, tile_offset, compressed_tile_size_in_bytes);
-		} else {
-			console_print_verbose("[thread %d] remote tile requested: level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
+// Per-thread scratch memory for the compressed bytes and intermediate (LZW) output of a tile.
+// The buffers only ever grow, so after the first few tiles decoding no longer touches the heap.
+typedef enum tiff_scratch_kind_enum {
+	TIFF_SCRATCH_COMPRESSED = 0,
+	TIFF_SCRATCH_DECOMPRESSED = 1,
+	TIFF_SCRATCH_KIND_COUNT
+} tiff_scratch_kind_enum;
 
-			i32 bytes_read = 0;
-			u8* read_buffer = download_remote_chunk(tiff->location.hostname, tiff->location.portno, tiff->location.filename,
-			                                        tile_offset, compressed_tile_size_in_bytes, &bytes_read, logical_thread_index);
-			if (read_buffer && bytes_read > 0) {
-				i64 content_offset = find_end_of_http_headers(read_buffer, bytes_read);
-				i64 content_length = bytes_read - content_offset;
-				u8* content = read_buffer + content_offset;
+typedef struct tiff_scratch_buffer_t {
+	u8* data;
+	size_t capacity;
+} tiff_scratch_buffer_t;
 
-				if (content_length >= compressed_tile_size_in_bytes) {
-					memcpy(compressed_tile_data, content, compressed_tile_size_in_bytes);
-				} else {
-					failed = true;
-				}
+static tiff_scratch_buffer_t tiff_scratch_buffers[MAX_THREAD_COUNT][TIFF_SCRATCH_KIND_COUNT];
+static ZSTD_DCtx* tiff_zstd_contexts[MAX_THREAD_COUNT];
 
-			} else {
-				failed = true;
-			}
-			if (read_buffer) {
-				free(read_buffer);
-			}
-			if (failed) {
-				console_print_error("[thread %d] failed to read from remote level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
-                free(compressed_tile_data);
-				return NULL;
-			}
+static u8* tiff_get_scratch_buffer(i32 logical_thread_index, tiff_scratch_kind_enum kind, size_t size) {
+	if (logical_thread_index < 0 || logical_thread_index >= MAX_THREAD_COUNT) {
+		ASSERT(!"logical thread index out of range");
+		return NULL;
+	}
+	tiff_scratch_buffer_t* scratch = &tiff_scratch_buffers[logical_thread_index][kind];
+	if (scratch->capacity < size) {
+		// Contents don't need to be preserved, so avoid realloc() copying them.
+		size_t new_capacity = MAX(size, scratch->capacity * 2);
+		if (scratch->data) {
+			free(scratch->data);
 		}
+		scratch->data = (u8*)malloc(new_capacity);
+		scratch->capacity = scratch->data ? new_capacity : 0;
+	}
+	return scratch->data;
+}
 
-	} else {
-		// image is not tiled
-
+// Returns the compressed bytes of a tile or strip in a local file. If the file is memory-mapped, this points straight
+// into the mapping (read-only); otherwise the bytes are read into the thread's scratch buffer.
+static u8* tiff_get_compressed_bytes(i32 logical_thread_index, tiff_t* tiff, u64 offset, u64 size) {
+	u8* mapped = mapped_file_get_bytes(&tiff->mapped_file, offset, size);
+	if (mapped) {
+		if (size > KILOBYTES(64)) {
+			// Fault in large strips/tiles with one readahead, instead of page by page.
+			mapped_file_advise(&tiff->mapped_file, offset, size, FILE_ACCESS_SEQUENTIAL);
+		}
+		return mapped;
+	}
+	u8* data = tiff_get_scratch_buffer(logical_thread_index, TIFF_SCRATCH_COMPRESSED, size);
+	if (data && file_handle_read_at_offset(data, tiff->file_handle, offset, size) != size) {
+		return NULL;
+	}
+	return data;
+}
 
-		if (!tiff->is_remote) {
+void tiff_release_scratch_buffers(i32 logical_thread_index) {
+	if (logical_thread_index < 0 || logical_thread_index >= MAX_THREAD_COUNT) {
+		return;
+	}
+	for (i32 kind = 0; kind < TIFF_SCRATCH_KIND_COUNT; ++kind) {
+		tiff_scratch_buffer_t* scratch = &tiff_scratch_buffers[logical_thread_index][kind];
+		if (scratch->data) {
+			free(scratch->data);
+		}
+		memset(scratch, 0, sizeof(*scratch));
+	}
+	if (tiff_zstd_contexts[logical_thread_index]) {
+		ZSTD_freeDCtx(tiff_zstd_contexts[logical_thread_index]);
+		tiff_zstd_contexts[logical_thread_index] = NULL;
+	}
+}
 
-			if (level_ifd->strip_count > 0) {
-				ASSERT(level_ifd->strip_offsets);
-				ASSERT(level_ifd->strip_byte_counts);
-				if (level_ifd->strip_count == 1) {
-					compressed_tile_size_in_bytes = level_ifd->strip_byte_counts[0];
-					compressed_tile_data = (u8*)malloc(compressed_tile_size_in_bytes);
-					size_t bytes_read = file_handle_read_at_offset(compressed_tile_data, tiff->file_handle, level_ifd->strip_offsets[0], compressed_tile_size_in_bytes);
-					if (bytes_read != compressed_tile_size_in_bytes) {
-						failed = true;
-					}
-				} else {
-					compressed_strip_data = (u8**)alloca(level_ifd->strip_count * sizeof(u8**));
-					memset(compressed_strip_data, 0, level_ifd->strip_count * sizeof(u8**));
-					for (i32 i = 0; i < level_ifd->strip_count; ++i) {
-						u64 strip_offset = level_ifd->strip_offsets[i];
-						u64 strip_byte_count = level_ifd->strip_byte_counts[i];
-						compressed_strip_data[i] = (u8*)malloc(strip_byte_count);
-						size_t bytes_read = file_handle_read_at_offset(compressed_strip_data[i], tiff->file_handle, strip_offset, strip_byte_count);
-						if (bytes_read != strip_byte_count) {
-							failed = true;
-						}
-					}
-				}
+static const char* tiff_get_compression_name(u16 compression) {
+	switch (compression) {
+		case TIFF_COMPRESSION_LZW: return "LZW";
+		case TIFF_COMPRESSION_ADOBE_DEFLATE: case TIFF_COMPRESSION_DEFLATE: return "Deflate";
+		case TIFF_COMPRESSION_ZSTD: return "Zstd";
+		default: return "TIFF";
+	}
+}
 
-			} else {
-				failed = true; // no tiles and no strips?
+// Decompresses a lossless (LZW, Deflate or Zstd) stream into exactly decompressed_size bytes.
+static bool tiff_decompress_lossless(i32 logical_thread_index, u16 compression, u8* compressed_stream, u64 compressed_stream_size,
+                                     u8* decompressed, size_t decompressed_size) {
+	if (compression == TIFF_COMPRESSION_LZW) {
+		// Check for old bit-reversed codes; only the libtiff decoder still handles those.
+		if (compressed_stream_size >= 2 && compressed_stream[0] == 0 && (compressed_stream[1] & 0x1)) {
+			PseudoTIFF tif = {};
+			tif.tif_rawdata = compressed_stream;
+			tif.tif_rawcp = compressed_stream;
+			tif.tif_rawdatasize = compressed_stream_size;
+			tif.tif_rawcc = compressed_stream_size;
+			int decode_success = 0;
+			if (LZWSetupDecode(&tif) && LZWPreDecode(&tif, 0)) {
+				decode_success = LZWDecodeCompat(&tif, decompressed, decompressed_size, 0);
 			}
-
-		} else {
-			failed = true;
+			LZWCleanupDecode(&tif);
+			return decode_success != 0;
 		}
-
-		if (failed) {
-			if (compressed_tile_data) {
-				free(compressed_tile_data);
-				compressed_tile_data = NULL;
-			}
-			if (compressed_strip_data) {
-				for (i32 i = 0; i < level_ifd->strip_count; ++i) {
-					free(compressed_strip_data[i]);
-					compressed_strip_data[i] = NULL;
-				}
-			}
-			return NULL;
-		}
-	}
-	// We should have either a compressed tile, or one or more compressed strips
-	ASSERT(compressed_tile_data != NULL || compressed_strip_data[0] != NULL);
-
-	// Now decompress
-	if (compressed_tile_data || compressed_strip_data)  {
-//		console_print_verbose("[thread %d] loading tile: level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
-
-		size_t pixel_memory_size = level_ifd->tile_width * level_ifd->tile_height * BYTES_PER_PIXEL;
-		u8* pixel_memory = (u8*)malloc(pixel_memory_size);
-		u8* decompressed = NULL; // allocated later if needed
-
-		// Take into account either tiled or multi-strip TIFF files
-		u8** compressed_streams;
-		u64* compressed_stream_sizes;
-		i32 compressed_stream_count;
-		if (compressed_tile_data) {
-			compressed_streams = &compressed_tile_data;
-			compressed_stream_sizes = &compressed_tile_size_in_bytes;
-			compressed_stream_count = 1;
-		} else if (level_ifd->strip_count > 0 && compressed_strip_data) {
-			compressed_streams = compressed_strip_data;
-			compressed_stream_sizes = level_ifd->strip_byte_counts;
-			compressed_stream_count = level_ifd->strip_count;
-		} else {
-			goto decompression_failed;
+		return LZWDecodeFast(compressed_stream, compressed_stream_size, decompressed, decompressed_size) != 0;
+	} else if (compression == TIFF_COMPRESSION_ADOBE_DEFLATE || compression == TIFF_COMPRESSION_DEFLATE) {
+		size_t bytes_written = tinfl_decompress_mem_to_mem(decompressed, decompressed_size, compressed_stream, compressed_stream_size,
+		                                                   TINFL_FLAG_PARSE_ZLIB_HEADER);
+		if (bytes_written == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED) {
+			return false;
+		}
+		if (bytes_written < decompressed_size) {
+			memset(decompressed + bytes_written, 0, decompressed_size - bytes_written); // truncated tile
 		}
+		return true;
+	} else if (compression == TIFF_COMPRESSION_ZSTD) {
+		if (logical_thread_index < 0 || logical_thread_index >= MAX_THREAD_COUNT) {
+			return false;
+		}
+		// Keep a decompression context per thread, so that we don't need to set one up for every tile.
+		ZSTD_DCtx* dctx = tiff_zstd_contexts[logical_thread_index];
+		if (!dctx) {
+			dctx = ZSTD_createDCtx();
+			tiff_zstd_contexts[logical_thread_index] = dctx;
+			if (!dctx) return false;
+		}
+		size_t bytes_written = ZSTD_decompressDCtx(dctx, decompressed, decompressed_size, compressed_stream, compressed_stream_size);
+		if (ZSTD_isError(bytes_written)) {
+			console_print_error("Zstd decompression error: %s\n", ZSTD_getErrorName(bytes_written));
+			return false;
+		}
+		if (bytes_written < decompressed_size) {
+			memset(decompressed + bytes_written, 0, decompressed_size - bytes_written); // truncated tile
+		}
+		return true;
+	}
+	return false;
+}
 
-		for (i32 compressed_stream_index = 0; compressed_stream_index < compressed_stream_count; ++compressed_stream_index) {
+u8* tiff_decode_tile(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 level, i32 tile_x, i32 tile_y) {
+	size_t pixel_memory_size = level_ifd->tile_width * level_ifd->tile_height * BYTES_PER_PIXEL;
+	u8* pixel_memory = (u8*)malloc(pixel_memory_size);
+	if (!tiff_decode_tile_to_buffer(logical_thread_index, tiff, level_ifd, tile_index, level, tile_x, tile_y, pixel_memory)) {
+		free(pixel_memory);
+		pixel_memory = NULL;
+	}
+	return pixel_memory;
+}
 
-			u8* compressed_stream = compressed_streams[compressed_stream_index];
-			u64 compressed_stream_size = compressed_stream_sizes[compressed_stream_index];
-			ASSERT(compressed_stream_size >= 2);
+// Decodes one or more compressed streams (a tile, or a run of consecutive strips) into BGRA pixels.
+// Each stream covers rows_per_stream rows of stream_width pixels; the last one may be shorter (up to total_height).
+// For JPEG, a region of interest may be given (single stream only): only the part intersecting it is decoded.
+static bool tiff_decode_compressed_streams(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd,
+                                           u8** compressed_streams, u64* compressed_stream_sizes, i32 compressed_stream_count,
+                                           u32 stream_width, u32 rows_per_stream, u32 total_height, u8* pixel_memory,
+                                           const jpeg_region_t* region, i32 level, i32 tile_index, i32 tile_x, i32 tile_y) {
+	u16 compression = level_ifd->compression;
+	u8* jpeg_tables = level_ifd->jpeg_tables;
+	u64 jpeg_tables_length = level_ifd->jpeg_tables_length;
+	u8* decompressed = NULL; // scratch memory, only needed for the lossless codecs
 
-			u8* pixel_memory_dest = pixel_memory;
-			if (compressed_stream_index > 0 && level_ifd->strip_count > 0) {
-				u64 row_offset = (u64)level_ifd->rows_per_strip * compressed_stream_index;
-				if (row_offset >= level_ifd->tile_height) {
-					goto decompression_failed; // out of bounds
-				}
-				pixel_memory_dest += row_offset * level_ifd->tile_width * BYTES_PER_PIXEL;
-			}
+	for (i32 compressed_stream_index = 0; compressed_stream_index < compressed_stream_count; ++compressed_stream_index) {
 
-			u32 decompressed_height;
-			if (level_ifd->strip_count > 0) {
-				decompressed_height = level_ifd->rows_per_strip;
-				if ((compressed_stream_index + 1) * decompressed_height > level_ifd->tile_height) {
-					// last strip height may be less, if the total height is not a multiple of rows_per_strip
-					decompressed_height = level_ifd->tile_height % level_ifd->rows_per_strip;
+		u8* compressed_stream = compressed_streams[compressed_stream_index];
+		u64 compressed_stream_size = compressed_stream_sizes[compressed_stream_index];
+		ASSERT(compressed_stream_size >= 2);
+
+		u64 row_offset = (u64)rows_per_stream * compressed_stream_index;
+		if (row_offset >= total_height) {
+			goto decompression_failed; // out of bounds
+		}
+		u8* pixel_memory_dest = pixel_memory + row_offset * stream_width * BYTES_PER_PIXEL;
+		// last strip height may be less, if the total height is not a multiple of rows_per_strip
+		u32 decompressed_height = (u32)MIN((u64)rows_per_stream, total_height - row_offset);
+
+		if (compression == TIFF_COMPRESSION_JPEG) {
+			if (compressed_stream[0] == 0xFF && compressed_stream[1] == 0xD9) {
+				// JPEG stream is empty
+				memset(pixel_memory_dest, 0xFF, stream_width * decompressed_height * sizeof(u32));
+			} else {
+				bool success = false;
+				if (level_ifd->is_ndpi) {
+					// Whole NDPI level, decoded at once (only if it could not be set up for tiled access)
+					i32 channels_in_file = 0;
+					u8* decoded = jpeg_decode_ndpi_image(compressed_stream, compressed_stream_size, stream_width, decompressed_height, &channels_in_file);
+					if (decoded) {
+						memcpy(pixel_memory_dest, decoded, (size_t)stream_width * decompressed_height * BYTES_PER_PIXEL);
+						free(decoded);
+						success = true;
+					}
+				} else if (region) {
+					success = jpeg_decode_tile_region(jpeg_tables, jpeg_tables_length, compressed_stream, compressed_stream_size,
+					                                  pixel_memory_dest, stream_width * BYTES_PER_PIXEL, stream_width, decompressed_height,
+					                                  (level_ifd->color_space == TIFF_PHOTOMETRIC_YCBCR), *region);
+				} else {
+					success = jpeg_decode_tile(jpeg_tables, jpeg_tables_length, compressed_stream,
+					                           compressed_stream_size,
+					                           pixel_memory_dest, (level_ifd->color_space == TIFF_PHOTOMETRIC_YCBCR));
 				}
-				if (decompressed_height == 0 || decompressed_height > level_ifd->tile_height) {
+				if (success) {
+//		                console_print_verbose("thread %d: successfully decoded level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
+					continue; // success
+				} else {
+					console_print_error("thread %d: failed to decode level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
 					goto decompression_failed;
 				}
+			}
+		} else if (compression == TIFF_COMPRESSION_WEBP) {
+			if (webp_decode_bgra_into(compressed_stream, compressed_stream_size, pixel_memory_dest,
+			                          stream_width, decompressed_height, stream_width * BYTES_PER_PIXEL)) {
+				continue; // success
 			} else {
-				decompressed_height = level_ifd->tile_height;
+				console_print_error("thread %d: failed to decode WebP level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
+				goto decompression_failed;
 			}
-
-			if (compression == TIFF_COMPRESSION_JPEG) {
-				if (compressed_stream[0] == 0xFF && compressed_stream[1] == 0xD9) {
-					// JPEG stream is empty
-					memset(pixel_memory_dest, 0xFF, level_ifd->tile_width * decompressed_height * sizeof(u32));
-				} else {
-					bool success = false;
-					if (level_ifd->is_ndpi) {
-						success = jpeg_decode_ndpi_image(compressed_stream, compressed_stream_size, level_ifd->image_width, level_ifd->image_height, NULL);
-					} else {
-						success = jpeg_decode_tile(jpeg_tables, jpeg_tables_length, compressed_stream,
-						                           compressed_stream_size,
-						                           pixel_memory_dest, (level_ifd->color_space == TIFF_PHOTOMETRIC_YCBCR));
-					}
-					if (success) {
-//		                console_print_verbose("thread %d: successfully decoded level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
-						continue; // success
-					} else {
-						console_print_error("thread %d: failed to decode level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
-						goto decompression_failed;
-					}
-				}
-			} else if (level_ifd->compression == TIFF_COMPRESSION_LZW) {
+		} else if (compression == TIFF_COMPRESSION_LZW || compression == TIFF_COMPRESSION_ADOBE_DEFLATE ||
+		           compression == TIFF_COMPRESSION_DEFLATE || compression == TIFF_COMPRESSION_ZSTD) {
 
 //			    i64 start = get_clock();
 
-				size_t decompressed_size = level_ifd->tile_width * decompressed_height * level_ifd->samples_per_pixel * level_ifd->bytes_per_sample;
-				decompressed = (u8*)malloc(decompressed_size);
-
-				PseudoTIFF tif = {};
-				tif.tif_rawdata = compressed_stream;
-				tif.tif_rawcp = compressed_stream;
-				tif.tif_rawdatasize = compressed_stream_size;
-				tif.tif_rawcc = compressed_stream_size;
-				LZWSetupDecode(&tif);
-				LZWPreDecode(&tif, 0);
-				// Check for old bit-reversed codes.
-				int decode_success = 0;
-				if (tif.tif_rawcc >= 2 && tif.tif_rawdata[0] == 0 && (tif.tif_rawdata[1] & 0x1)) {
-					decode_success = LZWDecodeCompat(&tif, decompressed, decompressed_size, 0);
-				} else {
-					decode_success = LZWDecode(&tif, decompressed, decompressed_size, 0);
-				}
-				if (!decode_success) {
-					console_print_error("LZW decompression failed\n");
-					goto decompression_failed;
-				}
+			const char* compression_name = tiff_get_compression_name(compression);
+			size_t decompressed_size = stream_width * decompressed_height * level_ifd->samples_per_pixel * level_ifd->bytes_per_sample;
+			decompressed = tiff_get_scratch_buffer(logical_thread_index, TIFF_SCRATCH_DECOMPRESSED, decompressed_size);
+			if (!decompressed) {
+				goto decompression_failed;
+			}
+
+			if (!tiff_decompress_lossless(logical_thread_index, compression, compressed_stream, compressed_stream_size, decompressed, decompressed_size)) {
+				console_print_error("%s decompression failed\n", compression_name);
+				goto decompression_failed;
+			}
 
-				if (level_ifd->predictor > 1) {
-					if (level_ifd->predictor == 2 /* PREDICTOR_HORIZONTAL */ && level_ifd->samples_per_pixel <= 8) {
-						// horizontal differencing
-						u32 samples = level_ifd->samples_per_pixel;
-						u32 subpixels_per_scanline = level_ifd->tile_width * samples;
-						for (u32 y = 0; y < decompressed_height; ++y) {
-							u8* scanline = decompressed + y * subpixels_per_scanline;
-							horAcc8(samples, scanline, subpixels_per_scanline);
+			if (level_ifd->predictor > 1) {
+				if (level_ifd->predictor == 2 /* PREDICTOR_HORIZONTAL */ && level_ifd->samples_per_pixel <= 8 &&
+				    (level_ifd->bytes_per_sample == 1 || level_ifd->bytes_per_sample == 2)) {
+					// horizontal differencing
+					u32 scanline_size = stream_width * level_ifd->samples_per_pixel * level_ifd->bytes_per_sample;
+					bool swap_bytes = level_ifd->bytes_per_sample == 2 && DATA_ENDIAN_DIFFERS(tiff->is_big_endian);
+					for (u32 y = 0; y < decompressed_height; ++y) {
+						u8* scanline = decompressed + y * scanline_size;
+						if (swap_bytes) {
+							u16* samples = (u16*)scanline;
+							for (u32 i = 0; i < scanline_size / 2; ++i) {
+								samples[i] = bswap_16(samples[i]);
+							}
 						}
-					} else {
-						console_print_error("LZW decoding failed: unsupported predictor operator (%d)\n", level_ifd->predictor);
-						goto decompression_failed;
+						tiff_undo_horizontal_predictor(scanline, stream_width, level_ifd->samples_per_pixel, level_ifd->bytes_per_sample);
 					}
+				} else {
+					console_print_error("%s decoding failed: unsupported predictor operator (%d)\n", compression_name, level_ifd->predictor);
+					goto decompression_failed;
 				}
+			}
 
 //			    i64 decode_end = get_clock();
 //			    console_print_verbose("[thread %d] decode  level %d, tile %d (%d, %d) took %g ms\n", logical_thread_index, level, tile_index, tile_x, tile_y, 1000.0f * get_seconds_elapsed(start, decode_end));
 
-				// Convert RGB to BGRA
-				if (level_ifd->samples_per_pixel == 4) {
-					// TODO: convert RGBA to BGRA
-					console_print_error("LZW decompression: RGBA to BGRA conversion not implemented, assuming already in BGRA\n");
-					memcpy(pixel_memory_dest, decompressed, decompressed_size);
-					free(decompressed);
-					decompressed = NULL;
-					continue; // success
-				} else if (level_ifd->samples_per_pixel == 3) {
+			// Convert RGB to BGRA
+			if (level_ifd->samples_per_pixel == 4) {
+				// TODO: convert RGBA to BGRA
+				// Convert RGBA to BGRA
+				u64 pixel_count = stream_width * decompressed_height;
+				u32* pixels = (u32*)pixel_memory_dest;
+				for (u64 i = 0; i < pixel_count; ++i) {
+					u8* rgba = decompressed + i * 4;
+					pixels[i] = MAKE_BGRA(rgba[0], rgba[1], rgba[2], rgba[3]);
+				}
+				continue; // success
+			} else if (level_ifd->samples_per_pixel == 3) {
 
-					// NOTE: Some TIFFs should actually be treated as palettized, but still set PhotometricInterpretation to TIFF_PHOTOMETRIC_RGB.
-					// (as an example, the TIFF masks from the Kaggle challenge do this)
-					// However, in that case they will still probably have set SMaxSampleValue to a low value (the number of colors/categories used).
-					// We can use this fact to guess that we still want to treat the image as palettized / using a color lookup table.
-					bool palettized = level_ifd->color_space == TIFF_PHOTOMETRIC_PALETTE || (level_ifd->max_sample_value > 0 && level_ifd->max_sample_value < 64);
+				// NOTE: Some TIFFs should actually be treated as palettized, but still set PhotometricInterpretation to TIFF_PHOTOMETRIC_RGB.
+				// (as an example, the TIFF masks from the Kaggle challenge do this)
+				// However, in that case they will still probably have set SMaxSampleValue to a low value (the number of colors/categories used).
+				// We can use this fact to guess that we still want to treat the image as palettized / using a color lookup table.
+				bool palettized = level_ifd->color_space == TIFF_PHOTOMETRIC_PALETTE || (level_ifd->max_sample_value > 0 && level_ifd->max_sample_value < 64);
 
-					u64 pixel_count = level_ifd->tile_width * decompressed_height;
-					i32 source_pos = 0;
-					u32* pixels = (u32*)pixel_memory_dest;
+				u64 pixel_count = stream_width * decompressed_height;
+				i32 source_pos = 0;
+				u32* pixels = (u32*)pixel_memory_dest;
 
-					// TODO: vectorize: https://stackoverflow.com/questions/7194452/fast-vectorized-conversion-from-rgb-to-bgra
-					if (palettized) {
-						for (u64 i = 0; i < pixel_count; ++i) {
-							u8 r = decompressed[source_pos]; // only the red channel is being used
+				// TODO: vectorize: https://stackoverflow.com/questions/7194452/fast-vectorized-conversion-from-rgb-to-bgra
+				if (palettized) {
+					for (u64 i = 0; i < pixel_count; ++i) {
+						u8 r = decompressed[source_pos]; // only the red channel is being used
 //						    u8 g = decompressed[source_pos+1];
 //					    	u8 b = decompressed[source_pos+2];
 //					    	pixels[i]=(r<<16) | (g<<8) | b | (0xff << 24);
-							u32 color = lookup_color_from_lut(r);
-							color = BGRA_SET_ALPHA(color, 128); // TODO: make color lookup tables configurable
-							pixels[i] = color;
-							source_pos+=3;
-						}
-					} else {
-						for (u64 i = 0; i < pixel_count; ++i) {
-							// TODO: optimize?
-							u8 r = decompressed[source_pos];
-							u8 g = decompressed[source_pos+1];
-							u8 b = decompressed[source_pos+2];
-							pixels[i] = MAKE_BGRA(r, g, b, 255);
-							source_pos+=3;
-						}
+						u32 color = lookup_color_from_lut(r);
+						color = BGRA_SET_ALPHA(color, 128); // TODO: make color lookup tables configurable
+						pixels[i] = color;
+						source_pos+=3;
 					}
+				} else {
+					for (u64 i = 0; i < pixel_count; ++i) {
+						// TODO: optimize?
+						u8 r = decompressed[source_pos];
+						u8 g = decompressed[source_pos+1];
+						u8 b = decompressed[source_pos+2];
+						pixels[i] = MAKE_BGRA(r, g, b, 255);
+						source_pos+=3;
+					}
+				}
 
-					free(decompressed);
-					decompressed = NULL;
 //				    console_print_verbose("[thread %d] swizzle level %d, tile %d (%d, %d) took %g ms\n", logical_thread_index, level, tile_index, tile_x, tile_y, 1000.0f * get_seconds_elapsed(decode_end, get_clock()));
-					continue; // success
-				} else if (level_ifd->samples_per_pixel == 1) {
-
-					// Grayscale image
-					u64 pixel_count = level_ifd->tile_width * decompressed_height;
-					u32* pixels = (u32*)pixel_memory_dest;
-					if (level_ifd->bits_per_sample == 8) {
-						i32 source_pos = 0;
-
-						// assume palettized
-						// TODO: how to decide if it's a palettized image or not?
-						for (u64 i = 0; i < pixel_count; ++i) {
-							u8 r = decompressed[source_pos]; // only the red channel is being used
+				continue; // success
+			} else if (level_ifd->samples_per_pixel == 1) {
+
+				// Grayscale image
+				u64 pixel_count = stream_width * decompressed_height;
+				u32* pixels = (u32*)pixel_memory_dest;
+				if (level_ifd->bits_per_sample == 8) {
+					i32 source_pos = 0;
+
+					// assume palettized
+					// TODO: how to decide if it's a palettized image or not?
+					for (u64 i = 0; i < pixel_count; ++i) {
+						u8 r = decompressed[source_pos]; // only the red channel is being used
 //						    u8 g = decompressed[source_pos+1];
 //					        u8 b = decompressed[source_pos+2];
 //					        pixels[i]=(r<<16) | (g<<8) | b | (0xff << 24);
-							u32 color = lookup_color_from_lut(r);
+						u32 color = lookup_color_from_lut(r);
 //                          color = BGRA_SET_ALPHA(color, 128); // TODO: make color lookup tables configurable
-							pixels[i] = color;
-							source_pos+=1;
-						}
-					} else if (level_ifd->bits_per_sample == 32) {
-						u32* source_pixels = (u32*)decompressed;
-						i32 source_pos = 0;
-						for (u64 i = 0; i < pixel_count; ++i) {
-							u32 as_u32 = source_pixels[source_pos];
-							float f = *(float*)(source_pixels + source_pos);
-							float normalized = f / 16000.0f;
-							u8 c = FLOAT_TO_BYTE(normalized);
-							u8 r = source_pixels[source_pos]; // only the red channel is being used
+						pixels[i] = color;
+						source_pos+=1;
+					}
+				} else if (level_ifd->bits_per_sample == 32) {
+					u32* source_pixels = (u32*)decompressed;
+					i32 source_pos = 0;
+					for (u64 i = 0; i < pixel_count; ++i) {
+						u32 as_u32 = source_pixels[source_pos];
+						float f = *(float*)(source_pixels + source_pos);
+						float normalized = f / 16000.0f;
+						u8 c = FLOAT_TO_BYTE(normalized);
+						u8 r = source_pixels[source_pos]; // only the red channel is being used
 //						    u8 g = source_pixels[source_pos+1];
 //					        u8 b = source_pixels[source_pos+2];
 //					        pixels[i]=(r<<16) | (g<<8) | b | (0xff << 24);
 //							u32 color = lookup_color_from_lut(r);
                             u32 color = MAKE_BGRA(c, c, c, 255);
-							pixels[i] = color;
-							source_pos+=1;
-						}
+						pixels[i] = color;
+						source_pos+=1;
 					}
+				}
 
 
 
-					/*u8 output_for_min_value = 0;
-					u8 output_for_max_value = 255;
-					if (level_ifd->color_space == TIFF_PHOTOMETRIC_MINISBLACK) {
-						// no action
-					} else if (level_ifd->color_space == TIFF_PHOTOMETRIC_MINISWHITE) {
-						output_for_min_value = 255;
-						output_for_max_value = 0;
-					} else {
-						// Issue warning? PhotometricInterpretation missing
-					}
-
-					bool is_bilevel = level_ifd->max_sample_value == 1 && level_ifd->min_sample_value == 0;
-
-					if (is_bilevel) {
-						for (u64 i = 0; i < pixel_count; ++i) {
-							u8 r = decompressed[source_pos];
-							r = r ? output_for_max_value : output_for_min_value;
-							u32 color = MAKE_BGRA(r, r, r, 255);
-							pixels[i] = color;
-							source_pos+=1;
-						}
-					} else {
-						if (level_ifd->max_sample_value == 0 *//*assume not set*//* || level_ifd->max_sample_value == 255) {
-						// output raw value as RGB value
-						for (u64 i = 0; i < pixel_count; ++i) {
-							u8 r = decompressed[source_pos];
-							u32 color = MAKE_BGRA(r, r, r, 255);
-							pixels[i] = color;
-							source_pos+=1;
-						}
-					} else {
-						// resample
-						float convert_factor = (1.0f / (float)level_ifd->max_sample_value) * 255.0f;
-						for (u64 i = 0; i < pixel_count; ++i) {
-							u8 r = decompressed[source_pos];
-							r = (u8)((float)r * convert_factor);
-							u32 color = MAKE_BGRA(r, r, r, 255);
-							pixels[i] = color;
-							source_pos+=1;
-						}
-					}
-
-				}*/
-
-					free(decompressed);
-					decompressed = NULL;
-					continue; // success
+				/*u8 output_for_min_value = 0;
+				u8 output_for_max_value = 255;
+				if (level_ifd->color_space == TIFF_PHOTOMETRIC_MINISBLACK) {
+					// no action
+				} else if (level_ifd->color_space == TIFF_PHOTOMETRIC_MINISWHITE) {
+					output_for_min_value = 255;
+					output_for_max_value = 0;
 				} else {
-					console_print_error("LZW decompression: unexpected number of samples per pixel (%d)\n", level_ifd->samples_per_pixel);
-					goto decompression_failed;
+					// Issue warning? PhotometricInterpretation missing
 				}
 
-			} else if (level_ifd->compression == TIFF_COMPRESSION_NONE) {
-				u8* uncompressed = (u8*)compressed_stream;
-				u64 pixel_count = level_ifd->tile_width * decompressed_height;
-				i32 source_pos = 0;
-				if (level_ifd->samples_per_pixel == 4) {
-					u32* pixels = (u32*)pixel_memory_dest;
+				bool is_bilevel = level_ifd->max_sample_value == 1 && level_ifd->min_sample_value == 0;
+
+				if (is_bilevel) {
 					for (u64 i = 0; i < pixel_count; ++i) {
-						u8 r = uncompressed[source_pos];
-						u8 g = uncompressed[source_pos+1];
-						u8 b = uncompressed[source_pos+2];
-						u8 a = uncompressed[source_pos+3];
-						pixels[i] = MAKE_BGRA(r, g, b, a);
-						source_pos+=4;
+						u8 r = decompressed[source_pos];
+						r = r ? output_for_max_value : output_for_min_value;
+						u32 color = MAKE_BGRA(r, r, r, 255);
+						pixels[i] = color;
+						source_pos+=1;
 					}
-					// memcpy(pixel_memory_dest, uncompressed, pixel_count * 4);
-				} else if (level_ifd->samples_per_pixel == 3) {
-					u32* pixels = (u32*)pixel_memory_dest;
+				} else {
+					if (level_ifd->max_sample_value == 0 *//*assume not set*//* || level_ifd->max_sample_value == 255) {
+					// output raw value as RGB value
 					for (u64 i = 0; i < pixel_count; ++i) {
-						u8 r = uncompressed[source_pos]; // only the red channel is being used
-						u8 g = uncompressed[source_pos+1];
-						u8 b = uncompressed[source_pos+2];
-						pixels[i] = MAKE_BGRA(r, g, b, 255);
-						source_pos+=3;
+						u8 r = decompressed[source_pos];
+						u32 color = MAKE_BGRA(r, r, r, 255);
+						pixels[i] = color;
+						source_pos+=1;
 					}
-					continue;
 				} else {
-					console_print_error("Uncompressed TIFF: unexpected number of samples per pixel (%d)\n", level_ifd->samples_per_pixel);
-					goto decompression_failed;
+					// resample
+					float convert_factor = (1.0f / (float)level_ifd->max_sample_value) * 255.0f;
+					for (u64 i = 0; i < pixel_count; ++i) {
+						u8 r = decompressed[source_pos];
+						r = (u8)((float)r * convert_factor);
+						u32 color = MAKE_BGRA(r, r, r, 255);
+						pixels[i] = color;
+						source_pos+=1;
+					}
 				}
+
+			}*/
+
+				continue; // success
 			} else {
-				console_print_error("\"thread %d: failed to decode level %d, tile %d (%d, %d): unsupported TIFF compression method (compression=%d)\n", logical_thread_index, level, tile_index, tile_x, tile_y, compression);
+				console_print_error("%s decompression: unexpected number of samples per pixel (%d)\n", compression_name, level_ifd->samples_per_pixel);
 				goto decompression_failed;
 			}
+
+		} else if (level_ifd->compression == TIFF_COMPRESSION_NONE) {
+			u8* uncompressed = (u8*)compressed_stream;
+			u64 pixel_count = stream_width * decompressed_height;
+			i32 source_pos = 0;
+			if (level_ifd->samples_per_pixel == 4) {
+				u32* pixels = (u32*)pixel_memory_dest;
+				for (u64 i = 0; i < pixel_count; ++i) {
+					u8 r = uncompressed[source_pos];
+					u8 g = uncompressed[source_pos+1];
+					u8 b = uncompressed[source_pos+2];
+					u8 a = uncompressed[source_pos+3];
+					pixels[i] = MAKE_BGRA(r, g, b, a);
+					source_pos+=4;
+				}
+				// memcpy(pixel_memory_dest, uncompressed, pixel_count * 4);
+			} else if (level_ifd->samples_per_pixel == 3) {
+				u32* pixels = (u32*)pixel_memory_dest;
+				for (u64 i = 0; i < pixel_count; ++i) {
+					u8 r = uncompressed[source_pos]; // only the red channel is being used
+					u8 g = uncompressed[source_pos+1];
+					u8 b = uncompressed[source_pos+2];
+					pixels[i] = MAKE_BGRA(r, g, b, 255);
+					source_pos+=3;
+				}
+				continue;
+			} else {
+				console_print_error("Uncompressed TIFF: unexpected number of samples per pixel (%d)\n", level_ifd->samples_per_pixel);
+				goto decompression_failed;
+			}
+		} else {
+			console_print_error("\"thread %d: failed to decode level %d, tile %d (%d, %d): unsupported TIFF compression method (compression=%d)\n", logical_thread_index, level, tile_index, tile_x, tile_y, compression);
+			goto decompression_failed;
+		}
+	}
+
+	return true;
+
+	decompression_failed:
+	return false;
+}
+
+// Reads and decodes a single strip (full image width) into dest.
+static bool tiff_decode_strip(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* ifd, u64 strip_index, i32 level, u8* dest) {
+	u64 strip_offset = ifd->strip_offsets[strip_index];
+	u64 strip_byte_count = ifd->strip_byte_counts[strip_index];
+	u32 strip_y = (u32)(strip_index * ifd->rows_per_strip);
+	u32 strip_rows = MIN(ifd->rows_per_strip, ifd->image_height - strip_y);
+	if (strip_byte_count < 2) {
+		return false;
+	}
+	u8* compressed_strip_data = tiff_get_compressed_bytes(logical_thread_index, tiff, strip_offset, strip_byte_count);
+	if (!compressed_strip_data) {
+		return false;
+	}
+	return tiff_decode_compressed_streams(logical_thread_index, tiff, ifd, &compressed_strip_data, &strip_byte_count, 1,
+	                                      ifd->image_width, strip_rows, strip_rows, dest, NULL, level, (i32)strip_index, 0, (i32)strip_index);
+}
+
+static tiff_decoded_strip_t* tiff_strip_cache_find(tiff_strip_cache_t* cache, u64 strip_index) {
+	for (i32 i = 0; i < cache->entry_count; ++i) {
+		tiff_decoded_strip_t* entry = cache->entries + i;
+		if (entry->strip_index == (i64)strip_index) {
+			entry->refcount++;
+			entry->last_used = ++cache->use_counter;
+			return entry;
 		}
+	}
+	return NULL;
+}
+
+// Returns the decoded pixels of a strip, decoding it if it is not already cached.
+// The strip must be given back with tiff_release_decoded_strip() when the caller is done with it.
+static u8* tiff_acquire_decoded_strip(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* ifd, u64 strip_index, i32 level,
+                                      tiff_decoded_strip_t** entry_out) {
+	*entry_out = NULL;
+	platform_mutex_lock(&tiff_strip_cache_mutex);
+	tiff_strip_cache_t* cache = ifd->strip_cache;
+	if (!cache) {
+		// Keep enough strips around to cover a row of virtual tiles, so that horizontally adjacent tiles can reuse them.
+		u64 strip_size = (u64)ifd->image_width * ifd->rows_per_strip * BYTES_PER_PIXEL;
+		u64 wanted_entry_count = (ifd->tile_height + ifd->rows_per_strip - 1) / ifd->rows_per_strip + 1;
+		u64 max_entry_count = ATLEAST(2, TIFF_STRIP_CACHE_MAX_BYTES / ATLEAST(1, strip_size));
+		cache = (tiff_strip_cache_t*)calloc(1, sizeof(tiff_strip_cache_t));
+		cache->entry_count = (i32)MIN(wanted_entry_count, max_entry_count);
+		cache->entries = (tiff_decoded_strip_t*)calloc(cache->entry_count, sizeof(tiff_decoded_strip_t));
+		for (i32 i = 0; i < cache->entry_count; ++i) {
+			cache->entries[i].strip_index = -1;
+		}
+		ifd->strip_cache = cache;
+	}
+	tiff_decoded_strip_t* entry = tiff_strip_cache_find(cache, strip_index);
+	platform_mutex_unlock(&tiff_strip_cache_mutex);
+	if (entry) {
+		*entry_out = entry;
+		return entry->pixels;
+	}
+
+	// Decode outside of the lock, so that other threads can decode other strips in the meantime.
+	u32 strip_y = (u32)(strip_index * ifd->rows_per_strip);
+	u32 strip_rows = MIN(ifd->rows_per_strip, ifd->image_height - strip_y);
+	u8* pixels = (u8*)malloc((size_t)ifd->image_width * strip_rows * BYTES_PER_PIXEL);
+	if (!pixels) {
+		return NULL;
+	}
+	if (!tiff_decode_strip(logical_thread_index, tiff, ifd, strip_index, level, pixels)) {
+		console_print_error("thread %d: failed to decode level %d, strip %d\n", logical_thread_index, level, (i32)strip_index);
+		free(pixels);
+		return NULL;
+	}
+
+	platform_mutex_lock(&tiff_strip_cache_mutex);
+	entry = tiff_strip_cache_find(cache, strip_index);
+	if (entry) {
+		// Another thread decoded the same strip in the meantime.
+		platform_mutex_unlock(&tiff_strip_cache_mutex);
+		free(pixels);
+		*entry_out = entry;
+		return entry->pixels;
+	}
+	// Evict the least recently used strip that is not in use.
+	tiff_decoded_strip_t* victim = NULL;
+	for (i32 i = 0; i < cache->entry_count; ++i) {
+		tiff_decoded_strip_t* candidate = cache->entries + i;
+		if (candidate->refcount == 0 && (!victim || candidate->last_used < victim->last_used)) {
+			victim = candidate;
+		}
+	}
+	if (victim) {
+		if (victim->pixels) free(victim->pixels);
+		victim->strip_index = (i64)strip_index;
+		victim->pixels = pixels;
+		victim->refcount = 1;
+		victim->last_used = ++cache->use_counter;
+		*entry_out = victim;
+	}
+	platform_mutex_unlock(&tiff_strip_cache_mutex);
+	return pixels; // if all slots are in use, the strip is not cached and will be freed on release
+}
+
+static void tiff_release_decoded_strip(tiff_decoded_strip_t* entry, u8* pixels) {
+	if (entry) {
+		platform_mutex_lock(&tiff_strip_cache_mutex);
+		ASSERT(entry->refcount > 0);
+		entry->refcount--;
+		platform_mutex_unlock(&tiff_strip_cache_mutex);
+	} else {
+		free(pixels);
+	}
+}
 
-		ASSERT(pixel_memory);
+// Decodes a virtual tile of a stripped image, from only the strips that it overlaps.
+static bool tiff_decode_strip_tile_to_buffer(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* ifd, i32 tile_index, i32 level, u8* pixel_memory) {
+	if (tiff->is_remote || ifd->strip_count == 0 || !ifd->strip_offsets || !ifd->strip_byte_counts ||
+	    ifd->rows_per_strip == 0 || ifd->width_in_tiles == 0 || tile_index < 0 || (u64)tile_index >= ifd->tile_count) {
+		return false;
+	}
+	u32 tile_x = (u32)tile_index % ifd->width_in_tiles;
+	u32 tile_y = (u32)tile_index / ifd->width_in_tiles;
+	u32 x0 = tile_x * ifd->tile_width;
+	u32 y0 = tile_y * ifd->tile_height;
+	if (x0 >= ifd->image_width || y0 >= ifd->image_height) {
+		return false;
+	}
+	u32 copy_width = MIN(ifd->tile_width, ifd->image_width - x0);
+	u32 y1 = MIN(y0 + ifd->tile_height, ifd->image_height);
+	size_t tile_pitch = (size_t)ifd->tile_width * BYTES_PER_PIXEL;
+	if (copy_width < ifd->tile_width || y1 - y0 < ifd->tile_height) {
+		// Edge tile: the part beyond the image boundary is transparent.
+		memset(pixel_memory, 0, tile_pitch * ifd->tile_height);
+	}
 
-		if (false) { decompression_failed:
-			// We'll return NULL in case of failure
-			if (pixel_memory) {
-				free(pixel_memory);
-				pixel_memory = NULL;
+	// Strips all have the same height, so the strips covering the tile can be looked up directly.
+	u64 first_strip = y0 / ifd->rows_per_strip;
+	u64 last_strip = (y1 - 1) / ifd->rows_per_strip;
+	if (last_strip >= ifd->strip_count) {
+		return false;
+	}
+	for (u64 strip_index = first_strip; strip_index <= last_strip; ++strip_index) {
+		u32 strip_y0 = (u32)(strip_index * ifd->rows_per_strip);
+		u32 strip_y1 = MIN(strip_y0 + ifd->rows_per_strip, ifd->image_height);
+		u32 row_begin = MAX(y0, strip_y0);
+		u32 row_end = MIN(y1, strip_y1);
+		if (ifd->tile_width == ifd->image_width && row_begin == strip_y0 && row_end == strip_y1) {
+			// The tile contains the whole strip, so there is nothing to share: decode it in place.
+			if (!tiff_decode_strip(logical_thread_index, tiff, ifd, strip_index, level, pixel_memory + (size_t)(strip_y0 - y0) * tile_pitch)) {
+				return false;
 			}
+			continue;
+		}
+		tiff_decoded_strip_t* entry = NULL;
+		u8* strip_pixels = tiff_acquire_decoded_strip(logical_thread_index, tiff, ifd, strip_index, level, &entry);
+		if (!strip_pixels) {
+			return false;
+		}
+		size_t strip_pitch = (size_t)ifd->image_width * BYTES_PER_PIXEL;
+		for (u32 y = row_begin; y < row_end; ++y) {
+			memcpy(pixel_memory + (size_t)(y - y0) * tile_pitch,
+			       strip_pixels + (size_t)(y - strip_y0) * strip_pitch + (size_t)x0 * BYTES_PER_PIXEL,
+			       (size_t)copy_width * BYTES_PER_PIXEL);
 		}
+		tiff_release_decoded_strip(entry, strip_pixels);
+	}
+	return true;
+}
 
-		// Cleanup
-		if (compressed_tile_data) {
-			free(compressed_tile_data);
+// Decodes a virtual tile of an NDPI level: the restart intervals covering the tile are gathered into a new
+// JPEG stream (with the restart markers renumbered), which is then decoded on its own.
+// If a region of interest is given, only the restart intervals intersecting it are gathered.
+static bool tiff_ndpi_decode_tile_to_buffer(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* ifd, i32 tile_index, i32 level,
+                                            const jpeg_region_t* region, u8* pixel_memory) {
+	tiff_ndpi_tiling_t* tiling = ifd->ndpi_tiling;
+	if (tiff->is_remote || tile_index < 0 || (u64)tile_index >= ifd->tile_count) {
+		return false;
+	}
+	u32 tile_x = (u32)tile_index % ifd->width_in_tiles;
+	u32 tile_y = (u32)tile_index / ifd->width_in_tiles;
+	u32 tile_first_column = tile_x * tiling->intervals_per_tile;
+	u32 tile_first_row = tile_y * tiling->mcu_rows_per_tile;
+	u32 first_column = tile_first_column;
+	u32 end_column = MIN(first_column + tiling->intervals_per_tile, tiling->intervals_per_row);
+	u32 first_row = tile_first_row;
+	u32 end_row = MIN(first_row + tiling->mcu_rows_per_tile, tiling->mcu_row_count);
+	if (region) {
+		if (region->width <= 0 || region->height <= 0) {
+			return true; // nothing to decode
+		}
+		u32 region_x = ATLEAST(0, region->x);
+		u32 region_y = ATLEAST(0, region->y);
+		first_column += region_x / tiling->interval_width;
+		end_column = MIN(end_column, tile_first_column + (region->x + region->width + tiling->interval_width - 1) / tiling->interval_width);
+		first_row += region_y / tiling->mcu_height;
+		end_row = MIN(end_row, tile_first_row + (region->y + region->height + tiling->mcu_height - 1) / tiling->mcu_height);
+	}
+	u32 x0 = first_column * tiling->interval_width;
+	u32 y0 = first_row * tiling->mcu_height;
+	if (first_column >= end_column || first_row >= end_row || x0 >= ifd->image_width || y0 >= ifd->image_height) {
+		return region != NULL; // a region beyond the image boundary is not an error
+	}
+	u32 decoded_width = MIN((end_column - first_column) * tiling->interval_width, ifd->image_width - x0);
+	u32 decoded_height = MIN((end_row - first_row) * tiling->mcu_height, ifd->image_height - y0);
+
+	u64* interval_starts = ifd->ndpi_optimization_markers;
+	u64 interval_count = ifd->ndpi_optimization_count;
+	u64 strip_offset = ifd->strip_offsets[0];
+	u64 strip_size = ifd->strip_byte_counts[0];
+	// The entropy-coded data of an interval ends where the restart marker before the next interval begins
+	// (or at the EOI marker, for the last interval).
+#define NDPI_INTERVAL_END(i) (((i) + 1 < interval_count) ? interval_starts[(i) + 1] - 2 : strip_size - 2)
+
+	u64 stream_size = tiling->jpeg_header_length + 2 /* EOI */;
+	for (u32 row = first_row; row < end_row; ++row) {
+		u64 first_interval = (u64)row * tiling->intervals_per_row + first_column;
+		u64 last_interval = (u64)row * tiling->intervals_per_row + end_column - 1;
+		stream_size += NDPI_INTERVAL_END(last_interval) - interval_starts[first_interval] + 2 /* RST */;
+	}
+	u8* stream = tiff_get_scratch_buffer(logical_thread_index, TIFF_SCRATCH_COMPRESSED, stream_size);
+	if (!stream) {
+		return false;
+	}
+	memcpy(stream, tiling->jpeg_header, tiling->jpeg_header_length);
+	u8* dimensions = stream + tiling->sof_dimensions_offset;
+	dimensions[0] = (u8)(decoded_height >> 8);
+	dimensions[1] = (u8)decoded_height;
+	dimensions[2] = (u8)(decoded_width >> 8);
+	dimensions[3] = (u8)decoded_width;
+
+	u64 pos = tiling->jpeg_header_length;
+	u32 restart_number = 0;
+	for (u32 row = first_row; row < end_row; ++row) {
+		// The intervals of one MCU row are contiguous in the file, so they can be read at once.
+		u64 first_interval = (u64)row * tiling->intervals_per_row + first_column;
+		u64 last_interval = (u64)row * tiling->intervals_per_row + end_column - 1;
+		u64 chunk_start = interval_starts[first_interval];
+		u64 chunk_size = NDPI_INTERVAL_END(last_interval) - chunk_start;
+		u8* chunk = stream + pos;
+		if (!tiff_read_at_offset(tiff, chunk, strip_offset + chunk_start, chunk_size)) {
+			return false;
 		}
-		if (compressed_strip_data) {
-			for (i32 i = 0; i < level_ifd->strip_count; ++i) {
-				free(compressed_strip_data[i]);
+		for (u64 i = first_interval + 1; i <= last_interval; ++i) {
+			u8* marker = chunk + (interval_starts[i] - 2 - chunk_start);
+			if (marker[0] != 0xFF || (marker[1] & 0xF8) != 0xD0) {
+				console_print_error("thread %d: NDPI level %d, tile %d: restart marker not found\n", logical_thread_index, level, tile_index);
+				return false;
 			}
+			marker[1] = (u8)(0xD0 | (restart_number++ & 7));
 		}
-		if (decompressed) {
-			free(decompressed);
+		pos += chunk_size;
+		if (row + 1 < end_row) {
+			stream[pos++] = 0xFF;
+			stream[pos++] = (u8)(0xD0 | (restart_number++ & 7));
 		}
+	}
+#undef NDPI_INTERVAL_END
+	stream[pos++] = 0xFF;
+	stream[pos++] = 0xD9; // EOI
+	ASSERT(pos <= stream_size);
+
+	if (!region && (decoded_width < ifd->tile_width || decoded_height < ifd->tile_height)) {
+		// Edge tile: the part beyond the image boundary is transparent.
+		memset(pixel_memory, 0, (size_t)ifd->tile_width * ifd->tile_height * BYTES_PER_PIXEL);
+	}
+	u32 dest_x = x0 - tile_first_column * tiling->interval_width;
+	u32 dest_y = y0 - tile_first_row * tiling->mcu_height;
+	u8* dest = pixel_memory + ((size_t)dest_y * ifd->tile_width + dest_x) * BYTES_PER_PIXEL;
+	if (!jpeg_decode_image_scaled(stream, (u32)pos, dest, ifd->tile_width * BYTES_PER_PIXEL,
+	                              ifd->tile_width - dest_x, ifd->tile_height - dest_y, 1)) {
+		console_print_error("thread %d: failed to decode NDPI level %d, tile %d\n", logical_thread_index, level, tile_index);
+		return false;
+	}
+	return true;
+}
 
-		return pixel_memory;
+static bool tiff_decode_tile_to_buffer_with_region(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 level,
+                                                   i32 tile_x, i32 tile_y, const jpeg_region_t* region, u8* pixel_memory) {
+	if (!pixel_memory) {
+		return false;
+	}
 
+	u64 tile_offset = 0;
+	u64 compressed_tile_size_in_bytes = 0;
+	u8* compressed_tile_data = NULL;
+	bool failed = false;
+
+	if (level_ifd->ndpi_tiling) {
+		return tiff_ndpi_decode_tile_to_buffer(logical_thread_index, tiff, level_ifd, tile_index, level, region, pixel_memory);
+	} else if (level_ifd->is_tiled) {
+		if (!tiff_get_tile_location(tiff, level_ifd, tile_index, &tile_offset, &compressed_tile_size_in_bytes)) {
+			return false;
+		}
+
+		// Some tiles apparently contain no data (not even an empty/dummy JPEG stream like some other tiles have).
+		// We need to check for this situation and chicken out if this is the case.
+		if (tile_offset == 0 || compressed_tile_size_in_bytes == 0) {
+#if DO_DEBUG
+			console_print("thread %d: tile level %d, tile %d (%d, %d) appears to be empty\n", logical_thread_index, level, tile_index, tile_x, tile_y);
+#endif
+			return false;
+		}
+
+		if (!tiff->is_remote) {
+			compressed_tile_data = tiff_get_compressed_bytes(logical_thread_index, tiff, tile_offset, compressed_tile_size_in_bytes);
+			if (!compressed_tile_data) {
+				return false;
+			}
+		} else {
+			compressed_tile_data = tiff_get_scratch_buffer(logical_thread_index, TIFF_SCRATCH_COMPRESSED, compressed_tile_size_in_bytes);
+			if (!compressed_tile_data) {
+				return false;
+			}
+			console_print_verbose("[thread %d] remote tile requested: level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
+
+			i32 bytes_read = 0;
+			u8* read_buffer = download_remote_chunk(tiff->location.hostname, tiff->location.portno, tiff->location.filename,
+			                                        tile_offset, compressed_tile_size_in_bytes, &bytes_read, logical_thread_index);
+			if (read_buffer && bytes_read > 0) {
+				i64 content_offset = find_end_of_http_headers(read_buffer, bytes_read);
+				i64 content_length = bytes_read - content_offset;
+				u8* content = read_buffer + content_offset;
+
+				if (content_length >= compressed_tile_size_in_bytes) {
+					memcpy(compressed_tile_data, content, compressed_tile_size_in_bytes);
+				} else {
+					failed = true;
+				}
+
+			} else {
+				failed = true;
+			}
+			if (read_buffer) {
+				free(read_buffer);
+			}
+			if (failed) {
+				console_print_error("[thread %d] failed to read from remote level %d, tile %d (%d, %d)\n", logical_thread_index, level, tile_index, tile_x, tile_y);
+				return false;
+			}
+		}
+
+	} else {
+		// image is not tiled: decode the virtual tile from the strips it covers
+		return tiff_decode_strip_tile_to_buffer(logical_thread_index, tiff, level_ifd, tile_index, level, pixel_memory);
 	}
-	ASSERT(!"should not reach this code");
-	return NULL;
+
+	return tiff_decode_compressed_streams(logical_thread_index, tiff, level_ifd, &compressed_tile_data, &compressed_tile_size_in_bytes, 1,
+	                                      level_ifd->tile_width, level_ifd->tile_height, level_ifd->tile_height, pixel_memory,
+	                                      region, level, tile_index, tile_x, tile_y);
 
 	// Trim the tile (replace with transparent color) if it extends beyond the image size
 	// TODO: anti-alias edge?
@@ -1964,3 +2689,83 @@ u8* tiff_decode_tile(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_i
 		}
 	}*/
 }
+
+// Decodes a tile into caller-provided memory (tile_width * tile_height * BYTES_PER_PIXEL bytes).
+bool tiff_decode_tile_to_buffer(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 level, i32 tile_x, i32 tile_y, u8* pixel_memory) {
+	return tiff_decode_tile_to_buffer_with_region(logical_thread_index, tiff, level_ifd, tile_index, level, tile_x, tile_y, NULL, pixel_memory);
+}
+
+// Like tiff_decode_tile_to_buffer(), but only the pixels within the given region of the tile are guaranteed to be
+// decoded. For JPEG-compressed tiles, the MCU rows and columns outside of the region are skipped.
+bool tiff_decode_tile_region_to_buffer(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 level,
+                                       i32 tile_x, i32 tile_y, i32 region_x, i32 region_y, i32 region_width, i32 region_height,
+                                       u8* pixel_memory) {
+	jpeg_region_t region = {region_x, region_y, region_width, region_height};
+	return tiff_decode_tile_to_buffer_with_region(logical_thread_index, tiff, level_ifd, tile_index, level, tile_x, tile_y, &region, pixel_memory);
+}
+
+bool tiff_can_decode_tile_region(tiff_t* tiff, tiff_ifd_t* level_ifd) {
+	return !tiff->is_remote && level_ifd->is_tiled && level_ifd->compression == TIFF_COMPRESSION_JPEG;
+}
+
+bool tiff_can_decode_tile_scaled(tiff_t* tiff, tiff_ifd_t* level_ifd) {
+	return !tiff->is_remote && level_ifd->is_tiled && !level_ifd->is_ndpi && level_ifd->compression == TIFF_COMPRESSION_JPEG;
+}
+
+// Decodes a JPEG-compressed tile at 1/scale_denom of its size (scale_denom = 1, 2, 4 or 8), into a rectangle
+// of at most max_width x max_height pixels in the destination. The downscaling happens in the DCT domain.
+bool tiff_decode_tile_scaled_to_buffer(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 scale_denom,
+                                       u8* dest, i32 dest_pitch, i32 max_width, i32 max_height) {
+	if (!tiff_can_decode_tile_scaled(tiff, level_ifd) || tile_index < 0 || (u64)tile_index >= level_ifd->tile_count) {
+		return false;
+	}
+	u64 tile_offset = 0;
+	u64 compressed_tile_size_in_bytes = 0;
+	if (!tiff_get_tile_location(tiff, level_ifd, tile_index, &tile_offset, &compressed_tile_size_in_bytes)) {
+		return false;
+	}
+	if (tile_offset == 0 || compressed_tile_size_in_bytes < 2) {
+		return false; // empty tile
+	}
+	u8* compressed_tile_data = tiff_get_compressed_bytes(logical_thread_index, tiff, tile_offset, compressed_tile_size_in_bytes);
+	if (!compressed_tile_data) {
+		return false;
+	}
+	if (compressed_tile_data[0] == 0xFF && compressed_tile_data[1] == 0xD9) {
+		// JPEG stream is empty
+		i32 scaled_width = ATMOST(max_width, (i32)((level_ifd->tile_width + scale_denom - 1) / scale_denom));
+		i32 scaled_height = ATMOST(max_height, (i32)((level_ifd->tile_height + scale_denom - 1) / scale_denom));
+		for (i32 y = 0; y < scaled_height; ++y) {
+			memset(dest + (size_t)y * dest_pitch, 0xFF, scaled_width * BYTES_PER_PIXEL);
+		}
+		return true;
+	}
+	return jpeg_decode_tile_scaled(level_ifd->jpeg_tables, level_ifd->jpeg_tables_length, compressed_tile_data, compressed_tile_size_in_bytes,
+	                               dest, dest_pitch, max_width, max_height, (level_ifd->color_space == TIFF_PHOTOMETRIC_YCBCR), scale_denom);
+}
+
+// Returns a malloc'd copy of the still-compressed bytes of a tile in a local file (or NULL if the tile is empty).
+// Used when exporting, to pass JPEG tiles through without decoding and re-encoding them.
+u8* tiff_copy_compressed_tile(tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, u64* size) {
+	if (tiff->is_remote || !level_ifd->is_tiled || level_ifd->is_ndpi || tile_index < 0 || (u64)tile_index >= level_ifd->tile_count) {
+		return NULL;
+	}
+	u64 tile_offset = 0;
+	u64 compressed_tile_size_in_bytes = 0;
+	if (!tiff_get_tile_location(tiff, level_ifd, tile_index, &tile_offset, &compressed_tile_size_in_bytes)) {
+		return NULL;
+	}
+	if (tile_offset == 0 || compressed_tile_size_in_bytes < 4) {
+		return NULL; // empty tile
+	}
+	u8* data = (u8*)malloc(compressed_tile_size_in_bytes);
+	u8* mapped = mapped_file_get_bytes(&tiff->mapped_file, tile_offset, compressed_tile_size_in_bytes);
+	if (mapped) {
+		memcpy(data, mapped, compressed_tile_size_in_bytes);
+	} else if (file_handle_read_at_offset(data, tiff->file_handle, tile_offset, compressed_tile_size_in_bytes) != compressed_tile_size_in_bytes) {
+		free(data);
+		return NULL;
+	}
+	*size = compressed_tile_size_in_bytes;
+	return data;
+}
@@ -187,7 +187,10 @@ enum tiff_compression_enum {
 	TIFF_COMPRESSION_OJPEG = 6, // old-style JPEG -> ignore
 	TIFF_COMPRESSION_JPEG = 7,
 	TIFF_COMPRESSION_ADOBE_DEFLATE = 8,
+	TIFF_COMPRESSION_DEFLATE = 32946, // obsolete code for Deflate, same encoding as TIFF_COMPRESSION_ADOBE_DEFLATE
 	TIFF_COMPRESSION_JP2000 = 34712,
+	TIFF_COMPRESSION_ZSTD = 50000,
+	TIFF_COMPRESSION_WEBP = 50001,
 };
 
 // https://www.awaresystems.be/imaging/tiff/tifftags/photometricinterpretation.html
@@ -232,6 +235,52 @@ enum subimage_type_enum {
 
 typedef struct tiff_t tiff_t;
 
+// TileOffsets and TileByteCounts are not read when the file is opened, but per page of tiles on first access,
+// so that opening a BigTIFF with millions of tiles only costs reading the IFD chain.
+#define TIFF_TILE_OFFSET_PAGE_SHIFT 12
+#define TIFF_TILE_OFFSET_PAGE_ENTRIES (1 << TIFF_TILE_OFFSET_PAGE_SHIFT)
+
+typedef struct tiff_tile_offset_page_t {
+	u64 offsets[TIFF_TILE_OFFSET_PAGE_ENTRIES];
+	u64 byte_counts[TIFF_TILE_OFFSET_PAGE_ENTRIES];
+} tiff_tile_offset_page_t;
+
+// Stripped (non-tiled) images are exposed as virtually tiled, with tiles of this size.
+#define TIFF_VIRTUAL_TILE_SIZE 512
+// Upper bound on the memory kept in an IFD's cache of decoded strips.
+#define TIFF_STRIP_CACHE_MAX_BYTES (256ULL * 1024 * 1024)
+
+// A decoded strip (full image width, BGRA), shared between the virtual tiles that overlap it.
+typedef struct tiff_decoded_strip_t {
+	i64 strip_index; // -1 if the slot is unused
+	u8* pixels;
+	i32 refcount;
+	u64 last_used;
+} tiff_decoded_strip_t;
+
+// NDPI levels are stored as a single JPEG stream with restart markers. The McuStarts tag gives the offset of
+// each restart interval, so a virtual tile can be decoded on its own, from a small JPEG stream synthesized
+// from the stream header and the restart intervals that cover the tile.
+typedef struct tiff_ndpi_tiling_t {
+	u8* jpeg_header; // SOI up to and including the SOS segment
+	u32 jpeg_header_length;
+	u32 sof_dimensions_offset; // position of the height and width fields of the SOF segment in jpeg_header
+	u32 mcu_width;
+	u32 mcu_height;
+	u32 restart_interval; // in MCUs
+	u32 interval_width; // in pixels
+	u32 intervals_per_row;
+	u32 mcu_row_count;
+	u32 intervals_per_tile;
+	u32 mcu_rows_per_tile;
+} tiff_ndpi_tiling_t;
+
+typedef struct tiff_strip_cache_t {
+	tiff_decoded_strip_t* entries;
+	i32 entry_count;
+	u64 use_counter;
+} tiff_strip_cache_t;
+
 
 typedef struct tiff_ifd_t {
 	u64 ifd_index;
@@ -242,11 +291,14 @@ typedef struct tiff_ifd_t {
 	u64 strip_count;
 	u64* strip_offsets;
 	u64* strip_byte_counts;
+	tiff_strip_cache_t* strip_cache; // decoded strips, used when the image is not tiled
 	u32 tile_width;
 	u32 tile_height;
 	u64 tile_count;
-	u64* tile_offsets;
-	u64* tile_byte_counts;
+	tiff_tag_t tile_offsets_tag;
+	tiff_tag_t tile_byte_counts_tag;
+	tiff_tile_offset_page_t** tile_offset_pages; // use tiff_get_tile_location()
+	u64 tile_offset_page_count;
 	u16 samples_per_pixel;
 	u16 bits_per_sample;
 	u16 bytes_per_sample;
@@ -285,8 +337,9 @@ typedef struct tiff_ifd_t {
 	tiff_rational_t x_position;
 	tiff_rational_t y_position;
 	tiff_resunit_enum resolution_unit;
-    u32* ndpi_optimization_markers;
-    u32 ndpi_optimization_count;
+    u64* ndpi_optimization_markers; // McuStarts: offsets of the restart intervals, relative to the strip
+    u64 ndpi_optimization_count;
+    tiff_ndpi_tiling_t* ndpi_tiling; // set if the level can be decoded one virtual tile at a time
 	u64 icc_profile_offset;
 	u64 icc_profile_length;
     bool is_ndpi;
@@ -307,6 +360,7 @@ struct tiff_t {
 	file_stream_t fp;
 #if !IS_SERVER
 	file_handle_t file_handle;
+	mapped_file_t mapped_file; // only if use_memory_mapped_files is set and the file is local
 #endif
 	i64 filesize;
 	u32 bytesize_of_offsets;
@@ -353,9 +407,9 @@ typedef struct {
 	u32 image_height;
 	u32 tile_width;
 	u32 tile_height;
-//	u64* tile_offsets;
 	u64 tile_count;
-//	u64* tile_byte_counts;
+	tiff_tag_t tile_offsets_tag; // the client reads the offsets from the file in pages, as needed
+	tiff_tag_t tile_byte_counts_tag;
 //	char* image_description;
 	u64 image_description_length;
 //	u8* jpeg_tables;
@@ -375,13 +429,36 @@ typedef struct {
 //	tiff_tile_t* tiles;
 } tiff_serial_ifd_t;
 
+// IFD layout sent by older servers, without the tile offset tags (they sent the complete arrays in separate blocks instead).
+typedef struct {
+	u32 image_width;
+	u32 image_height;
+	u32 tile_width;
+	u32 tile_height;
+	u64 tile_count;
+	u64 image_description_length;
+	u64 jpeg_tables_length;
+	u16 compression;
+	u16 color_space;
+	float level_magnification;
+	u32 width_in_tiles;
+	u32 height_in_tiles;
+	float um_per_pixel_x;
+	float um_per_pixel_y;
+	float x_tile_side_in_um;
+	float y_tile_side_in_um;
+	u16 chroma_subsampling_horizontal;
+	u16 chroma_subsampling_vertical;
+	u32 subimage_type;
+} tiff_serial_ifd_legacy_t;
+
 enum serial_block_type_enum {
 	SERIAL_BLOCK_LZ4_COMPRESSED_DATA = 4444,
 	SERIAL_BLOCK_TIFF_HEADER_AND_META = 9001, // using ridiculous numbers to make invalid file structure easier to detect
 	SERIAL_BLOCK_TIFF_IFDS = 9002,
 	SERIAL_BLOCK_TIFF_IMAGE_DESCRIPTION = 9003,
-	SERIAL_BLOCK_TIFF_TILE_OFFSETS = 9004,
-	SERIAL_BLOCK_TIFF_TILE_BYTE_COUNTS = 9005,
+	SERIAL_BLOCK_TIFF_TILE_OFFSETS = 9004, // no longer sent, but still accepted (together with tiff_serial_ifd_legacy_t)
+	SERIAL_BLOCK_TIFF_TILE_BYTE_COUNTS = 9005, // no longer sent, but still accepted (together with tiff_serial_ifd_legacy_t)
 	SERIAL_BLOCK_TIFF_JPEG_TABLES = 9006,
 	SERIAL_BLOCK_TERMINATOR = 800,
 };
@@ -401,6 +478,18 @@ i64 find_end_of_http_headers(u8* str, u64 len);
 bool32 tiff_deserialize(tiff_t* tiff, u8* buffer, u64 buffer_size);
 void tiff_destroy(tiff_t* tiff);
 u8* tiff_decode_tile(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 level, i32 tile_x, i32 tile_y);
+bool tiff_get_tile_location(tiff_t* tiff, tiff_ifd_t* ifd, u64 tile_index, u64* tile_offset, u64* tile_byte_count);
+bool tiff_decode_tile_to_buffer(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 level, i32 tile_x, i32 tile_y, u8* pixel_memory);
+bool tiff_decode_tile_region_to_buffer(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 level,
+                                       i32 tile_x, i32 tile_y, i32 region_x, i32 region_y, i32 region_width, i32 region_height,
+                                       u8* pixel_memory);
+bool tiff_can_decode_tile_region(tiff_t* tiff, tiff_ifd_t* level_ifd);
+void tiff_release_scratch_buffers(i32 logical_thread_index);
+bool tiff_undo_horizontal_predictor(u8* row, u32 pixel_count, u32 samples_per_pixel, u32 bytes_per_sample);
+bool tiff_can_decode_tile_scaled(tiff_t* tiff, tiff_ifd_t* level_ifd);
+bool tiff_decode_tile_scaled_to_buffer(i32 logical_thread_index, tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, i32 scale_denom,
+                                       u8* dest, i32 dest_pitch, i32 max_width, i32 max_height);
+u8* tiff_copy_compressed_tile(tiff_t* tiff, tiff_ifd_t* level_ifd, i32 tile_index, u64* size);
 double tiff_rational_to_float(tiff_rational_t rational);
 tiff_rational_t float_to_tiff_rational(double x);
 
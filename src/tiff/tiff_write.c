@@ -24,7 +24,10 @@
 #include "viewer.h"
 #include "image_resize.h"
 #include "jpeg_decoder.h"
+#include "tile_loader.h"
 #include "platform_mutex.h"
+#include "webp_api.h"
+#include "annotation_raster.h"
 
 #include "tiff_write.h"
 
@@ -36,12 +39,7 @@ typedef struct export_region_task_t {
     bounds2f world_bounds;
     bounds2i level0_bounds;
     const char* filename;
-    u32 export_tile_width;
-    u16 desired_photometric_interpretation;
-    i32 quality;
-    u32 export_flags;
-    bool need_resize;
-    v2f target_mpp;
+    export_options_t options;
 } export_region_task_t;
 
 typedef struct offset_fixup_t {
@@ -91,8 +89,13 @@ typedef struct image_draft_tile_t {
     i32 tile_y;
     i32 tile_index;
     i32 level;
+    volatile i32 children_remaining; // only used above the parallel frontier
 } image_draft_tile_t;
 
+// NOTE: only the tiles above the parallel frontier are kept in the level's 'tiles' array, because several workers
+// shrink into them. All other tiles only exist on the stack of the worker constructing them, so the bookkeeping
+// doesn't grow with the size of the export (apart from the offset tables, which need to be written out at the end).
+
 typedef struct image_draft_level_t {
     i32 level;
     i32 width_in_pixels;
@@ -100,7 +103,7 @@ typedef struct image_draft_level_t {
     i32 width_in_tiles;
     i32 height_in_tiles;
     i32 tile_count;
-    image_draft_tile_t* tiles;
+    image_draft_tile_t* tiles; // NULL at and below the parallel frontier
     u64 offset_of_tile_offsets;
     u64 offset_of_tile_bytecounts;
     bool are_tile_offsets_inlined_in_tag;
@@ -129,7 +132,13 @@ typedef struct image_draft_t {
     bool need_resize;
     v2f mpp;
     u64 image_data_base_offset;
-    u64 current_image_data_write_offset;
+    file_handle_t output_file;
+    volatile i64 image_data_end_offset; // ranges for compressed tiles are reserved with atomic_add_i64()
+    volatile i64 preallocated_end_offset;
+    platform_mutex_t preallocate_lock;
+    task_group_t encode_task_group;
+    i32 max_encode_tasks_in_flight;
+    volatile i32 write_error_count;
     i32 total_tiles_to_export;
     float progress_per_exported_tile;
     float supertile_width;
@@ -138,30 +147,87 @@ typedef struct image_draft_t {
     i32 supertile_height_read;
     u16 desired_photometric_interpretation;
     i32 quality;
-    platform_mutex_t write_lock;
+    export_compression_enum compression;
+    i32 compression_level;
+    platform_mutex_t* progress_lock; // shared by the drafts of a multi-resolution export
+    platform_mutex_t own_progress_lock;
+    u8* jpeg_tables; // as written in the JPEGTables tag
+    u64 jpeg_tables_length;
+    bool can_copy_source_tiles;
+    volatile i32 copied_tile_count;
+    i32 parallel_frontier_level; // -1 if the tiles are constructed on one thread, 0 if base tiles are handed out one by one
+    platform_mutex_t upper_tiles_lock;
+    i32 max_construct_workers;
+    i32 band_tile_count;
+    volatile i32 base_tiles_constructed;
+    platform_mutex_t band_lock;
+    bool release_page_cache; // EXPORT_FLAGS_RELEASE_PAGE_CACHE
+    u64 released_output_offset; // output before this offset has been dropped from the page cache
+    u64 written_back_output_offset; // output before this offset has been submitted for writeback
+    u64 previous_band_end_offset;
+    annotation_raster_t* annotation_raster; // annotations to burn into the base level tiles; NULL if none
+    v2f annotation_origin; // world position of the top left corner of the base level
+    v2f annotation_scale; // base level pixels per world unit
+    // Time spent in each stage of the export (in get_clock() ticks, summed over all threads), see export_stats_t
+    volatile i64 read_ticks;
+    volatile i64 resample_ticks;
+    volatile i64 annotation_ticks;
+    volatile i64 encode_ticks;
+    volatile i64 write_ticks;
 } image_draft_t;
 
+// Disk space for the compressed tiles is preallocated in chunks of this size, ahead of the writes.
+#define EXPORT_PREALLOCATE_CHUNK_SIZE MEGABYTES(64)
+
+// Used if no memory budget is given for an export.
+#define EXPORT_DEFAULT_MEMORY_BUDGET MEGABYTES(1024)
+
 typedef struct construct_export_tile_task_t {
     image_draft_t* draft;
     image_draft_level_t* frontier;
-    file_stream_t fp;
     volatile i32* next_tile_index;
-    volatile i32* started_count;
     volatile i32* participants_goal;
     volatile i32* finished_count;
+    semaphore_handle_t finished_semaphore; // posted by each participant when done
 } construct_export_tile_task_t;
 
-static void shrink_tile_and_propagate_to_next_level(image_draft_t* draft, image_draft_tile_t* tile) {
-    if (tile->level + 1 < draft->level_count) {
+static inline void image_draft_add_stage_time(volatile i64* stage_ticks, i64 start_clock) {
+    atomic_add_i64(stage_ticks, get_clock() - start_clock);
+}
+
+static image_draft_tile_t image_draft_make_tile(image_draft_t* draft, i32 level, i32 tile_x, i32 tile_y) {
+    image_draft_tile_t tile = {};
+    tile.tile_x = tile_x;
+    tile.tile_y = tile_y;
+    tile.tile_index = tile_y * draft->levels[level].width_in_tiles + tile_x;
+    tile.level = level;
+    return tile;
+}
 
-        // Find the parent tile and initialize an image buffer for it if needed
-        image_draft_level_t* parent_level = draft->levels + tile->level + 1;
-        i32 parent_tile_x = tile->tile_x / 2;
-        i32 parent_tile_y = tile->tile_y / 2;
-        image_draft_tile_t* parent_tile = parent_level->tiles + parent_tile_y * parent_level->width_in_tiles + parent_tile_x;
+// Returns the parent if it is shared between the workers (above the parallel frontier), or NULL for the top level.
+static image_draft_tile_t* image_draft_get_upper_parent_tile(image_draft_t* draft, image_draft_tile_t* tile) {
+    if (tile->level + 1 >= draft->level_count) {
+        return NULL;
+    }
+    image_draft_level_t* parent_level = draft->levels + tile->level + 1;
+    ASSERT(parent_level->tiles);
+    return parent_level->tiles + (tile->tile_y / 2) * parent_level->width_in_tiles + (tile->tile_x / 2);
+}
 
-        // TODO: how to make this safe for multithreading?
-        if (!parent_tile->buffer.pixels) {
+static void shrink_tile_and_propagate_to_next_level(image_draft_t* draft, image_draft_tile_t* tile, image_draft_tile_t* parent_tile) {
+    if (parent_tile) {
+        ASSERT(parent_tile->level == tile->level + 1);
+
+        // Initialize an image buffer for the parent tile if needed.
+        // NOTE: above the parallel frontier, several threads may shrink into the same parent. Those buffers are only
+        // allocated once the first child is done, so that only the partially filled upper tiles take up memory.
+        if (parent_tile->level > draft->parallel_frontier_level && draft->parallel_frontier_level >= 0) {
+            platform_mutex_lock(&draft->upper_tiles_lock);
+            if (!parent_tile->buffer.pixels) {
+                parent_tile->buffer = create_bgra_image_buffer(draft->tile_width, draft->tile_height);
+            }
+            platform_mutex_unlock(&draft->upper_tiles_lock);
+        } else if (!parent_tile->buffer.pixels) {
             parent_tile->buffer = create_bgra_image_buffer(draft->tile_width, draft->tile_height);
         }
 
@@ -179,50 +245,333 @@ static void shrink_tile_and_propagate_to_next_level(image_draft_t* draft, image_
         dest.height /= 2;
 
         // Do the shrink
+        i64 start = get_clock();
         image_shrink_2x2(&tile->buffer, &dest, (rect2i){0, 0, draft->tile_width, draft->tile_height});
+        image_draft_add_stage_time(&draft->resample_ticks, start);
     }
 }
 
-static void write_finished_bigtiff_tile(image_draft_t* draft, image_draft_tile_t* tile, file_stream_t fp) {
+// The export runs as a pipeline. Source tiles are decoded by the tile loader on the worker threads; the construct
+// workers resample them into base tiles and shrink those into the next level up; finished tiles are then handed off
+// to encode tasks, which compress them with the configured codec (JPEG, Deflate, Zstd or WebP; see
+// export_compression_enum) and write them out. Writes don't serialize: each encode task reserves its own range in
+// the output file and writes it with a positional write, so encoding scales across the worker threads.
+
+static u64 image_draft_reserve_output_range(image_draft_t* draft, u64 size) {
+    u64 offset = (u64)atomic_add_i64(&draft->image_data_end_offset, (i64)size) - size;
+    i64 end = (i64)(offset + size);
+    if (end > draft->preallocated_end_offset) {
+        platform_mutex_lock(&draft->preallocate_lock);
+        if (end > draft->preallocated_end_offset) {
+            u64 chunk_size = MAX((u64)(end - draft->preallocated_end_offset), (u64)EXPORT_PREALLOCATE_CHUNK_SIZE);
+            // Failure is not an error here: the writes will simply extend the file.
+            file_handle_preallocate(draft->output_file, draft->preallocated_end_offset, chunk_size);
+            draft->preallocated_end_offset += chunk_size;
+        }
+        platform_mutex_unlock(&draft->preallocate_lock);
+    }
+    return offset;
+}
+
+static void image_draft_report_tile_exported(image_draft_t* draft) {
+    platform_mutex_lock(draft->progress_lock);
+    global_tiff_export_progress += draft->progress_per_exported_tile;
+
+	// Console 'progress bar': write 20 dots to stdout during export ....................
+	i32 prev_console_dots = global_tiff_export_progress_console_dots_written;
+	global_tiff_export_progress_console_dots_written = (i32)(global_tiff_export_progress * 20.0f + 0.5f);
+	i32 dots_to_write = global_tiff_export_progress_console_dots_written - prev_console_dots;
+	for (i32 i = 0; i < dots_to_write; ++i) {
+		putc('.', stdout);
+	}
+    platform_mutex_unlock(draft->progress_lock);
+}
 
-    bool use_rgb = (draft->desired_photometric_interpretation == TIFF_PHOTOMETRIC_RGB);
+static u16 get_tiff_compression_for_export(export_compression_enum compression) {
+    switch (compression) {
+        default:
+        case EXPORT_COMPRESSION_JPEG: return TIFF_COMPRESSION_JPEG;
+        case EXPORT_COMPRESSION_DEFLATE: return TIFF_COMPRESSION_ADOBE_DEFLATE;
+        case EXPORT_COMPRESSION_ZSTD: return TIFF_COMPRESSION_ZSTD;
+        case EXPORT_COMPRESSION_WEBP: return TIFF_COMPRESSION_WEBP;
+        case EXPORT_COMPRESSION_WEBP_LOSSLESS: return TIFF_COMPRESSION_WEBP;
+    }
+}
 
+static void encode_and_write_bigtiff_tile(image_draft_t* draft, u8* pixels, i32 level, i32 tile_index) {
     u8* compressed_buffer = NULL;
     u64 compressed_size = 0;
-    jpeg_encode_tile(tile->buffer.pixels, draft->tile_width, draft->tile_width, draft->quality, NULL, NULL,
-                     &compressed_buffer, &compressed_size, use_rgb);
+    i64 encode_start = get_clock();
+    if (draft->compression == EXPORT_COMPRESSION_JPEG) {
+        bool use_rgb = (draft->desired_photometric_interpretation == TIFF_PHOTOMETRIC_RGB);
+        jpeg_encode_tile(pixels, draft->tile_width, draft->tile_height, draft->quality, NULL, NULL,
+                         &compressed_buffer, &compressed_size, use_rgb);
+    } else {
+        compressed_buffer = encode_export_tile(pixels, draft->tile_width, draft->tile_height, draft->compression,
+                                               draft->quality, draft->compression_level, &compressed_size);
+    }
+    image_draft_add_stage_time(&draft->encode_ticks, encode_start);
+    if (!compressed_buffer) {
+        atomic_increment(&draft->write_error_count);
+        image_draft_report_tile_exported(draft);
+        return;
+    }
 
-    // JPEG encoding is the expensive part and happens before the lock. Only the shared append position,
-    // tile offset tables, and progress counters are serialized.
-    platform_mutex_lock(&draft->write_lock);
+    i64 write_start = get_clock();
+    u64 write_offset = image_draft_reserve_output_range(draft, compressed_size);
+    if (file_handle_write_at_offset(compressed_buffer, draft->output_file, write_offset, compressed_size) != compressed_size) {
+        atomic_increment(&draft->write_error_count);
+    }
+    image_draft_add_stage_time(&draft->write_ticks, write_start);
 
-    fseeko64(fp, draft->current_image_data_write_offset, SEEK_SET); // this needed?
+    // Every tile is written exactly once, so the offset tables don't need a lock.
+    image_draft_level_t* draft_level = draft->levels + level;
+    draft_level->tile_offsets[tile_index] = write_offset;
+    draft_level->tile_bytecounts[tile_index] = compressed_size;
 
-    fwrite(compressed_buffer, compressed_size, 1, fp);
+    if (draft->compression == EXPORT_COMPRESSION_JPEG) {
+        libc_free(compressed_buffer);
+    } else {
+        free(compressed_buffer);
+    }
+    image_draft_report_tile_exported(draft);
+}
 
-    image_draft_level_t* draft_level = draft->levels + tile->level;
+typedef struct encode_export_tile_task_t {
+    image_draft_t* draft;
+    u8* pixels; // owned by the task
+    i32 level;
+    i32 tile_index;
+} encode_export_tile_task_t;
 
-    draft_level->tile_offsets[tile->tile_index] = draft->current_image_data_write_offset;
-    draft_level->tile_bytecounts[tile->tile_index] = compressed_size;
+static void encode_export_tile_task_func(i32 logical_thread_index, void* userdata) {
+    encode_export_tile_task_t* task = (encode_export_tile_task_t*)userdata;
+    encode_and_write_bigtiff_tile(task->draft, task->pixels, task->level, task->tile_index);
+    free(task->pixels);
+}
 
-    draft->current_image_data_write_offset += compressed_size;
-    global_tiff_export_progress += draft->progress_per_exported_tile;
+static void write_finished_bigtiff_tile(image_draft_t* draft, image_draft_tile_t* tile) {
+    // The queue of tiles waiting to be encoded is bounded: if it is full, the producer encodes the tile itself
+    // instead of buffering more pixels.
+    if (draft->encode_task_group.pending_count < draft->max_encode_tasks_in_flight) {
+        size_t pixels_size = (size_t)draft->tile_width * draft->tile_height * BYTES_PER_PIXEL;
+        u8* pixels = (u8*)malloc(pixels_size);
+        if (pixels) {
+            memcpy(pixels, tile->buffer.pixels, pixels_size);
+            encode_export_tile_task_t task = {draft, pixels, tile->level, tile->tile_index};
+            if (thread_pool_submit_task_to_group(&global_thread_pool, &draft->encode_task_group,
+                                                 encode_export_tile_task_func, &task, sizeof(task))) {
+                return;
+            }
+            free(pixels);
+        }
+    }
+    encode_and_write_bigtiff_tile(draft, tile->buffer.pixels, tile->level, tile->tile_index);
+}
 
-	// Console 'progress bar': write 20 dots to stdout during export ....................
-	i32 prev_console_dots = global_tiff_export_progress_console_dots_written;
-	global_tiff_export_progress_console_dots_written = (i32)(global_tiff_export_progress * 20.0f + 0.5f);
-	i32 dots_to_write = global_tiff_export_progress_console_dots_written - prev_console_dots;
-	for (i32 i = 0; i < dots_to_write; ++i) {
-		putc('.', stdout);
-	}
+// Crops that are tile-aligned at the source resolution can reuse the source's JPEG tiles as they are, instead of
+// decoding and re-encoding them (which costs time, and adds generation loss).
+static bool image_draft_can_copy_source_tiles(image_draft_t* draft) {
+    image_t* image = draft->source_image;
+    if (draft->compression != EXPORT_COMPRESSION_JPEG || draft->need_resize || draft->source_base_level != 0) {
+        return false;
+    }
+    if (image->backend != IMAGE_BACKEND_TIFF && image->backend != IMAGE_BACKEND_DICOM) {
+        return false;
+    }
+    level_image_t* source_level = image->level_images + 0;
+    if (!source_level->exists || source_level->is_virtual) {
+        return false;
+    }
+    if ((i32)source_level->tile_width != draft->tile_width || (i32)source_level->tile_height != draft->tile_height) {
+        return false;
+    }
+    bounds2i bounds = draft->source_level0_bounds;
+    return bounds.left >= 0 && bounds.top >= 0 && bounds.left % draft->tile_width == 0 && bounds.top % draft->tile_height == 0;
+}
+
+static bool is_jpeg_sampling_compatible(jpeg_stream_info_t* info, bool is_YCbCr) {
+    // Must agree with the YCbCrSubsampling tag (2,2); libtiff requires 1x1 sampling for RGB.
+    for (i32 i = 0; i < 3; ++i) {
+        u8 expected = (is_YCbCr && i == 0) ? 2 : 1;
+        if (info->h_samp_factor[i] != expected || info->v_samp_factor[i] != expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes the compressed source tile covering a base level tile, if it can be used unchanged. Only tiles lying fully
+// within the crop are copied: the tiles at the right and bottom edges are re-encoded, as are all the reduced levels.
+static bool image_draft_copy_source_tile(image_draft_t* draft, image_draft_tile_t* tile) {
+    if (!draft->can_copy_source_tiles) {
+        return false;
+    }
+    image_t* image = draft->source_image;
+    i32 x = draft->source_level0_bounds.left + draft->tile_width * tile->tile_x;
+    i32 y = draft->source_level0_bounds.top + draft->tile_height * tile->tile_y;
+    if (x + draft->tile_width > draft->source_level0_bounds.right || y + draft->tile_height > draft->source_level0_bounds.bottom ||
+        x + draft->tile_width > image->width_in_pixels || y + draft->tile_height > image->height_in_pixels) {
+        return false;
+    }
+    level_image_t* source_level = image->level_images + 0;
+    i32 source_tile_index = (y / draft->tile_height) * source_level->width_in_tiles + (x / draft->tile_width);
+
+    u64 size = 0;
+    u8* source_tables = NULL;
+    u64 source_tables_length = 0;
+    bool is_YCbCr = false;
+    i64 read_start = get_clock();
+    u8* data = tile_loader_copy_jpeg_tile(image, 0, source_tile_index, &size, &source_tables, &source_tables_length, &is_YCbCr);
+    image_draft_add_stage_time(&draft->read_ticks, read_start);
+    if (!data) {
+        return false;
+    }
+
+    bool want_YCbCr = (draft->desired_photometric_interpretation == TIFF_PHOTOMETRIC_YCBCR);
+    jpeg_stream_info_t info = {0};
+    bool compatible = jpeg_read_stream_info(data, (u32)size, &info) && info.is_baseline && info.component_count == 3 &&
+                      info.width == draft->tile_width && info.height == draft->tile_height &&
+                      is_YCbCr == want_YCbCr && is_jpeg_sampling_compatible(&info, want_YCbCr);
+    if (compatible && source_tables_length == 0 && !info.defines_tables) {
+        compatible = false; // abbreviated stream, but no tables to go with it
+    }
+    bool need_splice = compatible && source_tables_length > 0 &&
+                       !(source_tables_length == draft->jpeg_tables_length && memcmp(source_tables, draft->jpeg_tables, source_tables_length) == 0);
+    if (need_splice && !(source_tables_length >= 4 && source_tables[0] == 0xFF && source_tables[1] == 0xD8 &&
+                         source_tables[source_tables_length - 2] == 0xFF && source_tables[source_tables_length - 1] == 0xD9)) {
+        compatible = false;
+    }
+    if (!compatible) {
+        free(data);
+        return false;
+    }
+
+    if (need_splice) {
+        // The source tables differ from ours, so insert them into the stream: SOI, the tables, then the rest of the tile.
+        u64 tables_payload_size = source_tables_length - 4;
+        u8* spliced = (u8*)malloc(size + tables_payload_size);
+        memcpy(spliced, data, 2);
+        memcpy(spliced + 2, source_tables + 2, tables_payload_size);
+        memcpy(spliced + 2 + tables_payload_size, data + 2, size - 2);
+        free(data);
+        data = spliced;
+        size += tables_payload_size;
+    }
+
+    i64 write_start = get_clock();
+    u64 write_offset = image_draft_reserve_output_range(draft, size);
+    if (file_handle_write_at_offset(data, draft->output_file, write_offset, size) != size) {
+        atomic_increment(&draft->write_error_count);
+    }
+    image_draft_add_stage_time(&draft->write_ticks, write_start);
+    image_draft_level_t* draft_level = draft->levels + tile->level;
+    draft_level->tile_offsets[tile->tile_index] = write_offset;
+    draft_level->tile_bytecounts[tile->tile_index] = size;
+    free(data);
+
+    atomic_increment(&draft->copied_tile_count);
+    image_draft_report_tile_exported(draft);
+    return true;
+}
+
+// Exports are processed in bands of base tiles, sized to fit the memory budget. Reading the source and writing the
+// output both go through the page cache, and without releasing those pages along the way, the memory in use grows
+// with the size of the exported region. So for headless exports (EXPORT_FLAGS_RELEASE_PAGE_CACHE), after each band
+// the mapped source pages are dropped, and the output is released in two steps, without waiting for the disk:
+// - writeback is started for the output written before the previous band ended (tiles reserved more recently may
+//   still be in the encode queue);
+// - the output that was submitted for writeback one band earlier (and is hopefully clean by now) is evicted.
+// There is no barrier between bands: a worker that still needs a dropped source page faults it in again from the
+// page cache.
+static void image_draft_finish_base_tile(image_draft_t* draft) {
+    i32 constructed_count = atomic_increment(&draft->base_tiles_constructed);
+    if (!draft->release_page_cache || constructed_count % draft->band_tile_count != 0) {
+        return;
+    }
+    image_drop_resident_source_pages(draft->source_image);
+
+    platform_mutex_lock(&draft->band_lock);
+    u64 drop_start_offset = draft->released_output_offset;
+    u64 drop_end_offset = draft->written_back_output_offset;
+    if (drop_end_offset > drop_start_offset) {
+        file_handle_drop_cached_range(draft->output_file, drop_start_offset, drop_end_offset - drop_start_offset);
+        draft->released_output_offset = drop_end_offset;
+    }
+    u64 writeback_start_offset = draft->written_back_output_offset;
+    u64 writeback_end_offset = draft->previous_band_end_offset;
+    if (writeback_end_offset > writeback_start_offset) {
+        file_handle_start_writeback(draft->output_file, writeback_start_offset, writeback_end_offset - writeback_start_offset);
+        draft->written_back_output_offset = writeback_end_offset;
+    }
+    draft->previous_band_end_offset = (u64)draft->image_data_end_offset;
+    platform_mutex_unlock(&draft->band_lock);
+}
 
-    platform_mutex_unlock(&draft->write_lock);
+// Source pixels decoded once for several drafts (see construct_tiles_sharing_source()), at the source base level.
+typedef struct export_source_block_t {
+    image_buffer_t buffer;
+    i32 x;
+    i32 y;
+} export_source_block_t;
+
+// The source region that is needed to construct a base level tile. If resampling, the region includes a margin for
+// the lanczos3 kernel, and 'offset' is set to where the tile's area starts within the region.
+static rect2i image_draft_get_source_rect_for_base_tile(image_draft_t* draft, i32 tile_x, i32 tile_y, v2f* offset) {
+    rect2i rect = {};
+    if (draft->need_resize) {
+        float supertile_x = draft->source_level0_bounds.left + draft->supertile_width * (tile_x << draft->source_base_level);
+        float supertile_y = draft->source_level0_bounds.top + draft->supertile_height * (tile_y << draft->source_base_level);
+        rect.x = (i32)floorf(supertile_x) - 4;
+        rect.y = (i32)floorf(supertile_y) - 4;
+        rect.w = draft->supertile_width_read;
+        rect.h = draft->supertile_height_read;
+        if (offset) {
+            offset->x = supertile_x - (float)rect.x;
+            offset->y = supertile_y - (float)rect.y;
+        }
+    } else {
+        rect.x = draft->source_level0_bounds.left + draft->tile_width * tile_x;
+        rect.y = draft->source_level0_bounds.top + draft->tile_height * tile_y;
+        rect.w = draft->tile_width;
+        rect.h = draft->tile_height;
+    }
+    return rect;
+}
 
-    libc_free(compressed_buffer);
+// Copies the region out of the block if the block has it, otherwise reads it from the source.
+static bool image_draft_read_source_region(image_draft_t* draft, export_source_block_t* block, rect2i rect, image_buffer_t* dest) {
+    if (block && rect.x >= block->x && rect.y >= block->y &&
+        rect.x + rect.w <= block->x + block->buffer.width && rect.y + rect.h <= block->y + block->buffer.height) {
+        i64 read_start = get_clock();
+        u8* src = block->buffer.pixels + (rect.y - block->y) * block->buffer.stride_in_bytes + (rect.x - block->x) * BYTES_PER_PIXEL;
+        for (i32 y = 0; y < rect.h; ++y) {
+            memcpy(dest->pixels + y * dest->stride_in_bytes, src + y * block->buffer.stride_in_bytes, rect.w * BYTES_PER_PIXEL);
+        }
+        image_draft_add_stage_time(&draft->read_ticks, read_start);
+        return true;
+    }
+    i64 read_start = get_clock();
+    bool read_ok = image_read_region(draft->source_image, draft->source_base_level, rect.x, rect.y, rect.w, rect.h,
+                                     dest->pixels, dest->pixel_format);
+    image_draft_add_stage_time(&draft->read_ticks, read_start);
+    return read_ok;
+}
 
+// Draws the annotations into a base level tile, before it is encoded and shrunk into the levels above.
+static void image_draft_burn_in_annotations(image_draft_t* draft, image_draft_tile_t* tile) {
+    if (!draft->annotation_raster) {
+        return;
+    }
+    i64 annotation_start = get_clock();
+    v2f tile_origin = V2F(draft->annotation_origin.x + (float)(tile->tile_x * draft->tile_width) / draft->annotation_scale.x,
+                          draft->annotation_origin.y + (float)(tile->tile_y * draft->tile_height) / draft->annotation_scale.y);
+    annotation_raster_draw(draft->annotation_raster, &tile->buffer, tile_origin, draft->annotation_scale);
+    image_draft_add_stage_time(&draft->annotation_ticks, annotation_start);
 }
 
-static void construct_base_tile_with_resampling(image_draft_t* draft, image_draft_tile_t* tile, file_stream_t fp) {
+static void construct_base_tile_with_resampling(image_draft_t* draft, image_draft_tile_t* tile, image_draft_tile_t* parent_tile,
+                                                export_source_block_t* block) {
 
     temp_memory_t temp = begin_temp_memory_on_local_thread();
 
@@ -241,24 +590,21 @@ static void construct_base_tile_with_resampling(image_draft_t* draft, image_draf
             supertile_need_destroy = true;
         }
 
-        float supertile_y = draft->source_level0_bounds.top + draft->supertile_height * (tile->tile_y << draft->source_base_level);
-        i32 supertile_read_y = (i32)floorf(supertile_y) - 4;
-        float supertile_offset_y = supertile_y - (float)supertile_read_y;
-
-        float supertile_x = draft->source_level0_bounds.left + draft->supertile_width * (tile->tile_x << draft->source_base_level);
-        i32 supertile_read_x = (i32)floorf(supertile_x) - 4;
-        float supertile_offset_x = supertile_x - (float)supertile_read_x;
-
-        if (image_read_region(draft->source_image, draft->source_base_level, supertile_read_x, supertile_read_y,
-                              draft->supertile_width_read, draft->supertile_height_read, supertile.pixels,
-                              supertile.pixel_format)) {
-            rect2f box = {supertile_offset_x, supertile_offset_y, draft->supertile_width, draft->supertile_height};
+        v2f supertile_offset = {};
+        rect2i supertile_rect = image_draft_get_source_rect_for_base_tile(draft, tile->tile_x, tile->tile_y, &supertile_offset);
+        bool read_ok = image_draft_read_source_region(draft, block, supertile_rect, &supertile);
+        if (read_ok) {
+            rect2f box = {supertile_offset.x, supertile_offset.y, draft->supertile_width, draft->supertile_height};
 
-            if (image_resample_lanczos3(&supertile, &resized_tile, box)) {
+            i64 resample_start = get_clock();
+            bool resample_ok = image_resample_lanczos3(&supertile, &resized_tile, box);
+            image_draft_add_stage_time(&draft->resample_ticks, resample_start);
+            if (resample_ok) {
 //              stbi_write_png("debug_resample_result.png", draft->tile_width, draft->tile_width, 4, resized_tile.pixels, resized_tile.width * resized_tile.channels);
                 tile->buffer = resized_tile;
-                shrink_tile_and_propagate_to_next_level(draft, tile);
-                write_finished_bigtiff_tile(draft, tile, fp);
+                image_draft_burn_in_annotations(draft, tile);
+                shrink_tile_and_propagate_to_next_level(draft, tile, parent_tile);
+                write_finished_bigtiff_tile(draft, tile);
             } else {
                 // TODO: handle error condition
             }
@@ -281,14 +627,16 @@ static void construct_base_tile_with_resampling(image_draft_t* draft, image_draf
             tile_need_destroy = true;
         }
 
-        i32 x = draft->source_level0_bounds.left + draft->tile_width * tile->tile_x;
-        i32 y = draft->source_level0_bounds.top + draft->tile_height * tile->tile_y;
-        if (image_read_region(draft->source_image, draft->source_base_level, x, y,
-                          draft->tile_width, draft->tile_height, tile_buffer.pixels,
-                          tile_buffer.pixel_format)) {
+        rect2i tile_rect = image_draft_get_source_rect_for_base_tile(draft, tile->tile_x, tile->tile_y, NULL);
+        bool read_ok = image_draft_read_source_region(draft, block, tile_rect, &tile_buffer);
+        if (read_ok) {
             tile->buffer = tile_buffer;
-            shrink_tile_and_propagate_to_next_level(draft, tile);
-            write_finished_bigtiff_tile(draft, tile, fp);
+            image_draft_burn_in_annotations(draft, tile);
+            shrink_tile_and_propagate_to_next_level(draft, tile, parent_tile);
+            // The pixels are still needed for the levels above, but the tile itself may not need re-encoding.
+            if (!image_draft_copy_source_tile(draft, tile)) {
+                write_finished_bigtiff_tile(draft, tile);
+            }
         } else {
             // TODO: handle error condition
         }
@@ -298,66 +646,86 @@ static void construct_base_tile_with_resampling(image_draft_t* draft, image_draf
         }
     }
 
-
     release_temp_memory(&temp);
+    image_draft_finish_base_tile(draft);
 }
 
-static void construct_tiles_recursive(image_draft_t* draft, image_draft_tile_t* tile, file_stream_t fp, bool propagate_to_parent) {
+static void construct_tiles_recursive(image_draft_t* draft, image_draft_tile_t* tile, image_draft_tile_t* parent_tile) {
     ASSERT(tile->level >= 0);
     if (tile->level == 0) {
-        ASSERT(propagate_to_parent);
-        construct_base_tile_with_resampling(draft, tile, fp);
+        construct_base_tile_with_resampling(draft, tile, parent_tile, NULL);
     } else {
-        // find child tiles
+        // Construct the child tiles (in the order top left, top right, bottom left, bottom right)
         image_draft_level_t* child_level = draft->levels + tile->level - 1;
-        image_draft_tile_t* topleft = child_level->tiles + tile->tile_y * 2 * child_level->width_in_tiles + tile->tile_x * 2;
-        construct_tiles_recursive(draft, topleft, fp, true);
-        i32 tile_x_right = tile->tile_x * 2 + 1;
-        i32 tile_y_bottom = tile->tile_y * 2 + 1;
-        if (tile_x_right < child_level->width_in_tiles) {
-            image_draft_tile_t* topright = topleft + 1;
-            construct_tiles_recursive(draft, topright, fp, true);
-        }
-        if (tile_y_bottom < child_level->height_in_tiles) {
-            image_draft_tile_t* bottomleft = topleft + child_level->width_in_tiles;
-            construct_tiles_recursive(draft, bottomleft, fp, true);
-        }
-        if (tile_x_right < child_level->width_in_tiles && tile_y_bottom < child_level->height_in_tiles) {
-            image_draft_tile_t* bottomright = topleft + child_level->width_in_tiles + 1;
-            construct_tiles_recursive(draft, bottomright, fp, true);
+        for (i32 child_tile_y = tile->tile_y * 2; child_tile_y < MIN(tile->tile_y * 2 + 2, child_level->height_in_tiles); ++child_tile_y) {
+            for (i32 child_tile_x = tile->tile_x * 2; child_tile_x < MIN(tile->tile_x * 2 + 2, child_level->width_in_tiles); ++child_tile_x) {
+                image_draft_tile_t child_tile = image_draft_make_tile(draft, child_level->level, child_tile_x, child_tile_y);
+                construct_tiles_recursive(draft, &child_tile, tile);
+            }
         }
 
         // Now all quadrants of the tile are filled -> write out to file
 //        stbi_write_png("debug_resample_result.png", draft->tile_width, draft->tile_width, 4, tile->buffer.pixels, tile->buffer.width * tile->buffer.channels);
-        if (propagate_to_parent) {
-            shrink_tile_and_propagate_to_next_level(draft, tile);
-        }
-        write_finished_bigtiff_tile(draft, tile, fp);
-        if (propagate_to_parent) {
-            destroy_image_buffer(&tile->buffer);
+        shrink_tile_and_propagate_to_next_level(draft, tile, parent_tile);
+        write_finished_bigtiff_tile(draft, tile);
+        destroy_image_buffer(&tile->buffer);
+    }
+}
+
+// Called after a tile at or above the parallel frontier has been shrunk into its parent. The thread that delivers
+// the last child of a parent finishes that parent right away, so the upper levels fill in as a wave while the other
+// workers are still busy with the frontier subtrees.
+static void finish_parent_tiles_from_frontier(image_draft_t* draft, image_draft_tile_t* tile) {
+    for (;;) {
+        image_draft_tile_t* parent_tile = image_draft_get_upper_parent_tile(draft, tile);
+        if (!parent_tile || atomic_decrement(&parent_tile->children_remaining) > 0) {
+            break; // top level reached, or another thread will finish the parent
         }
+        shrink_tile_and_propagate_to_next_level(draft, parent_tile, image_draft_get_upper_parent_tile(draft, parent_tile));
+        write_finished_bigtiff_tile(draft, parent_tile);
+        destroy_image_buffer(&parent_tile->buffer);
+        tile = parent_tile;
     }
 }
 
 static void construct_export_tile_task_func(i32 logical_thread_index, void* userdata) {
     construct_export_tile_task_t* task = (construct_export_tile_task_t*)userdata;
-    atomic_increment(task->started_count);
-    while (*task->started_count < *task->participants_goal) {
-        platform_sleep(1);
-    }
-
+    // NOTE: participants don't wait for each other to start. Exports may themselves run as tasks on the thread pool
+    // (batch export), so a participant blocking on the others could deadlock the pool; a late one just finds no work.
+    // The frontier tiles are handed out in row order, so the workers move through the source together (in bands).
     for (;;) {
         i32 tile_index = atomic_increment(task->next_tile_index) - 1;
         if (tile_index >= task->frontier->tile_count) {
             break;
         }
 
-        image_draft_tile_t* tile = task->frontier->tiles + tile_index;
-        // The frontier root is retained after writing so the serial top pass can propagate it upward.
-        construct_tiles_recursive(task->draft, tile, task->fp, false);
+        image_draft_tile_t tile = image_draft_make_tile(task->draft, task->frontier->level,
+                                                        tile_index % task->frontier->width_in_tiles,
+                                                        tile_index / task->frontier->width_in_tiles);
+        construct_tiles_recursive(task->draft, &tile, image_draft_get_upper_parent_tile(task->draft, &tile));
+        finish_parent_tiles_from_frontier(task->draft, &tile);
     }
 
     atomic_increment(task->finished_count);
+    platform_semaphore_post(task->finished_semaphore); // last access to the task: the caller may return after this
+}
+
+// Waits for the participants of a parallel construction (including the calling thread's own part), helping out with
+// other tasks on the pool while there are any, and otherwise blocking until the next participant is done.
+// Each participant posts the semaphore once, as the very last thing it does. All of the posts are consumed before
+// returning, so that the semaphore (and the shared state on the caller's stack) can be destroyed afterwards.
+static void wait_for_construct_participants(volatile i32* finished_count, i32 participant_count, semaphore_handle_t finished_semaphore) {
+    i32 posts_consumed = 0;
+    while (*finished_count < participant_count) {
+        if (!thread_pool_do_work(&global_thread_pool)) {
+            platform_semaphore_wait(finished_semaphore);
+            ++posts_consumed;
+        }
+    }
+    while (posts_consumed < participant_count) {
+        platform_semaphore_wait(finished_semaphore);
+        ++posts_consumed;
+    }
 }
 
 // NOTE (2026-05-19): parallel image export currently seems to be functional and stable on Windows, macOS and Linux.
@@ -370,12 +738,12 @@ static i32 image_draft_choose_parallel_frontier_level(image_draft_t* draft) {
     }
 
     i32 top_level_index = draft->level_count - 1;
-    i32 active_worker_thread_count = thread_pool_get_active_worker_thread_count(&global_thread_pool);
-    if (top_level_index < 1 || active_worker_thread_count <= 1) {
+    i32 worker_count = draft->max_construct_workers;
+    if (top_level_index < 1 || worker_count <= 1) {
         return -1;
     }
 
-    i32 desired_task_count = ATLEAST(4, active_worker_thread_count * 4);
+    i32 desired_task_count = ATLEAST(4, worker_count * 4);
     for (i32 level = top_level_index; level >= 1; --level) {
         image_draft_level_t* draft_level = draft->levels + level;
         if (draft_level->tile_count >= desired_task_count) {
@@ -383,50 +751,41 @@ static i32 image_draft_choose_parallel_frontier_level(image_draft_t* draft) {
         }
     }
 
-    // Level 1 is the lowest useful frontier: each worker owns small subtrees, while base tiles
-    // can still be destroyed immediately instead of being retained for the upper pass.
+    // Level 1 is the lowest useful frontier: each worker owns small subtrees of base tiles, and everything
+    // above is finished by the workers as the subtrees complete.
     return 1;
 }
 
-static void image_draft_finish_upper_levels_from_frontier(image_draft_t* draft, i32 frontier_level, file_stream_t fp) {
-    i32 top_level_index = draft->level_count - 1;
-    for (i32 level = frontier_level; level < top_level_index; ++level) {
+// Prepare the tiles above the frontier: they are completed as soon as all of their children are done.
+static void image_draft_prepare_upper_tiles(image_draft_t* draft, i32 frontier_level) {
+    for (i32 level = frontier_level + 1; level < draft->level_count; ++level) {
         image_draft_level_t* draft_level = draft->levels + level;
-        image_draft_level_t* parent_level = draft->levels + level + 1;
-
-        for (i32 i = 0; i < draft_level->tile_count; ++i) {
-            image_draft_tile_t* tile = draft_level->tiles + i;
-            shrink_tile_and_propagate_to_next_level(draft, tile);
-            destroy_image_buffer(&tile->buffer);
-        }
-
-        for (i32 i = 0; i < parent_level->tile_count; ++i) {
-            image_draft_tile_t* tile = parent_level->tiles + i;
-            write_finished_bigtiff_tile(draft, tile, fp);
-            if (level + 1 == top_level_index) {
-                destroy_image_buffer(&tile->buffer);
+        image_draft_level_t* child_level = draft->levels + level - 1;
+        draft_level->tiles = calloc(1, draft_level->tile_count * sizeof(image_draft_tile_t));
+        for (i32 tile_y = 0; tile_y < draft_level->height_in_tiles; ++tile_y) {
+            for (i32 tile_x = 0; tile_x < draft_level->width_in_tiles; ++tile_x) {
+                image_draft_tile_t* tile = draft_level->tiles + tile_y * draft_level->width_in_tiles + tile_x;
+                *tile = image_draft_make_tile(draft, level, tile_x, tile_y);
+                i32 child_count_x = ATMOST(2, child_level->width_in_tiles - tile_x * 2);
+                i32 child_count_y = ATMOST(2, child_level->height_in_tiles - tile_y * 2);
+                tile->children_remaining = child_count_x * child_count_y;
             }
         }
     }
-
-    if (frontier_level == top_level_index) {
-        image_draft_level_t* top_level = draft->levels + top_level_index;
-        for (i32 i = 0; i < top_level->tile_count; ++i) {
-            destroy_image_buffer(&top_level->tiles[i].buffer);
-        }
-    }
 }
 
-static void construct_tiles_parallel_from_frontier(image_draft_t* draft, i32 frontier_level, file_stream_t fp) {
+static void construct_tiles_parallel_from_frontier(image_draft_t* draft, i32 frontier_level) {
     image_draft_level_t* frontier = draft->levels + frontier_level;
+    image_draft_prepare_upper_tiles(draft, frontier_level);
+
     volatile i32 next_tile_index = 0;
-    volatile i32 started_count = 0;
-    volatile i32 participants_goal = ATLEAST(1, ATMOST(frontier->tile_count, thread_pool_get_active_worker_thread_count(&global_thread_pool)));
+    volatile i32 participants_goal = ATLEAST(1, ATMOST(frontier->tile_count, draft->max_construct_workers));
     volatile i32 finished_count = 0;
 
     construct_export_tile_task_t task = {
-            draft, frontier, fp,
-            &next_tile_index, &started_count, &participants_goal, &finished_count,
+            draft, frontier,
+            &next_tile_index, &participants_goal, &finished_count,
+            platform_semaphore_create(NULL),
     };
 
     i32 worker_task_count = participants_goal - 1;
@@ -438,9 +797,183 @@ static void construct_tiles_parallel_from_frontier(image_draft_t* draft, i32 fro
 
     construct_export_tile_task_func(0, &task);
 
-    while (finished_count < participants_goal) {
-        thread_pool_do_work(&global_thread_pool);
+    wait_for_construct_participants(&finished_count, participants_goal, task.finished_semaphore);
+    platform_semaphore_destroy(task.finished_semaphore);
+}
+
+// Exporting the same region at several resolutions: the source is read in blocks, and each block is resampled into
+// the base tiles of all of the drafts, so that the source only needs to be decoded once. The blocks follow the base
+// tile grid of the draft that covers the most source pixels per tile; each base tile of the other drafts is assigned
+// to the block where it starts. The drafts' base tiles are handed out one block at a time (frontier level 0), and the
+// levels above are finished as their children come in, like above a parallel frontier.
+
+typedef struct shared_source_export_t {
+    image_draft_t** drafts;
+    i32 draft_count;
+    i32 blocks_x;
+    i32 blocks_y;
+    i32 block_count;
+    i32** first_tile_x_in_block; // per draft: blocks_x + 1 entries (the tiles of block bx are [bx], ..., [bx + 1] - 1)
+    i32** first_tile_y_in_block; // per draft: blocks_y + 1 entries
+    volatile i32 next_block_index;
+    volatile i32 participants_goal;
+    volatile i32 finished_count;
+    semaphore_handle_t finished_semaphore; // posted by each participant when done
+} shared_source_export_t;
+
+typedef struct construct_shared_source_task_t {
+    shared_source_export_t* shared;
+} construct_shared_source_task_t;
+
+// Source pixels covered by one base tile (in the direction of x or y).
+static float image_draft_get_source_step(image_draft_t* draft, bool is_y) {
+    if (draft->need_resize) {
+        return is_y ? draft->supertile_height : draft->supertile_width;
+    } else {
+        return (float)(is_y ? draft->tile_height : draft->tile_width);
+    }
+}
+
+static i32* image_draft_assign_tiles_to_blocks(image_draft_t* draft, i32 tile_count, float tile_step, i32 block_count, float block_step) {
+    i32* first_tile_in_block = (i32*)malloc((block_count + 1) * sizeof(i32));
+    i32 tile = 0;
+    for (i32 block = 0; block < block_count; ++block) {
+        while (tile < tile_count && ATMOST(block_count - 1, (i32)((double)tile * tile_step / block_step)) < block) {
+            ++tile;
+        }
+        first_tile_in_block[block] = tile;
+    }
+    first_tile_in_block[block_count] = tile_count;
+    return first_tile_in_block;
+}
+
+static void construct_shared_source_task_func(i32 logical_thread_index, void* userdata) {
+    shared_source_export_t* shared = ((construct_shared_source_task_t*)userdata)->shared;
+    image_buffer_t block_buffer = {};
+    i64 block_buffer_capacity = 0;
+
+    for (;;) {
+        i32 block_index = atomic_increment(&shared->next_block_index) - 1;
+        if (block_index >= shared->block_count) {
+            break;
+        }
+        i32 block_x = block_index % shared->blocks_x;
+        i32 block_y = block_index / shared->blocks_x;
+
+        // The block needs to cover the source regions of all the tiles assigned to it.
+        // Those move along with the tile position, so only the first and last tile matter.
+        bounds2i union_bounds = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+        for (i32 i = 0; i < shared->draft_count; ++i) {
+            image_draft_t* draft = shared->drafts[i];
+            i32 tile_x0 = shared->first_tile_x_in_block[i][block_x];
+            i32 tile_x1 = shared->first_tile_x_in_block[i][block_x + 1];
+            i32 tile_y0 = shared->first_tile_y_in_block[i][block_y];
+            i32 tile_y1 = shared->first_tile_y_in_block[i][block_y + 1];
+            if (tile_x0 >= tile_x1 || tile_y0 >= tile_y1) {
+                continue;
+            }
+            rect2i first = image_draft_get_source_rect_for_base_tile(draft, tile_x0, tile_y0, NULL);
+            rect2i last = image_draft_get_source_rect_for_base_tile(draft, tile_x1 - 1, tile_y1 - 1, NULL);
+            union_bounds.left = MIN(union_bounds.left, first.x);
+            union_bounds.top = MIN(union_bounds.top, first.y);
+            union_bounds.right = MAX(union_bounds.right, last.x + last.w);
+            union_bounds.bottom = MAX(union_bounds.bottom, last.y + last.h);
+        }
+        if (union_bounds.right <= union_bounds.left || union_bounds.bottom <= union_bounds.top) {
+            continue;
+        }
+
+        export_source_block_t block = {};
+        block.x = union_bounds.left;
+        block.y = union_bounds.top;
+        i32 block_width = union_bounds.right - union_bounds.left;
+        i32 block_height = union_bounds.bottom - union_bounds.top;
+        if ((i64)block_width * block_height > block_buffer_capacity) {
+            destroy_image_buffer(&block_buffer);
+            block_buffer = create_bgra_image_buffer(block_width, block_height);
+            block_buffer_capacity = (i64)block_width * block_height;
+        }
+        block.buffer = block_buffer;
+        block.buffer.width = block_width;
+        block.buffer.height = block_height;
+        block.buffer.stride_in_pixels = block_width;
+        block.buffer.stride_in_bytes = block_width * BYTES_PER_PIXEL;
+
+        // NOTE: the shared read is counted in the stats of the first draft.
+        i64 read_start = get_clock();
+        bool read_ok = block.buffer.pixels && image_read_region(shared->drafts[0]->source_image, 0, block.x, block.y, block_width, block_height,
+                                                                block.buffer.pixels, block.buffer.pixel_format);
+        image_draft_add_stage_time(&shared->drafts[0]->read_ticks, read_start);
+
+        for (i32 i = 0; i < shared->draft_count; ++i) {
+            image_draft_t* draft = shared->drafts[i];
+            for (i32 tile_y = shared->first_tile_y_in_block[i][block_y]; tile_y < shared->first_tile_y_in_block[i][block_y + 1]; ++tile_y) {
+                for (i32 tile_x = shared->first_tile_x_in_block[i][block_x]; tile_x < shared->first_tile_x_in_block[i][block_x + 1]; ++tile_x) {
+                    image_draft_tile_t tile = image_draft_make_tile(draft, 0, tile_x, tile_y);
+                    // If the block could not be read, the tiles try to read their own source regions instead.
+                    construct_base_tile_with_resampling(draft, &tile, image_draft_get_upper_parent_tile(draft, &tile), read_ok ? &block : NULL);
+                    finish_parent_tiles_from_frontier(draft, &tile);
+                }
+            }
+        }
+    }
+
+    destroy_image_buffer(&block_buffer);
+    atomic_increment(&shared->finished_count);
+    platform_semaphore_post(shared->finished_semaphore); // last access to the shared state: the caller may return after this
+}
+
+// All drafts need to be set up to read from the same source level (level 0).
+static void construct_tiles_sharing_source(image_draft_t** drafts, i32 draft_count, i32 max_construct_workers) {
+    // The blocks follow the base tiles of the draft that covers the most source pixels per tile.
+    image_draft_t* block_draft = drafts[0];
+    for (i32 i = 1; i < draft_count; ++i) {
+        if (image_draft_get_source_step(drafts[i], false) * image_draft_get_source_step(drafts[i], true) >
+            image_draft_get_source_step(block_draft, false) * image_draft_get_source_step(block_draft, true)) {
+            block_draft = drafts[i];
+        }
+    }
+
+    shared_source_export_t shared = {};
+    shared.drafts = drafts;
+    shared.draft_count = draft_count;
+    shared.blocks_x = block_draft->levels[0].width_in_tiles;
+    shared.blocks_y = block_draft->levels[0].height_in_tiles;
+    shared.block_count = shared.blocks_x * shared.blocks_y;
+    shared.first_tile_x_in_block = (i32**)calloc(draft_count, sizeof(i32*));
+    shared.first_tile_y_in_block = (i32**)calloc(draft_count, sizeof(i32*));
+    for (i32 i = 0; i < draft_count; ++i) {
+        image_draft_t* draft = drafts[i];
+        shared.first_tile_x_in_block[i] = image_draft_assign_tiles_to_blocks(draft, draft->levels[0].width_in_tiles, image_draft_get_source_step(draft, false),
+                                                                              shared.blocks_x, image_draft_get_source_step(block_draft, false));
+        shared.first_tile_y_in_block[i] = image_draft_assign_tiles_to_blocks(draft, draft->levels[0].height_in_tiles, image_draft_get_source_step(draft, true),
+                                                                              shared.blocks_y, image_draft_get_source_step(block_draft, true));
+        draft->parallel_frontier_level = 0;
+        image_draft_prepare_upper_tiles(draft, 0);
+    }
+
+    shared.participants_goal = ATLEAST(1, ATMOST(shared.block_count, max_construct_workers));
+    shared.finished_semaphore = platform_semaphore_create(NULL);
+    construct_shared_source_task_t task = {&shared};
+
+    i32 worker_task_count = shared.participants_goal - 1;
+    for (i32 i = 0; i < worker_task_count; ++i) {
+        if (!thread_pool_submit_task(&global_thread_pool, construct_shared_source_task_func, &task, sizeof(task))) {
+            atomic_decrement(&shared.participants_goal);
+        }
     }
+
+    construct_shared_source_task_func(0, &task);
+
+    wait_for_construct_participants(&shared.finished_count, shared.participants_goal, shared.finished_semaphore);
+    platform_semaphore_destroy(shared.finished_semaphore);
+
+    for (i32 i = 0; i < draft_count; ++i) {
+        free(shared.first_tile_x_in_block[i]);
+        free(shared.first_tile_y_in_block[i]);
+    }
+    free(shared.first_tile_x_in_block);
+    free(shared.first_tile_y_in_block);
 }
 
 static void image_draft_prepare_bigtiff_ifds_and_tags(image_draft_t* draft) {
@@ -473,13 +1006,15 @@ static void image_draft_prepare_bigtiff_ifds_and_tags(image_draft_t* draft) {
     raw_bigtiff_tag_t tag_new_subfile_type = {TIFF_TAG_NEW_SUBFILE_TYPE, TIFF_UINT32, 1, .offset = TIFF_FILETYPE_REDUCEDIMAGE};
     u16 bits_per_sample[4] = {8, 8, 8, 0};
     raw_bigtiff_tag_t tag_bits_per_sample = {TIFF_TAG_BITS_PER_SAMPLE, TIFF_UINT16, 3, .offset = *(u64*)bits_per_sample};
-    raw_bigtiff_tag_t tag_compression = {TIFF_TAG_COMPRESSION, TIFF_UINT16, 1, .offset = TIFF_COMPRESSION_JPEG};
+    raw_bigtiff_tag_t tag_compression = {TIFF_TAG_COMPRESSION, TIFF_UINT16, 1, .offset = get_tiff_compression_for_export(draft->compression)};
     raw_bigtiff_tag_t tag_photometric_interpretation = {TIFF_TAG_PHOTOMETRIC_INTERPRETATION, TIFF_UINT16, 1, .offset = draft->desired_photometric_interpretation};
     raw_bigtiff_tag_t tag_orientation = {TIFF_TAG_ORIENTATION, TIFF_UINT16, 1, .offset = TIFF_ORIENTATION_TOPLEFT};
     raw_bigtiff_tag_t tag_samples_per_pixel = {TIFF_TAG_SAMPLES_PER_PIXEL, TIFF_UINT16, 1, .offset = 3};
     raw_bigtiff_tag_t tag_tile_length = {TIFF_TAG_TILE_LENGTH, TIFF_UINT16, 1, .offset = draft->tile_height};
     raw_bigtiff_tag_t tag_tile_width = {TIFF_TAG_TILE_WIDTH, TIFF_UINT16, 1, .offset = draft->tile_width};
     raw_bigtiff_tag_t tag_resolution_unit = {TIFF_TAG_RESOLUTION_UNIT, TIFF_UINT16, 1, .data_u16 = 3 /*RESUNIT_CENTIMETER*/};
+    raw_bigtiff_tag_t tag_predictor = {TIFF_TAG_PREDICTOR, TIFF_UINT16, 1, .data_u16 = 2 /*horizontal differencing*/};
+    bool use_predictor = (draft->compression == EXPORT_COMPRESSION_DEFLATE || draft->compression == EXPORT_COMPRESSION_ZSTD);
     // NOTE: chroma subsampling is used for YCbCr-encoded images, but not for RGB
     u16 chroma_subsampling[4] = {2, 2, 0, 0};
     raw_bigtiff_tag_t tag_chroma_subsampling = {TIFF_TAG_YCBCRSUBSAMPLING, TIFF_UINT16, 2, .offset = *(u64*)(chroma_subsampling)};
@@ -562,6 +1097,10 @@ static void image_draft_prepare_bigtiff_ifds_and_tags(image_draft_t* draft) {
         }
 #endif
 
+        if (use_predictor) {
+            memrw_push_bigtiff_tag(&draft->tag_buffer, &tag_predictor); ++tag_count_for_ifd; // 317
+        }
+
         memrw_push_bigtiff_tag(&draft->tag_buffer, &tag_tile_width); ++tag_count_for_ifd; // 322
         memrw_push_bigtiff_tag(&draft->tag_buffer, &tag_tile_length); ++tag_count_for_ifd; // 323
 
@@ -583,14 +1122,22 @@ static void image_draft_prepare_bigtiff_ifds_and_tags(image_draft_t* draft) {
         // unused tag: SMinSampleValue
         // unused tag: SMaxSampleValue
 
-        u8* tables_buffer = NULL;
-        u64 tables_size = 0;
-        jpeg_encode_tile(NULL, draft->tile_width, draft->tile_height, draft->quality, &tables_buffer, &tables_size, NULL,
-                         NULL, 0);
-        add_large_bigtiff_tag(&draft->tag_buffer, &draft->small_data_buffer, &draft->fixups_buffer,
-                              TIFF_TAG_JPEG_TABLES, TIFF_UNDEFINED, tables_size, tables_buffer); // 347
-        ++tag_count_for_ifd;
-        if (tables_buffer) libc_free(tables_buffer);
+        if (draft->compression == EXPORT_COMPRESSION_JPEG) {
+            u8* tables_buffer = NULL;
+            u64 tables_size = 0;
+            jpeg_encode_tile(NULL, draft->tile_width, draft->tile_height, draft->quality, &tables_buffer, &tables_size, NULL,
+                             NULL, 0);
+            add_large_bigtiff_tag(&draft->tag_buffer, &draft->small_data_buffer, &draft->fixups_buffer,
+                                  TIFF_TAG_JPEG_TABLES, TIFF_UNDEFINED, tables_size, tables_buffer); // 347
+            ++tag_count_for_ifd;
+            if (level == 0 && !draft->jpeg_tables) {
+                // Kept for comparing against the tables of source tiles that are copied without re-encoding.
+                draft->jpeg_tables = tables_buffer;
+                draft->jpeg_tables_length = tables_size;
+            } else if (tables_buffer) {
+                libc_free(tables_buffer);
+            }
+        }
 
         if (draft->desired_photometric_interpretation == TIFF_PHOTOMETRIC_YCBCR) {
             memrw_push_bigtiff_tag(&draft->tag_buffer, &tag_chroma_subsampling); // 530
@@ -636,10 +1183,13 @@ static void image_draft_prepare_bigtiff_ifds_and_tags(image_draft_t* draft) {
     }
 }
 
-static void image_draft_write_bigtiff_ifds_and_small_data(image_draft_t* draft, file_stream_t fp) {
-    fwrite(draft->tag_buffer.data, draft->tag_buffer.used_size, 1, fp);
-    fwrite(draft->small_data_buffer.data, draft->small_data_buffer.used_size, 1,fp);
+static bool image_draft_write_bigtiff_ifds_and_small_data(image_draft_t* draft) {
+    bool success = true;
+    success &= (file_handle_write_at_offset(draft->tag_buffer.data, draft->output_file, 0, draft->tag_buffer.used_size) == draft->tag_buffer.used_size);
+    success &= (file_handle_write_at_offset(draft->small_data_buffer.data, draft->output_file, draft->tag_buffer.used_size,
+                                            draft->small_data_buffer.used_size) == draft->small_data_buffer.used_size);
     draft->image_data_base_offset = draft->tag_buffer.used_size + draft->small_data_buffer.used_size;
+    return success;
 }
 
 void image_draft_destroy(image_draft_t* draft) {
@@ -655,15 +1205,20 @@ void image_draft_destroy(image_draft_t* draft) {
             free(draft_level->tile_bytecounts);
         }
     }
+    if (draft->jpeg_tables) {
+        libc_free(draft->jpeg_tables);
+    }
     memrw_destroy(&draft->tag_buffer);
     memrw_destroy(&draft->small_data_buffer);
     memrw_destroy(&draft->fixups_buffer);
 }
 
 
-bool export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds, const char* filename,
-                            u32 export_tile_width, u16 desired_photometric_interpretation, i32 quality, u32 export_flags, bool need_resize, v2f target_mpp) {
-
+// Sets up a draft for exporting the region at the target resolution. Nothing is written yet.
+static bool image_draft_init(image_draft_t* draft, image_t* image, bounds2i level0_bounds,
+                             u32 export_tile_width, u16 desired_photometric_interpretation, i32 quality,
+                             export_compression_enum compression, i32 compression_level,
+                             bool need_resize, v2f target_mpp) {
     switch(desired_photometric_interpretation) {
         case TIFF_PHOTOMETRIC_YCBCR: break;
         case TIFF_PHOTOMETRIC_RGB: break;
@@ -672,6 +1227,33 @@ bool export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t* image
         } return false;
     }
 
+    // Only JPEG has a YCbCr mode (with chroma subsampling); the other encodings store RGB.
+    switch (compression) {
+        case EXPORT_COMPRESSION_JPEG: break;
+        case EXPORT_COMPRESSION_DEFLATE: {
+            init_libdeflate(); // optional (falls back to a slower built-in encoder)
+        } break;
+        case EXPORT_COMPRESSION_ZSTD: {
+            if (!init_zstd_encoder()) {
+                console_print_error("Error exporting BigTIFF: Zstd compression requires libzstd\n");
+                return false;
+            }
+        } break;
+        case EXPORT_COMPRESSION_WEBP:
+        case EXPORT_COMPRESSION_WEBP_LOSSLESS: {
+            if (!init_webp()) {
+                console_print_error("Error exporting BigTIFF: WebP compression requires libwebp\n");
+                return false;
+            }
+        } break;
+        default: {
+            console_print_error("Error exporting BigTIFF: unsupported compression (%d)\n", compression);
+        } return false;
+    }
+    if (compression != EXPORT_COMPRESSION_JPEG) {
+        desired_photometric_interpretation = TIFF_PHOTOMETRIC_RGB;
+    }
+
     // We need to downscale the image by some factor.
     if (need_resize && !image->is_mpp_known) {
         console_print_error("Error exporting BigTIFF: source image resolution is unknown.\n");
@@ -716,71 +1298,146 @@ bool export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t* image
         target_level0_height_in_pixels = roundf((float)target_level0_height_in_pixels * downsample_factor_y);
     }
 
-    image_draft_t draft = {};
-    draft.level_count = 9; // default value, maybe override later if fewer are needed
-    draft.base_width = target_level0_width_in_pixels;
-    draft.base_height = target_level0_height_in_pixels;
-    draft.tile_width = export_tile_width;
-    draft.tile_height = export_tile_width;
-    draft.is_mpp_known = true;
-    draft.is_background_black = image->is_background_black;
-    draft.need_resize = need_resize;
-    draft.mpp = target_mpp;
-    draft.desired_photometric_interpretation = desired_photometric_interpretation;
-    draft.quality = quality;
-
-    draft.source_image = image;
-    draft.source_level0_bounds = level0_bounds;
-    draft.source_base_level = source_base_level;
-    draft.base_downsample_factor_x = downsample_factor_x;
-    draft.base_downsample_factor_y = downsample_factor_y;
-    draft.supertile_width = (float)draft.tile_width / draft.base_downsample_factor_x;
-    draft.supertile_height = (float)draft.tile_height / draft.base_downsample_factor_y;
-    draft.supertile_width_read = ((i32)ceilf(draft.supertile_width) + 8);
-    draft.supertile_height_read = ((i32)ceilf(draft.supertile_height) + 8);
-    platform_mutex_init(&draft.write_lock);
+    memset(draft, 0, sizeof(*draft));
+    draft->level_count = 9; // default value, maybe override later if fewer are needed
+    draft->base_width = target_level0_width_in_pixels;
+    draft->base_height = target_level0_height_in_pixels;
+    draft->tile_width = export_tile_width;
+    draft->tile_height = export_tile_width;
+    draft->is_mpp_known = true;
+    draft->is_background_black = image->is_background_black;
+    draft->need_resize = need_resize;
+    draft->mpp = target_mpp;
+    draft->desired_photometric_interpretation = desired_photometric_interpretation;
+    draft->quality = quality;
+    draft->compression = compression;
+    draft->compression_level = compression_level;
+
+    draft->source_image = image;
+    draft->source_level0_bounds = level0_bounds;
+    draft->source_base_level = source_base_level;
+    draft->base_downsample_factor_x = downsample_factor_x;
+    draft->base_downsample_factor_y = downsample_factor_y;
+    draft->supertile_width = (float)draft->tile_width / draft->base_downsample_factor_x;
+    draft->supertile_height = (float)draft->tile_height / draft->base_downsample_factor_y;
+    draft->supertile_width_read = ((i32)ceilf(draft->supertile_width) + 8);
+    draft->supertile_height_read = ((i32)ceilf(draft->supertile_height) + 8);
+    i32 thread_count = ATLEAST(1, thread_pool_get_active_worker_thread_count(&global_thread_pool));
+    draft->max_encode_tasks_in_flight = ATMOST(2 * thread_count, thread_pool_get_task_capacity(&global_thread_pool) / 4);
+    draft->max_construct_workers = thread_count;
+    draft->can_copy_source_tiles = image_draft_can_copy_source_tiles(draft);
 
     for (i32 i = 0; i < 9; ++i) {
-        image_draft_level_t* draft_level = draft.levels + i;
+        image_draft_level_t* draft_level = draft->levels + i;
         draft_level->level = i;
 
         // Calculate dimensions for the current downsampling i
-        draft_level->width_in_pixels = draft.base_width >> i;
-        draft_level->height_in_pixels = draft.base_height >> i;
+        draft_level->width_in_pixels = draft->base_width >> i;
+        draft_level->height_in_pixels = draft->base_height >> i;
 
-        draft_level->width_in_tiles = (draft_level->width_in_pixels + (draft.tile_width - 1)) / draft.tile_width;
-        draft_level->height_in_tiles = (draft_level->height_in_pixels + (draft.tile_height - 1)) / draft.tile_height;
+        draft_level->width_in_tiles = (draft_level->width_in_pixels + (draft->tile_width - 1)) / draft->tile_width;
+        draft_level->height_in_tiles = (draft_level->height_in_pixels + (draft->tile_height - 1)) / draft->tile_height;
         draft_level->tile_count = draft_level->width_in_tiles * draft_level->height_in_tiles;
         ASSERT(draft_level->tile_count > 0);
-        draft.total_tiles_to_export += draft_level->tile_count;
-        draft_level->tiles = calloc(1, draft_level->tile_count * sizeof(image_draft_tile_t));
+        draft->total_tiles_to_export += draft_level->tile_count;
         draft_level->tile_offsets = calloc(1, draft_level->tile_count * sizeof(u64));
         draft_level->tile_bytecounts = calloc(1, draft_level->tile_count * sizeof(u64));
 
-        // Initialize tiles with self-referencing of the level and tile position (tile_x, tile_y)
-        for (i32 tile_y = 0; tile_y < draft_level->height_in_tiles; ++tile_y) {
-            image_draft_tile_t* tile_row = draft_level->tiles + tile_y * draft_level->width_in_tiles;
-            for (i32 tile_x = 0; tile_x < draft_level->width_in_tiles; ++tile_x) {
-                image_draft_tile_t* tile = tile_row + tile_x;
-                tile->tile_x = tile_x;
-                tile->tile_y = tile_y;
-                tile->tile_index = tile_y * draft_level->width_in_tiles + tile_x;
-                tile->level = i;
-            }
-        }
-
         // Don't bother adding more levels if everything already fits within a single tile
         if (draft_level->tile_count <= 1) {
-            draft.level_count = i;
+            draft->level_count = ATLEAST(1, i); // a region smaller than one tile still needs its base level
             break;
         }
     }
 
-    if (draft.level_count <= 0) {
+    if (draft->level_count <= 0) {
         fatal_error("invalid level count");
         return false;
     }
 
+    platform_mutex_init(&draft->preallocate_lock);
+    platform_mutex_init(&draft->own_progress_lock);
+    platform_mutex_init(&draft->upper_tiles_lock);
+    platform_mutex_init(&draft->band_lock);
+    draft->progress_lock = &draft->own_progress_lock;
+    return true;
+}
+
+static void image_draft_attach_annotation_raster(image_draft_t* draft, annotation_raster_t* annotation_raster) {
+    if (!annotation_raster) {
+        return;
+    }
+    image_t* image = draft->source_image;
+    float scale_x = draft->need_resize ? draft->base_downsample_factor_x : 1.0f;
+    float scale_y = draft->need_resize ? draft->base_downsample_factor_y : 1.0f;
+    draft->annotation_raster = annotation_raster;
+    draft->annotation_origin = V2F(image->origin_offset.x + (float)draft->source_level0_bounds.left * image->mpp_x,
+                                   image->origin_offset.y + (float)draft->source_level0_bounds.top * image->mpp_y);
+    draft->annotation_scale = V2F(scale_x / (image->mpp_x * (float)(1 << draft->source_base_level)),
+                                  scale_y / (image->mpp_y * (float)(1 << draft->source_base_level)));
+    // The source tiles don't have the annotations in them.
+    draft->can_copy_source_tiles = false;
+}
+
+static void image_draft_release(image_draft_t* draft) {
+    platform_mutex_destroy(&draft->preallocate_lock);
+    platform_mutex_destroy(&draft->own_progress_lock);
+    platform_mutex_destroy(&draft->upper_tiles_lock);
+    platform_mutex_destroy(&draft->band_lock);
+    image_draft_destroy(draft);
+}
+
+static i64 image_draft_get_source_size_per_base_tile(image_draft_t* draft) {
+    if (draft->need_resize) {
+        return (i64)draft->supertile_width_read * draft->supertile_height_read * BYTES_PER_PIXEL;
+    } else {
+        return (i64)draft->tile_width * draft->tile_height * BYTES_PER_PIXEL;
+    }
+}
+
+static void image_draft_apply_memory_budget(image_draft_t* draft, i64 memory_budget) {
+    // Split the memory budget: half of it for the pixel buffers (which limits how many workers can construct tiles
+    // at the same time), the other half for the source and output pages that pile up in the course of a band.
+    if (memory_budget <= 0) {
+        memory_budget = EXPORT_DEFAULT_MEMORY_BUDGET;
+    }
+    i64 tile_size = (i64)draft->tile_width * draft->tile_height * BYTES_PER_PIXEL;
+    i64 source_size_per_base_tile = image_draft_get_source_size_per_base_tile(draft);
+    i64 worker_memory_usage = (draft->level_count + 3) * tile_size + source_size_per_base_tile; // subtree, source region, encode queue
+    draft->max_construct_workers = (i32)ATMOST(draft->max_construct_workers, ATLEAST(1, (memory_budget / 2) / worker_memory_usage));
+    draft->max_encode_tasks_in_flight = ATMOST(draft->max_encode_tasks_in_flight, 2 * draft->max_construct_workers);
+    i64 band_size = ATLEAST(memory_budget - draft->max_construct_workers * worker_memory_usage, memory_budget / 2);
+    draft->band_tile_count = (i32)ATMOST(draft->levels[0].tile_count, ATLEAST(draft->max_construct_workers, band_size / (2 * source_size_per_base_tile)));
+}
+
+// Writes out the IFDs and TIFF tags, after which the tiles can be written.
+static bool image_draft_begin_writing(image_draft_t* draft, const char* filename) {
+    // Prepare all the IFDs and TIFF tags to be written out to file later
+    image_draft_prepare_bigtiff_ifds_and_tags(draft);
+
+    draft->output_file = open_file_handle_for_writing(filename);
+    if (!draft->output_file) {
+        console_print_error("Error exporting BigTIFF: could not open '%s' for writing\n", filename);
+        return false;
+    }
+
+    // Write out the IFDs and TIFF tags to file
+    if (!image_draft_write_bigtiff_ifds_and_small_data(draft)) {
+        atomic_increment(&draft->write_error_count);
+    }
+    draft->image_data_end_offset = (i64)draft->image_data_base_offset;
+    draft->preallocated_end_offset = (i64)draft->image_data_base_offset;
+    draft->released_output_offset = draft->image_data_base_offset;
+    draft->written_back_output_offset = draft->image_data_base_offset;
+    draft->previous_band_end_offset = draft->image_data_base_offset;
+
+    console_print_verbose("Starting TIFF export (%s), total tiles to export = %d (bands of %d base tiles, %d workers)\n",
+                          get_export_compression_name(draft->compression), draft->total_tiles_to_export,
+                          draft->band_tile_count, draft->max_construct_workers);
+    return true;
+}
+
+static void image_draft_construct_tiles(image_draft_t* draft) {
     // To construct the pyramid, we'll construct the base level first, then afterwards propagate its contents
     // up to higher levels
 
@@ -792,94 +1449,289 @@ bool export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t* image
     // for each base layer tile, prepare a 'supertile' that can be resized into the final base tile
     // The first step will be Lanczos resampling, after which there will be several box shrink steps
 
+    // Construct the images for each tile of the pyramid. The recursive dependency tree is split
+    // at a frontier level: each worker owns one complete subtree below that level, and the tiles
+    // above the frontier are finished by whichever worker completes their last child.
+    draft->parallel_frontier_level = image_draft_choose_parallel_frontier_level(draft);
+    if (draft->parallel_frontier_level >= 1) {
+        construct_tiles_parallel_from_frontier(draft, draft->parallel_frontier_level);
+    } else {
+        image_draft_level_t* top_level = draft->levels + draft->level_count - 1;
+        for (i32 tile_y = 0; tile_y < top_level->height_in_tiles; ++tile_y) {
+            for (i32 tile_x = 0; tile_x < top_level->width_in_tiles; ++tile_x) {
+                image_draft_tile_t tile = image_draft_make_tile(draft, top_level->level, tile_x, tile_y);
+                construct_tiles_recursive(draft, &tile, NULL);
+            }
+        }
+    }
+}
 
-    // Prepare all the IFDs and TIFF tags to be written out to file later
-    image_draft_prepare_bigtiff_ifds_and_tags(&draft);
+// Waits for the last tiles to be written, then fills in the offset tables and closes the file.
+static bool image_draft_finish_writing(image_draft_t* draft, const char* filename, i64 export_start, export_stats_t* stats) {
+    // All tiles must be written before the offset tables can be filled in.
+    thread_pool_wait_for_group(&global_thread_pool, &draft->encode_task_group);
 
-    FILE* fp = fopen64(filename, "wb");
-    bool success = false;
+    // Drop the unused part of the preallocated space.
+    bool write_ok = file_handle_set_size(draft->output_file, (u64)draft->image_data_end_offset);
+
+    // Rewrite the tile offsets and tile bytecounts
+    for (i32 i = 0; i < draft->level_count; ++i) {
+        image_draft_level_t* draft_level = draft->levels + i;
+        size_t table_size = draft_level->tile_count * sizeof(u64);
+        write_ok &= (file_handle_write_at_offset(draft_level->tile_offsets, draft->output_file,
+                                                 draft_level->offset_of_tile_offsets, table_size) == table_size);
+        write_ok &= (file_handle_write_at_offset(draft_level->tile_bytecounts, draft->output_file,
+                                                 draft_level->offset_of_tile_bytecounts, table_size) == table_size);
+    }
+
+    file_handle_close(draft->output_file);
+
+    if (draft->copied_tile_count > 0) {
+        console_print_verbose("TIFF export: copied %d of %d base level tiles without re-encoding\n",
+                              draft->copied_tile_count, draft->levels[0].tile_count);
+    }
+
+    export_stats_t export_stats = {0};
+    export_stats.total_seconds = get_seconds_elapsed(export_start, get_clock());
+    export_stats.read_seconds = get_seconds_elapsed(0, draft->read_ticks);
+    export_stats.resample_seconds = get_seconds_elapsed(0, draft->resample_ticks);
+    export_stats.annotation_seconds = get_seconds_elapsed(0, draft->annotation_ticks);
+    export_stats.encode_seconds = get_seconds_elapsed(0, draft->encode_ticks);
+    export_stats.write_seconds = get_seconds_elapsed(0, draft->write_ticks);
+    export_stats.output_bytes = (u64)draft->image_data_end_offset;
+    export_stats.tile_count = draft->total_tiles_to_export;
+    export_stats.copied_tile_count = draft->copied_tile_count;
+    console_print_verbose("TIFF export took %g seconds; summed over threads: read %g s, resample %g s, annotations %g s, encode %g s, write %g s\n",
+                          export_stats.total_seconds, export_stats.read_seconds, export_stats.resample_seconds,
+                          export_stats.annotation_seconds, export_stats.encode_seconds, export_stats.write_seconds);
+    if (stats) {
+        *stats = export_stats;
+    }
+
+    if (write_ok && draft->write_error_count == 0) {
+        console_print("Exported region to '%s'\n", filename);
+        return true;
+    } else {
+        console_print_error("Error exporting BigTIFF: could not write to '%s'\n", filename);
+        return false;
+    }
+}
+
+bool export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds, const char* filename,
+                                          const export_options_t* options, export_stats_t* stats) {
 
-    if (fp) {
-        // Write out the IFDs and TIFF tags to file
-        image_draft_write_bigtiff_ifds_and_small_data(&draft, fp);
-        draft.current_image_data_write_offset = draft.image_data_base_offset;
+    i64 export_start = get_clock();
 
+    image_draft_t draft = {};
+    if (!image_draft_init(&draft, image, level0_bounds, options->tile_width, options->photometric_interpretation, options->quality,
+                          options->compression, options->compression_level, options->need_resize, options->target_mpp)) {
+        return false;
+    }
+    image_draft_attach_annotation_raster(&draft, options->burn_in_annotations);
+    image_draft_apply_memory_budget(&draft, options->memory_budget);
+    draft.release_page_cache = (options->flags & EXPORT_FLAGS_RELEASE_PAGE_CACHE) != 0;
+
+    bool success = false;
+    if (image_draft_begin_writing(&draft, filename)) {
         // TODO: progress bar progress managed on the main thread?
         global_tiff_export_progress = 0.05f;
         float progress_left = 0.99f - global_tiff_export_progress;
         draft.progress_per_exported_tile = progress_left / (float)(ATLEAST(1, draft.total_tiles_to_export));
 
-        console_print_verbose("Starting TIFF export, total tiles to export = %d\n", draft.total_tiles_to_export);
+        image_draft_construct_tiles(&draft);
+        success = image_draft_finish_writing(&draft, filename, export_start, stats);
+    }
 
-        // Construct the images for each tile of the pyramid. The recursive dependency tree is split
-        // at a frontier level: each worker owns one complete subtree below that level, and the small
-        // remaining top section is finished serially from the retained frontier tiles.
-        i32 parallel_frontier_level = image_draft_choose_parallel_frontier_level(&draft);
-        if (parallel_frontier_level >= 1) {
-            construct_tiles_parallel_from_frontier(&draft, parallel_frontier_level, fp);
-            image_draft_finish_upper_levels_from_frontier(&draft, parallel_frontier_level, fp);
-        } else {
-            image_draft_level_t* top_level = draft.levels + draft.level_count - 1;
-            for (i32 tile_y = 0; tile_y < top_level->height_in_tiles; ++tile_y) {
-                for (i32 tile_x = 0; tile_x < top_level->width_in_tiles; ++tile_x) {
-                    image_draft_tile_t* tile = top_level->tiles + tile_y * top_level->width_in_tiles + tile_x;
-                    construct_tiles_recursive(&draft, tile, fp, true);
-                }
-            }
-        }
+    image_draft_release(&draft);
 
-        // Rewrite the tile offsets and tile bytecounts
-        for (i32 i = 0; i < draft.level_count; ++i) {
-            image_draft_level_t* draft_level = draft.levels + i;
+    if (options->flags & EXPORT_FLAGS_ALSO_EXPORT_ANNOTATIONS) {
+        export_annotations_for_region(&app_state->scene.annotation_set, world_bounds, filename, options->flags);
+    }
 
-            fseeko64(fp, draft_level->offset_of_tile_offsets, SEEK_SET);
-            fwrite(draft_level->tile_offsets, sizeof(u64), draft_level->tile_count, fp);
 
-            fseeko64(fp, draft_level->offset_of_tile_bytecounts, SEEK_SET);
-            fwrite(draft_level->tile_bytecounts, sizeof(u64), draft_level->tile_count, fp);
-        }
+    return success;
+}
 
+// Exports the same region at several target resolutions, decoding the source only once for all of the outputs that
+// are resampled from the full resolution level. Outputs more than 4x coarser than the source are resampled from a
+// lower level of the source pyramid instead (which is cheaper than sharing the full resolution pixels), so those are
+// exported one after the other.
+bool export_cropped_bigtiff_at_multiple_resolutions(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds,
+                                                    const char** filenames, const v2f* target_mpps, i32 target_count,
+                                                    const export_options_t* options) {
+    if (target_count <= 0) {
+        return false;
+    }
 
-        fclose(fp);
+    i64 export_start = get_clock();
+    i64 memory_budget = options->memory_budget;
+
+    image_draft_t* drafts = (image_draft_t*)calloc(target_count, sizeof(image_draft_t));
+    image_draft_t** shared_drafts = (image_draft_t**)calloc(target_count, sizeof(image_draft_t*));
+    bool* is_draft_ok = (bool*)calloc(target_count, sizeof(bool));
+    i32 shared_draft_count = 0; // drafts that read from the full resolution level
+    i32 total_tiles_to_export = 0;
+    bool success = true;
+    for (i32 i = 0; i < target_count; ++i) {
+        is_draft_ok[i] = image_draft_init(drafts + i, image, level0_bounds, options->tile_width, options->photometric_interpretation,
+                                          options->quality, options->compression, options->compression_level, true, target_mpps[i]);
+        if (!is_draft_ok[i]) {
+            success = false;
+            continue;
+        }
+        image_draft_attach_annotation_raster(drafts + i, options->burn_in_annotations);
+        drafts[i].release_page_cache = (options->flags & EXPORT_FLAGS_RELEASE_PAGE_CACHE) != 0;
+        total_tiles_to_export += drafts[i].total_tiles_to_export;
+        if (drafts[i].source_base_level == 0) {
+            shared_drafts[shared_draft_count++] = drafts + i;
+        }
+    }
 
-        success = true;
-        console_print("Exported region to '%s'\n", filename);
+    // TODO: progress bar progress managed on the main thread?
+    global_tiff_export_progress = 0.05f;
+    float progress_left = 0.99f - global_tiff_export_progress;
+    platform_mutex_t progress_lock;
+    platform_mutex_init(&progress_lock);
+    for (i32 i = 0; i < target_count; ++i) {
+        drafts[i].progress_per_exported_tile = progress_left / (float)(ATLEAST(1, total_tiles_to_export));
+        drafts[i].progress_lock = &progress_lock;
     }
 
-    platform_mutex_destroy(&draft.write_lock);
-    image_draft_destroy(&draft);
+    if (shared_draft_count >= 2) {
+        // The workers are shared between the drafts, so the budget is split differently: each worker holds one
+        // block of the source next to the pixel buffers for each draft, and the partially filled tiles above the base
+        // level take up about one row of base tiles per draft (the blocks are handed out in row order).
+        if (memory_budget <= 0) {
+            memory_budget = EXPORT_DEFAULT_MEMORY_BUDGET;
+        }
+        i64 block_size = 0;
+        i64 worker_memory_usage = 0;
+        i64 upper_tiles_memory_usage = 0;
+        for (i32 i = 0; i < shared_draft_count; ++i) {
+            image_draft_t* draft = shared_drafts[i];
+            i64 tile_size = (i64)draft->tile_width * draft->tile_height * BYTES_PER_PIXEL;
+            i64 block_width = 2 * (i64)ceilf(image_draft_get_source_step(draft, false)) + 16;
+            i64 block_height = 2 * (i64)ceilf(image_draft_get_source_step(draft, true)) + 16;
+            block_size = MAX(block_size, block_width * block_height * BYTES_PER_PIXEL);
+            worker_memory_usage += 3 * tile_size + image_draft_get_source_size_per_base_tile(draft);
+            upper_tiles_memory_usage += (draft->levels[0].width_in_tiles + draft->level_count) * tile_size;
+        }
+        worker_memory_usage += block_size;
+        i64 pixel_budget = ATLEAST(memory_budget / 2 - upper_tiles_memory_usage, worker_memory_usage);
+        i32 thread_count = ATLEAST(1, thread_pool_get_active_worker_thread_count(&global_thread_pool));
+        i32 max_construct_workers = (i32)ATMOST(thread_count, ATLEAST(1, pixel_budget / worker_memory_usage));
+        if (disable_parallel_image_export) {
+            max_construct_workers = 1;
+        }
+        i64 band_size = ATLEAST(memory_budget - max_construct_workers * worker_memory_usage - upper_tiles_memory_usage, memory_budget / 2) / shared_draft_count;
+        for (i32 i = 0; i < shared_draft_count; ++i) {
+            image_draft_t* draft = shared_drafts[i];
+            draft->max_construct_workers = max_construct_workers;
+            draft->max_encode_tasks_in_flight = ATMOST(draft->max_encode_tasks_in_flight, 2 * max_construct_workers);
+            draft->band_tile_count = (i32)ATMOST(draft->levels[0].tile_count, ATLEAST(max_construct_workers, band_size / (2 * image_draft_get_source_size_per_base_tile(draft))));
+        }
 
-    if (export_flags & EXPORT_FLAGS_ALSO_EXPORT_ANNOTATIONS) {
-        bool push_coordinates_inward = export_flags & EXPORT_FLAGS_PUSH_ANNOTATION_COORDINATES_INWARD;
-        annotation_set_t derived_set = create_offsetted_annotation_set_for_area(&app_state->scene.annotation_set, world_bounds, push_coordinates_inward);
+        i32 writing_draft_count = 0;
+        for (i32 i = 0; i < shared_draft_count; ++i) {
+            image_draft_t* draft = shared_drafts[i];
+            i32 index = (i32)(draft - drafts);
+            if (image_draft_begin_writing(draft, filenames[index])) {
+                shared_drafts[writing_draft_count++] = draft;
+            } else {
+                success = false;
+            }
+        }
+        console_print_verbose("Exporting %d resolutions in one pass over the source (%d workers)\n", writing_draft_count, max_construct_workers);
+        if (writing_draft_count > 0) {
+            construct_tiles_sharing_source(shared_drafts, writing_draft_count, max_construct_workers);
+        }
+        for (i32 i = 0; i < writing_draft_count; ++i) {
+            image_draft_t* draft = shared_drafts[i];
+            i32 index = (i32)(draft - drafts);
+            success &= image_draft_finish_writing(draft, filenames[index], export_start, NULL);
+        }
+    }
 
-        size_t filename_len = strlen(filename);
-        char* xml_filename = (char*)alloca(filename_len + 4);
-        memcpy(xml_filename, filename, filename_len + 1);
-        replace_file_extension(xml_filename, filename_len + 4, "xml");
-        save_asap_xml_annotations(&derived_set, xml_filename);
+    // The remaining outputs are exported on their own.
+    for (i32 i = 0; i < target_count; ++i) {
+        image_draft_t* draft = drafts + i;
+        bool is_shared = (shared_draft_count >= 2 && draft->source_base_level == 0);
+        if (!is_draft_ok[i] || is_shared) {
+            continue;
+        }
+        i64 draft_export_start = get_clock();
+        image_draft_apply_memory_budget(draft, memory_budget);
+        if (image_draft_begin_writing(draft, filenames[i])) {
+            image_draft_construct_tiles(draft);
+            success &= image_draft_finish_writing(draft, filenames[i], draft_export_start, NULL);
+        } else {
+            success = false;
+        }
+    }
 
-        destroy_annotation_set(&derived_set);
+    for (i32 i = 0; i < target_count; ++i) {
+        if (is_draft_ok[i]) {
+            image_draft_release(drafts + i);
+            if (options->flags & EXPORT_FLAGS_ALSO_EXPORT_ANNOTATIONS) {
+                export_annotations_for_region(&app_state->scene.annotation_set, world_bounds, filenames[i], options->flags);
+            }
+        }
     }
+    platform_mutex_destroy(&progress_lock);
+    free(drafts);
+    free(shared_drafts);
+    free(is_draft_ok);
+    return success;
+}
 
+// Saves the annotations within the exported region next to the exported image (same filename, .xml extension).
+void export_annotations_for_region(annotation_set_t* annotation_set, bounds2f world_bounds, const char* filename, u32 export_flags) {
+    bool push_coordinates_inward = export_flags & EXPORT_FLAGS_PUSH_ANNOTATION_COORDINATES_INWARD;
+    annotation_set_t derived_set = create_offsetted_annotation_set_for_area(annotation_set, world_bounds, push_coordinates_inward);
 
-    return success;
+    size_t filename_len = strlen(filename);
+    char* xml_filename = (char*)alloca(filename_len + 4);
+    memcpy(xml_filename, filename, filename_len + 1);
+    replace_file_extension(xml_filename, filename_len + 4, "xml");
+    save_asap_xml_annotations(&derived_set, xml_filename);
+
+    destroy_annotation_set(&derived_set);
+}
+
+// Rough upper bound for the memory an export holds at any one time, for scheduling several exports at once.
+// Each construct worker holds one tile per level of the subtree it is working on, the partially filled tiles above
+// the parallel frontier take up at most ~16 per worker thread, and up to 2 tiles per thread wait to be encoded.
+// On top of that come the source and output pages of the current band. The export keeps all of it within its budget.
+i64 estimate_bigtiff_export_memory_usage(i32 width, i32 height, u32 export_tile_width, i64 memory_budget) {
+    i64 tile_size = (i64)export_tile_width * export_tile_width * BYTES_PER_PIXEL;
+    i32 thread_count = ATLEAST(1, thread_pool_get_active_worker_thread_count(&global_thread_pool));
+    i32 level_count = 1;
+    while (level_count < 9 && ((width >> (level_count - 1)) > (i32)export_tile_width || (height >> (level_count - 1)) > (i32)export_tile_width)) {
+        ++level_count;
+    }
+    i64 tiles_in_memory = (i64)thread_count * (level_count + 16 + 2);
+    i64 base_level_size = (i64)width * height * BYTES_PER_PIXEL;
+    // Small exports never need more than their whole pyramid (plus the source pages read for it).
+    i64 estimate = ATMOST(tiles_in_memory * tile_size, base_level_size * 2 + tile_size) + base_level_size;
+    if (memory_budget <= 0) {
+        memory_budget = EXPORT_DEFAULT_MEMORY_BUDGET;
+    }
+    return ATMOST(estimate, memory_budget);
 }
 
 void export_cropped_bigtiff_with_resample_func(i32 logical_thread_index, void* userdata) {
     export_region_task_t* task = (export_region_task_t*) userdata;
     bool success = export_cropped_bigtiff_with_resample(task->app_state, task->image, task->world_bounds, task->level0_bounds,
-                                          task->filename, task->export_tile_width,
-                                          task->desired_photometric_interpretation, task->quality, task->export_flags,
-                                          task->need_resize, task->target_mpp);
+                                                        task->filename, &task->options, NULL);
 	global_tiff_export_progress = 1.0f;
 	task->app_state->is_export_in_progress = false;
 
 	atomic_decrement(&task->image->refcount);
 }
 
+// Starts an export on a worker thread. The options are copied; burning in annotations is not supported here.
 void begin_export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds, const char* filename,
-                                                u32 export_tile_width, u16 desired_photometric_interpretation, i32 quality, u32 export_flags, bool need_resize, v2f target_mpp) {
+                                                const export_options_t* options) {
 
     export_region_task_t task = {0};
     task.app_state = app_state;
@@ -887,12 +1739,8 @@ void begin_export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t*
     task.world_bounds = world_bounds;
     task.level0_bounds = level0_bounds;
     task.filename = filename;
-    task.export_tile_width = export_tile_width;
-    task.desired_photometric_interpretation = desired_photometric_interpretation;
-    task.quality = quality;
-    task.export_flags = export_flags;
-    task.need_resize = need_resize;
-    task.target_mpp = target_mpp;
+    task.options = *options;
+    task.options.burn_in_annotations = NULL;
 
 	global_tiff_export_progress = 0.0f;
 	global_tiff_export_progress_console_dots_written = 0;
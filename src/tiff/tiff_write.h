@@ -25,21 +25,59 @@ extern "C" {
 #include "common.h"
 #include "platform.h"
 #include "viewer.h"
+#include "compression_api.h"
+#include "annotation_raster.h"
 
 typedef enum export_flags_enum {
 	EXPORT_FLAGS_NONE = 0,
 	EXPORT_FLAGS_ALSO_EXPORT_ANNOTATIONS = 0x1,
 	EXPORT_FLAGS_PUSH_ANNOTATION_COORDINATES_INWARD = 0x2,
+	// For headless exports: after each band (see the memory budget), drop the source pages and the written output from
+	// the page cache, so that memory use does not grow with the size of the region. Not for use in the viewer, which
+	// may still be reading from the same source pages.
+	EXPORT_FLAGS_RELEASE_PAGE_CACHE = 0x4,
 } export_flags_enum;
 
+// How an export is written. Fields that don't apply may be left zero.
+typedef struct export_options_t {
+	u32 tile_width;
+	u16 photometric_interpretation; // TIFF_PHOTOMETRIC_YCBCR or TIFF_PHOTOMETRIC_RGB
+	i32 quality;                    // JPEG and lossy WebP
+	export_compression_enum compression;
+	i32 compression_level;          // Deflate and Zstd; 0 for the default
+	u32 flags;                      // export_flags_enum
+	bool need_resize;               // resample to target_mpp (for single-resolution exports)
+	v2f target_mpp;
+	i64 memory_budget;              // 0 for EXPORT_DEFAULT_MEMORY_BUDGET
+	annotation_raster_t* burn_in_annotations; // optional
+} export_options_t;
+
+// Optionally filled in by an export, for benchmarking. The stage times are summed over all the threads that took part.
+typedef struct export_stats_t {
+	float total_seconds;
+	float read_seconds;     // reading and decoding the source pixels
+	float resample_seconds; // lanczos3 resampling of the base level, and 2x2 shrinking into the levels above
+	float annotation_seconds; // drawing the burned-in annotations
+	float encode_seconds;
+	float write_seconds;
+	u64 output_bytes;       // size of the exported file
+	i32 tile_count;
+	i32 copied_tile_count;  // tiles copied from the source without re-encoding
+} export_stats_t;
+
 bool export_cropped_bigtiff(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds, const char* filename,
                               u32 export_tile_width, u16 desired_photometric_interpretation, i32 quality, u32 export_flags);
 bool export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds, const char* filename,
-                                          u32 export_tile_width, u16 desired_photometric_interpretation, i32 quality, u32 export_flags, bool need_resize, v2f target_mpp);
+                                          const export_options_t* options, export_stats_t* stats);
+bool export_cropped_bigtiff_at_multiple_resolutions(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds,
+                                                    const char** filenames, const v2f* target_mpps, i32 target_count,
+                                                    const export_options_t* options);
+void export_annotations_for_region(annotation_set_t* annotation_set, bounds2f world_bounds, const char* filename, u32 export_flags);
+i64 estimate_bigtiff_export_memory_usage(i32 width, i32 height, u32 export_tile_width, i64 memory_budget);
 void begin_export_cropped_bigtiff(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds, const char* filename,
                                   u32 export_tile_width, u16 desired_photometric_interpretation, i32 quality, u32 export_flags);
 void begin_export_cropped_bigtiff_with_resample(app_state_t* app_state, image_t* image, bounds2f world_bounds, bounds2i level0_bounds, const char* filename,
-                                                u32 export_tile_width, u16 desired_photometric_interpretation, i32 quality, u32 export_flags, bool need_resize, v2f target_mpp);
+                                                const export_options_t* options);
 
 #ifdef __cplusplus
 }
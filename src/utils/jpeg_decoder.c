@@ -1,10 +1,5 @@
 #include "common.h"
-
-#ifdef TARGET_EMSCRIPTEN
-#include <emscripten/emscripten.h>
-#else
-#define EMSCRIPTEN_KEEPALIVE
-#endif
+#include "jpeg_decoder.h"
 #include "jpeglib.h"
 
 #include "setjmp.h" // we need to use setjmp()/longjmp() for JPEG error handling
@@ -70,173 +65,419 @@ void setup_jpeg_source(j_decompress_ptr cinfo, uint8_t *input_ptr, uint32_t inpu
 
 
 
-EMSCRIPTEN_KEEPALIVE
-bool jpeg_decode_tile(uint8_t *table_ptr, uint32_t table_length, uint8_t *input_ptr, uint32_t input_length, uint8_t *output_ptr, bool is_YCbCr) {
-	struct jpeg_decompress_struct cinfo = {};
-	struct jpeg_error_mgr jerr = {};
+// Each thread keeps one long-lived decompressor around, instead of creating and destroying one for every tile.
+// For abbreviated (TIFF) tile streams, the shared JPEGTables are only parsed again when they actually change:
+// libjpeg keeps the quantization and Huffman tables in the decompressor's permanent pool between images.
+typedef struct jpeg_decoder_context_t {
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	bool is_created;
+	u8* loaded_tables; // copy of the JPEGTables currently loaded into cinfo
+	u32 loaded_tables_length;
+} jpeg_decoder_context_t;
 
-	// Setup error handling
-	cinfo.err = jpeg_std_error(&jerr);
-	jerr.error_exit = on_error;
+static THREAD_LOCAL jpeg_decoder_context_t* jpeg_thread_context;
+
+static void jpeg_decoder_forget_loaded_tables(jpeg_decoder_context_t* context) {
+	if (context->loaded_tables) {
+		free(context->loaded_tables);
+		context->loaded_tables = NULL;
+	}
+	context->loaded_tables_length = 0;
+}
+
+static jpeg_decoder_context_t* jpeg_decoder_get_thread_context(void) {
+	jpeg_decoder_context_t* context = jpeg_thread_context;
+	if (!context) {
+		context = (jpeg_decoder_context_t*)calloc(1, sizeof(jpeg_decoder_context_t));
+		jpeg_thread_context = context;
+	}
+	if (!context->is_created) {
+		context->cinfo.err = jpeg_std_error(&context->jerr);
+		context->jerr.error_exit = on_error;
+		jpeg_create_decompress(&context->cinfo);
+		context->is_created = true;
+	}
+	return context;
+}
+
+// After a decoding error the decompressor may be in any state, so start over with a fresh one next time.
+static void jpeg_decoder_reset_thread_context(jpeg_decoder_context_t* context) {
+	if (context->is_created) {
+		jpeg_destroy_decompress(&context->cinfo);
+		context->is_created = false;
+	}
+	jpeg_decoder_forget_loaded_tables(context);
+}
+
+void jpeg_decoder_release_thread_context(void) {
+	jpeg_decoder_context_t* context = jpeg_thread_context;
+	if (context) {
+		jpeg_decoder_reset_thread_context(context);
+		free(context);
+		jpeg_thread_context = NULL;
+	}
+}
+
+// Checks whether a JPEG stream carries its own DQT or DHT segments (before the first SOS marker).
+// If so, decoding it replaces whatever tables were loaded into the decompressor before.
+static bool jpeg_stream_defines_tables(const u8* data, u32 length) {
+	u32 pos = 2; // skip SOI
+	while (pos + 4 <= length) {
+		if (data[pos] != 0xFF) {
+			return true; // not a valid marker sequence; be conservative
+		}
+		u8 marker = data[pos + 1];
+		if (marker == 0xFF) {
+			++pos; // fill byte
+			continue;
+		}
+		if (marker == 0xDA /* SOS */ || marker == 0xD9 /* EOI */) {
+			return false;
+		}
+		if (marker == 0xDB /* DQT */ || marker == 0xC4 /* DHT */) {
+			return true;
+		}
+		u32 segment_length = ((u32)data[pos + 2] << 8) | data[pos + 3];
+		pos += 2 + segment_length;
+	}
+	return false;
+}
 
+// Walks the markers up to the first SOS, without decoding anything.
+bool jpeg_read_stream_info(const u8* data, u32 length, jpeg_stream_info_t* info) {
+	memset(info, 0, sizeof(*info));
+	if (length < 4 || data[0] != 0xFF || data[1] != 0xD8 /* SOI */) {
+		return false;
+	}
+	bool found_frame = false;
+	bool saw_jfif = false;
+	bool saw_adobe = false;
+	u8 adobe_transform = 0;
+	u8 component_ids[4] = {};
+	u32 pos = 2;
+	while (pos + 4 <= length) {
+		if (data[pos] != 0xFF) {
+			return false;
+		}
+		u8 marker = data[pos + 1];
+		if (marker == 0xFF) {
+			++pos; // fill byte
+			continue;
+		}
+		if (marker == 0xDA /* SOS */ || marker == 0xD9 /* EOI */) {
+			break;
+		}
+		u32 segment_length = ((u32)data[pos + 2] << 8) | data[pos + 3];
+		const u8* segment = data + pos + 4;
+		u32 payload_length = segment_length >= 2 ? segment_length - 2 : 0;
+		if (pos + 2 + segment_length > length) {
+			return false;
+		}
+		if (marker == 0xDB /* DQT */ || marker == 0xC4 /* DHT */) {
+			info->defines_tables = true;
+		} else if (marker == 0xE0 /* APP0 */ && payload_length >= 5 && memcmp(segment, "JFIF\0", 5) == 0) {
+			saw_jfif = true;
+		} else if (marker == 0xEE /* APP14 */ && payload_length >= 12 && memcmp(segment, "Adobe", 5) == 0) {
+			saw_adobe = true;
+			adobe_transform = segment[11];
+		} else if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			// Start of frame
+			if (payload_length < 6) {
+				return false;
+			}
+			info->is_baseline = (marker == 0xC0 || marker == 0xC1) && segment[0] == 8;
+			info->height = ((i32)segment[1] << 8) | segment[2];
+			info->width = ((i32)segment[3] << 8) | segment[4];
+			info->component_count = segment[5];
+			if (payload_length < 6 + 3 * (u32)info->component_count) {
+				return false;
+			}
+			for (i32 i = 0; i < MIN(info->component_count, 4); ++i) {
+				component_ids[i] = segment[6 + 3 * i];
+				info->h_samp_factor[i] = segment[6 + 3 * i + 1] >> 4;
+				info->v_samp_factor[i] = segment[6 + 3 * i + 1] & 0xF;
+			}
+			found_frame = true;
+		}
+		pos += 2 + segment_length;
+	}
+	if (!found_frame) {
+		return false;
+	}
+	// Same rules as libjpeg's default_decompress_parms()
+	if (info->component_count == 3) {
+		if (saw_jfif) {
+			info->is_YCbCr = true;
+		} else if (saw_adobe) {
+			info->is_YCbCr = (adobe_transform != 0);
+		} else {
+			info->is_YCbCr = !(component_ids[0] == 'R' && component_ids[1] == 'G' && component_ids[2] == 'B');
+		}
+	}
+	return true;
+}
+
+static bool jpeg_decoder_load_tables(jpeg_decoder_context_t* context, u8* table_ptr, u32 table_length) {
+	if (context->loaded_tables && context->loaded_tables_length == table_length &&
+	    memcmp(context->loaded_tables, table_ptr, table_length) == 0) {
+		return true; // already loaded
+	}
+	jpeg_decoder_forget_loaded_tables(context);
+	setup_jpeg_source(&context->cinfo, table_ptr, table_length);
+	if (jpeg_read_header(&context->cinfo, FALSE) != JPEG_HEADER_TABLES_ONLY) {
+		return false;
+	}
+	context->loaded_tables = (u8*)malloc(table_length);
+	if (context->loaded_tables) {
+		memcpy(context->loaded_tables, table_ptr, table_length);
+		context->loaded_tables_length = table_length;
+	}
+	return true;
+}
+
+// Decodes a JPEG stream as BGRA into a destination rectangle of at most max_width x max_height pixels,
+// optionally downscaled in the DCT domain by scale_denom (1, 2, 4 or 8). Output beyond the rectangle is cropped.
+// Pass JCS_UNKNOWN as color_space to use the color space signalled in the stream.
+// If region is not NULL, only the iMCU rows and columns intersecting it are decoded (using jpeg_skip_scanlines()
+// and jpeg_crop_scanline()); the pixels are still written at their own position in the destination.
+static bool jpeg_decode_into(u8* table_ptr, u32 table_length, u8* input_ptr, u32 input_length, u8* output_ptr,
+                             i32 output_pitch, i32 max_width, i32 max_height, J_COLOR_SPACE color_space, i32 scale_denom,
+                             const jpeg_region_t* region) {
+	jpeg_decoder_context_t* context = jpeg_decoder_get_thread_context();
+	struct jpeg_decompress_struct* cinfo = &context->cinfo;
+
+	// Setup error handling
 	jmp_buf on_err_jmp_buffer = {};
-	cinfo.client_data = (void*)on_err_jmp_buffer;
+	cinfo->client_data = (void*)on_err_jmp_buffer;
 	int r = setjmp(on_err_jmp_buffer);
 	if (r != 0) {
 		// We encountered an error during JPEG decoding -> handle the failure gracefully
-		jpeg_destroy_decompress(&cinfo);
+		jpeg_decoder_reset_thread_context(context);
 		return false;
 	}
 
-	jpeg_create_decompress(&cinfo);
-
 	// Load Jpeg table
 	if (table_ptr && table_length > 0) {
-		setup_jpeg_source(&cinfo, table_ptr, table_length);
-		if (jpeg_read_header(&cinfo, FALSE) != JPEG_HEADER_TABLES_ONLY) {
+		if (!jpeg_decoder_load_tables(context, table_ptr, table_length)) {
 			printf("Failed to load table\n");
-			jpeg_destroy_decompress(&cinfo);
+			jpeg_decoder_reset_thread_context(context);
 			return false;
 		}
 	}
+	if (jpeg_stream_defines_tables(input_ptr, input_length)) {
+		jpeg_decoder_forget_loaded_tables(context);
+	}
 
 	// Read tile data
-	setup_jpeg_source(&cinfo, input_ptr, input_length);
-	if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+	setup_jpeg_source(cinfo, input_ptr, input_length);
+	if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK) {
 		printf("Failed to read header\n");
-		jpeg_destroy_decompress(&cinfo);
+		jpeg_decoder_reset_thread_context(context);
 		return false;
 	}
 
-	cinfo.jpeg_color_space = is_YCbCr ? JCS_YCbCr : JCS_RGB;
-	cinfo.out_color_space = JCS_EXT_BGRA;
-
-	jpeg_start_decompress(&cinfo);
+	if (color_space != JCS_UNKNOWN) {
+		cinfo->jpeg_color_space = color_space;
+	}
+	cinfo->out_color_space = JCS_EXT_BGRA;
+	cinfo->scale_num = 1;
+	cinfo->scale_denom = ATLEAST(1, scale_denom);
+
+	jpeg_start_decompress(cinfo);
+
+	i32 output_width = cinfo->output_width;
+	i32 output_height = cinfo->output_height;
+	if (max_width <= 0) max_width = output_width;
+	if (max_height <= 0) max_height = output_height;
+	if (output_pitch <= 0) output_pitch = output_width * 4;
+	i32 rows_to_read = ATMOST(output_height, max_height);
+	i32 first_column = 0;
+
+	if (region) {
+		i32 region_x0 = ATLEAST(0, region->x);
+		i32 region_y0 = ATLEAST(0, region->y);
+		i32 region_x1 = ATMOST(ATMOST(output_width, max_width), region->x + region->width);
+		i32 region_y1 = ATMOST(rows_to_read, region->y + region->height);
+		if (region_x0 >= region_x1 || region_y0 >= region_y1) {
+			jpeg_abort_decompress(cinfo);
+			return true; // nothing to decode
+		}
+		// Keep a margin around the region, so that (fancy) chroma upsampling at the edges of the region sees
+		// the same neighbouring samples as in a full decode. libjpeg-turbo widens xoffset to an iMCU boundary.
+		i32 imcu_width = cinfo->max_h_samp_factor * cinfo->min_DCT_h_scaled_size;
+		i32 crop_x0 = ATLEAST(0, region_x0 - 1);
+		i32 crop_x1 = ATMOST(output_width, region_x1 + imcu_width);
+		if (crop_x0 > 0 || crop_x1 < output_width) {
+			JDIMENSION xoffset = (JDIMENSION)crop_x0;
+			JDIMENSION crop_width = (JDIMENSION)(crop_x1 - crop_x0);
+			jpeg_crop_scanline(cinfo, &xoffset, &crop_width);
+			first_column = (i32)xoffset;
+			output_width = (i32)cinfo->output_width;
+			max_width -= first_column;
+		}
+		if (region_y0 > 0) {
+			(void) jpeg_skip_scanlines(cinfo, (JDIMENSION)region_y0);
+		}
+		rows_to_read = region_y1;
+	}
+	output_ptr += (size_t)first_column * 4;
 
-	int row_width = cinfo.output_width;
-	int target_row_stride = row_width * 4;
-	int source_row_stride = row_width * cinfo.output_components;
-	JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)
-			((j_common_ptr) &cinfo, JPOOL_IMAGE, source_row_stride, 1);
+	if (output_width <= max_width) {
+		// Output is BGRA, so we can decode straight into the destination.
+		while (cinfo->output_scanline < rows_to_read) {
+			u8* buffer_array[1] = { output_ptr + (size_t)cinfo->output_scanline * output_pitch };
+			(void) jpeg_read_scanlines(cinfo, buffer_array, 1);
+		}
+	} else {
+		JSAMPARRAY buffer = (*cinfo->mem->alloc_sarray)((j_common_ptr) cinfo, JPOOL_IMAGE, output_width * 4, 1);
+		while (cinfo->output_scanline < rows_to_read) {
+			u8* dest = output_ptr + (size_t)cinfo->output_scanline * output_pitch;
+			(void) jpeg_read_scanlines(cinfo, buffer, 1);
+			memcpy(dest, buffer[0], max_width * 4);
+		}
+	}
 
-	while (cinfo.output_scanline < cinfo.output_height) {
-		(void) jpeg_read_scanlines(&cinfo, buffer, 1);
-		memcpy(output_ptr, buffer[0], target_row_stride);
-		output_ptr += target_row_stride;
+	if (cinfo->output_scanline < cinfo->output_height) {
+		jpeg_abort_decompress(cinfo); // cropped; the loaded tables are kept
+	} else {
+		(void) jpeg_finish_decompress(cinfo);
 	}
 
-	(void) jpeg_finish_decompress(&cinfo);
+	return true;
+}
 
-	jpeg_destroy_decompress(&cinfo);
+EMSCRIPTEN_KEEPALIVE
+bool jpeg_decode_tile(uint8_t *table_ptr, uint32_t table_length, uint8_t *input_ptr, uint32_t input_length, uint8_t *output_ptr, bool is_YCbCr) {
+	return jpeg_decode_into(table_ptr, table_length, input_ptr, input_length, output_ptr, 0, 0, 0,
+	                        is_YCbCr ? JCS_YCbCr : JCS_RGB, 1, NULL);
+}
 
-	return true;
+bool jpeg_decode_tile_region(u8* table_ptr, u32 table_length, u8* input_ptr, u32 input_length, u8* output_ptr,
+                             i32 output_pitch, i32 max_width, i32 max_height, bool is_YCbCr, jpeg_region_t region) {
+	return jpeg_decode_into(table_ptr, table_length, input_ptr, input_length, output_ptr, output_pitch, max_width, max_height,
+	                        is_YCbCr ? JCS_YCbCr : JCS_RGB, 1, &region);
+}
+
+bool jpeg_decode_tile_scaled(u8* table_ptr, u32 table_length, u8* input_ptr, u32 input_length, u8* output_ptr,
+                             i32 output_pitch, i32 max_width, i32 max_height, bool is_YCbCr, i32 scale_denom) {
+	return jpeg_decode_into(table_ptr, table_length, input_ptr, input_length, output_ptr, output_pitch, max_width, max_height,
+	                        is_YCbCr ? JCS_YCbCr : JCS_RGB, scale_denom, NULL);
+}
+
+bool jpeg_decode_image_scaled(u8* input_ptr, u32 input_length, u8* output_ptr, i32 output_pitch, i32 max_width,
+                              i32 max_height, i32 scale_denom) {
+	return jpeg_decode_into(NULL, 0, input_ptr, input_length, output_ptr, output_pitch, max_width, max_height,
+	                        JCS_UNKNOWN, scale_denom, NULL);
+}
+
+bool jpeg_decode_image_region(u8* input_ptr, u32 input_length, u8* output_ptr, i32 output_pitch, i32 max_width,
+                              i32 max_height, jpeg_region_t region) {
+	return jpeg_decode_into(NULL, 0, input_ptr, input_length, output_ptr, output_pitch, max_width, max_height,
+	                        JCS_UNKNOWN, 1, &region);
 }
 
 u8* jpeg_decode_image(u8* input_ptr, u32 input_length, i32* width, i32* height, i32 *channels_in_file) {
-	struct jpeg_decompress_struct cinfo = {};
-	struct jpeg_error_mgr jerr = {};
+	jpeg_decoder_context_t* context = jpeg_decoder_get_thread_context();
+	struct jpeg_decompress_struct* cinfo = &context->cinfo;
+	u8* volatile output_buffer = NULL; // volatile: inspected after longjmp()
 
 	// Setup error handling
-	cinfo.err = jpeg_std_error(&jerr);
-	jerr.error_exit = on_error;
-
 	jmp_buf on_err_jmp_buffer = {};
-	cinfo.client_data = (void*)on_err_jmp_buffer;
+	cinfo->client_data = (void*)on_err_jmp_buffer;
 	int r = setjmp(on_err_jmp_buffer);
 	if (r != 0) {
 		// We arrived via longjmp and encountered an error -> handle the failure gracefully
-		jpeg_destroy_decompress(&cinfo);
-		return false;
+		jpeg_decoder_reset_thread_context(context);
+		if (output_buffer) free(output_buffer);
+		return NULL;
 	}
 
-	jpeg_create_decompress(&cinfo);
+	// A complete JPEG stream brings its own tables, which replace any loaded JPEGTables.
+	jpeg_decoder_forget_loaded_tables(context);
 
 	// Read tile data
-	setup_jpeg_source(&cinfo, input_ptr, input_length);
-	if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+	setup_jpeg_source(cinfo, input_ptr, input_length);
+	if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK) {
 		printf("Failed to read header\n");
-		jpeg_destroy_decompress(&cinfo);
+		jpeg_decoder_reset_thread_context(context);
 		return NULL;
 	}
 
-	cinfo.out_color_space = JCS_EXT_BGRA;
+	cinfo->out_color_space = JCS_EXT_BGRA;
 
-	jpeg_start_decompress(&cinfo);
+	jpeg_start_decompress(cinfo);
 
-	int row_width = cinfo.output_width;
-	int target_row_stride = row_width * cinfo.output_components;
-	size_t output_size = target_row_stride * cinfo.output_height;
-	u8* output_buffer = malloc(output_size);
+	int row_width = cinfo->output_width;
+	int target_row_stride = row_width * cinfo->output_components;
+	size_t output_size = target_row_stride * cinfo->output_height;
+	output_buffer = malloc(output_size);
 
-	while (cinfo.output_scanline < cinfo.output_height) {
-		u8* output_pos = output_buffer + (cinfo.output_scanline) * target_row_stride;
+	while (cinfo->output_scanline < cinfo->output_height) {
+		u8* output_pos = output_buffer + (cinfo->output_scanline) * target_row_stride;
 		u8* buffer_array[1] = { output_pos };
-		i32 ret = jpeg_read_scanlines(&cinfo, buffer_array, 1);
+		i32 ret = jpeg_read_scanlines(cinfo, buffer_array, 1);
 	}
 
-	if (width) *width = cinfo.output_width;
-	if (height) *height = cinfo.output_height;
-	if (channels_in_file) *channels_in_file = cinfo.output_components;
+	if (width) *width = cinfo->output_width;
+	if (height) *height = cinfo->output_height;
+	if (channels_in_file) *channels_in_file = cinfo->output_components;
 
-	(void) jpeg_finish_decompress(&cinfo);
-	jpeg_destroy_decompress(&cinfo);
+	(void) jpeg_finish_decompress(cinfo);
 
 	return output_buffer;
 }
 
 u8* jpeg_decode_ndpi_image(u8* input_ptr, u32 input_length, i32 width, i32 height, i32 *channels_in_file) {
-    struct jpeg_decompress_struct cinfo = {};
-    struct jpeg_error_mgr jerr = {};
-
-    // Setup error handling
-    cinfo.err = jpeg_std_error(&jerr);
-    jerr.error_exit = on_error;
+	jpeg_decoder_context_t* context = jpeg_decoder_get_thread_context();
+	struct jpeg_decompress_struct* cinfo = &context->cinfo;
+	u8* volatile output_buffer = NULL; // volatile: inspected after longjmp()
 
 	jmp_buf on_err_jmp_buffer = {};
-	cinfo.client_data = (void*)on_err_jmp_buffer;
+	cinfo->client_data = (void*)on_err_jmp_buffer;
 	int r = setjmp(on_err_jmp_buffer);
 	if (r != 0) {
 		// We arrived via longjmp and encountered an error -> handle the failure gracefully
-		jpeg_destroy_decompress(&cinfo);
-		return false;
+		jpeg_decoder_reset_thread_context(context);
+		if (output_buffer) free(output_buffer);
+		return NULL;
 	}
 
-    jpeg_create_decompress(&cinfo);
+	jpeg_decoder_forget_loaded_tables(context);
 
     // We need to edit the SOF for image width and height so that libjpeg does not throw an error
 
 
     // Read tile data
-    setup_jpeg_source(&cinfo, input_ptr, input_length);
-    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+    setup_jpeg_source(cinfo, input_ptr, input_length);
+    if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK) {
         printf("Failed to read header\n");
-        jpeg_destroy_decompress(&cinfo);
+        jpeg_decoder_reset_thread_context(context);
         return NULL;
     }
-    cinfo.image_width = width;
-    cinfo.image_height = height;
+    cinfo->image_width = width;
+    cinfo->image_height = height;
 
-    cinfo.out_color_space = JCS_EXT_BGRA;
+    cinfo->out_color_space = JCS_EXT_BGRA;
 
-    jpeg_start_decompress(&cinfo);
+    jpeg_start_decompress(cinfo);
 
-    int row_width = cinfo.output_width;
-    int target_row_stride = row_width * cinfo.output_components;
-    size_t output_size = target_row_stride * cinfo.output_height;
-    u8* output_buffer = malloc(output_size);
+    int row_width = cinfo->output_width;
+    int target_row_stride = row_width * cinfo->output_components;
+    size_t output_size = target_row_stride * cinfo->output_height;
+    output_buffer = malloc(output_size);
 
-    while (cinfo.output_scanline < cinfo.output_height) {
-        u8* output_pos = output_buffer + (cinfo.output_scanline) * target_row_stride;
+    while (cinfo->output_scanline < cinfo->output_height) {
+        u8* output_pos = output_buffer + (cinfo->output_scanline) * target_row_stride;
         u8* buffer_array[1] = { output_pos };
-        i32 ret = jpeg_read_scanlines(&cinfo, buffer_array, 1);
+        i32 ret = jpeg_read_scanlines(cinfo, buffer_array, 1);
     }
 
-//    if (width) *width = cinfo.output_width;
-//    if (height) *height = cinfo.output_height;
-    if (channels_in_file) *channels_in_file = cinfo.output_components;
+//    if (width) *width = cinfo->output_width;
+//    if (height) *height = cinfo->output_height;
+    if (channels_in_file) *channels_in_file = cinfo->output_components;
 
-    (void) jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+    (void) jpeg_finish_decompress(cinfo);
 
     return output_buffer;
 }
@@ -10,12 +10,42 @@ extern "C" {
 #define EMSCRIPTEN_KEEPALIVE
 #endif
 
+// Region of interest for partial decoding, in output pixels.
+typedef struct jpeg_region_t {
+	i32 x;
+	i32 y;
+	i32 width;
+	i32 height;
+} jpeg_region_t;
+
+// Header information of a JPEG stream, as far as needed to decide whether it can be copied verbatim.
+typedef struct jpeg_stream_info_t {
+	i32 width;
+	i32 height;
+	i32 component_count;
+	u8 h_samp_factor[4];
+	u8 v_samp_factor[4];
+	bool is_baseline; // sequential Huffman (SOF0 or SOF1)
+	bool is_YCbCr; // color space assumed by libjpeg, based on the JFIF/Adobe markers and component IDs
+	bool defines_tables; // false for abbreviated streams (e.g. TIFF tiles relying on JPEGTables)
+} jpeg_stream_info_t;
+
 void jpeg_encode_tile(u8* pixels, i32 width, i32 height, i32 quality, u8** tables_buffer, u64* tables_size_ptr,
                       u8** jpeg_buffer, u64* jpeg_size_ptr, bool use_rgb);
 void jpeg_encode_image(u8* pixels, i32 width, i32 height, i32 quality, u8** jpeg_buffer, u64* jpeg_size_ptr);
 u8* jpeg_decode_image(u8* input_ptr, u32 input_length, i32 *width, i32 *height, i32 *channels_in_file);
 u8* jpeg_decode_ndpi_image(u8* input_ptr, u32 input_length, i32 width, i32 height, i32 *channels_in_file);
+void jpeg_decoder_release_thread_context(void);
 EMSCRIPTEN_KEEPALIVE bool jpeg_decode_tile(uint8_t *table_ptr, uint32_t table_length, uint8_t *input_ptr, uint32_t input_length, uint8_t *output_ptr, bool is_YCbCr);
+bool jpeg_decode_tile_scaled(u8* table_ptr, u32 table_length, u8* input_ptr, u32 input_length, u8* output_ptr,
+                             i32 output_pitch, i32 max_width, i32 max_height, bool is_YCbCr, i32 scale_denom);
+bool jpeg_decode_image_scaled(u8* input_ptr, u32 input_length, u8* output_ptr, i32 output_pitch, i32 max_width,
+                              i32 max_height, i32 scale_denom);
+bool jpeg_decode_tile_region(u8* table_ptr, u32 table_length, u8* input_ptr, u32 input_length, u8* output_ptr,
+                             i32 output_pitch, i32 max_width, i32 max_height, bool is_YCbCr, jpeg_region_t region);
+bool jpeg_decode_image_region(u8* input_ptr, u32 input_length, u8* output_ptr, i32 output_pitch, i32 max_width,
+                              i32 max_height, jpeg_region_t region);
+bool jpeg_read_stream_info(const u8* data, u32 length, jpeg_stream_info_t* info);
 EMSCRIPTEN_KEEPALIVE uint8_t *create_buffer(int size);
 EMSCRIPTEN_KEEPALIVE void destroy_buffer(uint8_t *p);
 
@@ -206,6 +206,45 @@ size_t count_lines(char* buffer) {
 	return lines_counted;
 }
 
+// Splits a CSV line in place. Fields may be quoted ("..."), with "" standing for a literal quote; unquoted fields are
+// trimmed. Stores up to max_fields fields, but returns the number of fields actually in the line.
+i32 split_csv_line(char* line, char** fields, i32 max_fields) {
+	i32 field_count = 0;
+	char* pos = line;
+	for (;;) {
+		while (*pos == ' ' || *pos == '\t') ++pos;
+		char* field = pos;
+		char* out = pos;
+		if (*pos == '"') {
+			++pos;
+			for (; *pos != '\0'; ++pos) {
+				if (*pos == '"') {
+					if (pos[1] == '"') {
+						++pos;
+					} else {
+						++pos;
+						break;
+					}
+				}
+				*out++ = *pos;
+			}
+			while (*pos != '\0' && *pos != ',') ++pos;
+		} else {
+			while (*pos != '\0' && *pos != ',') *out++ = *pos++;
+			while (out > field && (out[-1] == ' ' || out[-1] == '\t')) --out;
+		}
+		bool is_last = (*pos == '\0');
+		*out = '\0';
+		if (field_count < max_fields) {
+			fields[field_count] = field;
+		}
+		++field_count;
+		if (is_last) break;
+		++pos; // skip the comma
+	}
+	return field_count;
+}
+
 bool hex_digit_to_value(char c, u8* out_value) {
 	if (c >= '0' && c <= '9') {
 		*out_value = (u8)(c - '0');
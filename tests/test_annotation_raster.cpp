@@ -0,0 +1,189 @@
+#include "common.h"
+#include "doctest.h"
+
+#include "image.h"
+#include "annotation_raster.h"
+#include "test_helpers.h"
+
+#include <cmath>
+#include <vector>
+
+// The annotation sets are put together by hand here: the annotation loading and editing code lives in the viewer.
+
+namespace {
+
+struct test_annotations_t {
+	std::vector<annotation_t> annotations;
+	std::vector<i32> active_indices;
+	std::vector<std::vector<v2f>> coordinates;
+	std::vector<annotation_group_t> groups;
+	annotation_set_t set;
+
+	test_annotations_t() : set() {
+		annotation_group_t group = {};
+		group.color = RGBA(255, 0, 0, 255);
+		groups.push_back(group);
+		group.color = RGBA(0, 0, 255, 255);
+		group.hidden = true;
+		groups.push_back(group);
+	}
+
+	void add(annotation_type_enum type, std::vector<v2f> points, i32 group_id = 0) {
+		annotation_t annotation = {};
+		annotation.type = type;
+		annotation.group_id = group_id;
+		annotation.coordinate_count = (i32)points.size();
+		coordinates.push_back(points);
+		annotations.push_back(annotation);
+		active_indices.push_back((i32)active_indices.size());
+	}
+
+	void add_rectangle(float left, float top, float right, float bottom, i32 group_id = 0) {
+		add(ANNOTATION_RECTANGLE, {V2F(left, top), V2F(right, top), V2F(right, bottom), V2F(left, bottom)}, group_id);
+	}
+
+	annotation_set_t* get() {
+		for (size_t i = 0; i < annotations.size(); ++i) {
+			annotations[i].coordinates = coordinates[i].data();
+		}
+		set.stored_annotations = annotations.data();
+		set.stored_annotation_count = (i32)annotations.size();
+		set.active_annotation_indices = active_indices.data();
+		set.active_annotation_count = (i32)active_indices.size();
+		set.stored_groups = groups.data();
+		set.stored_group_count = (i32)groups.size();
+		return &set;
+	}
+};
+
+u8* pixel_at(std::vector<u8>& storage, i32 width, i32 x, i32 y) {
+	return storage.data() + ((size_t)y * width + x) * 4;
+}
+
+} // namespace
+
+TEST_CASE("annotation_raster fills closed shapes with anti-aliased edges") {
+	test_annotations_t annotations;
+	annotations.add_rectangle(10.0f, 10.0f, 30.5f, 30.0f);
+	annotation_raster_t raster;
+	REQUIRE(annotation_raster_init(&raster, annotations.get(), BOUNDS2F(0, 0, 64, 64), 16.0f, 0.0f, 1.0f));
+	CHECK(raster.shape_count == 1);
+
+	std::vector<u8> storage;
+	image_buffer_t buffer = make_bgra_buffer(64, 64, storage);
+	annotation_raster_draw(&raster, &buffer, V2F(0, 0), V2F(1, 1));
+
+	u8* inside = pixel_at(storage, 64, 20, 20);
+	CHECK(inside[0] == 0);
+	CHECK(inside[1] == 0);
+	CHECK(inside[2] == 255);
+	CHECK(inside[3] == 255);
+	CHECK(pixel_at(storage, 64, 9, 20)[2] == 0);
+	CHECK(pixel_at(storage, 64, 20, 30)[2] == 0);
+	CHECK(pixel_at(storage, 64, 31, 20)[2] == 0);
+	// The right edge runs through the middle of pixel column 30.
+	i32 edge = pixel_at(storage, 64, 30, 20)[2];
+	CHECK(edge >= 126);
+	CHECK(edge <= 129);
+
+	annotation_raster_destroy(&raster);
+}
+
+TEST_CASE("annotation_raster draws outlines, points and ellipses") {
+	test_annotations_t annotations;
+	annotations.add_rectangle(10.0f, 10.0f, 50.0f, 50.0f);
+	annotations.add(ANNOTATION_LINE, {V2F(5.0f, 60.0f), V2F(60.0f, 60.0f)});
+	annotations.add(ANNOTATION_POINT, {V2F(58.0f, 5.0f)});
+	annotations.add(ANNOTATION_ELLIPSE, {});
+	// Like in the viewer, the ellipse is centered between the control points, with the distance between them as the radii.
+	annotations.annotations.back().p0 = V2F(20.0f, 20.0f);
+	annotations.annotations.back().p1 = V2F(30.0f, 30.0f);
+	annotation_raster_t raster;
+	REQUIRE(annotation_raster_init(&raster, annotations.get(), BOUNDS2F(0, 0, 64, 64), 16.0f, 2.0f, 0.0f));
+	CHECK(raster.shape_count == 4);
+
+	std::vector<u8> storage;
+	image_buffer_t buffer = make_bgra_buffer(64, 64, storage);
+	annotation_raster_draw(&raster, &buffer, V2F(0, 0), V2F(1, 1));
+
+	CHECK(pixel_at(storage, 64, 30, 10)[2] == 255); // top of the rectangle outline
+	CHECK(pixel_at(storage, 64, 30, 45)[2] == 0); // no fill
+	CHECK(pixel_at(storage, 64, 30, 60)[2] == 255); // line
+	CHECK(pixel_at(storage, 64, 58, 5)[2] == 255); // point
+	CHECK(pixel_at(storage, 64, 34, 25)[2] == 255); // right-most point of the ellipse
+	CHECK(pixel_at(storage, 64, 25, 25)[2] == 0); // center of the ellipse
+
+	annotation_raster_destroy(&raster);
+}
+
+TEST_CASE("annotation_raster skips hidden groups and culls shapes outside the region") {
+	test_annotations_t annotations;
+	annotations.add_rectangle(10.0f, 10.0f, 20.0f, 20.0f, 1);
+	annotations.add_rectangle(1000.0f, 1000.0f, 1010.0f, 1010.0f);
+	annotations.add_rectangle(30.0f, 30.0f, 40.0f, 40.0f);
+	annotation_raster_t raster;
+	REQUIRE(annotation_raster_init(&raster, annotations.get(), BOUNDS2F(0, 0, 64, 64), 16.0f, 2.0f, 1.0f));
+	CHECK(raster.shape_count == 1);
+
+	std::vector<u8> storage;
+	image_buffer_t buffer = make_bgra_buffer(64, 64, storage);
+	annotation_raster_draw(&raster, &buffer, V2F(0, 0), V2F(1, 1));
+	CHECK(pixel_at(storage, 64, 15, 15)[0] == 0);
+	CHECK(pixel_at(storage, 64, 35, 35)[2] == 255);
+
+	annotation_raster_destroy(&raster);
+}
+
+TEST_CASE("annotation_raster gives the same result when drawing tile by tile") {
+	test_annotations_t annotations;
+	for (i32 i = 0; i < 200; ++i) {
+		float x = (float)((i * 37) % 180);
+		float y = (float)((i * 53) % 180);
+		if (i % 3 == 0) {
+			annotations.add_rectangle(x, y, x + 17.3f, y + 9.1f);
+		} else {
+			std::vector<v2f> points;
+			for (i32 j = 0; j < 7; ++j) {
+				float angle = (float)j * 2.0f * 3.14159265f / 7.0f;
+				float radius = (j % 2 == 0) ? 12.0f : 5.0f;
+				points.push_back(V2F(x + radius * cosf(angle), y + radius * sinf(angle)));
+			}
+			annotations.add(i % 3 == 1 ? ANNOTATION_POLYGON : ANNOTATION_LINE, points);
+		}
+	}
+	annotations.groups[0].color = RGBA(255, 128, 0, 160);
+	annotation_raster_t raster;
+	// The world is at half the resolution of the image, with the region starting at an offset.
+	REQUIRE(annotation_raster_init(&raster, annotations.get(), BOUNDS2F(-8, -8, 200, 200), 24.0f, 1.5f, 0.3f));
+
+	const i32 size = 384;
+	const i32 tile_size = 64;
+	const v2f origin = V2F(-8.0f, -8.0f);
+	const v2f scale = V2F(2.0f, 2.0f);
+	std::vector<u8> full_storage;
+	image_buffer_t full = make_bgra_buffer(size, size, full_storage);
+	annotation_raster_draw(&raster, &full, origin, scale);
+
+	i32 max_difference = 0;
+	for (i32 tile_y = 0; tile_y < size; tile_y += tile_size) {
+		for (i32 tile_x = 0; tile_x < size; tile_x += tile_size) {
+			std::vector<u8> tile_storage;
+			image_buffer_t tile = make_bgra_buffer(tile_size, tile_size, tile_storage);
+			v2f tile_origin = V2F(origin.x + (float)tile_x / scale.x, origin.y + (float)tile_y / scale.y);
+			annotation_raster_draw(&raster, &tile, tile_origin, scale);
+			for (i32 y = 0; y < tile_size; ++y) {
+				for (i32 x = 0; x < tile_size; ++x) {
+					u8* a = pixel_at(tile_storage, tile_size, x, y);
+					u8* b = pixel_at(full_storage, size, tile_x + x, tile_y + y);
+					for (i32 c = 0; c < 4; ++c) {
+						max_difference = std::max(max_difference, std::abs((i32)a[c] - (i32)b[c]));
+					}
+				}
+			}
+		}
+	}
+	// Only float rounding differences, because the tiles see the shapes at a different offset.
+	CHECK(max_difference <= 1);
+
+	annotation_raster_destroy(&raster);
+}
@@ -0,0 +1,122 @@
+#include "common.h"
+#include "doctest.h"
+
+#include "batch_export_manifest.h"
+
+#include <string>
+
+namespace {
+
+// The parser works in place, so each test gets its own copy of the text.
+struct manifest_t {
+	std::string text;
+	batch_export_item_t* items = NULL;
+	bool ok = false;
+
+	explicit manifest_t(const char* contents) : text(contents) {
+		ok = parse_batch_export_manifest(&text[0], &items);
+	}
+	~manifest_t() { arrfree(items); }
+	i32 count() const { return (i32)arrlen(items); }
+};
+
+} // namespace
+
+TEST_CASE("batch export manifest skips the header, comments and blank lines") {
+	manifest_t manifest(
+		"slide,roi,output,mpp,quality\n"
+		"# a comment\n"
+		"\n"
+		"   \n"
+		"a.tiff,tumor,a_tumor.tiff,0.5,80\n"
+		"  # an indented comment\n"
+		"b.isyntax,,,\n");
+	REQUIRE(manifest.ok);
+	REQUIRE(manifest.count() == 2);
+	batch_export_item_t* a = manifest.items + 0;
+	CHECK(a->line_number == 5);
+	CHECK(strcmp(a->slide, "a.tiff") == 0);
+	CHECK(strcmp(a->roi, "tumor") == 0);
+	CHECK(strcmp(a->output, "a_tumor.tiff") == 0);
+	CHECK(a->mpp == doctest::Approx(0.5f));
+	CHECK(a->quality == 80);
+	batch_export_item_t* b = manifest.items + 1;
+	CHECK(b->line_number == 7);
+	CHECK(strcmp(b->slide, "b.isyntax") == 0);
+	CHECK(strcmp(b->roi, "") == 0);
+	CHECK(strcmp(b->output, "") == 0);
+	CHECK(b->mpp == 0.0f);
+	CHECK(b->quality == 0);
+}
+
+TEST_CASE("batch export manifest header may follow comments, but only comes once") {
+	manifest_t manifest(
+		"# exported from the spreadsheet\n"
+		"Slide,ROI,Output\n"
+		"slide,roi,output\n");
+	REQUIRE(manifest.ok);
+	// Only the first line with content can be the header; a later 'slide' is just a file named 'slide'.
+	REQUIRE(manifest.count() == 1);
+	CHECK(manifest.items[0].line_number == 3);
+	CHECK(strcmp(manifest.items[0].slide, "slide") == 0);
+}
+
+TEST_CASE("batch export manifest handles CRLF line endings and a byte order mark") {
+	manifest_t manifest(
+		"\xEF\xBB\xBF" "slide,roi,output\r\n"
+		"\r\n"
+		"a.tiff,tumor,out.tiff\r\n"
+		"b.tiff,,,1.0,70\r\n"
+		"c.tiff");
+	REQUIRE(manifest.ok);
+	REQUIRE(manifest.count() == 3);
+	CHECK(strcmp(manifest.items[0].output, "out.tiff") == 0);
+	CHECK(manifest.items[0].line_number == 3);
+	CHECK(manifest.items[1].quality == 70);
+	CHECK(manifest.items[1].mpp == doctest::Approx(1.0f));
+	CHECK(strcmp(manifest.items[2].slide, "c.tiff") == 0);
+	CHECK(strcmp(manifest.items[2].roi, "") == 0);
+}
+
+TEST_CASE("batch export manifest unquotes fields with commas and escaped quotes") {
+	manifest_t manifest(
+		"\"slides/case 1, part 2.tiff\",\"group:tumor, invasive\",\"out \"\"final\"\".tiff\",0.25\n");
+	REQUIRE(manifest.ok);
+	REQUIRE(manifest.count() == 1);
+	CHECK(strcmp(manifest.items[0].slide, "slides/case 1, part 2.tiff") == 0);
+	CHECK(strcmp(manifest.items[0].roi, "group:tumor, invasive") == 0);
+	CHECK(strcmp(manifest.items[0].output, "out \"final\".tiff") == 0);
+	CHECK(manifest.items[0].mpp == doctest::Approx(0.25f));
+	CHECK(manifest.items[0].quality == 0);
+}
+
+TEST_CASE("batch export manifest fills in missing columns") {
+	manifest_t manifest(
+		"a.tiff\n"
+		"b.tiff,tumor\n");
+	REQUIRE(manifest.ok);
+	REQUIRE(manifest.count() == 2);
+	CHECK(strcmp(manifest.items[0].roi, "") == 0);
+	CHECK(strcmp(manifest.items[0].output, "") == 0);
+	CHECK(strcmp(manifest.items[1].roi, "tumor") == 0);
+	CHECK(strcmp(manifest.items[1].output, "") == 0);
+	CHECK(manifest.items[1].mpp == 0.0f);
+}
+
+TEST_CASE("batch export manifest rejects lines with too many columns") {
+	// An unquoted comma in a filename shifts the columns; this must not be exported with the wrong settings.
+	manifest_t manifest(
+		"a.tiff,tumor,a.tiff\n"
+		"case 1, part 2.tiff,tumor,out.tiff,0.5,80\n");
+	CHECK_FALSE(manifest.ok);
+	CHECK(manifest.items == NULL);
+}
+
+TEST_CASE("batch export manifest without entries gives an empty list") {
+	manifest_t empty("");
+	CHECK(empty.ok);
+	CHECK(empty.count() == 0);
+	manifest_t only_header("slide,roi,output\n# nothing yet\n\n");
+	CHECK(only_header.ok);
+	CHECK(only_header.count() == 0);
+}
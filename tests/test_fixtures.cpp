@@ -218,7 +218,9 @@ static bool select_decodable_tiff_tile(image_t* image, selected_tiff_tile_t* out
 	for (i32 tile_y = 0; tile_y < (i32)level_image->height_in_tiles; ++tile_y) {
 		for (i32 tile_x = 0; tile_x < (i32)level_image->width_in_tiles; ++tile_x) {
 			i32 tile_index = tile_y * (i32)level_image->width_in_tiles + tile_x;
-			if (ifd->tile_offsets[tile_index] == 0 || ifd->tile_byte_counts[tile_index] == 0) continue;
+			u64 tile_offset = 0, tile_byte_count = 0;
+			if (!tiff_get_tile_location(&image->tiff, ifd, tile_index, &tile_offset, &tile_byte_count)) continue;
+			if (tile_offset == 0 || tile_byte_count == 0) continue;
 
 			u8* pixels = tiff_decode_tile(0, &image->tiff, ifd, tile_index, 0, tile_x, tile_y);
 			if (!pixels) continue;
@@ -430,7 +432,9 @@ TEST_CASE("decode a representative TIFF tile") {
 	u8* pixels = NULL;
 	i32 tile_index = -1;
 	for (u64 i = 0; i < ifd->tile_count; ++i) {
-		if (ifd->tile_offsets[i] == 0 || ifd->tile_byte_counts[i] == 0) continue;
+		u64 tile_offset = 0, tile_byte_count = 0;
+		if (!tiff_get_tile_location(&tiff, ifd, i, &tile_offset, &tile_byte_count)) continue;
+		if (tile_offset == 0 || tile_byte_count == 0) continue;
 		pixels = tiff_decode_tile(0, &tiff, ifd, (i32)i, 0, (i32)(i % ifd->width_in_tiles), (i32)(i / ifd->width_in_tiles));
 		if (pixels) {
 			tile_index = (i32)i;
@@ -443,7 +447,20 @@ TEST_CASE("decode a representative TIFF tile") {
 	size_t pixel_count = (size_t)ifd->tile_width * (size_t)ifd->tile_height;
 	CHECK(pixel_buffer_has_variation((u32*)pixels, pixel_count));
 
+	// Decoding into caller memory reuses the thread's scratch buffers and must give the same result.
+	size_t pixel_memory_size = pixel_count * BYTES_PER_PIXEL;
+	u8* pixels_in_buffer = (u8*)malloc(pixel_memory_size);
+	REQUIRE(pixels_in_buffer != NULL);
+	for (i32 pass = 0; pass < 2; ++pass) {
+		memset(pixels_in_buffer, 0, pixel_memory_size);
+		CHECK(tiff_decode_tile_to_buffer(0, &tiff, ifd, tile_index, 0, tile_index % (i32)ifd->width_in_tiles,
+		                                 tile_index / (i32)ifd->width_in_tiles, pixels_in_buffer));
+		CHECK(memcmp(pixels, pixels_in_buffer, pixel_memory_size) == 0);
+	}
+	free(pixels_in_buffer);
+
 	free(pixels);
+	tiff_release_scratch_buffers(0);
 	tiff_destroy(&tiff);
 }
 
@@ -639,6 +656,206 @@ TEST_CASE("decode an iSyntax tile through libisyntax") {
 	libisyntax_close(isyntax);
 }
 
+TEST_CASE("batched iSyntax tile reads match single tile reads") {
+	const fixture_t* fixture = first_available_fixture("isyntax", "isyntax-tile");
+	if (!fixture) fixture = first_available_fixture("isyntax");
+	if (!fixture) {
+		MESSAGE("Skipping iSyntax batched read check: no iSyntax fixture is present locally.");
+		return;
+	}
+
+	REQUIRE(libisyntax_init() == LIBISYNTAX_OK);
+
+	isyntax_t* isyntax = NULL;
+	REQUIRE(libisyntax_open(fixture->path, (libisyntax_open_flags_t)0, &isyntax) == LIBISYNTAX_OK);
+	REQUIRE(isyntax != NULL);
+
+	isyntax_cache_t* cache = NULL;
+	REQUIRE(libisyntax_cache_create("slidescape_tests iSyntax cache", 256, &cache) == LIBISYNTAX_OK);
+	REQUIRE(libisyntax_cache_inject(cache, isyntax) == LIBISYNTAX_OK);
+
+	const isyntax_image_t* wsi = libisyntax_get_wsi_image(isyntax);
+	REQUIRE(wsi != NULL);
+	const isyntax_level_t* level = libisyntax_image_get_level(wsi, 0);
+	REQUIRE(level != NULL);
+
+	// Pick a handful of existing tiles from the base level, plus a duplicate and an out of bounds tile.
+	enum { batch_capacity = 6 };
+	int64_t tiles_x[batch_capacity] = {};
+	int64_t tiles_y[batch_capacity] = {};
+	i32 tile_count = 0;
+	for (u64 tile_index = 0; tile_index < level->tile_count && tile_count < batch_capacity - 2; ++tile_index) {
+		const isyntax_tile_t* tile = level->tiles + tile_index;
+		if (tile->exists) {
+			tiles_x[tile_count] = tile->tile_x;
+			tiles_y[tile_count] = tile->tile_y;
+			++tile_count;
+		}
+	}
+	if (tile_count == 0) {
+		MESSAGE("Skipping iSyntax batched read check: the base level has no tiles.");
+		libisyntax_cache_destroy(cache);
+		libisyntax_close(isyntax);
+		return;
+	}
+	tiles_x[tile_count] = tiles_x[0];
+	tiles_y[tile_count] = tiles_y[0];
+	++tile_count;
+	tiles_x[tile_count] = -1;
+	tiles_y[tile_count] = -1;
+	++tile_count;
+
+	size_t pixel_count = (size_t)libisyntax_get_tile_width(isyntax) * (size_t)libisyntax_get_tile_height(isyntax);
+	u32* batch_pixels = (u32*)calloc(pixel_count * tile_count, sizeof(u32));
+	u32* single_pixels = (u32*)calloc(pixel_count, sizeof(u32));
+	REQUIRE(static_cast<bool>(batch_pixels != NULL && single_pixels != NULL));
+	uint32_t* pixels_buffers[batch_capacity] = {};
+	for (i32 i = 0; i < tile_count; ++i) {
+		pixels_buffers[i] = batch_pixels + i * pixel_count;
+	}
+
+	REQUIRE(libisyntax_read_tiles(isyntax, cache, 0, tile_count, tiles_x, tiles_y, pixels_buffers,
+	                              LIBISYNTAX_PIXEL_FORMAT_RGBA) == LIBISYNTAX_OK);
+
+	// Every tile in the batch (including the duplicate and the white out of bounds tile) must match a single read.
+	for (i32 i = 0; i < tile_count; ++i) {
+		CAPTURE(tiles_x[i]);
+		CAPTURE(tiles_y[i]);
+		REQUIRE(libisyntax_tile_read(isyntax, cache, 0, tiles_x[i], tiles_y[i], single_pixels,
+		                             LIBISYNTAX_PIXEL_FORMAT_RGBA) == LIBISYNTAX_OK);
+		CHECK(memcmp(single_pixels, pixels_buffers[i], pixel_count * sizeof(u32)) == 0);
+	}
+
+	free(batch_pixels);
+	free(single_pixels);
+	libisyntax_cache_destroy(cache);
+	libisyntax_close(isyntax);
+}
+
+// Tiles are too many to keep around, so the streamed pixels are hashed, to be compared against random access reads later.
+static u64 hash_tile_pixels(const uint32_t* pixels, size_t pixel_count) {
+	u64 hash = 14695981039346656037ULL; // FNV-1a
+	const u8* bytes = (const u8*)pixels;
+	for (size_t i = 0; i < pixel_count * sizeof(u32); ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+struct isyntax_stream_test_t {
+	i64 tile_counts[16];
+	i64 width_in_tiles[16];
+	i64 height_in_tiles[16];
+	u64* tile_hashes[16];
+	i32* tile_visits[16];
+	i64 out_of_bounds_count;
+	size_t pixel_count;
+};
+
+static void isyntax_stream_test_callback(void* userdata, int32_t level, int64_t tile_x, int64_t tile_y,
+                                         const uint32_t* pixels_buffer) {
+	isyntax_stream_test_t* test = (isyntax_stream_test_t*)userdata;
+	if (level < 0 || level >= (i32)COUNT(test->tile_counts) || !test->tile_hashes[level] ||
+	    tile_x < 0 || tile_x >= test->width_in_tiles[level] || tile_y < 0 || tile_y >= test->height_in_tiles[level]) {
+		test->out_of_bounds_count++;
+		return;
+	}
+	test->tile_counts[level]++;
+	i64 tile_index = tile_y * test->width_in_tiles[level] + tile_x;
+	test->tile_visits[level][tile_index]++;
+	test->tile_hashes[level][tile_index] = hash_tile_pixels(pixels_buffer, test->pixel_count);
+}
+
+TEST_CASE("sequential iSyntax decode visits every tile once") {
+	const fixture_t* fixture = first_available_fixture("isyntax", "isyntax-tile");
+	if (!fixture) fixture = first_available_fixture("isyntax");
+	if (!fixture) {
+		MESSAGE("Skipping iSyntax sequential decode check: no iSyntax fixture is present locally.");
+		return;
+	}
+
+	REQUIRE(libisyntax_init() == LIBISYNTAX_OK);
+
+	isyntax_t* isyntax = NULL;
+	REQUIRE(libisyntax_open(fixture->path, (libisyntax_open_flags_t)0, &isyntax) == LIBISYNTAX_OK);
+	REQUIRE(isyntax != NULL);
+
+	isyntax_cache_t* cache = NULL;
+	REQUIRE(libisyntax_cache_create("slidescape_tests iSyntax cache", 256, &cache) == LIBISYNTAX_OK);
+	REQUIRE(libisyntax_cache_inject(cache, isyntax) == LIBISYNTAX_OK);
+
+	const isyntax_image_t* wsi = libisyntax_get_wsi_image(isyntax);
+	i32 level_count = MIN(libisyntax_image_get_level_count(wsi), (i32)COUNT(isyntax_stream_test_t::tile_counts));
+	isyntax_stream_test_t test = {};
+	test.pixel_count = (size_t)libisyntax_get_tile_width(isyntax) * (size_t)libisyntax_get_tile_height(isyntax);
+	for (i32 level_index = 0; level_index < level_count; ++level_index) {
+		const isyntax_level_t* level = libisyntax_image_get_level(wsi, level_index);
+		test.width_in_tiles[level_index] = level->width_in_tiles;
+		test.height_in_tiles[level_index] = level->height_in_tiles;
+		test.tile_hashes[level_index] = (u64*)calloc(level->tile_count, sizeof(u64));
+		test.tile_visits[level_index] = (i32*)calloc(level->tile_count, sizeof(i32));
+	}
+	u32* single_pixels = (u32*)calloc(test.pixel_count, sizeof(u32));
+	REQUIRE(single_pixels != NULL);
+
+	REQUIRE(libisyntax_read_all_tiles(isyntax, cache, LIBISYNTAX_PIXEL_FORMAT_RGBA,
+	                                  isyntax_stream_test_callback, &test) == LIBISYNTAX_OK);
+	CHECK(test.out_of_bounds_count == 0);
+
+	for (i32 level_index = 0; level_index < level_count; ++level_index) {
+		const isyntax_level_t* level = libisyntax_image_get_level(wsi, level_index);
+		i64 existing_tile_count = 0;
+		i64 wrong_visit_count = 0;
+		for (u64 tile_index = 0; tile_index < level->tile_count; ++tile_index) {
+			i32 expected_visits = level->tiles[tile_index].exists ? 1 : 0;
+			existing_tile_count += expected_visits;
+			wrong_visit_count += (test.tile_visits[level_index][tile_index] != expected_visits);
+		}
+		CAPTURE(level_index);
+		CHECK(test.tile_counts[level_index] == existing_tile_count);
+		CHECK(wrong_visit_count == 0);
+	}
+
+	// The streamed pixels must be identical to a regular random access read. Small levels are checked completely;
+	// for larger levels, a spread of rows and columns that includes the edges (and so the last row and column).
+	i64 compared_tile_count = 0;
+	for (i32 level_index = 0; level_index < level_count; ++level_index) {
+		const isyntax_level_t* level = libisyntax_image_get_level(wsi, level_index);
+		i64 width = level->width_in_tiles;
+		i64 height = level->height_in_tiles;
+		bool check_all = width * height <= 64;
+		i64 spread_x[] = {0, 1, width / 3, width / 2, (2 * width) / 3, width - 2, width - 1};
+		i64 spread_y[] = {0, 1, height / 3, height / 2, (2 * height) / 3, height - 2, height - 1};
+		for (i64 tile_y = 0; tile_y < height; ++tile_y) {
+			bool row_selected = check_all;
+			for (i32 i = 0; i < (i32)COUNT(spread_y); ++i) row_selected |= (tile_y == spread_y[i]);
+			if (!row_selected) continue;
+			for (i64 tile_x = 0; tile_x < width; ++tile_x) {
+				bool column_selected = check_all;
+				for (i32 i = 0; i < (i32)COUNT(spread_x); ++i) column_selected |= (tile_x == spread_x[i]);
+				i64 tile_index = tile_y * width + tile_x;
+				if (!column_selected || !level->tiles[tile_index].exists) continue;
+				CAPTURE(level_index);
+				CAPTURE(tile_x);
+				CAPTURE(tile_y);
+				REQUIRE(libisyntax_tile_read(isyntax, cache, level_index, tile_x, tile_y, single_pixels,
+				                             LIBISYNTAX_PIXEL_FORMAT_RGBA) == LIBISYNTAX_OK);
+				CHECK(hash_tile_pixels(single_pixels, test.pixel_count) == test.tile_hashes[level_index][tile_index]);
+				++compared_tile_count;
+			}
+		}
+	}
+	CHECK(compared_tile_count > 0);
+
+	for (i32 level_index = 0; level_index < level_count; ++level_index) {
+		free(test.tile_hashes[level_index]);
+		free(test.tile_visits[level_index]);
+	}
+	free(single_pixels);
+	libisyntax_cache_destroy(cache);
+	libisyntax_close(isyntax);
+}
+
 TEST_CASE("TODO: load ASAP XML fixture through annotation parser" * doctest::skip()) {
 	// This should call load_asap_xml_annotations() or a lower-level parser once annotation loading can
 	// be exercised without constructing a full app_state_t/GUI viewer context.
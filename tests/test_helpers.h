@@ -0,0 +1,112 @@
+#pragma once
+
+// Helpers shared between the test files: building small synthetic TIFF files, and BGRA image buffers.
+
+#include "common.h"
+#include "doctest.h"
+
+#include "image.h"
+#include "image_resize.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+inline void put_u16(std::vector<u8>& out, u16 x) {
+	out.push_back((u8)x);
+	out.push_back((u8)(x >> 8));
+}
+
+inline void put_u32(std::vector<u8>& out, u32 x) {
+	for (i32 i = 0; i < 4; ++i) out.push_back((u8)(x >> (8 * i)));
+}
+
+// Builds a little-endian classic TIFF with a single IFD.
+// The data referenced by the tags is appended first, so that its offsets are known when the tags are declared;
+// the IFD itself is written last, with the entries sorted by tag.
+struct test_tiff_builder_t {
+	struct entry_t {
+		u16 tag;
+		u16 type;
+		u32 count;
+		u32 value;
+	};
+	std::vector<u8> out = {'I', 'I', 42, 0, 0, 0, 0, 0};
+	std::vector<entry_t> entries;
+
+	// Returns the file offset of the appended data.
+	u32 append(const std::vector<u8>& data) {
+		if (out.size() % 2) out.push_back(0); // offsets should be word-aligned
+		u32 offset = (u32)out.size();
+		out.insert(out.end(), data.begin(), data.end());
+		return offset;
+	}
+
+	u32 append_u16s(const std::vector<u16>& values) {
+		std::vector<u8> data;
+		for (u16 value : values) put_u16(data, value);
+		return append(data);
+	}
+
+	u32 append_u32s(const std::vector<u32>& values) {
+		std::vector<u8> data;
+		for (u32 value : values) put_u32(data, value);
+		return append(data);
+	}
+
+	// For SHORT values that fit in the entry (count <= 2), pass them packed into value; otherwise value is an offset.
+	void entry(u16 tag, u16 type, u32 count, u32 value) {
+		entries.push_back({tag, type, count, value});
+	}
+
+	// BitsPerSample = 8,8,8, SamplesPerPixel = 3
+	void rgb8_samples() {
+		entry(258, 3, 3, append_u16s({8, 8, 8})); // BitsPerSample
+		entry(277, 3, 1, 3);                       // SamplesPerPixel
+	}
+
+	std::string write(const char* name) {
+		std::sort(entries.begin(), entries.end(), [](const entry_t& a, const entry_t& b) { return a.tag < b.tag; });
+		if (out.size() % 2) out.push_back(0);
+		u32 ifd_offset = (u32)out.size();
+		for (i32 i = 0; i < 4; ++i) out[4 + i] = (u8)(ifd_offset >> (8 * i));
+		put_u16(out, (u16)entries.size());
+		for (const entry_t& e : entries) {
+			put_u16(out, e.tag);
+			put_u16(out, e.type);
+			put_u32(out, e.count);
+			if (e.type == 3 && e.count <= 2) {
+				put_u16(out, (u16)e.value);
+				put_u16(out, (u16)(e.value >> 16));
+			} else {
+				put_u32(out, e.value);
+			}
+		}
+		put_u32(out, 0); // no next IFD
+
+		std::string path = (std::filesystem::temp_directory_path() / name).string();
+		FILE* fp = fopen(path.c_str(), "wb");
+		REQUIRE(fp != NULL);
+		REQUIRE(fwrite(out.data(), 1, out.size(), fp) == out.size());
+		fclose(fp);
+		return path;
+	}
+};
+
+// A zeroed BGRA buffer, backed by storage.
+inline image_buffer_t make_bgra_buffer(i32 width, i32 height, std::vector<u8>& storage) {
+	storage.assign((size_t)width * height * 4, 0);
+	image_buffer_t buffer = {};
+	buffer.pixels = storage.data();
+	buffer.channels = 4;
+	buffer.width = width;
+	buffer.height = height;
+	buffer.stride_in_pixels = width;
+	buffer.stride_in_bytes = width * 4;
+	buffer.pixel_format = PIXEL_FORMAT_U8_BGRA;
+	buffer.is_valid = true;
+	return buffer;
+}
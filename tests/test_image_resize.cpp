@@ -0,0 +1,123 @@
+#include "common.h"
+#include "doctest.h"
+
+#include "image.h"
+#include "image_resize.h"
+#include "test_helpers.h"
+
+#include <random>
+#include <vector>
+
+// The SIMD resampling paths do the same fixed-point arithmetic as the scalar loops, so the outputs
+// are compared exactly, with disable_simd_image_resize switching between the two.
+
+namespace {
+
+// Noise on top of gradients, with some hard edges so that the lanczos lobes over- and undershoot.
+void fill_test_pattern(std::vector<u8>& pixels, i32 width, i32 height, u32 seed) {
+	std::mt19937 rng(seed);
+	for (i32 y = 0; y < height; ++y) {
+		for (i32 x = 0; x < width; ++x) {
+			u8* p = pixels.data() + ((size_t)y * width + x) * 4;
+			bool edge = ((x / 7) + (y / 5)) % 2 == 0;
+			p[0] = (u8)(x * 3 + (rng() & 15));
+			p[1] = edge ? 255 : 0;
+			p[2] = (u8)(y * 5 + (rng() & 31));
+			p[3] = (u8)rng();
+		}
+	}
+}
+
+std::vector<u8> shrink(image_buffer_t* in, i32 out_width, i32 out_height, rect2i box, bool use_simd) {
+	std::vector<u8> storage;
+	image_buffer_t out = make_bgra_buffer(out_width, out_height, storage);
+	disable_simd_image_resize = !use_simd;
+	CHECK(image_shrink_2x2(in, &out, box));
+	disable_simd_image_resize = false;
+	return storage;
+}
+
+std::vector<u8> resample(image_buffer_t* in, i32 out_width, i32 out_height, rect2f box, bool use_simd) {
+	std::vector<u8> storage;
+	image_buffer_t out = make_bgra_buffer(out_width, out_height, storage);
+	disable_simd_image_resize = !use_simd;
+	CHECK(image_resample_lanczos3(in, &out, box));
+	disable_simd_image_resize = false;
+	return storage;
+}
+
+} // namespace
+
+TEST_CASE("SIMD 2x2 shrink gives the same result as the scalar loop") {
+	const i32 width = 75;
+	const i32 height = 38;
+	std::vector<u8> in_storage;
+	image_buffer_t in = make_bgra_buffer(width, height, in_storage);
+	fill_test_pattern(in_storage, width, height, 1234);
+
+	const rect2i boxes[] = {{0, 0, 74, 38}, {1, 2, 64, 36}, {3, 0, 14, 10}, {0, 0, 6, 2}};
+	for (rect2i box : boxes) {
+		i32 out_width = box.w / 2;
+		i32 out_height = box.h / 2;
+		std::vector<u8> scalar = shrink(&in, out_width, out_height, box, false);
+		std::vector<u8> simd = shrink(&in, out_width, out_height, box, true);
+		CHECK_MESSAGE(simd == scalar, "box=", box.x, ",", box.y, ",", box.w, ",", box.h);
+
+		i32 mismatches = 0;
+		for (i32 y = 0; y < out_height; ++y) {
+			for (i32 x = 0; x < out_width; ++x) {
+				for (i32 c = 0; c < 4; ++c) {
+					const u8* p = in_storage.data() + ((size_t)(box.y + y * 2) * width + box.x + x * 2) * 4 + c;
+					u32 sum = p[0] + p[4] + p[width * 4] + p[width * 4 + 4];
+					mismatches += (simd[((size_t)y * out_width + x) * 4 + c] != (u8)((sum + 2) >> 2));
+				}
+			}
+		}
+		CHECK(mismatches == 0);
+	}
+}
+
+TEST_CASE("SIMD lanczos3 resampling gives the same result as the scalar loop") {
+	const i32 width = 133;
+	const i32 height = 71;
+	std::vector<u8> in_storage;
+	image_buffer_t in = make_bgra_buffer(width, height, in_storage);
+	fill_test_pattern(in_storage, width, height, 42);
+
+	struct resample_case_t {
+		i32 out_width;
+		i32 out_height;
+		rect2f box;
+	};
+	const resample_case_t cases[] = {
+		{64, 32, {0.0f, 0.0f, 133.0f, 71.0f}},     // downsample, both directions
+		{133, 71, {0.4f, 0.7f, 132.0f, 70.0f}},    // fractional shift only
+		{47, 90, {4.25f, 3.5f, 120.5f, 60.0f}},    // down horizontally, up vertically
+		{3, 5, {10.0f, 10.0f, 17.0f, 23.0f}},      // fewer output pixels than one SIMD register
+		{200, 71, {0.0f, 0.0f, 133.0f, 71.0f}},    // horizontal pass only
+	};
+	for (const resample_case_t& c : cases) {
+		std::vector<u8> scalar = resample(&in, c.out_width, c.out_height, c.box, false);
+		std::vector<u8> simd = resample(&in, c.out_width, c.out_height, c.box, true);
+		CHECK_MESSAGE(simd == scalar, "out=", c.out_width, "x", c.out_height);
+	}
+}
+
+TEST_CASE("lanczos3 resampling keeps a flat color unchanged") {
+	const i32 width = 40;
+	const i32 height = 40;
+	std::vector<u8> in_storage;
+	image_buffer_t in = make_bgra_buffer(width, height, in_storage);
+	for (i32 i = 0; i < width * height; ++i) {
+		u32 color = MAKE_BGRA(200, 100, 30, 255);
+		memcpy(in_storage.data() + i * 4, &color, 4);
+	}
+	std::vector<u8> out = resample(&in, 17, 23, {1.5f, 2.5f, 33.0f, 31.0f}, true);
+	i32 mismatches = 0;
+	for (size_t i = 0; i < out.size(); i += 4) {
+		u32 color;
+		memcpy(&color, out.data() + i, 4);
+		mismatches += (color != MAKE_BGRA(200, 100, 30, 255));
+	}
+	CHECK(mismatches == 0);
+}
@@ -0,0 +1,241 @@
+#include "common.h"
+#include "doctest.h"
+
+#include "jpeg_decoder.h"
+
+#include <vector>
+
+namespace {
+
+struct encoded_tile_t {
+	u8* tables = NULL;
+	u64 tables_size = 0;
+	u8* jpeg = NULL;
+	u64 jpeg_size = 0;
+};
+
+std::vector<u8> make_test_pattern(i32 width, i32 height, i32 seed) {
+	std::vector<u8> pixels((size_t)width * height * 4);
+	for (i32 y = 0; y < height; ++y) {
+		for (i32 x = 0; x < width; ++x) {
+			u8* p = pixels.data() + ((size_t)y * width + x) * 4;
+			p[0] = (u8)(x * 4 + seed);
+			p[1] = (u8)(y * 4 + seed * 3);
+			p[2] = (u8)((x ^ y) + seed * 7);
+			p[3] = 255;
+		}
+	}
+	return pixels;
+}
+
+encoded_tile_t encode_test_tile(i32 width, i32 height, i32 quality, i32 seed) {
+	std::vector<u8> pixels = make_test_pattern(width, height, seed);
+	encoded_tile_t result;
+	jpeg_encode_tile(pixels.data(), width, height, quality, &result.tables, &result.tables_size,
+	                 &result.jpeg, &result.jpeg_size, false);
+	return result;
+}
+
+void free_encoded_tile(encoded_tile_t* tile) {
+	free(tile->tables);
+	free(tile->jpeg);
+}
+
+std::vector<u8> decode_fresh(const encoded_tile_t& tile, i32 width, i32 height) {
+	jpeg_decoder_release_thread_context();
+	std::vector<u8> pixels((size_t)width * height * 4);
+	bool ok = jpeg_decode_tile(tile.tables, (u32)tile.tables_size, tile.jpeg, (u32)tile.jpeg_size, pixels.data(), true);
+	REQUIRE(ok);
+	return pixels;
+}
+
+} // namespace
+
+TEST_CASE("reused JPEG decoder gives the same pixels as a fresh decoder") {
+	const i32 width = 64;
+	const i32 height = 64;
+	encoded_tile_t tile_a = encode_test_tile(width, height, 90, 1);
+	encoded_tile_t tile_b = encode_test_tile(width, height, 40, 2); // different quantization tables
+	REQUIRE(tile_a.tables_size > 0);
+	REQUIRE(tile_b.tables_size > 0);
+
+	std::vector<u8> expected_a = decode_fresh(tile_a, width, height);
+	std::vector<u8> expected_b = decode_fresh(tile_b, width, height);
+	CHECK(expected_a != expected_b);
+
+	// Alternate between tables so that the cached tables must be replaced, and interleave
+	// a complete JPEG stream that brings its own tables.
+	std::vector<u8> pattern = make_test_pattern(width, height, 3);
+	u8* full_jpeg = NULL;
+	u64 full_jpeg_size = 0;
+	jpeg_encode_image(pattern.data(), width, height, 75, &full_jpeg, &full_jpeg_size);
+	REQUIRE(full_jpeg != NULL);
+
+	const encoded_tile_t* sequence[] = {&tile_a, &tile_a, &tile_b, &tile_b, &tile_a, NULL, &tile_a, &tile_b};
+	std::vector<u8> pixels((size_t)width * height * 4);
+	for (size_t i = 0; i < COUNT(sequence); ++i) {
+		CAPTURE(i);
+		const encoded_tile_t* tile = sequence[i];
+		if (!tile) {
+			i32 decoded_width = 0, decoded_height = 0, channels = 0;
+			u8* decoded = jpeg_decode_image(full_jpeg, (u32)full_jpeg_size, &decoded_width, &decoded_height, &channels);
+			REQUIRE(decoded != NULL);
+			CHECK(decoded_width == width);
+			CHECK(decoded_height == height);
+			free(decoded);
+			continue;
+		}
+		REQUIRE(jpeg_decode_tile(tile->tables, (u32)tile->tables_size, tile->jpeg, (u32)tile->jpeg_size, pixels.data(), true));
+		CHECK(pixels == (tile == &tile_a ? expected_a : expected_b));
+	}
+
+	// A corrupt stream fails cleanly and does not break subsequent decodes.
+	std::vector<u8> corrupt(tile_a.jpeg, tile_a.jpeg + tile_a.jpeg_size);
+	for (size_t i = 2; i < 40 && i < corrupt.size(); ++i) {
+		corrupt[i] = 0x00;
+	}
+	CHECK_FALSE(jpeg_decode_tile(tile_a.tables, (u32)tile_a.tables_size, corrupt.data(), (u32)corrupt.size(), pixels.data(), true));
+	REQUIRE(jpeg_decode_tile(tile_b.tables, (u32)tile_b.tables_size, tile_b.jpeg, (u32)tile_b.jpeg_size, pixels.data(), true));
+	CHECK(pixels == expected_b);
+
+	free(full_jpeg);
+	free_encoded_tile(&tile_a);
+	free_encoded_tile(&tile_b);
+	jpeg_decoder_release_thread_context();
+}
+
+TEST_CASE("JPEG tiles decode at reduced scale into a destination rectangle") {
+	const i32 width = 64;
+	const i32 height = 64;
+	encoded_tile_t tile = encode_test_tile(width, height, 95, 4);
+	std::vector<u8> full = decode_fresh(tile, width, height);
+
+	for (i32 scale = 2; scale <= 8; scale *= 2) {
+		CAPTURE(scale);
+		// Decode into the lower right quadrant of a larger canvas, cropped to 3/4 of the scaled width.
+		const i32 canvas_width = 2 * width;
+		const i32 pitch = canvas_width * 4;
+		const i32 scaled_width = width / scale;
+		const i32 scaled_height = height / scale;
+		const i32 max_width = scaled_width * 3 / 4;
+		std::vector<u8> canvas((size_t)pitch * 2 * height, 0x11);
+		u8* dest = canvas.data() + (size_t)height * pitch + width * 4;
+		REQUIRE(jpeg_decode_tile_scaled(tile.tables, (u32)tile.tables_size, tile.jpeg, (u32)tile.jpeg_size,
+		                                dest, pitch, max_width, scaled_height, true, scale));
+
+		i32 max_error = 0;
+		for (i32 y = 0; y < scaled_height; ++y) {
+			for (i32 x = 0; x < scaled_width; ++x) {
+				u8* p = dest + (size_t)y * pitch + x * 4;
+				if (x >= max_width) {
+					CHECK(p[0] == 0x11); // cropped: destination must stay untouched
+					continue;
+				}
+				// Compare against the box average of the full-resolution decode.
+				for (i32 c = 0; c < 3; ++c) {
+					i32 sum = 0;
+					for (i32 sy = 0; sy < scale; ++sy) {
+						for (i32 sx = 0; sx < scale; ++sx) {
+							sum += full[((size_t)(y * scale + sy) * width + (x * scale + sx)) * 4 + c];
+						}
+					}
+					i32 average = sum / (scale * scale);
+					max_error = MAX(max_error, abs(average - (i32)p[c]));
+				}
+			}
+		}
+		CHECK(max_error < 32);
+		// Nothing may have been written outside of the destination rectangle.
+		CHECK(canvas[0] == 0x11);
+		CHECK(canvas[(size_t)height * pitch + width * 4 - 1] == 0x11);
+		CHECK(canvas[(size_t)(height + scaled_height) * pitch + width * 4] == 0x11);
+	}
+
+	free_encoded_tile(&tile);
+	jpeg_decoder_release_thread_context();
+}
+
+TEST_CASE("JPEG tiles decode only the requested region") {
+	const i32 width = 64;
+	const i32 height = 64;
+	encoded_tile_t tile = encode_test_tile(width, height, 90, 5);
+	std::vector<u8> full = decode_fresh(tile, width, height);
+
+	const jpeg_region_t regions[] = {
+		{20, 24, 10, 8},  // within the tile, not aligned to MCU boundaries
+		{16, 16, 16, 16}, // aligned to MCU boundaries
+		{0, 56, 64, 8},   // bottom rows only
+		{60, 0, 4, 64},   // rightmost columns only
+		{50, 50, 40, 40}, // extends beyond the tile
+	};
+	for (size_t i = 0; i < COUNT(regions); ++i) {
+		CAPTURE(i);
+		jpeg_region_t region = regions[i];
+		std::vector<u8> pixels((size_t)width * height * 4, 0x11);
+		REQUIRE(jpeg_decode_tile_region(tile.tables, (u32)tile.tables_size, tile.jpeg, (u32)tile.jpeg_size,
+		                                pixels.data(), width * 4, width, height, true, region));
+		bool region_matches = true;
+		for (i32 y = region.y; y < MIN(height, region.y + region.height); ++y) {
+			for (i32 x = region.x; x < MIN(width, region.x + region.width); ++x) {
+				size_t offset = ((size_t)y * width + x) * 4;
+				if (memcmp(pixels.data() + offset, full.data() + offset, 4) != 0) {
+					region_matches = false;
+				}
+			}
+		}
+		CHECK(region_matches);
+		// Rows above the region are skipped entirely.
+		if (region.y > 0) {
+			CHECK(pixels[0] == 0x11);
+		}
+	}
+
+	// An empty region decodes nothing, successfully.
+	std::vector<u8> pixels((size_t)width * height * 4, 0x11);
+	CHECK(jpeg_decode_tile_region(tile.tables, (u32)tile.tables_size, tile.jpeg, (u32)tile.jpeg_size,
+	                              pixels.data(), width * 4, width, height, true, jpeg_region_t{70, 0, 10, 10}));
+	CHECK(pixels[0] == 0x11);
+
+	free_encoded_tile(&tile);
+	jpeg_decoder_release_thread_context();
+}
+
+TEST_CASE("JPEG stream info is read from the markers") {
+	std::vector<u8> pixels = make_test_pattern(48, 32, 5);
+
+	encoded_tile_t tile = encode_test_tile(48, 32, 80, 5);
+	jpeg_stream_info_t info = {};
+	REQUIRE(jpeg_read_stream_info(tile.jpeg, (u32)tile.jpeg_size, &info));
+	CHECK(info.width == 48);
+	CHECK(info.height == 32);
+	CHECK(info.component_count == 3);
+	CHECK(info.is_baseline);
+	CHECK(info.is_YCbCr);
+	CHECK(!info.defines_tables); // abbreviated stream, the tables are in tile.tables
+	CHECK(info.h_samp_factor[0] == 2);
+	CHECK(info.v_samp_factor[0] == 2);
+	CHECK(info.h_samp_factor[1] == 1);
+	CHECK(info.v_samp_factor[2] == 1);
+	free_encoded_tile(&tile);
+
+	u8* rgb_jpeg = NULL;
+	u64 rgb_jpeg_size = 0;
+	jpeg_encode_tile(pixels.data(), 48, 32, 80, NULL, NULL, &rgb_jpeg, &rgb_jpeg_size, true);
+	REQUIRE(jpeg_read_stream_info(rgb_jpeg, (u32)rgb_jpeg_size, &info));
+	CHECK(!info.is_YCbCr);
+	CHECK(info.h_samp_factor[0] == 1);
+	CHECK(info.v_samp_factor[0] == 1);
+	free(rgb_jpeg);
+
+	u8* full_jpeg = NULL;
+	u64 full_jpeg_size = 0;
+	jpeg_encode_image(pixels.data(), 48, 32, 75, &full_jpeg, &full_jpeg_size);
+	REQUIRE(jpeg_read_stream_info(full_jpeg, (u32)full_jpeg_size, &info));
+	CHECK(info.defines_tables);
+	CHECK(info.is_YCbCr);
+	CHECK(!jpeg_read_stream_info(full_jpeg, 20, &info)); // truncated before the frame header
+	free(full_jpeg);
+
+	const u8 not_a_jpeg[] = {0x89, 'P', 'N', 'G', 0, 0, 0, 0};
+	CHECK(!jpeg_read_stream_info(not_a_jpeg, sizeof(not_a_jpeg), &info));
+}
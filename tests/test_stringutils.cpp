@@ -50,3 +50,31 @@ TEST_CASE("split_into_lines handles mixed newline conventions") {
 
 	free(lines);
 }
+
+TEST_CASE("split_csv_line handles quoted fields, escaped quotes and whitespace") {
+	char line[] = " slide.tiff , \"tumor, left\",\"say \"\"hi\"\"\",, \"  padded  \" ";
+	char* fields[8] = {};
+	i32 field_count = split_csv_line(line, fields, COUNT(fields));
+	REQUIRE(field_count == 5);
+	CHECK(strcmp(fields[0], "slide.tiff") == 0);
+	CHECK(strcmp(fields[1], "tumor, left") == 0);
+	CHECK(strcmp(fields[2], "say \"hi\"") == 0);
+	CHECK(strcmp(fields[3], "") == 0);
+	CHECK(strcmp(fields[4], "  padded  ") == 0); // quoted whitespace is kept
+}
+
+TEST_CASE("split_csv_line counts the fields that don't fit") {
+	char line[] = "a,b,c,d";
+	char* fields[2] = {};
+	CHECK(split_csv_line(line, fields, COUNT(fields)) == 4);
+	CHECK(strcmp(fields[0], "a") == 0);
+	CHECK(strcmp(fields[1], "b") == 0);
+
+	char empty[] = "";
+	CHECK(split_csv_line(empty, fields, COUNT(fields)) == 1);
+	CHECK(strcmp(fields[0], "") == 0);
+
+	char trailing_comma[] = "a,";
+	CHECK(split_csv_line(trailing_comma, fields, COUNT(fields)) == 2);
+	CHECK(strcmp(fields[1], "") == 0);
+}
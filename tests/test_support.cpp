@@ -1,4 +1,5 @@
 #include "common.h"
+#include "annotation.h"
 
 #include <stdarg.h>
 
@@ -32,4 +33,18 @@ u8* download_remote_chunk(const char*, i32, const char*, i64, i64, i32*, i32) {
 	return NULL;
 }
 
+// The export code reports its progress through these (normally owned by the GUI).
+float global_tiff_export_progress;
+i32 global_tiff_export_progress_console_dots_written;
+
+// The annotation code lives in the viewer; the exports in the tests don't write annotation files.
+annotation_set_t create_offsetted_annotation_set_for_area(annotation_set_t*, bounds2f, bool) {
+	annotation_set_t result = {};
+	return result;
+}
+
+void save_asap_xml_annotations(annotation_set_t*, const char*) {}
+
+void destroy_annotation_set(annotation_set_t*) {}
+
 }
@@ -0,0 +1,838 @@
+#include "common.h"
+#include "doctest.h"
+
+#include "tiff.h"
+#include "tif_lzw.h"
+#include "webp_api.h"
+#include "compression_api.h"
+#include "jpeg_decoder.h"
+#include "test_helpers.h"
+
+#include <stdio.h>
+#include "jpeglib.h"
+
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// These tests write small synthetic tiled TIFF files, so that the codec paths of tiff_decode_tile()
+// can be checked without depending on local fixtures.
+
+namespace {
+
+const u32 tile_size = 16;
+
+void put_u32_be(std::vector<u8>& out, u32 x) {
+	for (i32 i = 3; i >= 0; --i) out.push_back((u8)(x >> (8 * i)));
+}
+
+// Stored (uncompressed) deflate blocks wrapped in a zlib stream.
+std::vector<u8> zlib_store(const std::vector<u8>& data) {
+	std::vector<u8> out = {0x78, 0x01};
+	size_t pos = 0;
+	do {
+		size_t block_size = MIN(data.size() - pos, (size_t)65535);
+		bool is_last = pos + block_size == data.size();
+		out.push_back(is_last ? 1 : 0);
+		put_u16(out, (u16)block_size);
+		put_u16(out, (u16)~block_size);
+		out.insert(out.end(), data.begin() + pos, data.begin() + pos + block_size);
+		pos += block_size;
+	} while (pos < data.size());
+	u32 a = 1, b = 0;
+	for (u8 c : data) {
+		a = (a + c) % 65521;
+		b = (b + a) % 65521;
+	}
+	put_u32_be(out, (b << 16) | a);
+	return out;
+}
+
+// A Zstandard frame consisting of a single raw (uncompressed) block.
+std::vector<u8> zstd_store(const std::vector<u8>& data) {
+	std::vector<u8> out;
+	put_u32(out, 0xFD2FB528);
+	out.push_back(0xA0); // single segment, 4-byte frame content size, no checksum
+	put_u32(out, (u32)data.size());
+	u32 block_header = 1 /* last block */ | (0 << 1) /* raw */ | ((u32)data.size() << 3);
+	out.push_back((u8)block_header);
+	out.push_back((u8)(block_header >> 8));
+	out.push_back((u8)(block_header >> 16));
+	out.insert(out.end(), data.begin(), data.end());
+	return out;
+}
+
+// TIFF-flavoured LZW encoder (MSB-first codes, code width changes one code early), following libtiff's LZWEncode.
+std::vector<u8> lzw_encode(const std::vector<u8>& data) {
+	std::vector<u8> out;
+	u64 bit_buffer = 0;
+	i32 bit_count = 0;
+	u32 nbits = 9;
+	u32 free_ent = 258;
+	auto emit = [&](u32 code) {
+		bit_buffer = (bit_buffer << nbits) | code;
+		bit_count += nbits;
+		while (bit_count >= 8) {
+			out.push_back((u8)(bit_buffer >> (bit_count - 8)));
+			bit_count -= 8;
+		}
+	};
+	std::unordered_map<u32, u32> dictionary;
+	emit(256); // CODE_CLEAR
+	if (!data.empty()) {
+		u32 prefix = data[0];
+		for (size_t i = 1; i < data.size(); ++i) {
+			u32 key = (prefix << 8) | data[i];
+			auto found = dictionary.find(key);
+			if (found != dictionary.end()) {
+				prefix = found->second;
+				continue;
+			}
+			emit(prefix);
+			dictionary[key] = free_ent++;
+			if (free_ent == 4094) {
+				emit(256);
+				dictionary.clear();
+				free_ent = 258;
+				nbits = 9;
+			} else if (free_ent > (1u << nbits) - 1) {
+				++nbits;
+			}
+			prefix = data[i];
+		}
+		emit(prefix);
+		if (++free_ent > (1u << nbits) - 1 && nbits < 12) {
+			++nbits;
+		}
+	}
+	emit(257); // CODE_EOI
+	if (bit_count > 0) {
+		out.push_back((u8)(bit_buffer << (8 - bit_count)));
+	}
+	return out;
+}
+
+// Packs raw LZW codes (as a stream that need not be valid), using the code width a decoder expects at each position.
+std::vector<u8> lzw_pack_codes(const std::vector<u32>& codes) {
+	std::vector<u8> out;
+	u64 bit_buffer = 0;
+	i32 bit_count = 0;
+	u32 free_ent = 258;
+	bool after_clear = true;
+	for (u32 code : codes) {
+		u32 nbits = free_ent >= 2047 ? 12 : free_ent >= 1023 ? 11 : free_ent >= 511 ? 10 : 9;
+		bit_buffer = (bit_buffer << nbits) | code;
+		bit_count += nbits;
+		while (bit_count >= 8) {
+			out.push_back((u8)(bit_buffer >> (bit_count - 8)));
+			bit_count -= 8;
+		}
+		if (code == 256) {
+			free_ent = 258;
+			after_clear = true;
+		} else {
+			if (!after_clear && free_ent < 4096) ++free_ent;
+			after_clear = false;
+		}
+	}
+	if (bit_count > 0) {
+		out.push_back((u8)(bit_buffer << (8 - bit_count)));
+	}
+	return out;
+}
+
+// Reference: the original (libtiff) LZW decoder.
+std::vector<u8> lzw_decode_reference(std::vector<u8> compressed, size_t decompressed_size) {
+	std::vector<u8> result(decompressed_size);
+	PseudoTIFF tif = {};
+	tif.tif_rawdata = compressed.data();
+	tif.tif_rawcp = compressed.data();
+	tif.tif_rawdatasize = compressed.size();
+	tif.tif_rawcc = compressed.size();
+	REQUIRE(LZWSetupDecode(&tif));
+	REQUIRE(LZWPreDecode(&tif, 0));
+	CHECK(LZWDecode(&tif, result.data(), result.size(), 0));
+	LZWCleanupDecode(&tif);
+	return result;
+}
+
+std::string write_single_tile_tiff(const char* name, u16 compression, u16 predictor, const std::vector<u8>& tile_data) {
+	test_tiff_builder_t tiff;
+	u32 tile_data_offset = tiff.append(tile_data);
+	tiff.entry(256, 4, 1, tile_size);                // ImageWidth
+	tiff.entry(257, 4, 1, tile_size);                // ImageLength
+	tiff.entry(259, 3, 1, compression);              // Compression
+	tiff.entry(262, 3, 1, 2);                        // PhotometricInterpretation = RGB
+	tiff.entry(317, 3, 1, predictor);                // Predictor
+	tiff.entry(322, 4, 1, tile_size);                // TileWidth
+	tiff.entry(323, 4, 1, tile_size);                // TileLength
+	tiff.entry(324, 4, 1, tile_data_offset);         // TileOffsets
+	tiff.entry(325, 4, 1, (u32)tile_data.size());    // TileByteCounts
+	tiff.rgb8_samples();
+	return tiff.write(name);
+}
+
+// Writes a Zstd-compressed tiled TIFF in which all non-empty tiles share the same compressed data.
+// Every tile_count'th tile (as given by empty_every) is left empty. The offset arrays are stored after the tile data.
+std::string write_many_tiles_tiff(const char* name, u32 width_in_tiles, u32 height_in_tiles, u32 empty_every,
+                                  const std::vector<u8>& tile_data) {
+	u32 tile_count = width_in_tiles * height_in_tiles;
+	test_tiff_builder_t tiff;
+	u32 tile_data_offset = tiff.append(tile_data);
+	std::vector<u32> tile_offsets(tile_count);
+	std::vector<u32> tile_byte_counts(tile_count);
+	for (u32 i = 0; i < tile_count; ++i) {
+		tile_offsets[i] = (i % empty_every == 0) ? 0 : tile_data_offset;
+		tile_byte_counts[i] = (i % empty_every == 0) ? 0 : (u32)tile_data.size();
+	}
+	tiff.entry(256, 4, 1, width_in_tiles * tile_size);  // ImageWidth
+	tiff.entry(257, 4, 1, height_in_tiles * tile_size); // ImageLength
+	tiff.entry(259, 3, 1, TIFF_COMPRESSION_ZSTD);       // Compression
+	tiff.entry(262, 3, 1, 2);                           // PhotometricInterpretation = RGB
+	tiff.entry(317, 3, 1, 1);                           // Predictor
+	tiff.entry(322, 4, 1, tile_size);                   // TileWidth
+	tiff.entry(323, 4, 1, tile_size);                   // TileLength
+	tiff.entry(324, 4, tile_count, tiff.append_u32s(tile_offsets));     // TileOffsets
+	tiff.entry(325, 4, tile_count, tiff.append_u32s(tile_byte_counts)); // TileByteCounts
+	tiff.rgb8_samples();
+	return tiff.write(name);
+}
+
+// Writes a stripped (non-tiled) RGB TIFF, with Zstandard-compressed strips of rows_per_strip rows.
+std::string write_stripped_tiff(const char* name, u32 width, u32 height, u32 rows_per_strip, const std::vector<u8>& rgb) {
+	u32 strip_count = (height + rows_per_strip - 1) / rows_per_strip;
+	test_tiff_builder_t tiff;
+	std::vector<u32> strip_offsets;
+	std::vector<u32> strip_byte_counts;
+	for (u32 i = 0; i < strip_count; ++i) {
+		size_t begin = (size_t)i * rows_per_strip * width * 3;
+		size_t end = MIN((size_t)(i + 1) * rows_per_strip * width * 3, rgb.size());
+		std::vector<u8> strip = zstd_store(std::vector<u8>(rgb.begin() + begin, rgb.begin() + end));
+		strip_offsets.push_back(tiff.append(strip));
+		strip_byte_counts.push_back((u32)strip.size());
+	}
+	tiff.entry(256, 4, 1, width);                                            // ImageWidth
+	tiff.entry(257, 4, 1, height);                                           // ImageLength
+	tiff.entry(259, 3, 1, TIFF_COMPRESSION_ZSTD);                            // Compression
+	tiff.entry(262, 3, 1, 2);                                                // PhotometricInterpretation = RGB
+	tiff.entry(273, 4, strip_count, tiff.append_u32s(strip_offsets));        // StripOffsets
+	tiff.entry(278, 4, 1, rows_per_strip);                                   // RowsPerStrip
+	tiff.entry(279, 4, strip_count, tiff.append_u32s(strip_byte_counts));    // StripByteCounts
+	tiff.entry(317, 3, 1, 1);                                                // Predictor
+	tiff.rgb8_samples();
+	return tiff.write(name);
+}
+
+// Baseline JPEG with restart markers and no chroma subsampling (8x8 MCUs), like the levels in NDPI files.
+std::vector<u8> encode_jpeg_with_restart_markers(const std::vector<u8>& rgb, u32 width, u32 height, u32 restart_interval) {
+	struct jpeg_compress_struct cinfo = {};
+	struct jpeg_error_mgr jerr = {};
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	unsigned char* buffer = NULL;
+	unsigned long size = 0;
+	jpeg_mem_dest(&cinfo, &buffer, &size);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 85, TRUE);
+	for (i32 i = 0; i < cinfo.num_components; ++i) {
+		cinfo.comp_info[i].h_samp_factor = 1;
+		cinfo.comp_info[i].v_samp_factor = 1;
+	}
+	cinfo.restart_interval = restart_interval;
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW row = (JSAMPROW)(rgb.data() + (size_t)cinfo.next_scanline * width * 3);
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	std::vector<u8> result(buffer, buffer + size);
+	free(buffer);
+	return result;
+}
+
+// Writes a minimal NDPI-like TIFF: one JPEG strip plus the McuStarts tag, listing the start of each restart interval.
+std::string write_ndpi_tiff(const char* name, u32 width, u32 height, const std::vector<u8>& jpeg) {
+	std::vector<u32> mcu_starts;
+	size_t pos = 2;
+	while (pos + 4 <= jpeg.size()) {
+		u32 segment_length = ((u32)jpeg[pos + 2] << 8) | jpeg[pos + 3];
+		bool is_sos = jpeg[pos + 1] == 0xDA;
+		pos += 2 + segment_length;
+		if (is_sos) break;
+	}
+	mcu_starts.push_back((u32)pos);
+	for (; pos + 1 < jpeg.size(); ++pos) {
+		if (jpeg[pos] == 0xFF && (jpeg[pos + 1] & 0xF8) == 0xD0) {
+			mcu_starts.push_back((u32)pos + 2);
+		}
+	}
+	u32 count = (u32)mcu_starts.size();
+
+	test_tiff_builder_t tiff;
+	u32 jpeg_offset = tiff.append(jpeg);
+	tiff.entry(256, 4, 1, width);                          // ImageWidth
+	tiff.entry(257, 4, 1, height);                         // ImageLength
+	tiff.entry(259, 3, 1, TIFF_COMPRESSION_JPEG);          // Compression
+	tiff.entry(262, 3, 1, 6);                              // PhotometricInterpretation = YCbCr
+	tiff.entry(273, 4, 1, jpeg_offset);                    // StripOffsets
+	tiff.entry(278, 4, 1, height);                         // RowsPerStrip
+	tiff.entry(279, 4, 1, (u32)jpeg.size());               // StripByteCounts
+	tiff.entry(NDPI_TAG_ALWAYS_1, 4, 1, 1);
+	tiff.entry(NDPI_TAG_OPTIMISATION_FILE, 4, count, tiff.append_u32s(mcu_starts)); // McuStarts
+	tiff.rgb8_samples();
+	return tiff.write(name);
+}
+
+std::vector<u8> make_rgb_tile() {
+	std::vector<u8> rgb(tile_size * tile_size * 3);
+	for (u32 y = 0; y < tile_size; ++y) {
+		for (u32 x = 0; x < tile_size; ++x) {
+			u8* p = rgb.data() + (y * tile_size + x) * 3;
+			p[0] = (u8)(x * 16);
+			p[1] = (u8)(y * 16);
+			p[2] = (u8)(x * 7 + y * 3);
+		}
+	}
+	return rgb;
+}
+
+// Inverse of the TIFF horizontal predictor for 8-bit samples.
+std::vector<u8> apply_horizontal_differencing(const std::vector<u8>& rgb) {
+	std::vector<u8> result = rgb;
+	for (u32 y = 0; y < tile_size; ++y) {
+		u8* row = result.data() + y * tile_size * 3;
+		const u8* source_row = rgb.data() + y * tile_size * 3;
+		for (u32 i = 3; i < tile_size * 3; ++i) {
+			row[i] = (u8)(source_row[i] - source_row[i - 3]);
+		}
+	}
+	return result;
+}
+
+void check_decoded_tile(const char* name, u16 compression, u16 predictor, const std::vector<u8>& compressed) {
+	std::vector<u8> rgb = make_rgb_tile();
+	std::string path = write_single_tile_tiff(name, compression, predictor, compressed);
+	tiff_t tiff = {};
+	REQUIRE(open_tiff_file(&tiff, path.c_str()));
+	REQUIRE(tiff.main_image_ifd != NULL);
+	tiff_ifd_t* ifd = tiff.main_image_ifd;
+	CHECK(ifd->compression == compression);
+
+	u8* pixels = tiff_decode_tile(0, &tiff, ifd, 0, 0, 0, 0);
+	REQUIRE(pixels != NULL);
+	i32 mismatches = 0;
+	for (u32 i = 0; i < tile_size * tile_size; ++i) {
+		u32 expected = MAKE_BGRA(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2], 255);
+		mismatches += (((u32*)pixels)[i] != expected);
+	}
+	CHECK(mismatches == 0);
+	free(pixels);
+	tiff_destroy(&tiff);
+	std::filesystem::remove(path);
+}
+
+} // namespace
+
+TEST_CASE("TIFF Deflate tiles decode, with and without horizontal predictor") {
+	std::vector<u8> rgb = make_rgb_tile();
+	check_decoded_tile("slidescape_test_deflate.tiff", TIFF_COMPRESSION_ADOBE_DEFLATE, 1, zlib_store(rgb));
+	check_decoded_tile("slidescape_test_deflate_obsolete.tiff", TIFF_COMPRESSION_DEFLATE, 1, zlib_store(rgb));
+	check_decoded_tile("slidescape_test_deflate_predictor.tiff", TIFF_COMPRESSION_ADOBE_DEFLATE, 2,
+	                   zlib_store(apply_horizontal_differencing(rgb)));
+}
+
+TEST_CASE("TIFF Zstandard tiles decode, with and without horizontal predictor") {
+	std::vector<u8> rgb = make_rgb_tile();
+	check_decoded_tile("slidescape_test_zstd.tiff", TIFF_COMPRESSION_ZSTD, 1, zstd_store(rgb));
+	check_decoded_tile("slidescape_test_zstd_predictor.tiff", TIFF_COMPRESSION_ZSTD, 2,
+	                   zstd_store(apply_horizontal_differencing(rgb)));
+	tiff_release_scratch_buffers(0);
+}
+
+TEST_CASE("TIFF LZW tiles decode, with and without horizontal predictor") {
+	std::vector<u8> rgb = make_rgb_tile();
+	check_decoded_tile("slidescape_test_lzw.tiff", TIFF_COMPRESSION_LZW, 1, lzw_encode(rgb));
+	check_decoded_tile("slidescape_test_lzw_predictor.tiff", TIFF_COMPRESSION_LZW, 2,
+	                   lzw_encode(apply_horizontal_differencing(rgb)));
+}
+
+TEST_CASE("local TIFF files are memory-mapped, with regular reads as the fallback") {
+	std::vector<u8> rgb = make_rgb_tile();
+	std::string path = write_single_tile_tiff("slidescape_test_mmap.tiff", TIFF_COMPRESSION_LZW, 1, lzw_encode(rgb));
+	bool prev_use_memory_mapped_files = use_memory_mapped_files;
+	std::vector<u8> decoded[2];
+	for (i32 use_mmap = 0; use_mmap <= 1; ++use_mmap) {
+		CAPTURE(use_mmap);
+		use_memory_mapped_files = (use_mmap != 0);
+		tiff_t tiff = {};
+		REQUIRE(open_tiff_file(&tiff, path.c_str()));
+		if (use_mmap) {
+			REQUIRE(tiff.mapped_file.data != NULL);
+			CHECK(tiff.mapped_file.size == (u64)std::filesystem::file_size(path));
+			CHECK((mapped_file_get_bytes(&tiff.mapped_file, 0, tiff.mapped_file.size) == tiff.mapped_file.data));
+			CHECK_FALSE(mapped_file_get_bytes(&tiff.mapped_file, 1, tiff.mapped_file.size)); // beyond the end of the file
+			CHECK_FALSE(mapped_file_get_bytes(&tiff.mapped_file, tiff.mapped_file.size + 1, 0));
+		} else {
+			CHECK(tiff.mapped_file.data == NULL);
+		}
+		u8* pixels = tiff_decode_tile(0, &tiff, tiff.main_image_ifd, 0, 0, 0, 0);
+		REQUIRE(pixels != NULL);
+		decoded[use_mmap].assign(pixels, pixels + tile_size * tile_size * 4);
+		free(pixels);
+		if (use_mmap) {
+			// Dropping the resident pages (as done during exports) must not change what is read afterwards.
+			mapped_file_advise(&tiff.mapped_file, 0, tiff.mapped_file.size, FILE_ACCESS_DONE);
+			pixels = tiff_decode_tile(0, &tiff, tiff.main_image_ifd, 0, 0, 0, 0);
+			REQUIRE(pixels != NULL);
+			CHECK(memcmp(pixels, decoded[use_mmap].data(), decoded[use_mmap].size()) == 0);
+			free(pixels);
+		}
+		tiff_destroy(&tiff);
+		CHECK(tiff.mapped_file.data == NULL);
+	}
+	use_memory_mapped_files = prev_use_memory_mapped_files;
+	CHECK(decoded[0] == decoded[1]);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("fast LZW decoder gives the same output as the libtiff decoder") {
+	std::mt19937 rng(1234);
+	std::vector<std::vector<u8>> inputs;
+	std::vector<u8> noise(100000);
+	for (u8& x : noise) x = (u8)rng();
+	inputs.push_back(noise);
+	std::vector<u8> runs(200000);
+	for (size_t i = 0; i < runs.size(); ++i) runs[i] = (u8)((i / 37) % 5);
+	inputs.push_back(runs); // long strings, exercising the table resets
+	std::vector<u8> low_entropy(150000);
+	for (u8& x : low_entropy) x = (u8)(rng() % 3);
+	inputs.push_back(low_entropy);
+	inputs.push_back(std::vector<u8>(70000, 42)); // KwKwK codes only
+	inputs.push_back(std::vector<u8>(1, 7));
+
+	for (const std::vector<u8>& input : inputs) {
+		std::vector<u8> compressed = lzw_encode(input);
+		std::vector<u8> reference = lzw_decode_reference(compressed, input.size());
+		std::vector<u8> fast(input.size());
+		CHECK(LZWDecodeFast(compressed.data(), compressed.size(), fast.data(), fast.size()));
+		CHECK(reference == input);
+		CHECK(fast == input);
+
+		// Decoding only a prefix of the data must also work (strings cut off at the end of the buffer).
+		size_t partial_size = input.size() / 2 + 1;
+		std::vector<u8> partial(partial_size);
+		CHECK(LZWDecodeFast(compressed.data(), compressed.size(), partial.data(), partial.size()));
+		CHECK(std::equal(partial.begin(), partial.end(), input.begin()));
+	}
+
+	// Asking for more data than the stream contains fails, like the libtiff decoder.
+	std::vector<u8> compressed = lzw_encode(runs);
+	std::vector<u8> too_large(runs.size() + 1);
+	CHECK_FALSE(LZWDecodeFast(compressed.data(), compressed.size(), too_large.data(), too_large.size()));
+}
+
+TEST_CASE("fast LZW decoder rejects codes beyond the table") {
+	std::vector<u32> codes = {256};
+	for (u32 i = 0; i < 300; ++i) codes.push_back(i % 200);
+	codes.push_back(4000); // the table only has entries up to 557 here
+	for (u32 i = 0; i < 300; ++i) codes.push_back(i % 200);
+	codes.push_back(257);
+	std::vector<u8> compressed = lzw_pack_codes(codes);
+	std::vector<u8> output(601);
+	CHECK_FALSE(LZWDecodeFast(compressed.data(), compressed.size(), output.data(), output.size()));
+
+	// The same stream without the bad code decodes.
+	codes.erase(codes.begin() + 301);
+	compressed = lzw_pack_codes(codes);
+	output.resize(600);
+	CHECK(LZWDecodeFast(compressed.data(), compressed.size(), output.data(), output.size()));
+	CHECK(output[299] == 299 % 200);
+	CHECK(output[599] == 299 % 200);
+}
+
+TEST_CASE("SIMD horizontal predictor gives the same result as the scalar loop") {
+	std::mt19937 rng(5678);
+	const u32 widths[] = {1, 2, 3, 5, 16, 17, 100, 257};
+	for (u32 bytes_per_sample = 1; bytes_per_sample <= 2; ++bytes_per_sample) {
+		for (u32 samples_per_pixel = 1; samples_per_pixel <= 5; ++samples_per_pixel) {
+			for (u32 width : widths) {
+				u32 sample_count = width * samples_per_pixel;
+				std::vector<u8> row(sample_count * bytes_per_sample);
+				for (u8& x : row) x = (u8)rng();
+				std::vector<u8> expected = row;
+				if (bytes_per_sample == 1) {
+					for (u32 i = samples_per_pixel; i < sample_count; ++i) {
+						expected[i] = (u8)(expected[i] + expected[i - samples_per_pixel]);
+					}
+				} else {
+					u16* samples = (u16*)expected.data();
+					for (u32 i = samples_per_pixel; i < sample_count; ++i) {
+						samples[i] = (u16)(samples[i] + samples[i - samples_per_pixel]);
+					}
+				}
+				CHECK(tiff_undo_horizontal_predictor(row.data(), width, samples_per_pixel, bytes_per_sample));
+				CHECK_MESSAGE(row == expected, "bytes_per_sample=", bytes_per_sample, " samples_per_pixel=", samples_per_pixel, " width=", width);
+			}
+		}
+	}
+	u8 dummy[4] = {};
+	CHECK_FALSE(tiff_undo_horizontal_predictor(dummy, 1, 1, 4));
+}
+
+TEST_CASE("TIFF tile offsets are loaded lazily, one page at a time") {
+	const u32 width_in_tiles = 100;
+	const u32 height_in_tiles = 50; // 5000 tiles: two pages
+	std::vector<u8> compressed = zstd_store(make_rgb_tile());
+	std::string path = write_many_tiles_tiff("slidescape_test_lazy_offsets.tiff", width_in_tiles, height_in_tiles, 7, compressed);
+	tiff_t tiff = {};
+	REQUIRE(open_tiff_file(&tiff, path.c_str()));
+	tiff_ifd_t* ifd = tiff.main_image_ifd;
+	REQUIRE(ifd != NULL);
+	REQUIRE(ifd->tile_count == width_in_tiles * height_in_tiles);
+	REQUIRE(ifd->tile_offset_page_count == 2);
+	CHECK(ifd->tile_offset_pages[0] == NULL);
+	CHECK(ifd->tile_offset_pages[1] == NULL);
+
+	u64 offset = 0, byte_count = 0;
+	REQUIRE(tiff_get_tile_location(&tiff, ifd, 4500, &offset, &byte_count));
+	CHECK(ifd->tile_offset_pages[0] == NULL);
+	CHECK(ifd->tile_offset_pages[1] != NULL);
+	CHECK(offset != 0);
+	CHECK(byte_count == compressed.size());
+
+	i32 mismatches = 0;
+	for (u64 i = 0; i < ifd->tile_count; ++i) {
+		REQUIRE(tiff_get_tile_location(&tiff, ifd, i, &offset, &byte_count));
+		bool expect_empty = (i % 7 == 0);
+		mismatches += expect_empty ? (offset != 0 || byte_count != 0) : (byte_count != compressed.size());
+	}
+	CHECK(mismatches == 0);
+	CHECK_FALSE(tiff_get_tile_location(&tiff, ifd, ifd->tile_count, &offset, &byte_count));
+
+	// Tiles can be decoded as usual.
+	u8* pixels = tiff_decode_tile(0, &tiff, ifd, 4999, 0, 99, 49);
+	CHECK(pixels != NULL);
+	free(pixels);
+	u8* empty_tile_pixels = tiff_decode_tile(0, &tiff, ifd, 4998, 0, 98, 49);
+	CHECK(empty_tile_pixels == NULL); // empty tile
+	tiff_destroy(&tiff);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("TIFF tile offset pages can be loaded by several threads at once") {
+	const u32 width_in_tiles = 200;
+	const u32 height_in_tiles = 100; // 20000 tiles: five pages
+	std::vector<u8> compressed = zstd_store(make_rgb_tile());
+	std::string path = write_many_tiles_tiff("slidescape_test_concurrent_offsets.tiff", width_in_tiles, height_in_tiles, 7, compressed);
+	tiff_t tiff = {};
+	REQUIRE(open_tiff_file(&tiff, path.c_str()));
+	tiff_ifd_t* ifd = tiff.main_image_ifd;
+	REQUIRE(ifd != NULL);
+	REQUIRE(ifd->tile_offset_page_count == 5);
+
+	// Each thread walks the tiles starting from a different page, so that threads race to load the same pages.
+	const i32 thread_count = 8;
+	std::vector<i32> mismatches(thread_count, 0);
+	std::vector<std::thread> threads;
+	for (i32 t = 0; t < thread_count; ++t) {
+		threads.emplace_back([&, t]() {
+			for (u64 j = 0; j < ifd->tile_count; ++j) {
+				u64 i = (j + (u64)t * TIFF_TILE_OFFSET_PAGE_ENTRIES / 2) % ifd->tile_count;
+				u64 offset = 0, byte_count = 0;
+				if (!tiff_get_tile_location(&tiff, ifd, i, &offset, &byte_count)) {
+					++mismatches[t];
+					continue;
+				}
+				bool expect_empty = (i % 7 == 0);
+				mismatches[t] += expect_empty ? (offset != 0 || byte_count != 0) : (byte_count != compressed.size());
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	for (i32 t = 0; t < thread_count; ++t) {
+		CHECK(mismatches[t] == 0);
+	}
+	for (u64 page_index = 0; page_index < ifd->tile_offset_page_count; ++page_index) {
+		CHECK(ifd->tile_offset_pages[page_index] != NULL);
+	}
+	tiff_destroy(&tiff);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("TIFF metadata from older servers, with complete tile offset arrays, still deserializes") {
+	const u32 width_in_tiles = 100;
+	const u32 height_in_tiles = 50; // 5000 tiles: two pages
+	const u64 tile_count = width_in_tiles * height_in_tiles;
+	std::vector<u8> stream;
+	auto push_bytes = [&stream](const void* data, size_t size) {
+		stream.insert(stream.end(), (const u8*)data, (const u8*)data + size);
+	};
+	auto push_block = [&push_bytes](u32 block_type, u32 index, u64 length) {
+		serial_block_t block = {block_type, index, length};
+		push_bytes(&block, sizeof(block));
+	};
+
+	tiff_serial_header_t header = {};
+	header.ifd_count = 1;
+	header.level_image_ifd_count = 1;
+	header.bytesize_of_offsets = 8;
+	header.is_bigtiff = true;
+	push_block(SERIAL_BLOCK_TIFF_HEADER_AND_META, 0, sizeof(header));
+	push_bytes(&header, sizeof(header));
+
+	tiff_serial_ifd_legacy_t legacy_ifd = {};
+	legacy_ifd.image_width = width_in_tiles * tile_size;
+	legacy_ifd.image_height = height_in_tiles * tile_size;
+	legacy_ifd.tile_width = tile_size;
+	legacy_ifd.tile_height = tile_size;
+	legacy_ifd.tile_count = tile_count;
+	legacy_ifd.compression = TIFF_COMPRESSION_ZSTD;
+	legacy_ifd.width_in_tiles = width_in_tiles;
+	legacy_ifd.height_in_tiles = height_in_tiles;
+	push_block(SERIAL_BLOCK_TIFF_IFDS, 0, sizeof(legacy_ifd));
+	push_bytes(&legacy_ifd, sizeof(legacy_ifd));
+
+	std::vector<u64> offsets(tile_count), byte_counts(tile_count);
+	for (u64 i = 0; i < tile_count; ++i) {
+		offsets[i] = 1000 + i * 100;
+		byte_counts[i] = 50 + (i % 13);
+	}
+	push_block(SERIAL_BLOCK_TIFF_TILE_OFFSETS, 0, tile_count * sizeof(u64));
+	push_bytes(offsets.data(), tile_count * sizeof(u64));
+	push_block(SERIAL_BLOCK_TIFF_TILE_BYTE_COUNTS, 0, tile_count * sizeof(u64));
+	push_bytes(byte_counts.data(), tile_count * sizeof(u64));
+	push_block(SERIAL_BLOCK_TERMINATOR, 0, 0);
+
+	tiff_t tiff = {};
+	REQUIRE(tiff_deserialize(&tiff, stream.data(), stream.size()));
+	tiff.is_remote = true; // as set by the remote client, after deserializing
+	REQUIRE(tiff.ifd_count == 1);
+	tiff_ifd_t* ifd = tiff.ifds;
+	REQUIRE(ifd->tile_count == tile_count);
+	CHECK(ifd->width_in_tiles == width_in_tiles);
+	CHECK(ifd->compression == TIFF_COMPRESSION_ZSTD);
+	REQUIRE(ifd->tile_offset_page_count == 2);
+	CHECK(ifd->tile_offset_pages[0] != NULL);
+	CHECK(ifd->tile_offset_pages[1] != NULL);
+
+	i32 mismatches = 0;
+	for (u64 i = 0; i < tile_count; ++i) {
+		u64 offset = 0, byte_count = 0;
+		REQUIRE(tiff_get_tile_location(&tiff, ifd, i, &offset, &byte_count));
+		mismatches += (offset != offsets[i] || byte_count != byte_counts[i]);
+	}
+	CHECK(mismatches == 0);
+	tiff_destroy(&tiff);
+
+	// Neither the legacy nor the current IFD layout: rejected.
+	stream.clear();
+	push_block(SERIAL_BLOCK_TIFF_HEADER_AND_META, 0, sizeof(header));
+	push_bytes(&header, sizeof(header));
+	push_block(SERIAL_BLOCK_TIFF_IFDS, 0, sizeof(legacy_ifd) + 4);
+	push_bytes(&legacy_ifd, sizeof(legacy_ifd));
+	put_u32(stream, 0);
+	push_block(SERIAL_BLOCK_TERMINATOR, 0, 0);
+	tiff_t rejected = {};
+	CHECK_FALSE(tiff_deserialize(&rejected, stream.data(), stream.size()));
+}
+
+TEST_CASE("stripped TIFF images are decoded as virtual tiles, sharing decoded strips") {
+	const u32 width = 700, height = 600, rows_per_strip = 50;
+	std::vector<u8> rgb((size_t)width * height * 3);
+	for (u32 y = 0; y < height; ++y) {
+		for (u32 x = 0; x < width; ++x) {
+			u8* p = rgb.data() + ((size_t)y * width + x) * 3;
+			p[0] = (u8)x;
+			p[1] = (u8)y;
+			p[2] = (u8)(x * 3 + y * 7);
+		}
+	}
+	std::string path = write_stripped_tiff("slidescape_test_stripped.tiff", width, height, rows_per_strip, rgb);
+	tiff_t tiff = {};
+	REQUIRE(open_tiff_file(&tiff, path.c_str()));
+	tiff_ifd_t* ifd = tiff.main_image_ifd;
+	REQUIRE(ifd != NULL);
+	CHECK_FALSE(ifd->is_tiled);
+	CHECK(ifd->strip_count == 12);
+	CHECK(ifd->tile_width == TIFF_VIRTUAL_TILE_SIZE);
+	CHECK(ifd->tile_height == TIFF_VIRTUAL_TILE_SIZE);
+	REQUIRE(ifd->width_in_tiles == 2);
+	REQUIRE(ifd->height_in_tiles == 2);
+	REQUIRE(ifd->tile_count == 4);
+
+	i32 mismatches = 0;
+	for (u32 tile_index = 0; tile_index < ifd->tile_count; ++tile_index) {
+		u32 tile_x = tile_index % ifd->width_in_tiles;
+		u32 tile_y = tile_index / ifd->width_in_tiles;
+		u8* pixels = tiff_decode_tile(0, &tiff, ifd, tile_index, 0, tile_x, tile_y);
+		REQUIRE(pixels != NULL);
+		for (u32 y = 0; y < ifd->tile_height; ++y) {
+			for (u32 x = 0; x < ifd->tile_width; ++x) {
+				u32 image_x = tile_x * ifd->tile_width + x;
+				u32 image_y = tile_y * ifd->tile_height + y;
+				u32 expected = 0; // transparent beyond the image boundary
+				if (image_x < width && image_y < height) {
+					const u8* p = rgb.data() + ((size_t)image_y * width + image_x) * 3;
+					expected = MAKE_BGRA(p[0], p[1], p[2], 255);
+				}
+				mismatches += (((u32*)pixels)[y * ifd->tile_width + x] != expected);
+			}
+		}
+		free(pixels);
+	}
+	CHECK(mismatches == 0);
+
+	// The strips of the first row of tiles (11 strips) were decoded once and reused by the second tile in the row.
+	REQUIRE(ifd->strip_cache != NULL);
+	i32 cached_strips = 0;
+	for (i32 i = 0; i < ifd->strip_cache->entry_count; ++i) {
+		tiff_decoded_strip_t* entry = ifd->strip_cache->entries + i;
+		CHECK(entry->refcount == 0);
+		cached_strips += (entry->strip_index >= 0);
+	}
+	CHECK(cached_strips == ifd->strip_cache->entry_count);
+	CHECK(ifd->strip_cache->use_counter == 2 * (11 + 2));
+	tiff_destroy(&tiff);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("NDPI levels are decoded per tile, from the restart intervals that cover the tile") {
+	const u32 width = 960, height = 600, restart_interval = 8; // 120 MCUs per row, 15 restart intervals of 64 pixels
+	std::vector<u8> rgb((size_t)width * height * 3);
+	for (u32 y = 0; y < height; ++y) {
+		for (u32 x = 0; x < width; ++x) {
+			u8* p = rgb.data() + ((size_t)y * width + x) * 3;
+			p[0] = (u8)(x / 2);
+			p[1] = (u8)(y / 3);
+			p[2] = (u8)((x ^ y) & 0xF0);
+		}
+	}
+	std::vector<u8> jpeg = encode_jpeg_with_restart_markers(rgb, width, height, restart_interval);
+	i32 reference_width = 0, reference_height = 0;
+	u8* reference = jpeg_decode_image(jpeg.data(), (u32)jpeg.size(), &reference_width, &reference_height, NULL);
+	REQUIRE(reference != NULL);
+	REQUIRE(reference_width == (i32)width);
+
+	std::string path = write_ndpi_tiff("slidescape_test_ndpi.tiff", width, height, jpeg);
+	tiff_t tiff = {};
+	REQUIRE(open_tiff_file(&tiff, path.c_str()));
+	tiff_ifd_t* ifd = tiff.main_image_ifd;
+	REQUIRE(ifd != NULL);
+	CHECK(ifd->is_ndpi);
+	REQUIRE(ifd->ndpi_tiling != NULL);
+	CHECK(ifd->ndpi_tiling->intervals_per_row == 15);
+	CHECK(ifd->ndpi_tiling->mcu_row_count == 75);
+	CHECK(ifd->tile_width == 512);
+	CHECK(ifd->tile_height == 512);
+	REQUIRE(ifd->width_in_tiles == 2);
+	REQUIRE(ifd->height_in_tiles == 2);
+
+	i32 mismatches = 0;
+	for (u32 tile_index = 0; tile_index < ifd->tile_count; ++tile_index) {
+		u32 tile_x = tile_index % ifd->width_in_tiles;
+		u32 tile_y = tile_index / ifd->width_in_tiles;
+		u8* pixels = tiff_decode_tile(0, &tiff, ifd, tile_index, 0, tile_x, tile_y);
+		REQUIRE(pixels != NULL);
+		for (u32 y = 0; y < ifd->tile_height; ++y) {
+			for (u32 x = 0; x < ifd->tile_width; ++x) {
+				u32 image_x = tile_x * ifd->tile_width + x;
+				u32 image_y = tile_y * ifd->tile_height + y;
+				u32 expected = 0; // transparent beyond the image boundary
+				if (image_x < width && image_y < height) {
+					expected = ((u32*)reference)[(size_t)image_y * width + image_x];
+				}
+				mismatches += (((u32*)pixels)[y * ifd->tile_width + x] != expected);
+			}
+		}
+		free(pixels);
+	}
+	CHECK(mismatches == 0);
+	free(reference);
+	tiff_destroy(&tiff);
+	std::filesystem::remove(path);
+
+	// Restart intervals that span MCU rows cannot be split into tiles: fall back to decoding the whole level.
+	std::vector<u8> unaligned_jpeg = encode_jpeg_with_restart_markers(rgb, width, height, 7);
+	path = write_ndpi_tiff("slidescape_test_ndpi_unaligned.tiff", width, height, unaligned_jpeg);
+	REQUIRE(open_tiff_file(&tiff, path.c_str()));
+	CHECK(tiff.main_image_ifd->ndpi_tiling == NULL);
+	CHECK_FALSE(tiff.main_image_ifd->is_tiled);
+	u8* pixels = tiff_decode_tile(0, &tiff, tiff.main_image_ifd, 0, 0, 0, 0);
+	CHECK(pixels != NULL);
+	free(pixels);
+	tiff_destroy(&tiff);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("TIFF WebP tiles decode when libwebp is available") {
+	if (!init_webp()) {
+		MESSAGE("Skipping WebP tile decode check: libwebp could not be loaded.");
+		return;
+	}
+	std::vector<u8> rgb = make_rgb_tile();
+	std::vector<u8> bgra(tile_size * tile_size * 4);
+	for (u32 i = 0; i < tile_size * tile_size; ++i) {
+		bgra[i * 4 + 0] = rgb[i * 3 + 2];
+		bgra[i * 4 + 1] = rgb[i * 3 + 1];
+		bgra[i * 4 + 2] = rgb[i * 3 + 0];
+		bgra[i * 4 + 3] = 255;
+	}
+	u8* encoded = NULL;
+	size_t encoded_size = webp.EncodeLosslessBGRA(bgra.data(), tile_size, tile_size, tile_size * 4, &encoded);
+	REQUIRE(encoded != NULL);
+	REQUIRE(encoded_size > 0);
+	std::vector<u8> compressed(encoded, encoded + encoded_size);
+	webp.Free(encoded);
+	check_decoded_tile("slidescape_test_webp.tiff", TIFF_COMPRESSION_WEBP, 1, compressed);
+}
+
+TEST_CASE("exported Deflate, Zstd and lossless WebP tiles decode to the original pixels") {
+	std::vector<u8> rgb = make_rgb_tile();
+	std::vector<u8> bgra(tile_size * tile_size * 4);
+	for (u32 i = 0; i < tile_size * tile_size; ++i) {
+		bgra[i * 4 + 0] = rgb[i * 3 + 2];
+		bgra[i * 4 + 1] = rgb[i * 3 + 1];
+		bgra[i * 4 + 2] = rgb[i * 3 + 0];
+		bgra[i * 4 + 3] = 255;
+	}
+	struct export_case_t {
+		export_compression_enum compression;
+		u16 tiff_compression;
+		u16 predictor;
+		i32 compression_level;
+		bool is_available;
+	};
+	const export_case_t cases[] = {
+		{EXPORT_COMPRESSION_DEFLATE, TIFF_COMPRESSION_ADOBE_DEFLATE, 2, 0, true},
+		{EXPORT_COMPRESSION_DEFLATE, TIFF_COMPRESSION_ADOBE_DEFLATE, 2, 12, true},
+		{EXPORT_COMPRESSION_ZSTD, TIFF_COMPRESSION_ZSTD, 2, 0, init_zstd_encoder()},
+		{EXPORT_COMPRESSION_ZSTD, TIFF_COMPRESSION_ZSTD, 2, 19, init_zstd_encoder()},
+		{EXPORT_COMPRESSION_WEBP_LOSSLESS, TIFF_COMPRESSION_WEBP, 1, 0, init_webp()},
+	};
+	for (const export_case_t& c : cases) {
+		CAPTURE(get_export_compression_name(c.compression));
+		CAPTURE(c.compression_level);
+		if (!c.is_available) {
+			MESSAGE("Skipping ", get_export_compression_name(c.compression), ": the encoder library could not be loaded.");
+			continue;
+		}
+		u64 compressed_size = 0;
+		u8* compressed = encode_export_tile(bgra.data(), tile_size, tile_size, c.compression, 90, c.compression_level, &compressed_size);
+		REQUIRE(compressed != NULL);
+		REQUIRE(compressed_size > 0);
+		check_decoded_tile("slidescape_test_export_encoding.tiff", c.tiff_compression, c.predictor,
+		                   std::vector<u8>(compressed, compressed + compressed_size));
+		free(compressed);
+	}
+	tiff_release_scratch_buffers(0);
+}
@@ -0,0 +1,316 @@
+#include "common.h"
+#include "doctest.h"
+
+#include "platform.h"
+#include "tiff.h"
+#include "tiff_write.h"
+#include "image_loader.h"
+#include "jpeg_decoder.h"
+#include "test_helpers.h"
+
+#include <stdio.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// These tests export small synthetic JPEG-compressed slides with export_cropped_bigtiff_with_resample() and
+// export_cropped_bigtiff_at_multiple_resolutions(), and read the results back with the TIFF reader.
+
+namespace {
+
+const i32 export_tile_size = 256;
+
+// Gradients with some hard edges, so that the JPEG quality setting makes a difference.
+void make_source_tile(u8* bgra, i32 tile_x0, i32 tile_y0) {
+	for (i32 y = 0; y < export_tile_size; ++y) {
+		for (i32 x = 0; x < export_tile_size; ++x) {
+			i32 gx = tile_x0 + x;
+			i32 gy = tile_y0 + y;
+			u8* p = bgra + ((size_t)y * export_tile_size + x) * 4;
+			p[0] = (u8)(96 + (gx / 8) % 128);
+			p[1] = (u8)(64 + (gy / 4) % 160);
+			p[2] = (u8)(40 + ((gx + 2 * gy) / 3) % 180);
+			p[3] = 255;
+		}
+	}
+}
+
+struct jpeg_source_t {
+	std::string path;
+	std::vector<std::vector<u8>> tiles; // abbreviated streams, as stored in the file
+	std::vector<u8> tables;
+};
+
+// Writes a tiled TIFF with JPEG-compressed YCbCr tiles at 0.25 mpp, which share a JPEGTables tag.
+jpeg_source_t write_jpeg_source_tiff(const char* name, i32 width_in_tiles, i32 height_in_tiles, i32 quality) {
+	jpeg_source_t source;
+	std::vector<u8> pixels((size_t)export_tile_size * export_tile_size * 4);
+	for (i32 tile_y = 0; tile_y < height_in_tiles; ++tile_y) {
+		for (i32 tile_x = 0; tile_x < width_in_tiles; ++tile_x) {
+			make_source_tile(pixels.data(), tile_x * export_tile_size, tile_y * export_tile_size);
+			u8* jpeg = NULL;
+			u64 jpeg_size = 0;
+			jpeg_encode_tile(pixels.data(), export_tile_size, export_tile_size, quality, NULL, NULL, &jpeg, &jpeg_size, false);
+			REQUIRE(jpeg != NULL);
+			source.tiles.push_back(std::vector<u8>(jpeg, jpeg + jpeg_size));
+			libc_free(jpeg);
+		}
+	}
+	u8* tables = NULL;
+	u64 tables_size = 0;
+	jpeg_encode_tile(NULL, export_tile_size, export_tile_size, quality, &tables, &tables_size, NULL, NULL, false);
+	REQUIRE(tables != NULL);
+	source.tables.assign(tables, tables + tables_size);
+	libc_free(tables);
+
+	u32 tile_count = (u32)source.tiles.size();
+	test_tiff_builder_t tiff;
+	u32 tables_offset = tiff.append(source.tables);
+	std::vector<u32> tile_offsets;
+	std::vector<u32> tile_byte_counts;
+	for (const std::vector<u8>& tile : source.tiles) {
+		tile_offsets.push_back(tiff.append(tile));
+		tile_byte_counts.push_back((u32)tile.size());
+	}
+	u32 resolution_offset = tiff.append_u32s({40000, 1}); // pixels per centimeter (= 0.25 mpp)
+	tiff.entry(256, 4, 1, width_in_tiles * export_tile_size);  // ImageWidth
+	tiff.entry(257, 4, 1, height_in_tiles * export_tile_size); // ImageLength
+	tiff.entry(259, 3, 1, TIFF_COMPRESSION_JPEG);              // Compression
+	tiff.entry(262, 3, 1, TIFF_PHOTOMETRIC_YCBCR);             // PhotometricInterpretation
+	tiff.entry(282, 5, 1, resolution_offset);                  // XResolution
+	tiff.entry(283, 5, 1, resolution_offset);                  // YResolution
+	tiff.entry(296, 3, 1, 3);                                  // ResolutionUnit = centimeter
+	tiff.entry(322, 4, 1, export_tile_size);                   // TileWidth
+	tiff.entry(323, 4, 1, export_tile_size);                   // TileLength
+	tiff.entry(324, 4, tile_count, tiff.append_u32s(tile_offsets));     // TileOffsets
+	tiff.entry(325, 4, tile_count, tiff.append_u32s(tile_byte_counts)); // TileByteCounts
+	tiff.entry(347, 7, (u32)source.tables.size(), tables_offset); // JPEGTables
+	tiff.entry(530, 3, 2, 2 | (2 << 16));                      // YCbCrSubSampling
+	tiff.rgb8_samples();
+	source.path = tiff.write(name);
+	return source;
+}
+
+void ensure_export_thread_pool(void) {
+	if (!global_thread_pool.initialized) {
+		init_global_system_info(false);
+		if (global_system_info.suggested_total_thread_count < 2) {
+			global_system_info.suggested_total_thread_count = 2;
+		}
+		init_thread_pool(&global_thread_pool, 128, true, false, NULL);
+	}
+}
+
+image_t* load_export_source(const std::string& path) {
+	file_info_t file = viewer_get_file_info(path.c_str());
+	REQUIRE(file.is_valid);
+	image_load_options_t options = {};
+	options.use_builtin_tiff_backend = true;
+	options.thread_pool = &global_thread_pool;
+	image_t* image = image_load_from_file(&file, NULL, &options);
+	REQUIRE(image != NULL);
+	REQUIRE(image->is_valid);
+	REQUIRE(image->backend == IMAGE_BACKEND_TIFF);
+	return image;
+}
+
+export_options_t test_export_options(image_t* image) {
+	export_options_t options = {};
+	options.tile_width = export_tile_size;
+	options.photometric_interpretation = TIFF_PHOTOMETRIC_YCBCR;
+	options.quality = 90;
+	options.compression = EXPORT_COMPRESSION_JPEG;
+	options.target_mpp = V2F(image->mpp_x, image->mpp_y);
+	return options;
+}
+
+bool export_whole_image(image_t* image, const std::string& path, annotation_raster_t* burn_in_annotations, export_stats_t* stats) {
+	bounds2i bounds = BOUNDS2I(0, 0, (i32)image->width_in_pixels, (i32)image->height_in_pixels);
+	bounds2f world_bounds = pixel_bounds_to_world_bounds(bounds, image->mpp_x, image->mpp_y);
+	export_options_t options = test_export_options(image);
+	options.burn_in_annotations = burn_in_annotations;
+	return export_cropped_bigtiff_with_resample(NULL, image, world_bounds, bounds, path.c_str(), &options, stats);
+}
+
+std::vector<u8> decode_tiff_tile(tiff_t* tiff, tiff_ifd_t* ifd, i32 tile_index) {
+	u8* pixels = tiff_decode_tile(0, tiff, ifd, tile_index, 0, tile_index % ifd->width_in_tiles, tile_index / ifd->width_in_tiles);
+	REQUIRE(pixels != NULL);
+	std::vector<u8> result(pixels, pixels + (size_t)ifd->tile_width * ifd->tile_height * BYTES_PER_PIXEL);
+	free(pixels);
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("tile-aligned JPEG exports copy the source tiles, splicing in the source tables where they differ") {
+	ensure_export_thread_pool();
+	const i32 width_in_tiles = 4;
+	const i32 height_in_tiles = 3;
+
+	// The export writes its own JPEGTables at quality 90: with a source at the same quality the tables are identical,
+	// so the tiles are copied as they are; with a different quality, the source tables go into each tile's stream.
+	const i32 source_qualities[] = {90, 60};
+	for (i32 source_quality : source_qualities) {
+		CAPTURE(source_quality);
+		bool expect_splice = (source_quality != 90);
+		jpeg_source_t source = write_jpeg_source_tiff("slidescape_test_passthrough_source.tiff", width_in_tiles, height_in_tiles,
+		                                              source_quality);
+		image_t* image = load_export_source(source.path);
+		std::string output_path = (std::filesystem::temp_directory_path() / "slidescape_test_passthrough_output.tiff").string();
+		export_stats_t stats = {};
+		REQUIRE(export_whole_image(image, output_path, NULL, &stats));
+		CHECK(stats.copied_tile_count == width_in_tiles * height_in_tiles);
+
+		tiff_t source_tiff = {};
+		REQUIRE(open_tiff_file(&source_tiff, source.path.c_str()));
+		tiff_t output_tiff = {};
+		REQUIRE(open_tiff_file(&output_tiff, output_path.c_str()));
+		tiff_ifd_t* source_ifd = source_tiff.main_image_ifd;
+		tiff_ifd_t* output_ifd = output_tiff.main_image_ifd;
+		REQUIRE(output_ifd->compression == TIFF_COMPRESSION_JPEG);
+		REQUIRE(output_ifd->width_in_tiles == (u32)width_in_tiles);
+		REQUIRE(output_ifd->height_in_tiles == (u32)height_in_tiles);
+		REQUIRE(output_ifd->jpeg_tables != NULL);
+		bool tables_identical = output_ifd->jpeg_tables_length == source.tables.size() &&
+		                        memcmp(output_ifd->jpeg_tables, source.tables.data(), source.tables.size()) == 0;
+		CHECK(tables_identical == !expect_splice);
+
+		for (i32 tile_index = 0; tile_index < width_in_tiles * height_in_tiles; ++tile_index) {
+			CAPTURE(tile_index);
+			const std::vector<u8>& source_tile = source.tiles[tile_index];
+			u64 output_size = 0;
+			u8* output_data = tiff_copy_compressed_tile(&output_tiff, output_ifd, tile_index, &output_size);
+			REQUIRE(output_data != NULL);
+			std::vector<u8> output_tile(output_data, output_data + output_size);
+			free(output_data);
+
+			if (!expect_splice) {
+				CHECK(output_tile == source_tile);
+			} else {
+				// SOI, the source tables without their own SOI/EOI markers, then the source tile after its SOI.
+				std::vector<u8> expected(source_tile.begin(), source_tile.begin() + 2);
+				expected.insert(expected.end(), source.tables.begin() + 2, source.tables.end() - 2);
+				expected.insert(expected.end(), source_tile.begin() + 2, source_tile.end());
+				CHECK(output_tile == expected);
+
+				// The spliced stream decodes on its own, and also together with the output's (different) JPEGTables.
+				std::vector<u8> standalone((size_t)export_tile_size * export_tile_size * 4);
+				CHECK(jpeg_decode_tile(NULL, 0, output_tile.data(), (u32)output_tile.size(), standalone.data(), true));
+				std::vector<u8> source_pixels = decode_tiff_tile(&source_tiff, source_ifd, tile_index);
+				CHECK(standalone == source_pixels);
+			}
+			// Either way, a reader of the output sees exactly the source pixels.
+			CHECK(decode_tiff_tile(&output_tiff, output_ifd, tile_index) == decode_tiff_tile(&source_tiff, source_ifd, tile_index));
+		}
+		tiff_destroy(&output_tiff);
+
+		// Without copying (here: because annotations are burned in, although there are none), the tiles are decoded
+		// and re-encoded at quality 90. That path must end up with nearly the same pixels.
+		annotation_set_t no_annotations = {};
+		annotation_raster_t raster = {};
+		bounds2f world_bounds = pixel_bounds_to_world_bounds(BOUNDS2I(0, 0, (i32)image->width_in_pixels, (i32)image->height_in_pixels),
+		                                                     image->mpp_x, image->mpp_y);
+		REQUIRE(annotation_raster_init(&raster, &no_annotations, world_bounds, 64.0f, 1.0f, 0.0f));
+		std::string reencoded_path = (std::filesystem::temp_directory_path() / "slidescape_test_reencoded_output.tiff").string();
+		export_stats_t reencoded_stats = {};
+		REQUIRE(export_whole_image(image, reencoded_path, &raster, &reencoded_stats));
+		annotation_raster_destroy(&raster);
+		CHECK(reencoded_stats.copied_tile_count == 0);
+
+		tiff_t reencoded_tiff = {};
+		REQUIRE(open_tiff_file(&reencoded_tiff, reencoded_path.c_str()));
+		tiff_ifd_t* reencoded_ifd = reencoded_tiff.main_image_ifd;
+		for (i32 tile_index = 0; tile_index < width_in_tiles * height_in_tiles; ++tile_index) {
+			CAPTURE(tile_index);
+			std::vector<u8> source_pixels = decode_tiff_tile(&source_tiff, source_ifd, tile_index);
+			std::vector<u8> reencoded_pixels = decode_tiff_tile(&reencoded_tiff, reencoded_ifd, tile_index);
+			REQUIRE(source_pixels.size() == reencoded_pixels.size());
+			u64 total_difference = 0;
+			for (size_t i = 0; i < source_pixels.size(); ++i) {
+				if (i % 4 == 3) continue; // alpha
+				total_difference += (u64)abs((i32)source_pixels[i] - (i32)reencoded_pixels[i]);
+			}
+			double mean_difference = (double)total_difference / (double)(source_pixels.size() / 4 * 3);
+			CHECK(mean_difference < 3.0);
+		}
+		tiff_destroy(&reencoded_tiff);
+		tiff_destroy(&source_tiff);
+		image_destroy(image);
+		std::filesystem::remove(reencoded_path);
+		std::filesystem::remove(output_path);
+		std::filesystem::remove(source.path);
+	}
+	tiff_release_scratch_buffers(0);
+}
+
+TEST_CASE("exporting several resolutions in one pass gives the same tiles as separate exports") {
+	ensure_export_thread_pool();
+	jpeg_source_t source = write_jpeg_source_tiff("slidescape_test_multires_source.tiff", 7, 5, 90);
+	image_t* image = load_export_source(source.path);
+
+	// A crop that isn't aligned to the source tiles, at 1x, 2x and 4x the source mpp. With only one level in the source,
+	// all three read from level 0, so export_cropped_bigtiff_at_multiple_resolutions() decodes the source once for all.
+	bounds2i crop = BOUNDS2I(100, 37, 1650, 1230);
+	bounds2f world_bounds = pixel_bounds_to_world_bounds(crop, image->mpp_x, image->mpp_y);
+	enum { TARGET_COUNT = 3 };
+	std::string one_pass_paths[TARGET_COUNT];
+	std::string separate_paths[TARGET_COUNT];
+	const char* one_pass_filenames[TARGET_COUNT];
+	v2f target_mpps[TARGET_COUNT];
+	for (i32 i = 0; i < TARGET_COUNT; ++i) {
+		std::string suffix = std::to_string(1 << i) + "x.tiff";
+		one_pass_paths[i] = (std::filesystem::temp_directory_path() / ("slidescape_test_multires_one_pass_" + suffix)).string();
+		separate_paths[i] = (std::filesystem::temp_directory_path() / ("slidescape_test_multires_separate_" + suffix)).string();
+		one_pass_filenames[i] = one_pass_paths[i].c_str();
+		target_mpps[i] = V2F(image->mpp_x * (float)(1 << i), image->mpp_y * (float)(1 << i));
+	}
+	export_options_t options = test_export_options(image);
+	REQUIRE(export_cropped_bigtiff_at_multiple_resolutions(NULL, image, world_bounds, crop, one_pass_filenames, target_mpps, TARGET_COUNT,
+	                                                       &options));
+	options.need_resize = true;
+	for (i32 i = 0; i < TARGET_COUNT; ++i) {
+		options.target_mpp = target_mpps[i];
+		REQUIRE(export_cropped_bigtiff_with_resample(NULL, image, world_bounds, crop, separate_paths[i].c_str(), &options, NULL));
+	}
+
+	for (i32 i = 0; i < TARGET_COUNT; ++i) {
+		CAPTURE(i);
+		tiff_t one_pass_tiff = {};
+		REQUIRE(open_tiff_file(&one_pass_tiff, one_pass_paths[i].c_str()));
+		tiff_t separate_tiff = {};
+		REQUIRE(open_tiff_file(&separate_tiff, separate_paths[i].c_str()));
+		u32 expected_width = (u32)((crop.right - crop.left) >> i);
+		u32 expected_height = (u32)((crop.bottom - crop.top) >> i);
+		CHECK(one_pass_tiff.main_image_ifd->image_width >= expected_width);
+		CHECK(one_pass_tiff.main_image_ifd->image_width <= expected_width + 1);
+		CHECK(one_pass_tiff.main_image_ifd->image_height >= expected_height);
+		CHECK(one_pass_tiff.main_image_ifd->image_height <= expected_height + 1);
+		CHECK(one_pass_tiff.mpp_x == doctest::Approx(target_mpps[i].x));
+
+		// Every level of the pyramid, tile for tile.
+		REQUIRE(one_pass_tiff.level_image_ifd_count == separate_tiff.level_image_ifd_count);
+		for (u64 level = 0; level < one_pass_tiff.level_image_ifd_count; ++level) {
+			CAPTURE(level);
+			tiff_ifd_t* one_pass_ifd = one_pass_tiff.level_images_ifd + level;
+			tiff_ifd_t* separate_ifd = separate_tiff.level_images_ifd + level;
+			REQUIRE(one_pass_ifd->image_width == separate_ifd->image_width);
+			REQUIRE(one_pass_ifd->image_height == separate_ifd->image_height);
+			REQUIRE(one_pass_ifd->tile_count == separate_ifd->tile_count);
+			i32 mismatched_tile_count = 0;
+			for (i32 tile_index = 0; tile_index < (i32)one_pass_ifd->tile_count; ++tile_index) {
+				if (decode_tiff_tile(&one_pass_tiff, one_pass_ifd, tile_index) != decode_tiff_tile(&separate_tiff, separate_ifd, tile_index)) {
+					++mismatched_tile_count;
+				}
+			}
+			CHECK(mismatched_tile_count == 0);
+		}
+		tiff_destroy(&separate_tiff);
+		tiff_destroy(&one_pass_tiff);
+		std::filesystem::remove(one_pass_paths[i]);
+		std::filesystem::remove(separate_paths[i]);
+	}
+	image_destroy(image);
+	std::filesystem::remove(source.path);
+	tiff_release_scratch_buffers(0);
+}
@@ -44,6 +44,29 @@ static void large_userdata_task(int logical_thread_index, void* userdata) {
 	atomic_increment(task->counter);
 }
 
+typedef struct test_semaphore_task_t {
+	i32 volatile* counter;
+	i32 post_at;
+	semaphore_handle_t semaphore;
+} test_semaphore_task_t;
+
+static void post_semaphore_when_last_task(int logical_thread_index, void* userdata) {
+	(void)logical_thread_index;
+	test_semaphore_task_t* task = (test_semaphore_task_t*)userdata;
+	if (atomic_increment(task->counter) == task->post_at) {
+		platform_semaphore_post(task->semaphore);
+	}
+}
+
+static i32 volatile exited_thread_count;
+static i32 volatile exited_thread_index_sum;
+
+static void count_thread_exit(int logical_thread_index, void* userdata) {
+	(void)userdata;
+	atomic_increment(&exited_thread_count);
+	atomic_add(&exited_thread_index_sum, logical_thread_index);
+}
+
 static void ensure_test_thread_memory(void) {
 	if (!threadlocal_thread_memory) {
 		init_global_system_info(false);
@@ -144,6 +167,26 @@ TEST_CASE("thread pool runs work and can be destroyed") {
 	global_system_info = old_system_info;
 }
 
+TEST_CASE("thread pool calls the exit callback on each worker thread") {
+	ensure_test_thread_memory();
+
+	init_global_system_info(false);
+	system_info_t old_system_info = global_system_info;
+	global_system_info.suggested_total_thread_count = 4;
+
+	thread_pool_t pool = {};
+	init_thread_pool(&pool, 8, false, false, NULL);
+	exited_thread_count = 0;
+	exited_thread_index_sum = 0;
+	thread_pool_set_thread_exit_callback(&pool, count_thread_exit);
+
+	thread_pool_destroy(&pool);
+	CHECK(exited_thread_count == 3);
+	CHECK(exited_thread_index_sum == 1 + 2 + 3);
+
+	global_system_info = old_system_info;
+}
+
 TEST_CASE("thread pool without high priority queue can be reused after destroy") {
 	ensure_test_thread_memory();
 
@@ -223,3 +266,32 @@ TEST_CASE("task groups allow nested tasks to wait for child work") {
 
 	global_system_info = old_system_info;
 }
+
+TEST_CASE("a semaphore wakes up the thread waiting for the last task") {
+	ensure_test_thread_memory();
+
+	init_global_system_info(false);
+	system_info_t old_system_info = global_system_info;
+	global_system_info.suggested_total_thread_count = 3;
+
+	thread_pool_t pool = {};
+	init_thread_pool(&pool, 16, false, false, NULL);
+	semaphore_handle_t semaphore = platform_semaphore_create(NULL);
+	REQUIRE(semaphore != NULL);
+
+	// The same semaphore is reused for consecutive rounds, each posting it exactly once.
+	for (i32 round = 0; round < 3; ++round) {
+		i32 volatile counter = 0;
+		test_semaphore_task_t task = {&counter, 8, semaphore};
+		for (i32 i = 0; i < task.post_at; ++i) {
+			REQUIRE(thread_pool_submit_task(&pool, post_semaphore_when_last_task, &task, sizeof(task)));
+		}
+		platform_semaphore_wait(semaphore);
+		CHECK(counter == task.post_at);
+	}
+
+	platform_semaphore_destroy(semaphore);
+	thread_pool_destroy(&pool);
+
+	global_system_info = old_system_info;
+}